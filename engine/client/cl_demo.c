@@ -38,8 +38,12 @@ GNU General Public License for more details.
 #define FDEMO_FADE_OUT_FAST	0x40	// Fade out (fast)
 
 #define IDEMOHEADER		(('M'<<24)+('E'<<16)+('D'<<8)+'I') // little-endian "IDEM"
+#define IDEMOINDEX		(('X'<<24)+('D'<<16)+('I'<<8)+'D') // little-endian "DIDX"
 #define DEMO_PROTOCOL	3
 
+#define MAX_DEMO_KEYFRAMES	65536
+#define DEMO_KEYFRAME_GAP	1.0f	// don't index full updates closer than this
+
 const char *demo_cmd[dem_lastcmd+1] =
 {
 	"dem_unknown",
@@ -89,6 +93,16 @@ typedef struct
 	vec3_t		viewangles;
 } demoangle_t;
 
+// seek index, stored after the directory so older
+// engines still can play the demo
+typedef struct
+{
+	float		time;		// demo clock at this message
+	float		clockbase;	// demo clock at the last dem_jumptime
+	int		offset;		// file offset of the first message
+	int		entry;		// directory entry
+} demokeyframe_t;
+
 // private demo states
 struct
 {
@@ -105,8 +119,74 @@ struct
 	// interpolation stuff
 	demoangle_t	cmds[ANGLE_BACKUP];
 	int		angle_position;
+
+	// demo clock keeps running across dem_jumptime
+	float		clockbase;
+	float		cmdtime;
+
+	// seek index
+	demokeyframe_t	*keyframes;
+	int		numkeyframes;
+	int		maxkeyframes;
+	qboolean		fullupdate;	// non-delta update was parsed, record a keyframe
+	double		nextkeyframe;	// cls.demotime when the next one is requested
+	int		msgoffset;	// offset of the message being parsed
+
+	// demo_seek
+	qboolean		seeking;
+	float		seektime;
+	double		seekstart;
+	int		seekmessages;
 } demo;
 
+#define TD_TOTAL		TD_PHASES	// whole frame, including the time out of the client
+#define TD_WORST_FRAMES	5
+
+// timedemo frame sample, msec
+typedef struct
+{
+	float		time[TD_PHASES + 1];
+} tdframe_t;
+
+typedef struct
+{
+	float		min, avg, p50, p95, p99, max;
+	float		phases[TD_PHASES];	// average per phase
+	int		worst[TD_WORST_FRAMES];	// frame indexes, slowest first
+} tdsummary_t;
+
+// timedemo stats
+static struct
+{
+	tdframe_t		*frames;
+	int		numframes;
+	int		maxframes;
+	tdframe_t		cur;
+	double		framestart;	// 0 if the frame is not timed
+	double		phasestart;
+
+	// repeated runs
+	char		demoname[MAX_QPATH];
+	int		runs;
+	int		run;		// finished runs
+	qboolean		restart;		// next timedemo command continues the series
+	tdsummary_t	total;		// summed over the finished runs
+} td;
+
+// demo_bench parse stats
+static struct
+{
+	double		cost[256];	// seconds spent per server command
+	int		count[256];
+	int		lastcmd;		// command being parsed, -1 if none
+	double		cmdstart;
+	int		messages;
+	int		entities;		// delta-decoded
+} bench;
+
+CVAR_DEFINE_AUTO( demo_keyframe, "0", FCVAR_ARCHIVE, "seconds between seek keyframes in recorded demos, 0 to disable" );
+CVAR_DEFINE_AUTO( timedemo_export, "", FCVAR_ARCHIVE, "dump timedemo frame times into a \"csv\" or \"json\" file" );
+
 /*
 ====================
 CL_StartupDemoHeader
@@ -187,6 +267,205 @@ double CL_GetDemoFramerate( void )
 	return bound( MIN_FPS, demo.header.host_fps, MAX_FPS );
 }
 
+/*
+====================
+CL_DemoClock
+
+demo time of the last message, unlike message
+timestamps it keeps running across level changes
+====================
+*/
+static float CL_DemoClock( void )
+{
+	return demo.clockbase + demo.cmdtime;
+}
+
+/*
+====================
+CL_DemoAdvanceClock
+====================
+*/
+static void CL_DemoAdvanceClock( byte cmd, float dt )
+{
+	if( cmd == dem_jumptime )
+		demo.clockbase += demo.cmdtime;
+	demo.cmdtime = dt;
+}
+
+/*
+====================
+CL_FreeDemoIndex
+====================
+*/
+static void CL_FreeDemoIndex( void )
+{
+	if( demo.keyframes )
+		Mem_Free( demo.keyframes );
+
+	demo.keyframes = NULL;
+	demo.numkeyframes = 0;
+	demo.maxkeyframes = 0;
+}
+
+/*
+====================
+CL_AddDemoKeyframe
+
+keyframes are kept sorted by entry and time
+====================
+*/
+static void CL_AddDemoKeyframe( int entry, float time, float clockbase, int offset )
+{
+	demokeyframe_t	*kf;
+	int		i;
+
+	for( i = demo.numkeyframes; i > 0; i-- )
+	{
+		kf = &demo.keyframes[i - 1];
+
+		if( kf->entry < entry || ( kf->entry == entry && kf->time <= time ))
+			break;
+	}
+
+	// neighbours are close enough
+	if( i > 0 && demo.keyframes[i - 1].entry == entry && time - demo.keyframes[i - 1].time < DEMO_KEYFRAME_GAP )
+		return;
+
+	if( i < demo.numkeyframes && demo.keyframes[i].entry == entry && demo.keyframes[i].time - time < DEMO_KEYFRAME_GAP )
+		return;
+
+	if( demo.numkeyframes >= MAX_DEMO_KEYFRAMES )
+		return;
+
+	if( demo.numkeyframes == demo.maxkeyframes )
+	{
+		demo.maxkeyframes = Q_max( 64, demo.maxkeyframes * 2 );
+		demo.keyframes = Mem_Realloc( cls.mempool, demo.keyframes, sizeof( demokeyframe_t ) * demo.maxkeyframes );
+	}
+
+	memmove( &demo.keyframes[i + 1], &demo.keyframes[i], sizeof( demokeyframe_t ) * ( demo.numkeyframes - i ));
+	demo.numkeyframes++;
+
+	kf = &demo.keyframes[i];
+	kf->entry = entry;
+	kf->time = time;
+	kf->clockbase = clockbase;
+	kf->offset = offset;
+}
+
+/*
+====================
+CL_FindDemoKeyframe
+
+last keyframe of the entry at or before the time
+====================
+*/
+static demokeyframe_t *CL_FindDemoKeyframe( int entry, float time )
+{
+	demokeyframe_t	*kf;
+	int		i;
+
+	for( i = demo.numkeyframes - 1; i >= 0; i-- )
+	{
+		kf = &demo.keyframes[i];
+
+		if( kf->entry == entry && kf->time <= time )
+			return kf;
+	}
+
+	return NULL;
+}
+
+/*
+====================
+CL_WriteDemoIndex
+====================
+*/
+static void CL_WriteDemoIndex( file_t *file )
+{
+	int	id = IDEMOINDEX;
+
+	FS_Write( file, &id, sizeof( int ));
+	FS_Write( file, &demo.numkeyframes, sizeof( int ));
+	FS_Write( file, demo.keyframes, sizeof( demokeyframe_t ) * demo.numkeyframes );
+}
+
+/*
+====================
+CL_ReadDemoIndex
+
+file is positioned after the directory,
+demos without index have nothing there
+====================
+*/
+static void CL_ReadDemoIndex( file_t *file )
+{
+	demokeyframe_t	kf;
+	int		i, id, count;
+
+	CL_FreeDemoIndex();
+
+	if( FS_Read( file, &id, sizeof( int )) != sizeof( int ) || id != IDEMOINDEX )
+		return;
+
+	if( FS_Read( file, &count, sizeof( int )) != sizeof( int ) || count < 0 || count > MAX_DEMO_KEYFRAMES )
+		return;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( FS_Read( file, &kf, sizeof( kf )) != sizeof( kf ))
+			break;
+
+		if( kf.entry < 1 || kf.entry >= demo.directory.numentries )
+			continue;
+
+		CL_AddDemoKeyframe( kf.entry, kf.time, kf.clockbase, kf.offset );
+	}
+}
+
+/*
+====================
+CL_DemoFullUpdate
+
+non-delta entity update was parsed, next message
+written to the demo becomes a keyframe, during
+playback the index is extended for old demos
+====================
+*/
+void CL_DemoFullUpdate( void )
+{
+	if( cls.demorecording )
+	{
+		demo.fullupdate = true;
+		return;
+	}
+
+	if( cls.demoplayback == DEMO_XASH3D && demo.entryIndex > 0 )
+		CL_AddDemoKeyframe( demo.entryIndex, CL_DemoClock(), demo.clockbase, demo.msgoffset );
+}
+
+/*
+====================
+CL_DemoWantsFullUpdate
+
+ask the server for non-delta entities
+when it's time for a keyframe
+====================
+*/
+qboolean CL_DemoWantsFullUpdate( void )
+{
+	if( !cls.demorecording || cls.demowaiting || demo_keyframe.value <= 0.0f )
+		return false;
+
+	if( cls.demotime < demo.nextkeyframe )
+		return false;
+
+	// ask again later if the reply is lost
+	demo.nextkeyframe = cls.demotime + 1.0;
+
+	return true;
+}
+
 /*
 ====================
 CL_WriteDemoCmdHeader
@@ -207,6 +486,9 @@ void CL_WriteDemoCmdHeader( byte cmd, file_t *file )
 	// time offset
 	dt = (float)(CL_GetDemoRecordClock() - demo.starttime);
 	FS_Write( file, &dt, sizeof( float ));
+
+	if( file == cls.demofile )
+		CL_DemoAdvanceClock( cmd, dt );
 }
 
 /*
@@ -280,6 +562,66 @@ void CL_WriteDemoSequence( file_t *file )
 	FS_Write( file, &cls.netchan.last_reliable_sequence, sizeof( int ));
 }
 
+/*
+====================
+CL_WriteDemoState
+
+write engine side state that isn't sent again by the
+server as a regular message, so playback can start
+from the following full update
+====================
+*/
+static void CL_WriteDemoState( file_t *file )
+{
+	player_info_t	*player;
+	lightstyle_t	*ls;
+	sizebuf_t		buf;
+	byte		*data;
+	int		i, len;
+
+	data = Mem_Malloc( cls.mempool, MAX_INIT_MSG );
+	MSG_Init( &buf, "DemoState", data, MAX_INIT_MSG );
+
+	for( i = 0, ls = cl.lightstyles; i < MAX_LIGHTSTYLES; i++, ls++ )
+	{
+		if( !ls->pattern[0] )
+			continue;
+
+		MSG_BeginServerCmd( &buf, svc_lightstyle );
+		MSG_WriteByte( &buf, i );
+		MSG_WriteString( &buf, ls->pattern );
+		MSG_WriteFloat( &buf, ls->time );
+	}
+
+	// legacy protocol has another userinfo layout
+	for( i = 0, player = cl.players; i < cl.maxclients && !cls.legacymode; i++, player++ )
+	{
+		MSG_BeginServerCmd( &buf, svc_updateuserinfo );
+		MSG_WriteUBitLong( &buf, i, MAX_CLIENT_BITS );
+		MSG_WriteLong( &buf, player->userid );
+
+		if( player->name[0] )
+		{
+			MSG_WriteOneBit( &buf, 1 );
+			MSG_WriteString( &buf, player->userinfo );
+			MSG_WriteBytes( &buf, player->hashedcdkey, sizeof( player->hashedcdkey ));
+		}
+		else MSG_WriteOneBit( &buf, 0 );
+	}
+
+	len = MSG_GetNumBytesWritten( &buf );
+
+	if( len > 0 && !MSG_CheckOverflow( &buf ))
+	{
+		CL_WriteDemoCmdHeader( dem_read, file );
+		CL_WriteDemoSequence( file );
+		FS_Write( file, &len, sizeof( int ));
+		FS_Write( file, data, len );
+	}
+
+	Mem_Free( data );
+}
+
 /*
 ====================
 CL_WriteDemoMessage
@@ -304,6 +646,16 @@ void CL_WriteDemoMessage( qboolean startup, int start, sizebuf_t *msg )
 
 	if( !startup ) demo.framecount++;
 
+	if( !startup && demo.fullupdate )
+	{
+		// state goes first, the full update follows it
+		CL_AddDemoKeyframe( demo.entry - demo.directory.entries, demo.clockbase + CL_GetDemoRecordClock() - demo.starttime,
+			demo.clockbase, FS_Tell( file ));
+		CL_WriteDemoState( file );
+		demo.nextkeyframe = cls.demotime + demo_keyframe.value;
+		demo.fullupdate = false;
+	}
+
 	// demo playback should read this as an incoming message.
 	c = (cls.state != ca_active) ? dem_norewind : dem_read;
 
@@ -419,6 +771,12 @@ void CL_WriteDemoHeader( const char *name )
 
 	demo.entry->offset = FS_Tell( cls.demofile );
 
+	// first full update becomes the first keyframe
+	CL_FreeDemoIndex();
+	demo.clockbase = demo.cmdtime = 0.0f;
+	demo.nextkeyframe = 0.0;
+	demo.fullupdate = false;
+
 	// demo playback should read this as an incoming message.
 	// write the client's realtime value out so we can synchronize the reads.
 	CL_WriteDemoCmdHeader( dem_jumptime, cls.demofile );
@@ -461,6 +819,9 @@ void CL_StopRecord( void )
 	for( i = 0; i < demo.directory.numentries; i++ )
 		FS_Write( cls.demofile, &demo.directory.entries[i], sizeof( demoentry_t ));
 
+	CL_WriteDemoIndex( cls.demofile );
+	CL_FreeDemoIndex();
+
 	Mem_Free( demo.directory.entries );
 	demo.directory.numentries = 0;
 
@@ -685,6 +1046,8 @@ void CL_DemoAborted( void )
 	demo.framecount = 0;
 	cls.demofile = NULL;
 	cls.demonum = -1;
+	CL_FreeDemoIndex();
+	demo.seeking = false;
 
 	Cvar_SetValue( "v_dark", 0.0f );
 }
@@ -696,11 +1059,21 @@ CL_DemoCompleted
 */
 void CL_DemoCompleted( void )
 {
+	// timedemo series goes on with the next run
+	qboolean	again = cls.timedemo && td.run + 1 < td.runs;
+
 	if( cls.demonum != -1 )
 		cls.changedemo = true;
 
 	CL_StopPlayback();
 
+	if( again )
+	{
+		td.restart = true;
+		Cbuf_AddText( va( "timedemo \"%s\"\n", td.demoname ));
+		return;
+	}
+
 	if( !CL_NextDemo() && !cls.changedemo )
 		UI_SetActiveMenu( true );
 
@@ -734,6 +1107,10 @@ qboolean CL_DemoMoveToNextSection( void )
 	demo.starttime = CL_GetDemoPlaybackClock();
 	demo.framecount = 0;
 
+	// section start can always be seeked to
+	demo.clockbase = demo.cmdtime = 0.0f;
+	CL_AddDemoKeyframe( demo.entryIndex, 0.0f, 0.0f, demo.entry->offset );
+
 	return true;
 }
 
@@ -874,6 +1251,38 @@ qboolean CL_DemoReadMessageQuake( byte *buffer, size_t *length )
 	return true;
 }
 
+/*
+=================
+CL_DemoFinishSeek
+
+resume normal playback at the current message
+=================
+*/
+static void CL_DemoFinishSeek( void )
+{
+	int	i;
+
+	demo.seeking = false;
+	demo.starttime = CL_GetDemoPlaybackClock() - demo.timestamp;
+
+	// angles recorded before a jump back are in the future now
+	memset( demo.cmds, 0, sizeof( demo.cmds ));
+	demo.angle_position = 1;
+	demo.lasttime = 0.0f;
+
+	// everything spawned on the way would show up at once
+	S_StopAllSounds( false );
+	CL_ClearTempEnts();
+	CL_ClearViewBeams();
+	CL_ClearParticles();
+
+	for( i = 0; i < MAX_EVENT_QUEUE; i++ )
+		CL_ResetEvent( &cl.events.ei[i] );
+
+	Con_Printf( "demo_seek: at %.2f sec, %i messages parsed in %.2f msec\n", CL_DemoClock(),
+		demo.seekmessages, ( Sys_DoubleTime() - demo.seekstart ) * 1000.0 );
+}
+
 /*
 =================
 CL_DemoReadMessage
@@ -897,7 +1306,7 @@ qboolean CL_DemoReadMessage( byte *buffer, size_t *length )
 		return false;
 	}
 
-	if(( !cl.background && ( cl.paused || cls.key_dest != key_game )) || cls.key_dest == key_console )
+	if( !demo.seeking && (( !cl.background && ( cl.paused || cls.key_dest != key_game )) || cls.key_dest == key_console ))
 	{
 		demo.starttime += host.frametime;
 		return false; // paused
@@ -916,7 +1325,7 @@ qboolean CL_DemoReadMessage( byte *buffer, size_t *length )
 		CL_ReadDemoCmdHeader( &cmd, &demo.timestamp );
 
 		fElapsedTime = CL_GetDemoPlaybackClock() - demo.starttime;
-		if( !cls.timedemo ) bSkipMessage = ((demo.timestamp - cl_serverframetime()) >= fElapsedTime) ? true : false;
+		if( !cls.timedemo && !demo.seeking ) bSkipMessage = ((demo.timestamp - cl_serverframetime()) >= fElapsedTime) ? true : false;
 		if( cls.changelevel ) demo.framecount = 1;
 
 		// changelevel issues
@@ -936,19 +1345,23 @@ qboolean CL_DemoReadMessage( byte *buffer, size_t *length )
 
 		// we already have the usercmd_t for this frame
 		// don't read next usercmd_t so predicting will work properly
-		if( cmd == dem_usercmd && lastpos != 0 && demo.framecount != 0 )
+		if( cmd == dem_usercmd && lastpos != 0 && demo.framecount != 0 && !demo.seeking )
 		{
 			FS_Seek( cls.demofile, lastpos, SEEK_SET );
 			return false; // not time yet.
 		}
 
+		CL_DemoAdvanceClock( cmd, demo.timestamp );
+
 		// COMMAND HANDLERS
 		switch( cmd )
 		{
 		case dem_jumptime:
 			demo.starttime = CL_GetDemoPlaybackClock();
+			if( demo.seeking ) break; // keep going
 			return false; // time is changed, skip frame
 		case dem_stop:
+			if( demo.seeking ) CL_DemoFinishSeek(); // ran out of demo
 			CL_DemoMoveToNextSection();
 			return false; // header is ended, skip frame
 		case dem_userdata:
@@ -966,6 +1379,7 @@ qboolean CL_DemoReadMessage( byte *buffer, size_t *length )
 			lastpos = FS_Tell( cls.demofile );
 			break;
 		default:
+			demo.msgoffset = curpos;
 			swallowmessages = false;
 			break;
 		}
@@ -999,6 +1413,15 @@ qboolean CL_DemoReadMessage( byte *buffer, size_t *length )
 	demo.framecount++;
 	CL_ReadDemoSequence( false );
 
+	if( demo.seeking )
+	{
+		demo.seekmessages++;
+
+		// this one is still parsed before the playback goes on
+		if( CL_DemoClock() >= demo.seektime )
+			CL_DemoFinishSeek();
+	}
+
 	return CL_ReadRawNetworkData( buffer, length );
 }
 
@@ -1090,6 +1513,288 @@ void CL_DemoInterpolateAngles( void )
 		VectorCopy( cl.cmd->viewangles, cl.viewangles );
 }
 
+/*
+==============
+CL_TimeDemoFrame
+
+called at the start of each client frame,
+stores the previous one if it was timed
+==============
+*/
+void CL_TimeDemoFrame( void )
+{
+	double	now;
+
+	if( !cls.timedemo )
+	{
+		td.framestart = 0.0;
+		return;
+	}
+
+	now = Sys_DoubleTime();
+
+	if( td.framestart != 0.0 )
+	{
+		td.cur.time[TD_TOTAL] = ( now - td.framestart ) * 1000.0;
+
+		if( td.numframes == td.maxframes )
+		{
+			td.maxframes = Q_max( 1024, td.maxframes * 2 );
+			td.frames = Z_Realloc( td.frames, sizeof( *td.frames ) * td.maxframes );
+		}
+
+		td.frames[td.numframes++] = td.cur;
+	}
+
+	memset( &td.cur, 0, sizeof( td.cur ));
+
+	// the first frame didn't count
+	td.framestart = ( host.framecount > cls.td_startframe + 1 ) ? now : 0.0;
+	td.phasestart = now;
+}
+
+/*
+==============
+CL_TimeDemoMark
+
+add the time since the last mark to the phase
+==============
+*/
+void CL_TimeDemoMark( int phase )
+{
+	double	now;
+
+	if( td.framestart == 0.0 )
+		return;
+
+	now = Sys_DoubleTime();
+	td.cur.time[phase] += ( now - td.phasestart ) * 1000.0;
+	td.phasestart = now;
+}
+
+/*
+==============
+CL_DemoBenchCommand
+
+charge the time since the previous command to it,
+-1 ends the message
+==============
+*/
+void CL_DemoBenchCommand( int cmd )
+{
+	double	now = Sys_DoubleTime();
+
+	if( bench.lastcmd >= 0 )
+		bench.cost[bench.lastcmd] += now - bench.cmdstart;
+
+	if( cmd < 0 )
+	{
+		bench.messages++;
+		bench.lastcmd = -1;
+		return;
+	}
+
+	bench.lastcmd = cmd & 255;
+	bench.count[bench.lastcmd]++;
+	bench.cmdstart = now;
+}
+
+/*
+==============
+CL_DemoBenchEntity
+==============
+*/
+void CL_DemoBenchEntity( void )
+{
+	bench.entities++;
+}
+
+/*
+==============
+CL_DemoBenchReport
+==============
+*/
+static void CL_DemoBenchReport( double time )
+{
+	int	order[256];
+	int	i, j, num = 0, cmd;
+	double	total = 0.0;
+
+	// most expensive commands first
+	for( i = 0; i < 256; i++ )
+	{
+		if( !bench.count[i] )
+			continue;
+
+		for( j = num; j > 0 && bench.cost[order[j - 1]] < bench.cost[i]; j-- )
+			order[j] = order[j - 1];
+		order[j] = i;
+		num++;
+		total += bench.cost[i];
+	}
+
+	Con_Printf( "demo_bench: %i messages, %.0f msg/sec, %i entities, %.0f ents/sec, parse %.3f sec\n",
+		bench.messages, bench.messages / time, bench.entities, bench.entities / time, total );
+
+	for( i = 0; i < num; i++ )
+	{
+		cmd = order[i];
+
+		Con_Printf( "  %-24s %8i %10.3f msec %8.2f usec/cmd\n",
+			cmd <= svc_lastmsg ? svc_strings[cmd] : va( "user message %i", cmd ),
+			bench.count[cmd], bench.cost[cmd] * 1000.0, bench.cost[cmd] * 1000000.0 / bench.count[cmd] );
+	}
+}
+
+static int CL_TimeDemoCompare( const void *a, const void *b )
+{
+	float	fa = *(const float *)a;
+	float	fb = *(const float *)b;
+
+	return ( fa > fb ) - ( fa < fb );
+}
+
+/*
+==============
+CL_TimeDemoPercentile
+
+nearest rank on sorted samples
+==============
+*/
+static float CL_TimeDemoPercentile( const float *sorted, int count, float percent )
+{
+	int	i = (int)ceil( percent * 0.01f * count ) - 1;
+
+	return sorted[bound( 0, i, count - 1 )];
+}
+
+/*
+==============
+CL_TimeDemoSummary
+==============
+*/
+static void CL_TimeDemoSummary( const tdframe_t *frames, int count, tdsummary_t *s )
+{
+	double	sum[TD_PHASES + 1];
+	float	*sorted;
+	int	i, j, k;
+
+	memset( s, 0, sizeof( *s ));
+	memset( sum, 0, sizeof( sum ));
+
+	if( count <= 0 )
+		return;
+
+	sorted = Z_Malloc( sizeof( *sorted ) * count );
+
+	for( i = 0; i < count; i++ )
+	{
+		for( j = 0; j <= TD_PHASES; j++ )
+			sum[j] += frames[i].time[j];
+		sorted[i] = frames[i].time[TD_TOTAL];
+	}
+
+	qsort( sorted, count, sizeof( *sorted ), CL_TimeDemoCompare );
+
+	s->min = sorted[0];
+	s->max = sorted[count - 1];
+	s->avg = sum[TD_TOTAL] / count;
+	s->p50 = CL_TimeDemoPercentile( sorted, count, 50.0f );
+	s->p95 = CL_TimeDemoPercentile( sorted, count, 95.0f );
+	s->p99 = CL_TimeDemoPercentile( sorted, count, 99.0f );
+
+	for( j = 0; j < TD_PHASES; j++ )
+		s->phases[j] = sum[j] / count;
+
+	Z_Free( sorted );
+
+	// keep the slowest frames, insertion into a short list
+	for( i = 0; i < TD_WORST_FRAMES; i++ )
+		s->worst[i] = -1;
+
+	for( i = 0; i < count; i++ )
+	{
+		for( j = 0; j < TD_WORST_FRAMES; j++ )
+		{
+			if( s->worst[j] == -1 || frames[i].time[TD_TOTAL] > frames[s->worst[j]].time[TD_TOTAL] )
+				break;
+		}
+
+		if( j == TD_WORST_FRAMES )
+			continue;
+
+		for( k = TD_WORST_FRAMES - 1; k > j; k-- )
+			s->worst[k] = s->worst[k - 1];
+		s->worst[j] = i;
+	}
+}
+
+/*
+==============
+CL_TimeDemoExport
+
+write the frame samples of the finished run
+==============
+*/
+static void CL_TimeDemoExport( const tdsummary_t *s )
+{
+	const char	*ext = timedemo_export.string;
+	char		name[MAX_QPATH];
+	qboolean		json;
+	file_t		*f;
+	int		i, j;
+
+	if( !Q_stricmp( ext, "json" ))
+		json = true;
+	else if( !Q_stricmp( ext, "csv" ))
+		json = false;
+	else return;
+
+	if( td.runs > 1 )
+		Q_snprintf( name, sizeof( name ), "timedemo_%s_%i.%s", COM_FileWithoutPath( td.demoname ), td.run + 1, ext );
+	else Q_snprintf( name, sizeof( name ), "timedemo_%s.%s", COM_FileWithoutPath( td.demoname ), ext );
+
+	if(( f = FS_Open( name, "w", false )) == NULL )
+	{
+		Con_Printf( S_ERROR "couldn't write %s\n", name );
+		return;
+	}
+
+	if( json )
+	{
+		FS_Printf( f, "{\n\t\"demo\": \"%s\",\n\t\"run\": %i,\n\t\"frames\": %i,\n", td.demoname, td.run + 1, td.numframes );
+		FS_Printf( f, "\t\"min\": %.3f,\n\t\"avg\": %.3f,\n\t\"p50\": %.3f,\n\t\"p95\": %.3f,\n\t\"p99\": %.3f,\n\t\"max\": %.3f,\n",
+			s->min, s->avg, s->p50, s->p95, s->p99, s->max );
+		FS_Printf( f, "\t\"worst\": [" );
+		for( i = 0; i < TD_WORST_FRAMES && s->worst[i] != -1; i++ )
+			FS_Printf( f, i ? ", %i" : "%i", s->worst[i] );
+		FS_Printf( f, "],\n\t\"columns\": [\"total\", \"net\", \"think\", \"render\", \"sound\"],\n\t\"samples\": [\n" );
+	}
+	else FS_Printf( f, "frame,total,net,think,render,sound\n" );
+
+	for( i = 0; i < td.numframes; i++ )
+	{
+		const float	*t = td.frames[i].time;
+
+		if( json )
+			FS_Printf( f, "\t\t[%.3f", t[TD_TOTAL] );
+		else FS_Printf( f, "%i,%.3f", i, t[TD_TOTAL] );
+
+		for( j = 0; j < TD_PHASES; j++ )
+			FS_Printf( f, json ? ", %.3f" : ",%.3f", t[j] );
+
+		if( json )
+			FS_Printf( f, i < td.numframes - 1 ? "],\n" : "]\n" );
+		else FS_Printf( f, "\n" );
+	}
+
+	if( json )
+		FS_Printf( f, "\t]\n}\n" );
+
+	FS_Close( f );
+	Con_Printf( "timedemo: wrote %s\n", name );
+}
+
 /*
 ==============
 CL_FinishTimeDemo
@@ -1099,10 +1804,12 @@ show stats
 */
 void CL_FinishTimeDemo( void )
 {
-	int	frames;
-	double	time;
+	tdsummary_t	s;
+	int		frames, i;
+	double		time;
 
 	cls.timedemo = false;
+	td.framestart = 0.0;
 
 	// the first frame didn't count
 	frames = (host.framecount - cls.td_startframe) - 1;
@@ -1110,6 +1817,46 @@ void CL_FinishTimeDemo( void )
 	if( !time ) time = 1.0;
 
 	Con_Printf( "%i frames %5.3f seconds %5.3f fps\n", frames, time, frames / time );
+
+	if( cls.demobench )
+	{
+		CL_DemoBenchReport( time );
+		cls.demobench = false;
+	}
+
+	if( td.numframes <= 0 )
+		return;
+
+	CL_TimeDemoSummary( td.frames, td.numframes, &s );
+
+	Con_Printf( "frame time: min %.2f avg %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f msec\n",
+		s.min, s.avg, s.p50, s.p95, s.p99, s.max );
+	Con_Printf( "phases: net %.2f think %.2f render %.2f sound %.2f other %.2f msec\n",
+		s.phases[TD_NET], s.phases[TD_THINK], s.phases[TD_RENDER], s.phases[TD_SOUND],
+		s.avg - ( s.phases[TD_NET] + s.phases[TD_THINK] + s.phases[TD_RENDER] + s.phases[TD_SOUND] ));
+
+	Con_Printf( "worst frames:" );
+	for( i = 0; i < TD_WORST_FRAMES && s.worst[i] != -1; i++ )
+		Con_Printf( " #%i (%.2f)", s.worst[i], td.frames[s.worst[i]].time[TD_TOTAL] );
+	Con_Printf( "\n" );
+
+	CL_TimeDemoExport( &s );
+
+	td.total.min += s.min;
+	td.total.avg += s.avg;
+	td.total.p50 += s.p50;
+	td.total.p95 += s.p95;
+	td.total.p99 += s.p99;
+	td.total.max += s.max;
+	td.run++;
+
+	if( td.runs > 1 && td.run == td.runs )
+	{
+		Con_Printf( "average of %i runs: min %.2f avg %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f msec\n", td.runs,
+			td.total.min / td.runs, td.total.avg / td.runs, td.total.p50 / td.runs,
+			td.total.p95 / td.runs, td.total.p99 / td.runs, td.total.max / td.runs );
+	}
+
 }
 
 /*
@@ -1132,6 +1879,8 @@ void CL_StopPlayback( void )
 	cls.olddemonum = Q_max( -1, cls.demonum - 1 );
 	if( demo.directory.entries != NULL )
 		Mem_Free( demo.directory.entries );
+	CL_FreeDemoIndex();
+	demo.seeking = false;
 	cls.td_lastframe = host.framecount;
 	demo.directory.numentries = 0;
 	demo.directory.entries = NULL;
@@ -1512,6 +2261,9 @@ void CL_PlayDemo_f( void )
 		FS_Read( cls.demofile, &demo.directory.entries[i], sizeof( demoentry_t ));
 	}
 
+	// optional seek index follows the directory
+	CL_ReadDemoIndex( cls.demofile );
+
 	demo.entryIndex = 0;
 	demo.entry = &demo.directory.entries[demo.entryIndex];
 
@@ -1530,17 +2282,31 @@ void CL_PlayDemo_f( void )
 ====================
 CL_TimeDemo_f
 
-timedemo <demoname>
+timedemo <demoname> [runs]
 ====================
 */
 void CL_TimeDemo_f( void )
 {
-	if( Cmd_Argc() != 2 )
+	if( Cmd_Argc() != 2 && Cmd_Argc() != 3 )
 	{
-		Con_Printf( S_USAGE "timedemo <demoname>\n" );
+		Con_Printf( S_USAGE "timedemo <demoname> [runs]\n" );
 		return;
 	}
 
+	// start a new series unless it's the next run
+	if( !td.restart )
+	{
+		memset( &td.total, 0, sizeof( td.total ));
+		td.runs = ( Cmd_Argc() == 3 ) ? Q_max( 1, Q_atoi( Cmd_Argv( 2 ))) : 1;
+		td.run = 0;
+		Q_strncpy( td.demoname, Cmd_Argv( 1 ), sizeof( td.demoname ));
+		COM_StripExtension( td.demoname );
+	}
+
+	td.restart = false;
+	td.numframes = 0;
+	td.framestart = 0.0;
+
 	CL_PlayDemo_f ();
 
 	// cls.td_starttime will be grabbed at the second frame of the demo, so
@@ -1551,6 +2317,85 @@ void CL_TimeDemo_f( void )
 	cls.td_lastframe = -1;		// get a new message this frame
 }
 
+/*
+====================
+CL_DemoBench_f
+
+demo_bench <demoname>
+timedemo without rendering and sound, measures
+the client parse and entity pipeline alone
+====================
+*/
+void CL_DemoBench_f( void )
+{
+	if( Cmd_Argc() != 2 )
+	{
+		Con_Printf( S_USAGE "demo_bench <demoname>\n" );
+		return;
+	}
+
+	CL_TimeDemo_f ();
+
+	if( !cls.demoplayback )
+		return;
+
+	memset( &bench, 0, sizeof( bench ));
+	bench.lastcmd = -1;
+	cls.demobench = true;
+}
+
+/*
+====================
+CL_DemoSeek_f
+
+demo_seek <seconds>
+jump to the closest keyframe and parse
+up to the time without rendering
+====================
+*/
+void CL_DemoSeek_f( void )
+{
+	demokeyframe_t	*kf;
+	float		target, now;
+
+	if( cls.demoplayback != DEMO_XASH3D || cls.timedemo || !cls.demofile || demo.entryIndex < 1 )
+	{
+		Con_Printf( "demo_seek: no demo is playing\n" );
+		return;
+	}
+
+	now = CL_DemoClock();
+
+	if( Cmd_Argc() != 2 )
+	{
+		Con_Printf( S_USAGE "demo_seek <seconds>\n" );
+		Con_Printf( "at %.2f of %.2f sec, %i keyframes\n", now, demo.entry->playback_time, demo.numkeyframes );
+		return;
+	}
+
+	target = Q_max( 0.0f, Q_atof( Cmd_Argv( 1 )));
+	kf = CL_FindDemoKeyframe( demo.entryIndex, target );
+
+	// going back needs a keyframe, going forward only when it saves parsing
+	if( target < now || ( kf && kf->time > now + DEMO_KEYFRAME_GAP ))
+	{
+		if( !kf )
+		{
+			Con_Printf( "demo_seek: no keyframe before %.2f sec\n", target );
+			return;
+		}
+
+		FS_Seek( cls.demofile, kf->offset, SEEK_SET );
+		demo.clockbase = kf->clockbase;
+		demo.cmdtime = kf->time - kf->clockbase;
+	}
+
+	demo.seeking = true;
+	demo.seektime = target;
+	demo.seekstart = Sys_DoubleTime();
+	demo.seekmessages = 0;
+}
+
 /*
 ==================
 CL_StartDemos_f
@@ -1627,3 +2472,211 @@ void CL_Stop_f( void )
 		S_StopBackgroundTrack();
 	}
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+void Test_RunTimeDemoStats( void )
+{
+	tdframe_t		frames[100];
+	tdsummary_t	s;
+	int		i;
+
+	// 1..100 msec in scrambled order, 37 is coprime with 100
+	memset( frames, 0, sizeof( frames ));
+	for( i = 0; i < 100; i++ )
+	{
+		frames[i].time[TD_TOTAL] = ( i * 37 % 100 ) + 1;
+		frames[i].time[TD_RENDER] = 0.5f;
+	}
+
+	CL_TimeDemoSummary( frames, 100, &s );
+
+	TASSERT( s.min == 1.0f && s.max == 100.0f && s.avg == 50.5f );
+	TASSERT( s.p50 == 50.0f && s.p95 == 95.0f && s.p99 == 99.0f && s.phases[TD_RENDER] == 0.5f );
+	TASSERT( frames[s.worst[0]].time[TD_TOTAL] == 100.0f && frames[s.worst[4]].time[TD_TOTAL] == 96.0f );
+}
+
+#define DEMO_TEST_FRAMETIME	0.05	// 20 updates per second
+#define DEMO_TEST_FRAMES	12000	// ten minutes
+#define DEMO_TEST_MSGSIZE	1400
+#define DEMO_TEST_TARGET	590.02f	// between two messages
+
+/*
+====================
+Test_DemoSeekTo
+
+read messages like demo_seek does until the
+target time, returns the first message payload
+====================
+*/
+static int Test_DemoSeekTo( int offset, float clockbase, float time, float target, double *msec )
+{
+	byte	buffer[DEMO_TEST_MSGSIZE];
+	size_t	length;
+	double	start;
+	int	first = -1;
+
+	start = Sys_DoubleTime();
+	FS_Seek( cls.demofile, offset, SEEK_SET );
+	demo.clockbase = clockbase;
+	demo.cmdtime = time - clockbase;
+	demo.seeking = true;
+	demo.seektime = 1e9f; // the test stops it, finishing needs the whole client
+	demo.seekmessages = 0;
+
+	while( CL_DemoClock() < target && cls.demofile )
+	{
+		if( !CL_DemoReadMessage( buffer, &length ))
+			continue;
+
+		if( first == -1 && length >= sizeof( int ))
+			memcpy( &first, buffer, sizeof( int ));
+	}
+
+	*msec = ( Sys_DoubleTime() - start ) * 1000.0;
+	demo.seeking = false;
+
+	return first;
+}
+
+void Test_RunDemoIndex( void )
+{
+	const char	*name = "test_demoindex.dem";
+	poolhandle_t	oldpool = cls.mempool;
+	connstate_t	oldstate = cls.state;
+	demokeyframe_t	*kf;
+	sizebuf_t		msg;
+	byte		data[DEMO_TEST_MSGSIZE];
+	double		times[2] = { 1e9, 1e9 }, t;
+	int		messages[2] = { 0 };
+	int		i, r, first, numkeyframes;
+	qboolean		pending = false;
+	float		kftime;
+
+	cls.mempool = Mem_AllocPool( "Demo Index Test" );
+	cls.state = ca_active;
+	Cvar_RegisterVariable( &demo_keyframe );
+	Cvar_DirectSet( &demo_keyframe, "10" );
+
+	// what CL_WriteDemoHeader sets up, without the startup messages
+	memset( &demo, 0, sizeof( demo ));
+	cl.mtime[0] = 0.0;
+	cls.demotime = 0.0;
+	cls.demofile = FS_Open( name, "wb", false );
+	TASSERT( cls.demofile != NULL );
+	if( !cls.demofile )
+		goto cleanup;
+
+	demo.header.id = IDEMOHEADER;
+	demo.header.dem_protocol = DEMO_PROTOCOL;
+	demo.header.net_protocol = PROTOCOL_VERSION;
+	FS_Write( cls.demofile, &demo.header, sizeof( demo.header ));
+
+	demo.directory.numentries = 2;
+	demo.directory.entries = Mem_Calloc( cls.mempool, sizeof( demoentry_t ) * demo.directory.numentries );
+	demo.directory.entries[0].entrytype = DEMO_STARTUP;
+	demo.directory.entries[0].offset = FS_Tell( cls.demofile );
+	demo.entry = &demo.directory.entries[1];
+	demo.entry->entrytype = DEMO_NORMAL;
+	demo.entry->offset = FS_Tell( cls.demofile );
+	CL_WriteDemoCmdHeader( dem_jumptime, cls.demofile );
+
+	cls.demorecording = true;
+	cls.demowaiting = false;
+
+	// the server answers a full update request with the next message
+	for( i = 0; i < DEMO_TEST_FRAMES; i++ )
+	{
+		cl.mtime[0] = cls.demotime = i * DEMO_TEST_FRAMETIME;
+
+		if( pending )
+			CL_DemoFullUpdate();
+		pending = CL_DemoWantsFullUpdate();
+
+		memset( data, i, sizeof( data ));
+		MSG_Init( &msg, "DemoTest", data, sizeof( data ));
+		MSG_WriteLong( &msg, i );
+		MSG_SeekToBit( &msg, sizeof( data ) << 3, SEEK_SET );
+		CL_WriteDemoMessage( false, 0, &msg );
+	}
+
+	numkeyframes = demo.numkeyframes;
+	CL_StopRecord();
+	demo.directory.entries = NULL;
+
+	// read it back as CL_PlayDemo_f does, no game directory is mounted yet
+	cls.demofile = FS_Open( name, "rb", false );
+	TASSERT( cls.demofile != NULL );
+	if( !cls.demofile )
+		goto cleanup;
+
+	FS_Read( cls.demofile, &demo.header, sizeof( demo.header ));
+	TASSERT( demo.header.id == IDEMOHEADER );
+	FS_Seek( cls.demofile, demo.header.directory_offset, SEEK_SET );
+	FS_Read( cls.demofile, &demo.directory.numentries, sizeof( int ));
+	TASSERT( demo.directory.numentries == 2 );
+	if( demo.directory.numentries != 2 )
+		goto cleanup;
+
+	demo.directory.entries = Mem_Malloc( cls.mempool, sizeof( demoentry_t ) * demo.directory.numentries );
+	FS_Read( cls.demofile, demo.directory.entries, sizeof( demoentry_t ) * demo.directory.numentries );
+	CL_ReadDemoIndex( cls.demofile );
+
+	// 10 seconds apart, each one a frame after the request
+	TASSERT( numkeyframes == 60 && demo.numkeyframes == numkeyframes );
+
+	demo.entryIndex = 1;
+	demo.entry = &demo.directory.entries[1];
+	cls.demoplayback = DEMO_XASH3D;
+
+	kf = CL_FindDemoKeyframe( 1, DEMO_TEST_TARGET );
+	TASSERT( kf != NULL && kf->time <= DEMO_TEST_TARGET && kf->time > DEMO_TEST_TARGET - 10.0f - DEMO_TEST_FRAMETIME * 2 );
+	if( !kf )
+		goto cleanup;
+	kftime = kf->time;
+
+	// best of a few alternating rounds from the entry start and from the keyframe
+	for( r = 0; r < 6; r++ )
+	{
+		if( r & 1 )
+		{
+			first = Test_DemoSeekTo( kf->offset, kf->clockbase, kf->time, DEMO_TEST_TARGET, &t );
+			TASSERT( fabs( first * DEMO_TEST_FRAMETIME - kftime ) < 0.001 );
+		}
+		else
+		{
+			first = Test_DemoSeekTo( demo.entry->offset, 0.0f, 0.0f, DEMO_TEST_TARGET, &t );
+			TASSERT( first == 0 );
+		}
+
+		times[r & 1] = Q_min( times[r & 1], t );
+		messages[r & 1] = demo.seekmessages;
+	}
+
+	TASSERT( messages[0] == (int)( DEMO_TEST_TARGET / DEMO_TEST_FRAMETIME ) + 2 );
+	TASSERT( messages[1] < 250 );
+
+	Con_Printf( "Test_RunDemoIndex: %i keyframes, seek to %.0f sec: %i messages %.2f msec from the start, %i messages %.2f msec from a keyframe\n",
+		numkeyframes, DEMO_TEST_TARGET, messages[0], times[0], messages[1], times[1] );
+
+cleanup:
+	if( cls.demofile )
+		FS_Close( cls.demofile );
+	FS_Delete( name );
+	CL_FreeDemoIndex();
+	if( demo.directory.entries )
+		Mem_Free( demo.directory.entries );
+	memset( &demo, 0, sizeof( demo ));
+
+	cls.demofile = NULL;
+	cls.demorecording = false;
+	cls.demoplayback = false;
+	cls.demotime = 0.0;
+	cl.mtime[0] = 0.0;
+	cls.state = oldstate;
+	Cvar_DirectSet( &demo_keyframe, demo_keyframe.def_string );
+	Mem_FreePool( &cls.mempool );
+	cls.mempool = oldpool;
+}
+#endif /* XASH_ENGINE_TESTS */
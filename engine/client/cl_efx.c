@@ -6,7 +6,18 @@
 #include "r_efx.h"
 #include "cl_tent.h"
 #include "pm_local.h"
+
+// vector kernels follow the compiler target, SSE2 is always there on amd64
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define PART_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define PART_NEON	1
+#endif
+
 #define PART_SIZE	Q_max( 0.5f, cl_draw_particles->value )
+#define PART_STAGE	256	// batched particles spawned between flushes
 
 /*
 ==============================================================
@@ -32,6 +43,90 @@ particle_t	*cl_particles = NULL;	// particle pool
 static vec3_t	cl_avelocities[NUMVERTEXNORMALS];
 static float	cl_lasttimewarn = 0.0f;
 
+// particles spawned by engine effects never leave the engine,
+// so they are kept as arrays and updated in one pass, the linked
+// particle_t list only serves game dll particles and tracers
+typedef struct
+{
+	int	count;
+	int	max;
+	float	*org[3];
+	float	*vel[3];
+	float	*damp[2];		// velocity scale per second, xy and z
+	float	*grav;		// gravity multiplier
+	float	*ramp;
+	float	*die;
+	short	*color;
+	short	*packedColor;
+	byte	*type;
+	byte	*rampkind;
+
+	float	*floats;		// storage
+	short	*shorts;
+	byte	*bytes;
+} partstore_t;
+
+// how each particle type moves, blob types with packedColor
+// other than 255 are sparks and use the last entry
+typedef struct
+{
+	float	dampxy;
+	float	dampz;
+	float	grav;
+	int	rampkind;
+} partmotion_t;
+
+// color ramps advanced by time
+typedef struct
+{
+	float	speed;
+	float	limit;
+	const int	*colors;
+	qboolean	flicker;		// wrap around and switch between blob types
+} partramp_t;
+
+enum
+{
+	RAMP_NONE = 0,
+	RAMP_FIRE,
+	RAMP_EXPLODE,
+	RAMP_EXPLODE2,
+	RAMP_SPARK,
+};
+
+static const partramp_t cl_partramps[] =
+{
+	{ 0.0f, 0.0f, NULL, false },
+	{ 5.0f, 6.0f, ramp3, false },
+	{ 10.0f, 8.0f, ramp1, false },
+	{ 15.0f, 8.0f, ramp2, false },
+	{ 10.0f, 9.0f, gSparkRamp, true },
+};
+
+static const partmotion_t cl_partmotion[] =
+{
+	{ 0.0f, 0.0f, 0.0f, RAMP_NONE },	// pt_static
+	{ 0.0f, 0.0f, 20.0f, RAMP_NONE },	// pt_grav
+	{ 0.0f, 0.0f, 1.0f, RAMP_NONE },	// pt_slowgrav
+	{ 0.0f, 0.0f, -1.0f, RAMP_FIRE },	// pt_fire
+	{ 4.0f, 4.0f, 1.0f, RAMP_EXPLODE },	// pt_explode
+	{ -1.0f, -1.0f, 1.0f, RAMP_EXPLODE2 },	// pt_explode2
+	{ 4.0f, 4.0f, 1.0f, RAMP_NONE },	// pt_blob
+	{ -4.0f, 0.0f, 1.0f, RAMP_NONE },	// pt_blob2
+	{ 0.0f, 0.0f, 4.0f, RAMP_NONE },	// pt_vox_slowgrav
+	{ 0.0f, 0.0f, 8.0f, RAMP_NONE },	// pt_vox_grav
+	{ 0.0f, 0.0f, 0.0f, RAMP_NONE },	// pt_clientcustom, can't be batched
+	{ -0.5f, -0.5f, 5.0f, RAMP_SPARK },	// spark
+};
+
+static partstore_t	cl_parts;
+static particle_t	*cl_partview;	// batched particles as a list for the renderer
+static particle_t	cl_partstage[PART_STAGE];
+static int	cl_numstaged;
+
+static void CL_AllocPartStore( partstore_t *ps, int max, poolhandle_t pool );
+static void CL_FreePartStore( partstore_t *ps );
+
 /*
 ================
 R_LookupColor
@@ -90,6 +185,8 @@ void CL_InitParticles( void )
 	int	i;
 
 	cl_particles = Mem_Calloc( cls.mempool, sizeof( particle_t ) * GI->max_particles );
+	CL_AllocPartStore( &cl_parts, GI->max_particles, cls.mempool );
+	cl_partview = Mem_Calloc( cls.mempool, sizeof( particle_t ) * GI->max_particles );
 	CL_ClearParticles ();
 
 	// this is used for EF_BRIGHTFIELD
@@ -120,6 +217,8 @@ void CL_ClearParticles( void )
 	cl_free_particles = cl_particles;
 	cl_active_particles = NULL;
 	cl_active_tracers = NULL;
+	cl_parts.count = 0;
+	cl_numstaged = 0;
 
 	for( i = 0; i < GI->max_particles - 1; i++ )
 		cl_particles[i].next = &cl_particles[i+1];
@@ -138,6 +237,12 @@ void CL_FreeParticles( void )
 	if( cl_particles )
 		Mem_Free( cl_particles );
 	cl_particles = NULL;
+
+	if( cl_partview )
+		Mem_Free( cl_partview );
+	cl_partview = NULL;
+
+	CL_FreePartStore( &cl_parts );
 }
 
 /*
@@ -275,6 +380,504 @@ particle_t *R_AllocTracer( const vec3_t org, const vec3_t vel, float life )
 
 	return p;
 }
+
+/*
+==============================================================
+
+BATCHED PARTICLES
+
+==============================================================
+*/
+/*
+================
+CL_AllocPartStore
+
+================
+*/
+static void CL_AllocPartStore( partstore_t *ps, int max, poolhandle_t pool )
+{
+	int	i;
+
+	memset( ps, 0, sizeof( *ps ));
+	ps->max = max;
+
+	ps->floats = Mem_Malloc( pool, max * 11 * sizeof( float ));
+	ps->shorts = Mem_Malloc( pool, max * 2 * sizeof( short ));
+	ps->bytes = Mem_Malloc( pool, max * 2 );
+
+	for( i = 0; i < 3; i++ )
+	{
+		ps->org[i] = ps->floats + max * i;
+		ps->vel[i] = ps->floats + max * ( 3 + i );
+	}
+
+	ps->damp[0] = ps->floats + max * 6;
+	ps->damp[1] = ps->floats + max * 7;
+	ps->grav = ps->floats + max * 8;
+	ps->ramp = ps->floats + max * 9;
+	ps->die = ps->floats + max * 10;
+	ps->color = ps->shorts;
+	ps->packedColor = ps->shorts + max;
+	ps->type = ps->bytes;
+	ps->rampkind = ps->bytes + max;
+}
+
+/*
+================
+CL_FreePartStore
+
+================
+*/
+static void CL_FreePartStore( partstore_t *ps )
+{
+	if( ps->floats )
+	{
+		Mem_Free( ps->floats );
+		Mem_Free( ps->shorts );
+		Mem_Free( ps->bytes );
+	}
+
+	memset( ps, 0, sizeof( *ps ));
+}
+
+/*
+================
+CL_SetBatchParticleType
+
+================
+*/
+static void CL_SetBatchParticleType( partstore_t *ps, int i, int type )
+{
+	const partmotion_t	*m;
+
+	if(( type == pt_blob || type == pt_blob2 ) && ps->packedColor[i] != 255 )
+		m = &cl_partmotion[pt_clientcustom + 1];
+	else m = &cl_partmotion[bound( pt_static, type, pt_clientcustom )];
+
+	ps->type[i] = type;
+	ps->damp[0][i] = m->dampxy;
+	ps->damp[1][i] = m->dampz;
+	ps->grav[i] = m->grav;
+	ps->rampkind[i] = m->rampkind;
+}
+
+/*
+================
+CL_AddBatchParticle
+
+copy particle into the arrays, caller checked the space
+================
+*/
+static void CL_AddBatchParticle( partstore_t *ps, const particle_t *p )
+{
+	int	i = ps->count++;
+
+	ps->org[0][i] = p->org[0];
+	ps->org[1][i] = p->org[1];
+	ps->org[2][i] = p->org[2];
+	ps->vel[0][i] = p->vel[0];
+	ps->vel[1][i] = p->vel[1];
+	ps->vel[2][i] = p->vel[2];
+	ps->ramp[i] = p->ramp;
+	ps->die[i] = p->die;
+	ps->color[i] = p->color;
+	ps->packedColor[i] = p->packedColor;
+	CL_SetBatchParticleType( ps, i, p->type );
+}
+
+/*
+================
+CL_RemoveBatchParticle
+
+move last particle into the hole
+================
+*/
+static void CL_RemoveBatchParticle( partstore_t *ps, int i )
+{
+	int	j, last = --ps->count;
+
+	if( i == last )
+		return;
+
+	for( j = 0; j < 3; j++ )
+	{
+		ps->org[j][i] = ps->org[j][last];
+		ps->vel[j][i] = ps->vel[j][last];
+	}
+
+	ps->damp[0][i] = ps->damp[0][last];
+	ps->damp[1][i] = ps->damp[1][last];
+	ps->grav[i] = ps->grav[last];
+	ps->ramp[i] = ps->ramp[last];
+	ps->die[i] = ps->die[last];
+	ps->color[i] = ps->color[last];
+	ps->packedColor[i] = ps->packedColor[last];
+	ps->type[i] = ps->type[last];
+	ps->rampkind[i] = ps->rampkind[last];
+}
+
+/*
+================
+CL_FlushBatchParticles
+
+move particles spawned since last update into the arrays
+================
+*/
+static void CL_FlushBatchParticles( void )
+{
+	int	i;
+
+	for( i = 0; i < cl_numstaged && cl_parts.count < cl_parts.max; i++ )
+		CL_AddBatchParticle( &cl_parts, &cl_partstage[i] );
+
+	cl_numstaged = 0;
+}
+
+/*
+================
+CL_AllocBatchParticle
+
+particle for engine effects, pointer is only valid
+until the next allocation, can return NULL if particles is out
+================
+*/
+particle_t *CL_AllocBatchParticle( void )
+{
+	particle_t	*p;
+
+	if( !cl_draw_particles->value )
+		return NULL;
+
+	if( cl_numstaged == PART_STAGE )
+		CL_FlushBatchParticles();
+
+	if( cl_parts.count + cl_numstaged >= cl_parts.max )
+	{
+		if( cl_lasttimewarn < host.realtime )
+		{
+			// don't spam about overflow
+			Con_DPrintf( S_ERROR "Overflow %d particles\n", cl_parts.max );
+			cl_lasttimewarn = host.realtime + 1.0f;
+		}
+		return NULL;
+	}
+
+	p = &cl_partstage[cl_numstaged++];
+
+	// clear old particle
+	p->type = pt_static;
+	VectorClear( p->vel );
+	VectorClear( p->org );
+	p->packedColor = 0;
+	p->die = cl.time;
+	p->color = 0;
+	p->ramp = 0;
+
+	return p;
+}
+
+/*
+================
+CL_IntegrateParticles
+
+advance velocity and position of particles [start, end)
+================
+*/
+static void CL_IntegrateParticles( partstore_t *ps, int start, int end, float frametime, float grav )
+{
+	float	vx, vy, vz;
+	int	i;
+
+	for( i = start; i < end; i++ )
+	{
+		vx = ps->vel[0][i];
+		vy = ps->vel[1][i];
+		vz = ps->vel[2][i];
+
+		ps->org[0][i] += vx * frametime;
+		ps->org[1][i] += vy * frametime;
+		ps->org[2][i] += vz * frametime;
+
+		ps->vel[0][i] = vx + vx * ( ps->damp[0][i] * frametime );
+		ps->vel[1][i] = vy + vy * ( ps->damp[0][i] * frametime );
+		ps->vel[2][i] = vz + vz * ( ps->damp[1][i] * frametime ) - ps->grav[i] * grav;
+	}
+}
+
+#ifdef PART_SSE2
+/*
+================
+CL_IntegrateParticlesSSE2
+
+four particles at once, returns count of done particles
+================
+*/
+static int CL_IntegrateParticlesSSE2( partstore_t *ps, float frametime, float grav )
+{
+	__m128	dt = _mm_set1_ps( frametime );
+	__m128	g = _mm_set1_ps( grav );
+	__m128	vx, vy, vz, dxy, dz;
+	int	i;
+
+	for( i = 0; i + 4 <= ps->count; i += 4 )
+	{
+		vx = _mm_loadu_ps( ps->vel[0] + i );
+		vy = _mm_loadu_ps( ps->vel[1] + i );
+		vz = _mm_loadu_ps( ps->vel[2] + i );
+		dxy = _mm_mul_ps( _mm_loadu_ps( ps->damp[0] + i ), dt );
+		dz = _mm_mul_ps( _mm_loadu_ps( ps->damp[1] + i ), dt );
+
+		_mm_storeu_ps( ps->org[0] + i, _mm_add_ps( _mm_loadu_ps( ps->org[0] + i ), _mm_mul_ps( vx, dt )));
+		_mm_storeu_ps( ps->org[1] + i, _mm_add_ps( _mm_loadu_ps( ps->org[1] + i ), _mm_mul_ps( vy, dt )));
+		_mm_storeu_ps( ps->org[2] + i, _mm_add_ps( _mm_loadu_ps( ps->org[2] + i ), _mm_mul_ps( vz, dt )));
+
+		_mm_storeu_ps( ps->vel[0] + i, _mm_add_ps( vx, _mm_mul_ps( vx, dxy )));
+		_mm_storeu_ps( ps->vel[1] + i, _mm_add_ps( vy, _mm_mul_ps( vy, dxy )));
+		vz = _mm_add_ps( vz, _mm_mul_ps( vz, dz ));
+		_mm_storeu_ps( ps->vel[2] + i, _mm_sub_ps( vz, _mm_mul_ps( _mm_loadu_ps( ps->grav + i ), g )));
+	}
+
+	return i;
+}
+#endif // PART_SSE2
+
+#ifdef PART_NEON
+/*
+================
+CL_IntegrateParticlesNEON
+
+four particles at once, returns count of done particles
+================
+*/
+static int CL_IntegrateParticlesNEON( partstore_t *ps, float frametime, float grav )
+{
+	float32x4_t	dt = vdupq_n_f32( frametime );
+	float32x4_t	g = vdupq_n_f32( grav );
+	float32x4_t	vx, vy, vz, dxy, dz;
+	int		i;
+
+	for( i = 0; i + 4 <= ps->count; i += 4 )
+	{
+		vx = vld1q_f32( ps->vel[0] + i );
+		vy = vld1q_f32( ps->vel[1] + i );
+		vz = vld1q_f32( ps->vel[2] + i );
+		dxy = vmulq_f32( vld1q_f32( ps->damp[0] + i ), dt );
+		dz = vmulq_f32( vld1q_f32( ps->damp[1] + i ), dt );
+
+		vst1q_f32( ps->org[0] + i, vaddq_f32( vld1q_f32( ps->org[0] + i ), vmulq_f32( vx, dt )));
+		vst1q_f32( ps->org[1] + i, vaddq_f32( vld1q_f32( ps->org[1] + i ), vmulq_f32( vy, dt )));
+		vst1q_f32( ps->org[2] + i, vaddq_f32( vld1q_f32( ps->org[2] + i ), vmulq_f32( vz, dt )));
+
+		vst1q_f32( ps->vel[0] + i, vaddq_f32( vx, vmulq_f32( vx, dxy )));
+		vst1q_f32( ps->vel[1] + i, vaddq_f32( vy, vmulq_f32( vy, dxy )));
+		vz = vaddq_f32( vz, vmulq_f32( vz, dz ));
+		vst1q_f32( ps->vel[2] + i, vsubq_f32( vz, vmulq_f32( vld1q_f32( ps->grav + i ), g )));
+	}
+
+	return i;
+}
+#endif // PART_NEON
+
+/*
+================
+CL_UpdateBatchParticles
+
+free expired particles, advance color ramps
+then move the rest
+================
+*/
+static void CL_UpdateBatchParticles( partstore_t *ps, float frametime, double time, qboolean simd )
+{
+	float		grav = frametime * clgame.movevars.gravity * 0.05f;
+	const partramp_t	*r;
+	int		i;
+
+	for( i = 0; i < ps->count; )
+	{
+		if( ps->die[i] < time )
+		{
+			CL_RemoveBatchParticle( ps, i );
+			continue;
+		}
+
+		if( ps->rampkind[i] != RAMP_NONE )
+		{
+			r = &cl_partramps[ps->rampkind[i]];
+			ps->ramp[i] += r->speed * frametime;
+
+			if( ps->ramp[i] >= r->limit )
+			{
+				if( !r->flicker )
+				{
+					CL_RemoveBatchParticle( ps, i );
+					continue;
+				}
+				ps->ramp[i] = 0.0f;
+			}
+
+			ps->color[i] = r->colors[(int)ps->ramp[i]];
+
+			// sparks are hidden by renderer as pt_blob
+			if( r->flicker )
+				ps->type[i] = COM_RandomLong( 0, 3 ) ? pt_blob : pt_blob2;
+		}
+
+		i++;
+	}
+
+	i = 0;
+
+	if( simd )
+	{
+#if defined( PART_SSE2 )
+		i = CL_IntegrateParticlesSSE2( ps, frametime, grav );
+#elif defined( PART_NEON )
+		i = CL_IntegrateParticlesNEON( ps, frametime, grav );
+#endif
+	}
+
+	CL_IntegrateParticles( ps, i, ps->count, frametime, grav );
+}
+
+/*
+================
+CL_LinkBatchParticles
+
+fill the particle list renderer walks, game dll
+particles follow the batched ones
+================
+*/
+static particle_t *CL_LinkBatchParticles( void )
+{
+	particle_t	*p;
+	int		i;
+
+	if( !cl_parts.count )
+		return cl_active_particles;
+
+	for( i = 0, p = cl_partview; i < cl_parts.count; i++, p++ )
+	{
+		p->org[0] = cl_parts.org[0][i];
+		p->org[1] = cl_parts.org[1][i];
+		p->org[2] = cl_parts.org[2][i];
+		p->color = cl_parts.color[i];
+		p->packedColor = cl_parts.packedColor[i];
+		p->type = cl_parts.type[i];
+		p->die = cl_parts.die[i];
+		p->ramp = cl_parts.ramp[i];
+		p->next = p + 1;
+	}
+
+	cl_partview[cl_parts.count - 1].next = cl_active_particles;
+
+	return cl_partview;
+}
+
+/*
+================
+CL_ParticleBench_f
+
+cl_particlebench [count]
+update the same burst as a linked list and as arrays
+================
+*/
+void CL_ParticleBench_f( void )
+{
+	const float	frametime = 1.0f / 200.0f;
+	const int		frames = 100;
+	float		oldgravity = clgame.movevars.gravity;
+	double		start, time[3];
+	int		i, j, tmp, count, pass;
+	int		processed[3];
+	particle_t	*list, *head, *p;
+	partstore_t	ps;
+	int		*order;
+
+	count = Q_max( 16, Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 )) : 100000 );
+
+	if( !clgame.movevars.gravity )
+		clgame.movevars.gravity = 800.0f;
+
+	list = Mem_Calloc( host.mempool, sizeof( *list ) * count );
+	order = Mem_Malloc( host.mempool, sizeof( *order ) * count );
+	CL_AllocPartStore( &ps, count, host.mempool );
+
+	for( pass = 0; pass < 3; pass++ )
+	{
+		COM_SetRandomSeed( 1 );
+
+		for( i = 0; i < count; i++ )
+		{
+			p = &list[i];
+			p->type = i % pt_clientcustom;
+			p->packedColor = ( i & 16 ) ? 255 : 0;
+			p->ramp = 0.0f;
+			p->color = ramp1[0];
+			p->die = 1.0f + COM_RandomFloat( 0.0f, 2.0f );
+			for( j = 0; j < 3; j++ )
+			{
+				p->org[j] = COM_RandomFloat( -16.0f, 16.0f );
+				p->vel[j] = COM_RandomFloat( -256.0f, 256.0f );
+			}
+			order[i] = i;
+		}
+
+		processed[pass] = 0;
+
+		if( pass == 0 )
+		{
+			// a list that lived for a while is scattered over the pool
+			for( i = count - 1; i > 0; i-- )
+			{
+				j = COM_RandomLong( 0, i );
+				tmp = order[i];
+				order[i] = order[j];
+				order[j] = tmp;
+			}
+
+			for( i = 0; i < count - 1; i++ )
+				list[order[i]].next = &list[order[i + 1]];
+			list[order[count - 1]].next = NULL;
+			head = &list[order[0]];
+
+			start = Sys_DoubleTime();
+			for( i = 0; i < frames; i++ )
+			{
+				for( p = head; p; p = p->next )
+				{
+					if( p->die < i * frametime )
+						continue;
+					CL_ThinkParticle( frametime, p );
+					processed[pass]++;
+				}
+			}
+			time[pass] = Sys_DoubleTime() - start;
+			continue;
+		}
+
+		ps.count = 0;
+		for( i = 0; i < count; i++ )
+			CL_AddBatchParticle( &ps, &list[i] );
+
+		start = Sys_DoubleTime();
+		for( i = 0; i < frames; i++ )
+		{
+			CL_UpdateBatchParticles( &ps, frametime, i * frametime, pass == 2 );
+			processed[pass] += ps.count;
+		}
+		time[pass] = Sys_DoubleTime() - start;
+	}
+
+	Con_Printf( "cl_particlebench: %i particles, %i frames\n", count, frames );
+	Con_Printf( "  linked list    %6.2f ns/particle\n", time[0] * 1e9 / Q_max( processed[0], 1 ));
+	Con_Printf( "  arrays scalar  %6.2f ns/particle\n", time[1] * 1e9 / Q_max( processed[1], 1 ));
+	Con_Printf( "  arrays simd    %6.2f ns/particle\n", time[2] * 1e9 / Q_max( processed[2], 1 ));
+
+	CL_FreePartStore( &ps );
+	Mem_Free( order );
+	Mem_Free( list );
+	clgame.movevars.gravity = oldgravity;
+}
 /*
 ==============================================================
 
@@ -415,6 +1018,204 @@ cl_entity_t *R_BeamGetEntity( int index )
 	return CL_GetEntityByIndex( BEAMENT_ENTITY( index ));
 }
 
+/*
+==============================================================
+
+BEAM SEGMENTS
+
+==============================================================
+*/
+static struct
+{
+	qboolean	built[NOISE_DIVISIONS+1];
+	byte	sample[NOISE_DIVISIONS+1][NOISE_DIVISIONS];	// noise entry of each segment
+	float	sine[NOISE_DIVISIONS+1][NOISE_DIVISIONS];	// sine noise, already resampled
+} cl_beamnoise;
+
+/*
+==============
+CL_BuildBeamNoise
+
+noise is generated in powers of 2 and resampled
+to the segment count, so both only depend on it
+==============
+*/
+static void CL_BuildBeamNoise( int segments )
+{
+	float	sine[NOISE_DIVISIONS];
+	float	div, freq = 0.0f, step = M_PI_F / (float)NOISE_DIVISIONS;
+	int	i, noiseIndex = 0, noiseStep;
+
+	for( i = 0; i < NOISE_DIVISIONS; i++ )
+	{
+		sine[i] = sin( freq );
+		freq += step;
+	}
+
+	div = 1.0f / ( segments - 1 );
+	noiseStep = (int)((float)( NOISE_DIVISIONS - 1 ) * div * 65536.0f );
+
+	for( i = 0; i < segments; i++ )
+	{
+		Assert( noiseIndex < ( NOISE_DIVISIONS << 16 ));
+
+		cl_beamnoise.sample[segments][i] = noiseIndex >> 16;
+		cl_beamnoise.sine[segments][i] = sine[noiseIndex >> 16];
+		noiseIndex += noiseStep;
+	}
+
+	cl_beamnoise.built[segments] = true;
+}
+
+static float CL_BeamSegmentBrightness( int flags, float fraction )
+{
+	if( FBitSet( flags, FBEAM_SHADEIN ) && FBitSet( flags, FBEAM_SHADEOUT ))
+		return ( fraction < 0.5f ) ? fraction : ( 1.0f - fraction );
+	if( FBitSet( flags, FBEAM_SHADEIN ))
+		return fraction;
+	if( FBitSet( flags, FBEAM_SHADEOUT ))
+		return 1.0f - fraction;
+	return 1.0f;
+}
+
+/*
+==============
+CL_BeamSegments
+
+triangle strip of a segmented beam, noise is the fractal
+table of the renderer, sine noise comes from the cache
+every stage runs over all segments before the next one
+==============
+*/
+int CL_BeamSegments( const vec3_t source, const vec3_t delta, float width, float scale, float freq, float speed, int segments, int flags, const float *noise, const beamview_t *view, beamvert_t *verts )
+{
+	vec3_t		pos[NOISE_DIVISIONS];
+	vec3_t		normal[NOISE_DIVISIONS];
+	float		texcoord[NOISE_DIVISIONS];
+	float		div, length, fraction, factor;
+	float		flMaxWidth, vLast, vStep, s, c;
+	vec3_t		perp1, center, tangent, dir, ave;
+	const byte	*sample;
+	const float	*sine;
+	beamvert_t	*v;
+	int		i;
+
+	if( segments < 2 ) return 0;
+
+	length = VectorLength( delta );
+	flMaxWidth = width * 0.5f;
+	div = 1.0f / ( segments - 1 );
+
+	if( length * div < flMaxWidth * 1.414f )
+	{
+		// here, we have too many segments; we could get overlap... so lets have less segments
+		segments = (int)( length / ( flMaxWidth * 1.414f )) + 1.0f;
+		if( segments < 2 ) segments = 2;
+	}
+
+	if( segments > NOISE_DIVISIONS )
+		segments = NOISE_DIVISIONS;
+
+	div = 1.0f / ( segments - 1 );
+	length *= 0.01f;
+	vStep = length * div;	// Texture length texels per space pixel
+
+	// Scroll speed 3.5 -- initial texture position, scrolls 3.5/sec (1.0 is entire texture)
+	vLast = fmod( freq * speed, 1 );
+
+	if( FBitSet( flags, FBEAM_SINENOISE ))
+	{
+		if( segments < 16 )
+		{
+			segments = 16;
+			div = 1.0f / ( segments - 1 );
+		}
+		scale *= 100.0f;
+		length = segments * 0.1f;
+	}
+	else
+	{
+		scale *= length * 2.0f;
+	}
+
+	if( !cl_beamnoise.built[segments] )
+		CL_BuildBeamNoise( segments );
+
+	sample = cl_beamnoise.sample[segments];
+	sine = cl_beamnoise.sine[segments];
+
+	// choose a vector that is perpendicular to the beam
+	VectorNormalize2( delta, center );
+	CrossProduct( view->forward, center, perp1 );
+	VectorNormalize( perp1 );
+
+	for( i = 0; i < segments; i++ )
+	{
+		VectorMA( source, i * div, delta, pos[i] );
+		texcoord[i] = vLast;
+		vLast += vStep; // advance texture scroll (v axis only)
+	}
+
+	// distort using noise
+	if( scale != 0 && FBitSet( flags, FBEAM_SINENOISE ))
+	{
+		for( i = 0; i < segments; i++ )
+		{
+			fraction = i * div;
+			factor = sine[i] * scale;
+			SinCos( fraction * M_PI_F * length + freq, &s, &c );
+			VectorMA( pos[i], ( factor * s ), view->up, pos[i] );
+
+			// rotate the noise along the perpendicluar axis a bit to keep the bolt from looking diagonal
+			VectorMA( pos[i], ( factor * c ), view->right, pos[i] );
+		}
+	}
+	else if( scale != 0 )
+	{
+		for( i = 0; i < segments; i++ )
+		{
+			factor = noise[sample[i]] * scale;
+			VectorMA( pos[i], factor, perp1, pos[i] );
+		}
+	}
+
+	// perpendicular to the segment and to the view, used to fatten the beam
+	for( i = 0; i < segments - 1; i++ )
+	{
+		VectorSubtract( pos[i], pos[i + 1], tangent );
+		VectorSubtract( pos[i], view->origin, dir );
+		CrossProduct( tangent, dir, normal[i] );
+		VectorNormalizeFast( normal[i] );
+	}
+
+	for( i = 0, v = verts; i < segments; i++, v += 2 )
+	{
+		if( i == segments - 1 )
+		{
+			VectorCopy( normal[i - 1], ave );
+		}
+		else if( i > 0 )
+		{
+			// average this with the previous normal
+			VectorAdd( normal[i], normal[i - 1], ave );
+			VectorScale( ave, 0.5f, ave );
+			VectorNormalizeFast( ave );
+		}
+		else VectorCopy( normal[i], ave );
+
+		VectorMA( pos[i], width, ave, v[0].pos );
+		VectorMA( pos[i], -width, ave, v[1].pos );
+		VectorCopy( ave, v[0].normal );
+		VectorCopy( ave, v[1].normal );
+		v[0].s = 0.0f;
+		v[1].s = 1.0f;
+		v[0].t = v[1].t = texcoord[i];
+		v[0].brightness = v[1].brightness = CL_BeamSegmentBrightness( flags, i * div );
+	}
+
+	return segments * 2;
+}
+
 /*
 ==============
 CL_KillDeadBeams
@@ -1064,7 +1865,7 @@ void GAME_EXPORT R_EntityParticles( cl_entity_t *ent )
 
 	for( i = 0; i < NUMVERTEXNORMALS; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		angle = cl.time * cl_avelocities[i][0];
@@ -1096,7 +1897,7 @@ void GAME_EXPORT R_ParticleExplosion( const vec3_t org )
 
 	for( i = 0; i < 1024; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + 5.0f;
@@ -1128,7 +1929,7 @@ void GAME_EXPORT R_ParticleExplosion2( const vec3_t org, int colorStart, int col
 
 	for( i = 0; i < 512; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + 0.3f;
@@ -1159,7 +1960,7 @@ void GAME_EXPORT R_BlobExplosion( const vec3_t org )
 
 	for( i = 0; i < 1024; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + COM_RandomFloat( 2.0f, 2.4f );
@@ -1205,7 +2006,7 @@ void GAME_EXPORT R_RunParticleEffect( const vec3_t org, const vec3_t dir, int co
 
 	for( i = 0; i < count; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->color = (color & ~7) + COM_RandomLong( 0, 7 );
@@ -1240,7 +2041,7 @@ void GAME_EXPORT R_Blood( const vec3_t org, const vec3_t ndir, int pcolor, int s
 
 		for( j = 0; j < 7; j++ )
 		{
-			p = R_AllocParticle( NULL );
+			p = CL_AllocBatchParticle();
 			if( !p ) return;
 
 			p->die = cl.time + 1.5f;
@@ -1269,7 +2070,7 @@ void GAME_EXPORT R_BloodStream( const vec3_t org, const vec3_t dir, int pcolor,
 
 	for( arc = 0.05f, i = 0; i < 100; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + 2.0f;
@@ -1289,7 +2090,7 @@ void GAME_EXPORT R_BloodStream( const vec3_t org, const vec3_t dir, int pcolor,
 	{
 		float	num;
 
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + 3.0f;
@@ -1311,7 +2112,7 @@ void GAME_EXPORT R_BloodStream( const vec3_t org, const vec3_t dir, int pcolor,
 
 		for( j = 0; j < 2; j++ )
 		{
-			p = R_AllocParticle( NULL );
+			p = CL_AllocBatchParticle();
 			if( !p ) return;
 
 			p->die = cl.time + 3.0f;
@@ -1350,7 +2151,7 @@ void GAME_EXPORT R_LavaSplash( const vec3_t org )
 		{
 			for( k = 0; k < 1; k++ )
 			{
-				p = R_AllocParticle( NULL );
+				p = CL_AllocBatchParticle();
 				if( !p ) return;
 
 				p->die = cl.time + COM_RandomFloat( 2.0f, 2.62f );
@@ -1390,7 +2191,7 @@ void GAME_EXPORT R_ParticleBurst( const vec3_t org, int size, int color, float l
 	{
 		for( j = 0; j < 32; j++ )
 		{
-			p = R_AllocParticle( NULL );
+			p = CL_AllocBatchParticle();
 			if( !p ) return;
 
 			p->die = cl.time + life + COM_RandomFloat( -0.5f, 0.5f );
@@ -1423,7 +2224,7 @@ void GAME_EXPORT R_LargeFunnel( const vec3_t org, int reverse )
 	{
 		for( j = -8; j < 8; j++ )
 		{
-			p = R_AllocParticle( NULL );
+			p = CL_AllocBatchParticle();
 			if( !p ) return;
 
 			dest[0] = (i * 32.0f) + org[0];
@@ -1472,7 +2273,7 @@ void GAME_EXPORT R_TeleportSplash( const vec3_t org )
 		{
 			for( k = -24; k < 32; k += 4 )
 			{
-				p = R_AllocParticle( NULL );
+				p = CL_AllocBatchParticle();
 				if( !p ) return;
 
 				p->die = cl.time + COM_RandomFloat( 0.2f, 0.34f );
@@ -1533,7 +2334,7 @@ void GAME_EXPORT R_RocketTrail( vec3_t start, vec3_t end, int type )
 	{
 		len -= dec;
 
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + 2.0f;
@@ -1670,7 +2471,7 @@ void GAME_EXPORT R_ShowLine( const vec3_t start, const vec3_t end )
 	{
 		len -= 5.0f;
 
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die = cl.time + 30;
@@ -1707,7 +2508,7 @@ void GAME_EXPORT R_BulletImpactParticles( const vec3_t pos )
 
 	for( i = 0; i < quantity * 4; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		VectorCopy( pos, p->org);
@@ -1736,7 +2537,7 @@ void GAME_EXPORT R_FlickerParticles( const vec3_t org )
 
 	for( i = 0; i < 15; i++ )
 	{
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		VectorCopy( org, p->org );
@@ -1788,7 +2589,7 @@ void R_DebugParticle( const vec3_t pos, byte r, byte g, byte b )
 {
 	particle_t	*p;
 
-	p = R_AllocParticle( NULL );
+	p = CL_AllocBatchParticle();
 	if( !p ) return;
 
 	VectorCopy( pos, p->org );
@@ -1807,7 +2608,7 @@ void CL_Particle( const vec3_t org, int color, float life, int zpos, int zvel )
 {
 	particle_t	*p;
 
-	p = R_AllocParticle( NULL );
+	p = CL_AllocBatchParticle();
 	if( !p ) return;
 
 	if( org ) VectorCopy( org, p->org );
@@ -2097,8 +2898,10 @@ void CL_DrawEFX( float time, qboolean fTrans )
 	if( fTrans )
 	{
 		R_FreeDeadParticles( &cl_active_particles );
+		CL_FlushBatchParticles();
+		CL_UpdateBatchParticles( &cl_parts, time, cl.time, true );
 		if( CVAR_TO_BOOL( cl_draw_particles ))
-			ref.dllFuncs.CL_DrawParticles( time, cl_active_particles, PART_SIZE );
+			ref.dllFuncs.CL_DrawParticles( time, CL_LinkBatchParticles( ), PART_SIZE );
 		R_FreeDeadParticles( &cl_active_tracers );
 		if( CVAR_TO_BOOL( cl_draw_tracers ))
 			ref.dllFuncs.CL_DrawTracers( time, cl_active_tracers );
@@ -2113,6 +2916,9 @@ void CL_ThinkParticle( double frametime, particle_t *p )
 	float		dvel = 4.0f * frametime;
 	float		grav = frametime * clgame.movevars.gravity * 0.05f;
 
+	// batched particles were moved already
+	if( cl_partview && p >= cl_partview && p < cl_partview + cl_parts.max )
+		return;
 
 	if( p->type != pt_clientcustom )
 	{
@@ -2190,3 +2996,128 @@ void CL_ThinkParticle( double frametime, particle_t *p )
 	}
 }
 
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define PART_TEST_COUNT	1003	// not a multiple of vector width
+#define PART_TEST_FRAMES	25	// ramps are half way through
+
+static void Test_SpawnParticles( particle_t *list )
+{
+	int	i, j;
+
+	COM_SetRandomSeed( 1 );
+
+	for( i = 0; i < PART_TEST_COUNT; i++ )
+	{
+		list[i].type = i % pt_clientcustom;
+		list[i].packedColor = ( i & 4 ) ? 255 : 0;
+		list[i].ramp = COM_RandomLong( 0, 3 );
+		list[i].color = 0;
+		list[i].die = ( i % 7 ) ? 10.0f : 0.5f; // some expire on the way
+		for( j = 0; j < 3; j++ )
+		{
+			list[i].org[j] = COM_RandomFloat( -16.0f, 16.0f );
+			list[i].vel[j] = COM_RandomFloat( -256.0f, 256.0f );
+		}
+	}
+}
+
+void Test_RunParticles( void )
+{
+	static particle_t	list[PART_TEST_COUNT];
+	float	oldgravity = clgame.movevars.gravity;
+	const float	frametime = 0.02f;
+	partstore_t	ps[2];
+	double	sum[3] = { 0 };
+	int	i, j, k, alive = 0;
+
+	clgame.movevars.gravity = 800.0f;
+	Test_SpawnParticles( list );
+
+	// scalar and vector paths
+	for( k = 0; k < 2; k++ )
+	{
+		CL_AllocPartStore( &ps[k], PART_TEST_COUNT, host.mempool );
+		for( i = 0; i < PART_TEST_COUNT; i++ )
+			CL_AddBatchParticle( &ps[k], &list[i] );
+
+		for( i = 1; i <= PART_TEST_FRAMES; i++ )
+			CL_UpdateBatchParticles( &ps[k], frametime, i * frametime, k );
+
+		for( i = 0; i < ps[k].count; i++ )
+			sum[k] += ps[k].org[0][i] + ps[k].org[1][i] + ps[k].org[2][i] + ps[k].color[i];
+	}
+
+	// reference is the particle_t think, ramps set die to -1 there
+	for( i = 1; i <= PART_TEST_FRAMES; i++ )
+	{
+		for( j = 0; j < PART_TEST_COUNT; j++ )
+		{
+			if( list[j].die >= i * frametime )
+				CL_ThinkParticle( frametime, &list[j] );
+		}
+	}
+
+	for( j = 0; j < PART_TEST_COUNT; j++ )
+	{
+		if( list[j].die < 0.0f || list[j].die < PART_TEST_FRAMES * frametime )
+			continue;
+		sum[2] += list[j].org[0] + list[j].org[1] + list[j].org[2] + list[j].color;
+		alive++;
+	}
+
+	TASSERT( ps[0].count == alive && ps[1].count == alive );
+	TASSERT( fabs( sum[0] - sum[2] ) < 1.0 && fabs( sum[1] - sum[2] ) < 1.0 );
+
+	CL_FreePartStore( &ps[0] );
+	CL_FreePartStore( &ps[1] );
+	clgame.movevars.gravity = oldgravity;
+}
+
+#define BEAM_TEST_BEAMS	2000
+
+void Test_RunBeamSegments( void )
+{
+	beamvert_t	verts[MAX_BEAM_VERTS];
+	float		noise[NOISE_DIVISIONS+1];
+	beamview_t	view;
+	vec3_t		source = { 0, 0, 0 }, delta = { 1000, 0, 0 }, mid;
+	const int		counts[] = { 8, 16, 32, 64 };
+	int		i, j, numverts, bad = 0;
+	double		start, time;
+
+	memset( &view, 0, sizeof( view ));
+	VectorSet( view.origin, 500, 0, 100 );
+	VectorSet( view.forward, 0, 0, -1 );
+	VectorSet( view.right, 0, 1, 0 );
+	VectorSet( view.up, 1, 0, 0 );
+
+	for( i = 0; i <= NOISE_DIVISIONS; i++ )
+		noise[i] = COM_RandomFloat( -1.0f, 1.0f );
+
+	// without noise the strip is centered on the beam and as wide as asked
+	numverts = CL_BeamSegments( source, delta, 4.0f, 0.0f, 0.0f, 0.0f, 10, FBEAM_SHADEIN, noise, &view, verts );
+
+	for( i = 0; i < numverts; i += 2 )
+	{
+		VectorAverage( verts[i].pos, verts[i + 1].pos, mid );
+		if( fabs( mid[1] ) > 0.001f || fabs( mid[2] ) > 0.001f || fabs( mid[0] - delta[0] * i / ( numverts - 2 )) > 0.01f )
+			bad++;
+		if( fabs( VectorDistance( verts[i].pos, verts[i + 1].pos ) - 8.0f ) > 0.05f )
+			bad++;
+	}
+
+	TASSERT( numverts == 20 && bad == 0 && verts[0].brightness == 0.0f && fabs( verts[18].brightness - 1.0f ) < 0.001f );
+
+	for( i = 0; i < ARRAYSIZE( counts ); i++ )
+	{
+		start = Sys_DoubleTime();
+		for( j = 0; j < BEAM_TEST_BEAMS; j++ )
+			CL_BeamSegments( source, delta, 4.0f, 0.1f, j * 0.01f, 1.0f, counts[i], 0, noise, &view, verts );
+		time = Sys_DoubleTime() - start;
+
+		Con_Reportf( "%s: %i segments, %.0f beams/ms\n", __func__, counts[i], BEAM_TEST_BEAMS / Q_max( time * 1000.0, 0.000001 ));
+	}
+}
+#endif /* XASH_ENGINE_TESTS */
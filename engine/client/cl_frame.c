@@ -45,6 +45,29 @@ FRAME INTERPOLATION
 
 =========================================================================
 */
+/*
+==================
+CL_PositionsOrdered
+
+how many newest history entries have non-zero
+animtime decreasing with age, NULL if not tracked
+==================
+*/
+static byte *CL_PositionsOrdered( cl_entity_t *ent )
+{
+	int	index;
+
+	if( !clgame.ph_ordered || !clgame.entities )
+		return NULL;
+
+	index = ent - clgame.entities;
+
+	if( index < 0 || index >= clgame.maxEntities )
+		return NULL;
+
+	return &clgame.ph_ordered[index];
+}
+
 /*
 ==================
 CL_UpdatePositions
@@ -55,6 +78,8 @@ Store another position into interpolation circular buffer
 void CL_UpdatePositions( cl_entity_t *ent )
 {
 	position_history_t	*ph;
+	byte		*ordered = CL_PositionsOrdered( ent );
+	float		prevtime = ent->ph[ent->current_position].animtime;
 
 	ent->current_position = (ent->current_position + 1) & HISTORY_MASK;
 	ph = &ent->ph[ent->current_position];
@@ -62,6 +87,15 @@ void CL_UpdatePositions( cl_entity_t *ent )
 	VectorCopy( ent->curstate.origin, ph->origin );
 	VectorCopy( ent->curstate.angles, ph->angles );
 	ph->animtime = ent->curstate.animtime;	// !!!
+
+	if( !ordered )
+		return;
+
+	if( ph->animtime == 0.0f )
+		*ordered = 0;
+	else if( *ordered > 0 && ph->animtime > prevtime )
+		*ordered = Q_min( *ordered + 1, HISTORY_MAX );
+	else *ordered = 1;
 }
 
 /*
@@ -74,6 +108,7 @@ Interpolation init or reset after teleporting
 void CL_ResetPositions( cl_entity_t *ent )
 {
 	position_history_t	store;
+	byte		*ordered;
 
 	if( !ent ) return;
 
@@ -83,6 +118,10 @@ void CL_ResetPositions( cl_entity_t *ent )
 	memset( ent->ph, 0, sizeof( position_history_t ) * HISTORY_MAX );
 	memcpy( &ent->ph[1], &store, sizeof( position_history_t ));
 	memcpy( &ent->ph[0], &store, sizeof( position_history_t ));
+
+	// both entries have the same time
+	if(( ordered = CL_PositionsOrdered( ent )) != NULL )
+		*ordered = ( store.animtime != 0.0f ) ? 1 : 0;
 }
 
 /*
@@ -344,30 +383,83 @@ void CL_ProcessEntityUpdate( cl_entity_t *ent )
 CL_FindInterpolationUpdates
 
 find two timestamps
+the ordered part of the history is searched by
+galloping back from the newest entry and bisecting
+the last step, the rest is walked back as before
 ==================
 */
 qboolean CL_FindInterpolationUpdates( cl_entity_t *ent, float targettime, position_history_t **ph0, position_history_t **ph1 )
 {
 	qboolean	extrapolate = true;
 	int	i, i0, i1, imod;
+	int	lo, hi, mid, step, end;
+	byte	*ordered;
 	float	at;
 
 	imod = ent->current_position;
 	i0 = (imod - 0) & HISTORY_MASK;	// curpos (lerp end)
 	i1 = (imod - 1) & HISTORY_MASK;	// oldpos (lerp start)
 
-	for( i = 1; i < HISTORY_MAX - 1; i++ )
+	// nearly always the target is right past the newest update
+	at = ent->ph[i1].animtime;
+	if( at == 0.0f || targettime > at )
 	{
-		at = ent->ph[( imod - i ) & HISTORY_MASK].animtime;
-		if( at == 0.0f ) break;
+		if( ph0 != NULL ) *ph0 = &ent->ph[i0];
+		if( ph1 != NULL ) *ph1 = &ent->ph[i1];
+		return ( at == 0.0f );
+	}
 
-		if( targettime > at )
+	// first entry older than targettime, the walk below
+	// only goes on past the ordered entries if there was none
+	lo = 2;
+	end = 0;
+	if(( ordered = CL_PositionsOrdered( ent )) != NULL )
+	{
+		end = hi = Q_min( *ordered, HISTORY_MAX - 1 );
+
+		// gallop back over 2, 3, 5, 9... so the next newest
+		// entries still cost as little as the plain walk
+		for( mid = 2, step = 1; mid < hi; mid += step, step <<= 1 )
 		{
-			// found it
-			i0 = (( imod - i ) + 1 ) & HISTORY_MASK;
-			i1 = (( imod - i ) + 0 ) & HISTORY_MASK;
-			extrapolate = false;
-			break;
+			if( targettime > ent->ph[( imod - mid ) & HISTORY_MASK].animtime )
+			{
+				hi = mid;
+				break;
+			}
+			lo = mid + 1;
+		}
+
+		while( lo < hi )
+		{
+			mid = ( lo + hi ) >> 1;
+			if( targettime > ent->ph[( imod - mid ) & HISTORY_MASK].animtime )
+				hi = mid;
+			else lo = mid + 1;
+		}
+	}
+
+	if( lo < end )
+	{
+		// already probed, it's older
+		i0 = (( imod - lo ) + 1 ) & HISTORY_MASK;
+		i1 = (( imod - lo ) + 0 ) & HISTORY_MASK;
+		extrapolate = false;
+	}
+	else
+	{
+		for( i = lo; i < HISTORY_MAX - 1; i++ )
+		{
+			at = ent->ph[( imod - i ) & HISTORY_MASK].animtime;
+			if( at == 0.0f ) break;
+
+			if( targettime > at )
+			{
+				// found it
+				i0 = (( imod - i ) + 1 ) & HISTORY_MASK;
+				i1 = (( imod - i ) + 0 ) & HISTORY_MASK;
+				extrapolate = false;
+				break;
+			}
 		}
 	}
 
@@ -712,7 +804,10 @@ void CL_DeltaEntity( sizebuf_t *msg, frame_t *frame, int newnum, entity_state_t
 	if( newent ) old = &ent->baseline;
 
 	if( has_update )
+	{
 		alive = MSG_ReadDeltaEntity( msg, old, state, newnum, delta_type, cl.mtime[0] );
+		if( cls.demobench ) CL_DemoBenchEntity();
+	}
 	else memcpy( state, old, sizeof( entity_state_t ));
 
 	if( !alive )
@@ -815,6 +910,7 @@ int CL_ParsePacketEntities( sizebuf_t *msg, qboolean delta )
 		oldpacket = -1;		// delta too old or is initial message
 		cl.send_reply = true;	// send reply
 		cls.demowaiting = false;	// we can start recording now
+		CL_DemoFullUpdate();
 	}
 
 	// mark current delta state
@@ -1426,3 +1522,141 @@ void CL_ExtraUpdate( void )
 	clgame.dllFuncs.IN_Accumulate();
 	S_ExtraUpdate();
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+// the history walk before bisection, kept as a reference
+static qboolean Test_FindUpdatesLinear( cl_entity_t *ent, float targettime, position_history_t **ph0, position_history_t **ph1 )
+{
+	int	i, imod = ent->current_position;
+	float	at;
+
+	*ph0 = &ent->ph[imod & HISTORY_MASK];
+	*ph1 = &ent->ph[( imod - 1 ) & HISTORY_MASK];
+
+	for( i = 1; i < HISTORY_MAX - 1; i++ )
+	{
+		at = ent->ph[( imod - i ) & HISTORY_MASK].animtime;
+		if( at == 0.0f ) break;
+
+		if( targettime > at )
+		{
+			*ph0 = &ent->ph[( imod - i + 1 ) & HISTORY_MASK];
+			*ph1 = &ent->ph[( imod - i ) & HISTORY_MASK];
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#define INTERP_TEST_LOOKUPS	( 1 << 20 )
+#define INTERP_TEST_DEPTH	40
+
+void Test_RunInterpHistory( void )
+{
+	cl_entity_t	*saved_entities = clgame.entities;
+	byte		*saved_ordered = clgame.ph_ordered;
+	int		saved_max = clgame.maxEntities;
+	cl_entity_t	*ents = Mem_Calloc( host.mempool, sizeof( *ents ) * 4 );
+	byte		ordered[4] = { 0 };
+	position_history_t	*a0, *a1, *b0, *b1;
+	float		last[4] = { 0 }, target;
+	int		i, j, r, bad = 0, bisected = 0;
+	uint		seed = 0x2545F491;
+	double		start, times[2][2];
+	// called through pointers so neither one gets inlined here
+	qboolean		(* volatile find[2])( cl_entity_t *, float, position_history_t **, position_history_t ** ) =
+	{
+		CL_FindInterpolationUpdates,
+		Test_FindUpdatesLinear,
+	};
+	cl_entity_t	*e;
+
+	clgame.entities = ents;
+	clgame.ph_ordered = ordered;
+	clgame.maxEntities = 4;
+
+	// mostly growing timestamps with resets, repeats,
+	// jumps back and zero times mixed in
+	for( i = 0; i < 20000; i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		j = ( seed >> 16 ) & 3;
+		r = ( seed >> 8 ) & 255;
+		e = &ents[j];
+
+		if( r < 4 )
+		{
+			CL_ResetPositions( e );
+			continue;
+		}
+
+		// 16..23 keeps the same time
+		if( r < 12 ) last[j] -= ( r & 3 ) * 0.1f;
+		else if( r < 16 ) last[j] = 0.0f;
+		else if( r >= 24 ) last[j] += 0.05f + ( r & 7 ) * 0.01f;
+
+		e->curstate.animtime = last[j];
+		VectorSet( e->curstate.origin, i, j, r );
+		CL_UpdatePositions( e );
+
+		if( ordered[j] > 2 )
+			bisected++;
+
+		for( r = 0; r < 4; r++ )
+		{
+			seed = seed * 1103515245 + 12345;
+			target = last[j] + 0.1f - ( seed >> 8 & 1023 ) * 0.002f;
+
+			if( CL_FindInterpolationUpdates( e, target, &a0, &a1 ) != Test_FindUpdatesLinear( e, target, &b0, &b1 ) || a0 != b0 || a1 != b1 )
+				bad++;
+		}
+	}
+
+	// full ordered history, targets among the newest entries
+	// as in normal play and far back as with a big lag
+	e = &ents[0];
+	CL_ResetPositions( e );
+	for( i = 1; i <= HISTORY_MAX; i++ )
+	{
+		e->curstate.animtime = i * 0.05f;
+		CL_UpdatePositions( e );
+	}
+
+	// best of a few alternating rounds, the first one
+	// timed otherwise pays for the warm up
+	for( j = 0; j < 2; j++ )
+	{
+		times[j][0] = times[j][1] = 1e9;
+
+		for( r = 0; r < 6; r++ )
+		{
+			start = Sys_DoubleTime();
+			for( i = 0; i < INTERP_TEST_LOOKUPS; i++ )
+			{
+				int depth = j ? INTERP_TEST_DEPTH : 1 + i % 3;
+
+				target = ( HISTORY_MAX - depth ) * 0.05f + 0.025f;
+				find[r & 1]( e, target, &a0, &a1 );
+
+				if( a1 != &e->ph[( e->current_position - depth ) & HISTORY_MASK] )
+					bad++;
+			}
+			times[j][r & 1] = Q_min( times[j][r & 1], ( Sys_DoubleTime() - start ) * 1e9 / INTERP_TEST_LOOKUPS );
+		}
+	}
+
+	Con_Printf( "Test_RunInterpHistory: newest entries %.1f ns, %.1f ns walking; %i back %.1f ns, %.1f ns walking\n",
+		times[0][0], times[0][1], INTERP_TEST_DEPTH, times[1][0], times[1][1] );
+
+	clgame.entities = saved_entities;
+	clgame.ph_ordered = saved_ordered;
+	clgame.maxEntities = saved_max;
+	Mem_Free( ents );
+
+	TASSERT( bisected > 10000 );
+	TASSERT( bad == 0 );
+}
+#endif /* XASH_ENGINE_TESTS */
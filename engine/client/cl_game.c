@@ -1098,6 +1098,7 @@ void CL_InitEdicts( void )
 	cls.num_client_entities = CL_UPDATE_BACKUP * NUM_PACKET_ENTITIES;
 	cls.packet_entities = Mem_Realloc( clgame.mempool, cls.packet_entities, sizeof( entity_state_t ) * cls.num_client_entities );
 	clgame.entities = Mem_Calloc( clgame.mempool, sizeof( cl_entity_t ) * clgame.maxEntities );
+	clgame.ph_ordered = Mem_Calloc( clgame.mempool, sizeof( byte ) * clgame.maxEntities );
 	clgame.static_entities = Mem_Calloc( clgame.mempool, sizeof( cl_entity_t ) * MAX_STATIC_ENTITIES );
 	clgame.numStatics = 0;
 
@@ -1119,6 +1120,10 @@ void CL_FreeEdicts( void )
 		Mem_Free( clgame.entities );
 	clgame.entities = NULL;
 
+	if( clgame.ph_ordered )
+		Mem_Free( clgame.ph_ordered );
+	clgame.ph_ordered = NULL;
+
 	if( clgame.static_entities )
 		Mem_Free( clgame.static_entities );
 	clgame.static_entities = NULL;
@@ -2218,6 +2223,9 @@ static pmtrace_t *pfnTraceLine( float *start, float *end, int flags, int usehull
 	static pmtrace_t	tr;
 	int		old_usehull;
 
+	if( cl_tentstats.inupdate )
+		cl_tentstats.frame.traces++;
+
 	old_usehull = clgame.pmove->usehull;
 	clgame.pmove->usehull = usehull;
 
@@ -2492,6 +2500,10 @@ pfnPlayerTrace
 void GAME_EXPORT CL_PlayerTrace( float *start, float *end, int traceFlags, int ignore_pe, pmtrace_t *tr )
 {
 	if( !tr ) return;
+
+	if( cl_tentstats.inupdate )
+		cl_tentstats.frame.traces++;
+
 	*tr = PM_PlayerTraceExt( clgame.pmove, start, end, traceFlags, clgame.pmove->numphysent, clgame.pmove->physents, ignore_pe, NULL );
 }
 
@@ -2504,6 +2516,10 @@ pfnPlayerTraceExt
 void GAME_EXPORT CL_PlayerTraceExt( float *start, float *end, int traceFlags, int (*pfnIgnore)( physent_t *pe ), pmtrace_t *tr )
 {
 	if( !tr ) return;
+
+	if( cl_tentstats.inupdate )
+		cl_tentstats.frame.traces++;
+
 	*tr = PM_PlayerTraceExt( clgame.pmove, start, end, traceFlags, clgame.pmove->numphysent, clgame.pmove->physents, -1, pfnIgnore );
 }
 
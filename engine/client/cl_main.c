@@ -841,7 +841,7 @@ void CL_WritePacket( void )
 		i = cls.netchan.outgoing_sequence & CL_UPDATE_MASK;
 
 		// determine if we need to ask for a new set of delta's.
-		if( cl.validsequence && (cls.state == ca_active) && !( cls.demorecording && cls.demowaiting ))
+		if( cl.validsequence && (cls.state == ca_active) && !( cls.demorecording && cls.demowaiting ) && !CL_DemoWantsFullUpdate( ))
 		{
 			cl.delta_sequence = cl.validsequence;
 
@@ -2816,6 +2816,10 @@ void CL_InitLocal( void )
 	Cvar_RegisterVariable( &cl_logofile );
 	Cvar_RegisterVariable( &cl_logocolor );
 	Cvar_RegisterVariable( &cl_test_bandwidth );
+	Cvar_RegisterVariable( &demo_keyframe );
+	Cvar_RegisterVariable( &timedemo_export );
+	Cvar_RegisterVariable( &cl_predcache );
+	Cvar_RegisterVariable( &cl_physindex );
 
 	// register our variables
 	cl_crosshair = Cvar_Get( "crosshair", "1", FCVAR_ARCHIVE, "show weapon chrosshair" );
@@ -2898,6 +2902,9 @@ void CL_InitLocal( void )
 	Cmd_AddCommand ("record", CL_Record_f, "record a demo" );
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f, "play a demo" );
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f, "demo benchmark" );
+	Cmd_AddCommand ("demo_seek", CL_DemoSeek_f, "jump to a time in the playing demo" );
+	Cmd_AddCommand ("demo_bench", CL_DemoBench_f, "replay a demo as fast as possible without rendering and sound" );
+	Cmd_AddCommand ("pred_stats", CL_PredictionStats_f, "show prediction cache hit rate and server agreement, 'reset' to clear" );
 	Cmd_AddCommand ("killdemo", CL_DeleteDemo_f, "delete a specified demo file" );
 	Cmd_AddCommand ("startdemos", CL_StartDemos_f, "start playing back the selected demos sequentially" );
 	Cmd_AddCommand ("demos", CL_Demos_f, "restart looping demos defined by the last startdemos command" );
@@ -2908,6 +2915,7 @@ void CL_InitLocal( void )
 	Cmd_AddCommand ("togglemenu", CL_Escape_f, "toggle between game and menu" );
 	Cmd_AddCommand ("pointfile", CL_ReadPointFile_f, "show leaks on a map (if present of course)" );
 	Cmd_AddCommand ("linefile", CL_ReadLineFile_f, "show leaks on a map (if present of course)" );
+	Cmd_AddCommand ("cl_particlebench", CL_ParticleBench_f, "measure particle update speed, linked list against arrays" );
 	Cmd_AddCommand ("fullserverinfo", CL_FullServerinfo_f, "sent by server when serverinfo changes" );
 	Cmd_AddCommand ("upload", CL_BeginUpload_f, "uploading file to the server" );
 
@@ -3002,6 +3010,8 @@ void Host_ClientFrame( void )
 	// if client is not active, do nothing
 	if( !cls.initialized ) return;
 
+	CL_TimeDemoFrame ();
+
 	// if running the server remotely, send intentions now after
 	// the incoming messages have been read
 	if( !SV_Active( )) CL_SendCommand ();
@@ -3010,9 +3020,11 @@ void Host_ClientFrame( void )
 
 	// remember last received framenum
 	CL_SetLastUpdate ();
+	CL_TimeDemoMark( TD_THINK );
 
 	// read updates from server
 	CL_ReadPackets ();
+	CL_TimeDemoMark( TD_NET );
 
 	// do prediction again in case we got
 	// a new portion updates from server
@@ -3041,12 +3053,19 @@ void Host_ClientFrame( void )
 
 	// process VGUI
 	VGui_RunFrame ();
+	CL_TimeDemoMark( TD_THINK );
 
-	// update the screen
-	SCR_UpdateScreen ();
+	// demo_bench only measures the client side
+	if( !cls.demobench )
+	{
+		// update the screen
+		SCR_UpdateScreen ();
+		CL_TimeDemoMark( TD_RENDER );
 
-	// update audio
-	SND_UpdateSound ();
+		// update audio
+		SND_UpdateSound ();
+		CL_TimeDemoMark( TD_SOUND );
+	}
 
 	// play avi-files
 	SCR_RunCinematic ();
@@ -3127,3 +3146,46 @@ void CL_Shutdown( void )
 
 	Con_Shutdown ();
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+static struct
+{
+	gameinfo_t	gameinfo;
+	gameinfo_t	*oldinfo;
+	ui_globalvars_t	uiglobals;
+	ui_globalvars_t	*olduiglobals;
+} test_client;
+
+/*
+==================
+Test_ClientSetup
+
+client tests run before gameinfo and menu are loaded,
+give them what a game without gameinfo.txt would have
+==================
+*/
+void Test_ClientSetup( void )
+{
+	test_client.oldinfo = SI.GameInfo;
+	FS_InitGameInfo( &test_client.gameinfo, SI.basedirName );
+	SI.GameInfo = &test_client.gameinfo;
+
+	test_client.olduiglobals = gameui.globals;
+	memset( &test_client.uiglobals, 0, sizeof( test_client.uiglobals ));
+	if( !gameui.globals )
+		gameui.globals = &test_client.uiglobals;
+}
+
+/*
+==================
+Test_ClientShutdown
+==================
+*/
+void Test_ClientShutdown( void )
+{
+	SI.GameInfo = test_client.oldinfo;
+	gameui.globals = test_client.olduiglobals;
+}
+#endif /* XASH_ENGINE_TESTS */
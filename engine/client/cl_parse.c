@@ -284,7 +284,7 @@ void CL_ParseParticles( sizebuf_t *msg )
 	{
 		particle_t	*p;
 
-		p = R_AllocParticle( NULL );
+		p = CL_AllocBatchParticle();
 		if( !p ) return;
 
 		p->die += life;
@@ -2153,6 +2153,7 @@ void CL_ParseServerMessage( sizebuf_t *msg, qboolean normal_message )
 
 		// record command for debugging spew on parse problem
 		CL_Parse_RecordCommand( cmd, bufStart );
+		if( cls.demobench ) CL_DemoBenchCommand( cmd );
 
 		// other commands
 		switch( cmd )
@@ -2388,6 +2389,7 @@ void CL_ParseServerMessage( sizebuf_t *msg, qboolean normal_message )
 	}
 
 	cl.frames[cl.parsecountmod].graphdata.msgbytes += MSG_GetNumBytesRead( msg ) - cls.starting_count;
+	if( cls.demobench ) CL_DemoBenchCommand( -1 );
 	CL_Parse_Debug( false ); // done
 
 	// we don't know if it is ok to save a demo message until
@@ -2916,6 +2918,7 @@ void CL_ParseLegacyServerMessage( sizebuf_t *msg, qboolean normal_message )
 
 		// record command for debugging spew on parse problem
 		CL_Parse_RecordCommand( cmd, bufStart );
+		if( cls.demobench ) CL_DemoBenchCommand( cmd );
 
 		// other commands
 		switch( cmd )
@@ -3175,6 +3178,7 @@ void CL_ParseLegacyServerMessage( sizebuf_t *msg, qboolean normal_message )
 	}
 
 	cl.frames[cl.parsecountmod].graphdata.msgbytes += MSG_GetNumBytesRead( msg ) - cls.starting_count;
+	if( cls.demobench ) CL_DemoBenchCommand( -1 );
 	CL_Parse_Debug( false ); // done
 
 	// we don't know if it is ok to save a demo message until
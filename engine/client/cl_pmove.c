@@ -25,6 +25,34 @@ GNU General Public License for more details.
 #define MIN_CORRECTION_DISTANCE	0.25f	// use smoothing if error is > this
 #define MIN_PREDICTION_EPSILON	0.5f	// complain if error is > this and we have cl_showerror set
 #define MAX_PREDICTION_ERROR		64.0f	// above this is assumed to be a teleport, don't smooth, etc.
+#define PREDICTION_AGREE_EPSILON	0.125f	// coarsest precision delta.lst sends player positions with
+
+// result of one predicted command, reused while nothing it depends on changes
+typedef struct
+{
+	uint		sequence;		// command number
+	dword		key;		// inputs: previous step, command, start time and world
+	double		end;		// time after the command
+	int		lastground;
+	local_state_t	state;
+} predstep_t;
+
+static struct
+{
+	predstep_t	steps[MULTIPLAYER_BACKUP];
+	uint		acknowledged;	// last chain start
+	uint		replayed;		// commands simulated
+	uint		lookups;		// commands that could be taken from the cache
+	uint		reused;
+	uint		acks;		// new acknowledged states
+	uint		agreed;		// ... that matched the prediction
+} predcache;
+
+static pmindex_t	cl_physgrid;
+static int	cl_physgridparse = -1;	// cl.parsecount the index was built for
+
+CVAR_DEFINE_AUTO( cl_predcache, "1", FCVAR_ARCHIVE, "reuse predicted movement of commands whose inputs didn't change" );
+CVAR_DEFINE_AUTO( cl_physindex, "1", FCVAR_ARCHIVE, "let client traces test only the physents near the move" );
 
 /*
 =============
@@ -38,6 +66,12 @@ void CL_ClearPhysEnts( void )
 	clgame.pmove->numvisent = 0;
 	clgame.pmove->nummoveent = 0;
 	clgame.pmove->numphysent = 0;
+
+	// new level, nothing predicted before is valid
+	memset( predcache.steps, 0, sizeof( predcache.steps ));
+
+	cl_physgrid.numents = 0;
+	cl_physgridparse = -1;
 }
 
 /*
@@ -528,6 +562,18 @@ void CL_SetSolidEntities( void )
 
 	// add all other entities exlucde players
 	CL_AddLinksToPmove( &cl.frames[cl.parsecountmod] );
+
+	// physents only change with a new packet
+	if( !cl_physindex.value )
+	{
+		cl_physgrid.numents = 0;
+		cl_physgridparse = -1;
+	}
+	else if( cl_physgridparse != cl.parsecount || cl_physgrid.numents != clgame.pmove->numphysent )
+	{
+		PM_BuildIndex( &cl_physgrid, clgame.pmove->physents, clgame.pmove->numphysent );
+		cl_physgridparse = cl.parsecount;
+	}
 }
 
 /*
@@ -900,6 +946,7 @@ void CL_InitClientMove( void )
 	int	i;
 
 	Pmove_Init ();
+	PM_SetIndex( &cl_physgrid );
 
 	clgame.pmove->server = false;	// running at client
 	clgame.pmove->movevars = &clgame.movevars;
@@ -1122,6 +1169,240 @@ void CL_RunUsercmd( local_state_t *from, local_state_t *to, usercmd_t *u, qboole
 	*time += (double)cmd.msec / 1000.0;
 }
 
+/*
+=================
+CL_PredictionWorldKey
+
+everything the player movement sees besides its own state,
+physents only count when the move can get to them in the
+given time, other players are interpolated every frame
+=================
+*/
+static dword CL_PredictionWorldKey( const local_state_t *from, float seconds )
+{
+	playermove_t	*pmove = clgame.pmove;
+	vec3_t		mins, maxs, absmin, absmax;
+	float		speed, reach, hull;
+	physent_t		*pe;
+	dword		crc;
+	int		i, j;
+
+	// rounded up so a chain that grows by a command
+	// each frame doesn't change the key every time
+	for( reach = 0.125f; reach < seconds; reach *= 2.0f );
+
+	speed = clgame.movevars.maxvelocity;
+	for( j = 0; j < 3; j++ )
+		speed = Q_max( speed, clgame.movevars.maxvelocity + fabs( from->playerstate.basevelocity[j] ));
+
+	for( j = 0; j < 3; j++ )
+	{
+		for( i = 0, hull = 0.0f; i < 4; i++ )
+			hull = Q_max( hull, Q_max( -pmove->player_mins[i][j], pmove->player_maxs[i][j] ));
+
+		mins[j] = from->playerstate.origin[j] - speed * reach - hull - 1.0f;
+		maxs[j] = from->playerstate.origin[j] + speed * reach + hull + 1.0f;
+	}
+
+	CRC32_Init( &crc );
+
+	// world and unbounded entities can be touched from anywhere
+	for( i = 0, pe = pmove->physents; i < pmove->numphysent; i++, pe++ )
+	{
+		if( i == 0 || !PM_PhysentBounds( pe, absmin, absmax ) || BoundsIntersect( mins, maxs, absmin, absmax ))
+			CRC32_ProcessBuffer( &crc, pe, sizeof( *pe ));
+	}
+
+	for( i = 0, pe = pmove->moveents; i < pmove->nummoveent; i++, pe++ )
+	{
+		if( !PM_PhysentBounds( pe, absmin, absmax ) || BoundsIntersect( mins, maxs, absmin, absmax ))
+			CRC32_ProcessBuffer( &crc, pe, sizeof( *pe ));
+	}
+
+	CRC32_ProcessBuffer( &crc, &cl.servercount, sizeof( cl.servercount ));
+	CRC32_ProcessBuffer( &crc, pmove->player_mins, sizeof( pmove->player_mins ));
+	CRC32_ProcessBuffer( &crc, pmove->player_maxs, sizeof( pmove->player_maxs ));
+	CRC32_ProcessBuffer( &crc, &clgame.movevars, sizeof( clgame.movevars ));
+	CRC32_ProcessBuffer( &crc, cls.physinfo, Q_strlen( cls.physinfo ));
+	CRC32_ProcessBuffer( &crc, &cl.local.health, sizeof( cl.local.health ));
+
+	return crc;
+}
+
+/*
+=================
+CL_PredictedStateMatches
+
+compares the part of the state that the prediction reads
+and writes, the rest is passed on from the acknowledged frame.
+server sends positions rounded, so those only have to agree
+within the network precision
+=================
+*/
+static qboolean CL_PredictedStateMatches( const local_state_t *a, const local_state_t *b )
+{
+	const entity_state_t	*pa = &a->playerstate;
+	const entity_state_t	*pb = &b->playerstate;
+	clientdata_t		ca, cb;
+	int			j;
+
+	for( j = 0; j < 3; j++ )
+	{
+		if( fabs( pa->origin[j] - pb->origin[j] ) > PREDICTION_AGREE_EPSILON
+		 || fabs( pa->angles[j] - pb->angles[j] ) > PREDICTION_AGREE_EPSILON
+		 || fabs( pa->basevelocity[j] - pb->basevelocity[j] ) > PREDICTION_AGREE_EPSILON
+		 || fabs( a->client.velocity[j] - b->client.velocity[j] ) > PREDICTION_AGREE_EPSILON
+		 || fabs( a->client.punchangle[j] - b->client.punchangle[j] ) > PREDICTION_AGREE_EPSILON
+		 || fabs( a->client.view_ofs[j] - b->client.view_ofs[j] ) > PREDICTION_AGREE_EPSILON )
+			return false;
+	}
+
+	if( fabs( pa->flFallVelocity - pb->flFallVelocity ) > PREDICTION_AGREE_EPSILON )
+		return false;
+
+	if( pa->number != pb->number || pa->oldbuttons != pb->oldbuttons || pa->friction != pb->friction
+	 || pa->gravity != pb->gravity || pa->movetype != pb->movetype || pa->onground != pb->onground
+	 || pa->effects != pb->effects || pa->usehull != pb->usehull || pa->iStepLeft != pb->iStepLeft )
+		return false;
+
+	// client.origin is not predicted, the rest must be the same
+	ca = a->client;
+	cb = b->client;
+	VectorClear( ca.origin );
+	VectorClear( cb.origin );
+	VectorCopy( cb.velocity, ca.velocity );
+	VectorCopy( cb.punchangle, ca.punchangle );
+	VectorCopy( cb.view_ofs, ca.view_ofs );
+
+	if( memcmp( &ca, &cb, sizeof( ca )))
+		return false;
+
+	return !memcmp( a->weapondata, b->weapondata, sizeof( a->weapondata ));
+}
+
+/*
+=================
+CL_CopyPredictedState
+
+cached result on top of the state passed on from the
+previous command, same as running the command again
+=================
+*/
+static void CL_CopyPredictedState( local_state_t *to, const local_state_t *from, const local_state_t *cached )
+{
+	entity_state_t		*ps = &to->playerstate;
+	const entity_state_t	*cs = &cached->playerstate;
+
+	*to = *from;
+
+	VectorCopy( cs->origin, ps->origin );
+	VectorCopy( cs->angles, ps->angles );
+	VectorCopy( cs->basevelocity, ps->basevelocity );
+	ps->oldbuttons = cs->oldbuttons;
+	ps->friction = cs->friction;
+	ps->movetype = cs->movetype;
+	ps->onground = cs->onground;
+	ps->effects = cs->effects;
+	ps->usehull = cs->usehull;
+	ps->iStepLeft = cs->iStepLeft;
+	ps->flFallVelocity = cs->flFallVelocity;
+
+	to->client = cached->client;
+	VectorCopy( from->client.origin, to->client.origin );
+	memcpy( to->weapondata, cached->weapondata, sizeof( to->weapondata ));
+}
+
+/*
+=================
+CL_PredictionBaseKey
+
+a chain of predicted commands starts from the acknowledged state,
+if the server agreed with the prediction the old chain goes on
+=================
+*/
+static dword CL_PredictionBaseKey( const local_state_t *from, uint acknowledged )
+{
+	predstep_t	*step = &predcache.steps[acknowledged & CL_UPDATE_MASK];
+	qboolean		agreed;
+	dword		crc;
+
+	agreed = ( step->sequence == acknowledged && CL_PredictedStateMatches( &step->state, from ));
+
+	if( predcache.acknowledged != acknowledged )
+	{
+		predcache.acknowledged = acknowledged;
+		predcache.acks++;
+		if( agreed ) predcache.agreed++;
+	}
+
+	if( agreed )
+		return step->key;
+
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, from, sizeof( *from ));
+
+	return crc;
+}
+
+/*
+=================
+CL_PredictUsercmd
+
+CL_RunUsercmd through the prediction cache, key chains
+the inputs of all the commands up to this one. start time
+is one of them, pmove and client.dll weapon code see it
+=================
+*/
+static void CL_PredictUsercmd( local_state_t *from, local_state_t *to, usercmd_t *u, qboolean runfuncs, double *time, uint sequence, dword world, dword *key )
+{
+	predstep_t	*step = &predcache.steps[sequence & CL_UPDATE_MASK];
+
+	CRC32_ProcessBuffer( key, u, sizeof( *u ));
+	CRC32_ProcessBuffer( key, &sequence, sizeof( sequence ));
+	CRC32_ProcessBuffer( key, time, sizeof( *time ));
+	CRC32_ProcessBuffer( key, &world, sizeof( world ));
+
+	// client.dll must see the command once with runfuncs set
+	if( !runfuncs && cl_predcache.value )
+	{
+		predcache.lookups++;
+
+		if( step->sequence == sequence && step->key == *key )
+		{
+			CL_CopyPredictedState( to, from, &step->state );
+			*time = step->end;
+			cl.local.lastground = step->lastground;
+			predcache.reused++;
+			return;
+		}
+	}
+
+	CL_RunUsercmd( from, to, u, runfuncs, time, sequence );
+	predcache.replayed++;
+
+	step->sequence = sequence;
+	step->key = *key;
+	step->end = *time;
+	step->lastground = cl.local.lastground;
+	step->state = *to;
+}
+
+/*
+=================
+CL_PredictionStats_f
+=================
+*/
+void CL_PredictionStats_f( void )
+{
+	Con_Printf( "prediction: %u commands simulated, %u of %u cacheable reused (%.1f%%)\n",
+		predcache.replayed, predcache.reused, predcache.lookups,
+		predcache.lookups ? predcache.reused * 100.0 / predcache.lookups : 0.0 );
+	Con_Printf( "server agreed with %u of %u acknowledged states (%.1f%%)\n", predcache.agreed, predcache.acks,
+		predcache.acks ? predcache.agreed * 100.0 / predcache.acks : 0.0 );
+
+	if( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ))
+		predcache.replayed = predcache.lookups = predcache.reused = predcache.acks = predcache.agreed = 0;
+}
 
 /*
 =================
@@ -1161,11 +1442,12 @@ void CL_PredictMovement( qboolean repredicting )
 	uint		current_command;
 	uint		current_command_mod;
 	frame_t		*frame = NULL;
-	uint		i, stoppoint;
+	uint		i, stoppoint, msec;
 	qboolean		runfuncs;
 	double		f = 1.0;
 	cl_entity_t	*ent;
 	double		time;
+	dword		world, key;
 
 	if( cls.state != ca_active || cls.spectator )
 		return;
@@ -1214,6 +1496,13 @@ void CL_PredictMovement( qboolean repredicting )
 	CL_PushPMStates();
 	CL_SetSolidPlayers( cl.playernum );
 
+	// how long the move can go on from the acknowledged state
+	for( i = 1, msec = 0; i < CL_UPDATE_MASK && cls.netchan.incoming_acknowledged + i < cls.netchan.outgoing_sequence + stoppoint; i++ )
+		msec += cl.commands[( cls.netchan.incoming_acknowledged + i ) & CL_UPDATE_MASK].cmd.msec;
+
+	world = CL_PredictionWorldKey( from, msec / 1000.0f );
+	key = CL_PredictionBaseKey( from, cls.netchan.incoming_acknowledged );
+
 	for( i = 1; i < CL_UPDATE_MASK && cls.netchan.incoming_acknowledged + i < cls.netchan.outgoing_sequence + stoppoint; i++ )
 	{
 		current_command = cls.netchan.incoming_acknowledged + i;
@@ -1223,7 +1512,7 @@ void CL_PredictMovement( qboolean repredicting )
 		to_cmd = &cl.commands[current_command_mod];
 		runfuncs = ( !repredicting && !to_cmd->processedfuncs );
 
-		CL_RunUsercmd( from, to, &to_cmd->cmd, runfuncs, &time, current_command );
+		CL_PredictUsercmd( from, to, &to_cmd->cmd, runfuncs, &time, current_command, world, &key );
 		VectorCopy( to->playerstate.origin, cl.local.predicted_origins[current_command_mod] );
 		to_cmd->processedfuncs = true;
 
@@ -1350,3 +1639,178 @@ void CL_PredictMovement( qboolean repredicting )
 	VectorCopy( cl.simorg, cl.local.lastorigin );
 	cl.local.repredicting = false;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define PRED_TEST_COMMANDS	10
+
+static int	test_pmove_calls;
+
+static void Test_PlayerMove( playermove_t *pmove, int server )
+{
+	pmove->origin[0] += pmove->cmd.forwardmove * pmove->frametime;
+	pmove->origin[1] += pmove->time * 0.001f;
+	test_pmove_calls++;
+}
+
+static void Test_PostRunCmd( local_state_t *from, local_state_t *to, usercmd_t *cmd, int runfuncs, double time, unsigned int random_seed )
+{
+	to->client.fuser1 = time;
+}
+
+// returns number of commands that were simulated
+static int Test_PredictChain( local_state_t *base, uint acknowledged, usercmd_t *cmds, int count, local_state_t *out, dword world, qboolean cached, double *time )
+{
+	local_state_t	*from = base;
+	uint		replayed = predcache.replayed;
+	dword		key = CL_PredictionBaseKey( base, acknowledged );
+	int		i;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( cached ) CL_PredictUsercmd( from, &out[i], &cmds[i], false, time, acknowledged + 1 + i, world, &key );
+		else CL_RunUsercmd( from, &out[i], &cmds[i], false, time, acknowledged + 1 + i );
+		from = &out[i];
+	}
+
+	return predcache.replayed - replayed;
+}
+
+// every step, reused or not, must be what a plain replay gives
+static qboolean Test_MatchesReplay( local_state_t *base, uint acknowledged, usercmd_t *cmds, int count, const local_state_t *out, double time, double end )
+{
+	local_state_t	*ref = Mem_Malloc( host.mempool, sizeof( *ref ) * count );
+	qboolean		match;
+
+	Test_PredictChain( base, acknowledged, cmds, count, ref, 0, false, &time );
+	match = !memcmp( out, ref, sizeof( *out ) * count ) && time == end;
+	Mem_Free( ref );
+
+	return match;
+}
+
+void Test_RunPredictionCache( void )
+{
+	playermove_t	*saved_pmove = clgame.pmove;
+	convar_t		*saved_nopred = cl_nopred;
+	float		saved_value = cl_predcache.value;
+	cldll_func_t	saved_funcs = clgame.dllFuncs;
+	movevars_t	saved_movevars = clgame.movevars;
+	convar_t		nopred = { 0 };
+	local_state_t	*base = Mem_Calloc( host.mempool, sizeof( *base ) * ( 2 + PRED_TEST_COMMANDS * 3 ));
+	local_state_t	*out = base + 1, *ref = out + PRED_TEST_COMMANDS;
+	local_state_t	*acked = ref + PRED_TEST_COMMANDS, *next = acked + 1;
+	usercmd_t		cmds[PRED_TEST_COMMANDS];
+	int		i, first, again, diverged, moved, agreed, bad = 0;
+	double		t, t3;
+	uint		acks;
+	dword		world;
+	playermove_t	*pmove = Mem_Calloc( host.mempool, sizeof( *pmove ));
+
+	clgame.pmove = pmove;
+	clgame.dllFuncs.pfnPlayerMove = Test_PlayerMove;
+	clgame.dllFuncs.pfnPostRunCmd = Test_PostRunCmd;
+	cl_nopred = &nopred;
+	cl_predcache.value = 1.0f;
+
+	memset( cmds, 0, sizeof( cmds ));
+	for( i = 0; i < PRED_TEST_COMMANDS; i++ )
+	{
+		cmds[i].msec = 10 + i * 7; // the last ones are split in two halves
+		cmds[i].forwardmove = 100.0f * i;
+	}
+	VectorSet( base->playerstate.origin, 16.0f, 32.0f, 64.0f );
+
+	t = 1.0;
+	first = Test_PredictChain( base, 100, cmds, PRED_TEST_COMMANDS, out, 1, true, &t );
+	test_pmove_calls = 0;
+	t = 1.0;
+	again = Test_PredictChain( base, 100, cmds, PRED_TEST_COMMANDS, out, 1, true, &t );
+	TASSERT( first == PRED_TEST_COMMANDS && again == 0 && test_pmove_calls == 0 );
+	TASSERT( Test_MatchesReplay( base, 100, cmds, PRED_TEST_COMMANDS, out, 1.0, t ));
+
+	// the changed command and all after it are simulated again
+	cmds[6].forwardmove = -50.0f;
+	t = 1.0;
+	diverged = Test_PredictChain( base, 100, cmds, PRED_TEST_COMMANDS, out, 1, true, &t );
+	TASSERT( diverged == PRED_TEST_COMMANDS - 6 );
+	TASSERT( Test_MatchesReplay( base, 100, cmds, PRED_TEST_COMMANDS, out, 1.0, t ));
+
+	// so is everything when the world has changed
+	t = 1.0;
+	moved = Test_PredictChain( base, 100, cmds, PRED_TEST_COMMANDS, out, 2, true, &t );
+	TASSERT( moved == PRED_TEST_COMMANDS );
+
+	// time the chain reached at 103
+	t3 = 1.0;
+	Test_PredictChain( base, 100, cmds, 3, ref, 0, false, &t3 );
+
+	// server acknowledged 103 and agreed, the frame has its own
+	// animation and client origin and the time goes on, so does the chain
+	*acked = out[2];
+	acked->client.origin[2] = 1000.0f;
+	acked->playerstate.frame = 17.0f;
+	acks = predcache.acks;
+	agreed = predcache.agreed;
+	t = t3;
+	moved = Test_PredictChain( acked, 103, &cmds[3], PRED_TEST_COMMANDS - 3, next, 2, true, &t );
+	TASSERT( moved == 0 && predcache.acks == acks + 1 && predcache.agreed == agreed + 1 );
+	TASSERT( Test_MatchesReplay( acked, 103, &cmds[3], PRED_TEST_COMMANDS - 3, next, t3, t ));
+
+	for( i = 0; i < PRED_TEST_COMMANDS - 3; i++ )
+	{
+		// not predicted, passed on from the new frame
+		if( next[i].playerstate.frame != 17.0f || next[i].client.origin[2] != 1000.0f )
+			bad++;
+	}
+	TASSERT( bad == 0 );
+
+	// positions come back rounded, that still counts as agreement
+	acked->playerstate.origin[0] = (int)( acked->playerstate.origin[0] * 8.0f ) / 8.0f;
+	t = t3;
+	moved = Test_PredictChain( acked, 103, &cmds[3], PRED_TEST_COMMANDS - 3, next, 2, true, &t );
+	TASSERT( moved == 0 );
+
+	// same state at another time, pmove and client.dll see the time
+	t = 7.5;
+	moved = Test_PredictChain( acked, 103, &cmds[3], PRED_TEST_COMMANDS - 3, next, 2, true, &t );
+	TASSERT( moved == PRED_TEST_COMMANDS - 3 );
+	TASSERT( Test_MatchesReplay( acked, 103, &cmds[3], PRED_TEST_COMMANDS - 3, next, 7.5, t ));
+
+	// off by a unit at 104, everything after it is simulated again
+	*acked = next[0];
+	acked->playerstate.origin[1] += 1.0f;
+	agreed = predcache.agreed;
+	t = 7.5 + cmds[3].msec / 1000.0;
+	moved = Test_PredictChain( acked, 104, &cmds[4], PRED_TEST_COMMANDS - 4, next, 2, true, &t );
+	TASSERT( moved == PRED_TEST_COMMANDS - 4 && predcache.agreed == agreed );
+
+	// physents only count when the move can get to them
+	clgame.movevars.maxvelocity = 2000.0f;
+	pmove->numphysent = 3;
+	for( i = 1; i < pmove->numphysent; i++ )
+	{
+		pmove->physents[i].solid = SOLID_BBOX;
+		VectorSet( pmove->physents[i].mins, -16.0f, -16.0f, -16.0f );
+		VectorSet( pmove->physents[i].maxs, 16.0f, 16.0f, 16.0f );
+	}
+	VectorSet( pmove->physents[1].origin, 4000.0f, 0.0f, 0.0f );
+	VectorSet( pmove->physents[2].origin, 64.0f, 0.0f, 0.0f );
+
+	world = CL_PredictionWorldKey( base, 0.1f );
+	pmove->physents[1].origin[1] += 100.0f;
+	TASSERT( CL_PredictionWorldKey( base, 0.1f ) == world );
+	pmove->physents[2].origin[1] += 1.0f;
+	TASSERT( CL_PredictionWorldKey( base, 0.1f ) != world );
+
+	clgame.pmove = saved_pmove;
+	clgame.dllFuncs = saved_funcs;
+	clgame.movevars = saved_movevars;
+	cl_nopred = saved_nopred;
+	cl_predcache.value = saved_value;
+	memset( predcache.steps, 0, sizeof( predcache.steps ));
+	Mem_Free( pmove );
+	Mem_Free( base );
+}
+#endif /* XASH_ENGINE_TESTS */
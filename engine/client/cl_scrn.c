@@ -235,6 +235,14 @@ void SCR_RSpeeds( void )
 		char	*p, *start, *end;
 		rgba_t	color;
 
+		// tempent counters are kept by engine, add them to the tempents page
+		if( Cvar_VariableInteger( "r_speeds" ) == 5 )
+		{
+			Q_strncat( msg, va( "\n%3i tent allocs, %i evicted, %i failed\n%3i tent traces, %.3f ms tent update",
+				cl_tentstats.last.allocs, cl_tentstats.last.evictions, cl_tentstats.last.failed,
+				cl_tentstats.last.traces, cl_tentstats.updatetime * 1000.0 ), sizeof( msg ));
+		}
+
 		x = refState.width - 340;
 		y = 64;
 
@@ -38,6 +38,30 @@ TEMPENTS MANAGEMENT
 TEMPENTITY	*cl_active_tents;
 TEMPENTITY	*cl_free_tents;
 TEMPENTITY	*cl_tempents = NULL;		// entities pool
+tentstats_t	cl_tentstats;
+
+// client dll frees tents by moving them to cl_free_tents,
+// so low priority ones are also kept in allocation order here
+// and the oldest one is known without walking the active list
+static struct
+{
+	int	*prev;
+	int	*next;
+	int	head;		// oldest
+	int	tail;
+} cl_tentage;
+
+// collision tents sorted by leaf before update
+typedef struct
+{
+	int		leaf;
+	int		order;
+	TEMPENTITY	*tent;
+} tentsort_t;
+
+static tentsort_t	*cl_tentsort;
+static convar_t	*cl_tent_sort;
+static convar_t	*cl_lightbins;
 
 model_t		*cl_sprite_muzzleflash[MAX_MUZZLEFLASH];	// muzzle flashes
 model_t		*cl_sprite_dot = NULL;
@@ -206,6 +230,11 @@ CL_InitTempents
 void CL_InitTempEnts( void )
 {
 	cl_tempents = Mem_Calloc( cls.mempool, sizeof( TEMPENTITY ) * GI->max_tents );
+	cl_tentage.prev = Mem_Malloc( cls.mempool, sizeof( int ) * GI->max_tents );
+	cl_tentage.next = Mem_Malloc( cls.mempool, sizeof( int ) * GI->max_tents );
+	cl_tentsort = Mem_Malloc( cls.mempool, sizeof( tentsort_t ) * GI->max_tents );
+	cl_tent_sort = Cvar_Get( "cl_tent_sort", "1", FCVAR_ARCHIVE, "group colliding tempents by leaf before update" );
+	cl_lightbins = Cvar_Get( "cl_lightbins", "1", FCVAR_ARCHIVE, "give renderers only the dynamic lights near a model" );
 	CL_ClearTempEnts();
 
 	// load tempent sprites (glowshell, muzzleflashes etc)
@@ -233,6 +262,12 @@ void CL_ClearTempEnts( void )
 	cl_tempents[GI->max_tents-1].next = NULL;
 	cl_free_tents = cl_tempents;
 	cl_active_tents = NULL;
+
+	for( i = 0; i < GI->max_tents; i++ )
+		cl_tentage.prev[i] = cl_tentage.next[i] = -2; // not linked
+
+	cl_tentage.head = cl_tentage.tail = -1;
+	memset( &cl_tentstats, 0, sizeof( cl_tentstats ));
 }
 
 /*
@@ -244,8 +279,59 @@ CL_FreeTempEnts
 void CL_FreeTempEnts( void )
 {
 	if( cl_tempents )
+	{
 		Mem_Free( cl_tempents );
+		Mem_Free( cl_tentage.prev );
+		Mem_Free( cl_tentage.next );
+		Mem_Free( cl_tentsort );
+	}
+
 	cl_tempents = NULL;
+	cl_tentage.prev = cl_tentage.next = NULL;
+	cl_tentsort = NULL;
+}
+
+/*
+================
+CL_TempEntUnlinkAge
+
+================
+*/
+static void CL_TempEntUnlinkAge( int i )
+{
+	if( cl_tentage.next[i] == -2 )
+		return; // not linked
+
+	if( cl_tentage.prev[i] != -1 )
+		cl_tentage.next[cl_tentage.prev[i]] = cl_tentage.next[i];
+	else cl_tentage.head = cl_tentage.next[i];
+
+	if( cl_tentage.next[i] != -1 )
+		cl_tentage.prev[cl_tentage.next[i]] = cl_tentage.prev[i];
+	else cl_tentage.tail = cl_tentage.prev[i];
+
+	cl_tentage.prev[i] = cl_tentage.next[i] = -2;
+}
+
+/*
+================
+CL_TempEntLinkAge
+
+tent becomes the newest low priority one
+================
+*/
+static void CL_TempEntLinkAge( int i )
+{
+	CL_TempEntUnlinkAge( i );
+
+	cl_tentage.prev[i] = cl_tentage.tail;
+	cl_tentage.next[i] = -1;
+
+	if( cl_tentage.tail != -1 )
+		cl_tentage.next[cl_tentage.tail] = i;
+	else cl_tentage.head = i;
+
+	cl_tentage.tail = i;
 }
 
 /*
@@ -409,6 +495,70 @@ int CL_TempEntAddEntity( cl_entity_t *pEntity )
 	return 0;
 }
 
+/*
+==============
+CL_CompareTempEnts
+
+==============
+*/
+static int CL_CompareTempEnts( const void *a, const void *b )
+{
+	const tentsort_t	*ta = a, *tb = b;
+
+	if( ta->leaf != tb->leaf )
+		return ta->leaf - tb->leaf;
+	return ta->order - tb->order;
+}
+
+/*
+==============
+CL_SortTempEnts
+
+put colliding tents of the same leaf next to each other,
+so their traces in client dll go down the same nodes
+the rest keeps its order at the end of list
+==============
+*/
+static void CL_SortTempEnts( void )
+{
+	TEMPENTITY	*pTemp, *rest = NULL, **restlink = &rest;
+	int		i, count = 0;
+	mleaf_t		*leaf;
+
+	if( !cl.worldmodel || !cl_tentsort )
+		return;
+
+	for( pTemp = cl_active_tents; pTemp; pTemp = pTemp->next )
+	{
+		if( FBitSet( pTemp->flags, FTENT_COLLIDEWORLD|FTENT_COLLIDEALL|FTENT_COLLIDEKILL ))
+		{
+			leaf = Mod_PointInLeaf( pTemp->entity.origin, cl.worldmodel->nodes );
+			cl_tentsort[count].leaf = leaf - cl.worldmodel->leafs;
+			cl_tentsort[count].order = count;
+			cl_tentsort[count].tent = pTemp;
+			count++;
+		}
+		else
+		{
+			*restlink = pTemp;
+			restlink = &pTemp->next;
+		}
+	}
+
+	*restlink = NULL;
+
+	if( count > 1 )
+		qsort( cl_tentsort, count, sizeof( *cl_tentsort ), CL_CompareTempEnts );
+
+	for( i = count - 1; i >= 0; i-- )
+	{
+		cl_tentsort[i].tent->next = rest;
+		rest = cl_tentsort[i].tent;
+	}
+
+	cl_active_tents = rest;
+}
+
 /*
 ==============
 CL_AddTempEnts
@@ -421,42 +571,47 @@ void CL_TempEntUpdate( void )
 {
 	double	ft = cl.time - cl.oldtime;
 	float	gravity = clgame.movevars.gravity;
+	double	start;
+
+	if( CVAR_TO_BOOL( cl_tent_sort ))
+		CL_SortTempEnts();
 
+	cl_tentstats.inupdate = true;
+	start = Sys_DoubleTime();
 	clgame.dllFuncs.pfnTempEntUpdate( ft, cl.time, gravity, &cl_free_tents, &cl_active_tents, CL_TempEntAddEntity, CL_TempEntPlaySound );
+	cl_tentstats.updatetime = Sys_DoubleTime() - start;
+	cl_tentstats.inupdate = false;
+
+	// tents made on previous frame were updated just now
+	cl_tentstats.last = cl_tentstats.frame;
+	memset( &cl_tentstats.frame, 0, sizeof( cl_tentstats.frame ));
 }
 
 /*
 ==============
-CL_TEntAddEntity
+CL_EvictLowPriorityTempEnt
 
-free the first low priority tempent it finds.
+take the oldest low priority tempent, it stays
+where it is in the active list. only valid while
+free list is empty: every tent is active then
 ==============
 */
-qboolean CL_FreeLowPriorityTempEnt( void )
+static TEMPENTITY *CL_EvictLowPriorityTempEnt( void )
 {
-	TEMPENTITY	*pActive = cl_active_tents;
-	TEMPENTITY	*pPrev = NULL;
+	TEMPENTITY	*pTemp;
+	int		i;
 
-	while( pActive )
+	while(( i = cl_tentage.head ) != -1 )
 	{
-		if( pActive->priority == TENTPRIORITY_LOW )
-		{
-			// remove from the active list.
-			if( pPrev ) pPrev->next = pActive->next;
-			else cl_active_tents = pActive->next;
-
-			// add to the free list.
-			pActive->next = cl_free_tents;
-			cl_free_tents = pActive;
-
-			return true;
-		}
+		pTemp = &cl_tempents[i];
+		CL_TempEntUnlinkAge( i );
 
-		pPrev = pActive;
-		pActive = pActive->next;
+		// client dll may raise priority by itself
+		if( pTemp->priority == TENTPRIORITY_LOW )
+			return pTemp;
 	}
 
-	return false;
+	return NULL;
 }
 
 /*
@@ -473,6 +628,7 @@ TEMPENTITY *CL_TempEntAlloc( const vec3_t org, model_t *pmodel )
 	if( !cl_free_tents )
 	{
 		Con_DPrintf( "Overflow %d temporary ents!\n", GI->max_tents );
+		cl_tentstats.frame.failed++;
 		return NULL;
 	}
 
@@ -487,6 +643,9 @@ TEMPENTITY *CL_TempEntAlloc( const vec3_t org, model_t *pmodel )
 	pTemp->next = cl_active_tents;
 	cl_active_tents = pTemp;
 
+	CL_TempEntLinkAge( pTemp - cl_tempents );
+	cl_tentstats.frame.allocs++;
+
 	return pTemp;
 }
 
@@ -499,34 +658,42 @@ alloc high priority tempentity
 */
 TEMPENTITY *CL_TempEntAllocHigh( const vec3_t org, model_t *pmodel )
 {
-	TEMPENTITY	*pTemp;
+	TEMPENTITY	*pTemp, *pNext;
 
 	if( !cl_free_tents )
 	{
-		// no temporary ents free, so find the first active low-priority temp ent
-		// and overwrite it.
-		CL_FreeLowPriorityTempEnt();
-	}
+		// no temporary ents free, so overwrite the oldest
+		// active low-priority temp ent in place
+		if(( pTemp = CL_EvictLowPriorityTempEnt( )) == NULL )
+		{
+			// didn't find anything? The tent list is full of high-priority tents
+			Con_DPrintf( "Couldn't alloc a high priority TENT!\n" );
+			cl_tentstats.frame.failed++;
+			return NULL;
+		}
 
-	if( !cl_free_tents )
-	{
-		// didn't find anything? The tent list is either full of high-priority tents
-		// or all tents in the list are still due to live for > 10 seconds.
-		Con_DPrintf( "Couldn't alloc a high priority TENT!\n" );
-		return NULL;
+		pNext = pTemp->next;
+		CL_PrepareTEnt( pTemp, pmodel );
+		pTemp->next = pNext;
+		cl_tentstats.frame.evictions++;
 	}
+	else
+	{
+		// Move out of the free list and into the active list.
+		pTemp = cl_free_tents;
+		cl_free_tents = pTemp->next;
 
-	// Move out of the free list and into the active list.
-	pTemp = cl_free_tents;
-	cl_free_tents = pTemp->next;
+		CL_PrepareTEnt( pTemp, pmodel );
 
-	CL_PrepareTEnt( pTemp, pmodel );
+		pTemp->next = cl_active_tents;
+		cl_active_tents = pTemp;
+		CL_TempEntUnlinkAge( pTemp - cl_tempents );
+	}
 
 	pTemp->priority = TENTPRIORITY_HIGH;
 	if( org ) VectorCopy( org, pTemp->entity.origin );
 
-	pTemp->next = cl_active_tents;
-	cl_active_tents = pTemp;
+	cl_tentstats.frame.allocs++;
 
 	return pTemp;
 }
@@ -2476,6 +2643,229 @@ DLIGHT MANAGEMENT
 dlight_t	cl_dlights[MAX_DLIGHTS];
 dlight_t	cl_elights[MAX_ELIGHTS];
 
+/*
+==============================================================
+
+DLIGHT BINNING
+
+lights are hashed into a coarse xy grid once per change so
+renderers don't walk every light for every model they draw
+
+==============================================================
+*/
+#define LIGHTBIN_CELL_SHIFT	8	// 256 units
+#define LIGHTBIN_HASH	256
+#define LIGHTBIN_MAX_CELLS	64	// larger lights are tested on every query
+#define LIGHTBIN_MAX_REFS	4096
+#define MAX_BINNED_LIGHTS	256
+
+// studio lighting drops elights weaker than 5% of full strength,
+// so they reach sqrt( 1 / 0.05 ) times their radius
+#define ELIGHT_REACH	4.4722f
+
+enum
+{
+	LIGHTBIN_INACTIVE = 0,
+	LIGHTBIN_BOUNDS,	// must touch the query box
+	LIGHTBIN_ATTACHED,	// always returned
+};
+
+typedef struct
+{
+	int	numlights;
+	byte	state[MAX_BINNED_LIGHTS];
+	vec3_t	mins[MAX_BINNED_LIGHTS];
+	vec3_t	maxs[MAX_BINNED_LIGHTS];
+
+	int	numunbinned;
+	short	unbinned[MAX_BINNED_LIGHTS];	// big or attached lights
+
+	short	first[LIGHTBIN_HASH+1];	// start of each cell in refs
+	short	refs[LIGHTBIN_MAX_REFS];
+
+	int	visits;	// candidates tested by queries, for stats
+} lightbins_t;
+
+static lightbins_t	cl_dlightbins;
+static lightbins_t	cl_elightbins;
+static qboolean	cl_lightbins_dirty = true;
+
+static int CL_LightBinCell( int x, int y )
+{
+	return (((uint)x * 73856093u ) ^ ((uint)y * 19349663u )) & ( LIGHTBIN_HASH - 1 );
+}
+
+static void CL_LightBinRange( const vec3_t mins, const vec3_t maxs, int *range )
+{
+	range[0] = (int)floor( mins[0] ) >> LIGHTBIN_CELL_SHIFT;
+	range[1] = (int)floor( mins[1] ) >> LIGHTBIN_CELL_SHIFT;
+	range[2] = (int)floor( maxs[0] ) >> LIGHTBIN_CELL_SHIFT;
+	range[3] = (int)floor( maxs[1] ) >> LIGHTBIN_CELL_SHIFT;
+}
+
+/*
+===============
+CL_BuildLightBins
+
+counting sort of light references into hashed cells
+elights attached to an entity are moved by the renderer
+while it draws, so they are never binned
+===============
+*/
+static void CL_BuildLightBins( lightbins_t *bins, dlight_t *lights, int count, float reach, qboolean elights )
+{
+	int	range[MAX_BINNED_LIGHTS][4];
+	int	i, x, y, cells, numrefs = 0;
+	short	fill[LIGHTBIN_HASH];
+	dlight_t	*dl;
+
+	count = Q_min( count, MAX_BINNED_LIGHTS );
+	bins->numlights = count;
+	bins->numunbinned = 0;
+	memset( bins->first, 0, sizeof( bins->first ));
+
+	for( i = 0, dl = lights; i < count; i++, dl++ )
+	{
+		range[i][0] = 1; // nothing to bin
+		range[i][2] = 0;
+
+		if( dl->die < cl.time || dl->radius <= 0.0f )
+		{
+			bins->state[i] = LIGHTBIN_INACTIVE;
+			continue;
+		}
+
+		bins->state[i] = ( elights && ( dl->key & 0xFFF )) ? LIGHTBIN_ATTACHED : LIGHTBIN_BOUNDS;
+
+		VectorSet( bins->mins[i], dl->origin[0] - dl->radius * reach, dl->origin[1] - dl->radius * reach, dl->origin[2] - dl->radius * reach );
+		VectorSet( bins->maxs[i], dl->origin[0] + dl->radius * reach, dl->origin[1] + dl->radius * reach, dl->origin[2] + dl->radius * reach );
+		CL_LightBinRange( bins->mins[i], bins->maxs[i], range[i] );
+		cells = ( range[i][2] - range[i][0] + 1 ) * ( range[i][3] - range[i][1] + 1 );
+
+		if( bins->state[i] == LIGHTBIN_ATTACHED || cells > LIGHTBIN_MAX_CELLS || numrefs + cells > LIGHTBIN_MAX_REFS )
+		{
+			bins->unbinned[bins->numunbinned++] = i;
+			range[i][0] = 1;
+			range[i][2] = 0;
+			continue;
+		}
+
+		for( x = range[i][0]; x <= range[i][2]; x++ )
+		{
+			for( y = range[i][1]; y <= range[i][3]; y++ )
+				bins->first[CL_LightBinCell( x, y ) + 1]++;
+		}
+
+		numrefs += cells;
+	}
+
+	for( i = 0; i < LIGHTBIN_HASH; i++ )
+	{
+		bins->first[i + 1] += bins->first[i];
+		fill[i] = bins->first[i];
+	}
+
+	// lights are added in order, so every cell is sorted by index
+	for( i = 0; i < count; i++ )
+	{
+		for( x = range[i][0]; x <= range[i][2]; x++ )
+		{
+			for( y = range[i][1]; y <= range[i][3]; y++ )
+				bins->refs[fill[CL_LightBinCell( x, y )]++] = i;
+		}
+	}
+}
+
+/*
+===============
+CL_QueryLightBins
+
+collect lights whose bounds touch the box, sorted by index
+without the grid every light is a candidate
+===============
+*/
+static int CL_QueryLightBins( lightbins_t *bins, const vec3_t mins, const vec3_t maxs, int *list, int maxlist, qboolean grid )
+{
+	uint	mask[MAX_BINNED_LIGHTS / 32];
+	int	range[4];
+	int	i, j, x, y, cell, count = 0;
+
+	memset( mask, 0, sizeof( mask ));
+	CL_LightBinRange( mins, maxs, range );
+
+	if( !grid || ( range[2] - range[0] + 1 ) * ( range[3] - range[1] + 1 ) > LIGHTBIN_MAX_CELLS )
+	{
+		// box is too big for the grid, test everything
+		for( i = 0; i < bins->numlights; i++ )
+			SetBits( mask[i >> 5], BIT( i & 31 ));
+		bins->visits += bins->numlights;
+	}
+	else
+	{
+		for( x = range[0]; x <= range[2]; x++ )
+		{
+			for( y = range[1]; y <= range[3]; y++ )
+			{
+				cell = CL_LightBinCell( x, y );
+
+				for( j = bins->first[cell]; j < bins->first[cell + 1]; j++ )
+					SetBits( mask[bins->refs[j] >> 5], BIT( bins->refs[j] & 31 ));
+				bins->visits += bins->first[cell + 1] - bins->first[cell];
+			}
+		}
+
+		for( j = 0; j < bins->numunbinned; j++ )
+			SetBits( mask[bins->unbinned[j] >> 5], BIT( bins->unbinned[j] & 31 ));
+		bins->visits += bins->numunbinned;
+	}
+
+	for( i = 0; i < bins->numlights && count < maxlist; i++ )
+	{
+		if( !mask[i >> 5] )
+		{
+			i |= 31; // skip empty words
+			continue;
+		}
+
+		if( !FBitSet( mask[i >> 5], BIT( i & 31 )))
+			continue;
+
+		if( bins->state[i] == LIGHTBIN_INACTIVE )
+			continue;
+
+		if( bins->state[i] == LIGHTBIN_BOUNDS && !BoundsIntersect( mins, maxs, bins->mins[i], bins->maxs[i] ))
+			continue;
+
+		list[count++] = i;
+	}
+
+	return count;
+}
+
+/*
+===============
+CL_GetLightsInBox
+
+indices of dlights or elights that may light something
+inside the box, rebuilds the bins after lights were changed
+===============
+*/
+int CL_GetLightsInBox( const vec3_t mins, const vec3_t maxs, qboolean elights, int *list, int maxlist )
+{
+	qboolean	grid = !cl_lightbins || CVAR_TO_BOOL( cl_lightbins );
+
+	if( cl_lightbins_dirty )
+	{
+		CL_BuildLightBins( &cl_dlightbins, cl_dlights, MAX_DLIGHTS, 1.0f, false );
+		CL_BuildLightBins( &cl_elightbins, cl_elights, MAX_ELIGHTS, ELIGHT_REACH, true );
+		cl_lightbins_dirty = false;
+	}
+
+	if( elights )
+		return CL_QueryLightBins( &cl_elightbins, mins, maxs, list, maxlist, grid );
+	return CL_QueryLightBins( &cl_dlightbins, mins, maxs, list, maxlist, grid );
+}
+
 /*
 ================
 CL_ClearDlights
@@ -2485,6 +2875,7 @@ void CL_ClearDlights( void )
 {
 	memset( cl_dlights, 0, sizeof( cl_dlights ));
 	memset( cl_elights, 0, sizeof( cl_elights ));
+	cl_lightbins_dirty = true;
 }
 
 /*
@@ -2498,6 +2889,9 @@ dlight_t *CL_AllocDlight( int key )
 	dlight_t	*dl;
 	int	i;
 
+	// caller sets the light up after this
+	cl_lightbins_dirty = true;
+
 	// first look for an exact key match
 	if( key )
 	{
@@ -2543,6 +2937,9 @@ dlight_t *CL_AllocElight( int key )
 	dlight_t	*dl;
 	int	i;
 
+	// caller sets the light up after this
+	cl_lightbins_dirty = true;
+
 	// first look for an exact key match
 	if( key )
 	{
@@ -2590,6 +2987,7 @@ void CL_DecayLights( void )
 	int	i;
 
 	time = cl.time - cl.oldtime;
+	cl_lightbins_dirty = true;
 
 	for( i = 0, dl = cl_dlights; i < MAX_DLIGHTS; i++, dl++ )
 	{
@@ -2859,6 +3257,7 @@ void CL_TestLights( void )
 		return;
 
 	numLights = bound( 1, cl_testlights->value, MAX_DLIGHTS );
+	cl_lightbins_dirty = true;
 	AngleVectors( cl.viewangles, forward, right, NULL );
 
 	for( i = 0; i < numLights; i++ )
@@ -3063,3 +3462,143 @@ void CL_ClearEffects( void )
 	CL_ClearLightStyles ();
 }
 
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+void Test_RunTempEnts( void )
+{
+	TEMPENTITY	*pTemp, *lows[64], *prev;
+	int		i, numlows = 0, count, bad = 0;
+
+	cl_tempents = Mem_Calloc( host.mempool, sizeof( TEMPENTITY ) * GI->max_tents );
+	cl_tentage.prev = Mem_Malloc( host.mempool, sizeof( int ) * GI->max_tents );
+	cl_tentage.next = Mem_Malloc( host.mempool, sizeof( int ) * GI->max_tents );
+	cl_tentsort = Mem_Malloc( host.mempool, sizeof( tentsort_t ) * GI->max_tents );
+	CL_ClearTempEnts();
+
+	// fill the pool, every 8th tent is low priority
+	for( i = 0; i < GI->max_tents; i++ )
+	{
+		if( i % 8 == 0 && numlows < ARRAYSIZE( lows ))
+			lows[numlows++] = CL_TempEntAlloc( NULL, NULL );
+		else CL_TempEntAllocHigh( NULL, NULL );
+	}
+
+	TASSERT( CL_TempEntAlloc( NULL, NULL ) == NULL );
+
+	// client dll frees the oldest one and it's taken again,
+	// so now it's the newest
+	for( prev = NULL, pTemp = cl_active_tents; pTemp != lows[0]; prev = pTemp, pTemp = pTemp->next );
+	if( prev ) prev->next = pTemp->next;
+	else cl_active_tents = pTemp->next;
+	pTemp->next = cl_free_tents;
+	cl_free_tents = pTemp;
+
+	if( CL_TempEntAlloc( NULL, NULL ) != lows[0] )
+		bad++;
+
+	// high priority tents take the place of low ones, oldest first
+	for( i = 1; i < numlows; i++ )
+	{
+		if( CL_TempEntAllocHigh( NULL, NULL ) != lows[i] )
+			bad++;
+	}
+
+	if( CL_TempEntAllocHigh( NULL, NULL ) != lows[0] )
+		bad++;
+
+	for( count = 0, pTemp = cl_active_tents; pTemp; pTemp = pTemp->next )
+		count++;
+
+	TASSERT( bad == 0 && count == GI->max_tents && cl_tentstats.frame.evictions == numlows );
+	TASSERT( CL_TempEntAllocHigh( NULL, NULL ) == NULL );
+
+	CL_FreeTempEnts();
+}
+
+#define LIGHT_TEST_QUERIES	1024
+
+void Test_RunLightBins( void )
+{
+	lightbins_t	*bins = Mem_Calloc( host.mempool, sizeof( *bins ));
+	dlight_t		*lights = Mem_Calloc( host.mempool, sizeof( *lights ) * MAX_BINNED_LIGHTS );
+	int		list[MAX_BINNED_LIGHTS], count, expect;
+	int		i, j, bad = 0, brute;
+	uint		seed = 0x1234567;
+	double		start, gridtime, brutetime;
+	vec3_t		org;
+
+	// 256 lights spread over a 8192x8192 map
+	for( i = 0; i < MAX_BINNED_LIGHTS; i++ )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			seed = seed * 1103515245 + 12345;
+			lights[i].origin[j] = (int)(( seed >> 8 ) % 8192 ) - 4096;
+		}
+		lights[i].origin[2] *= 0.125f;
+		lights[i].radius = 50 + i % 250;
+		lights[i].die = cl.time + 1.0f;
+	}
+
+	lights[7].die = cl.time - 1.0f; // dead lights are never returned
+	lights[9].key = 5; // attached lights always are
+	VectorSet( lights[9].origin, 100000.0f, 100000.0f, 0.0f );
+
+	CL_BuildLightBins( bins, lights, MAX_BINNED_LIGHTS, 1.0f, true );
+
+	for( i = 0; i < LIGHT_TEST_QUERIES; i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		VectorSet( org, (int)(( seed >> 8 ) % 8192 ) - 4096, (int)(( seed >> 4 ) % 8192 ) - 4096, 0.0f );
+		count = CL_QueryLightBins( bins, org, org, list, ARRAYSIZE( list ), true );
+
+		for( j = 0, expect = 0; j < MAX_BINNED_LIGHTS; j++ )
+		{
+			if( j == 7 || ( j != 9 && ( fabs( org[0] - lights[j].origin[0] ) > lights[j].radius
+				|| fabs( org[1] - lights[j].origin[1] ) > lights[j].radius || fabs( org[2] - lights[j].origin[2] ) > lights[j].radius )))
+				continue;
+
+			if( expect >= count || list[expect] != j )
+				bad++;
+			expect++;
+		}
+
+		if( expect != count )
+			bad++;
+	}
+
+	TASSERT( bad == 0 );
+
+	// same queries with and without the grid
+	bins->visits = 0;
+	start = Sys_DoubleTime();
+	for( i = 0; i < LIGHT_TEST_QUERIES; i++ )
+	{
+		VectorSet( org, ( i * 37 ) % 8192 - 4096, ( i * 101 ) % 8192 - 4096, 0.0f );
+		CL_QueryLightBins( bins, org, org, list, ARRAYSIZE( list ), true );
+	}
+	gridtime = Sys_DoubleTime() - start;
+	j = bins->visits;
+
+	bins->visits = 0;
+	start = Sys_DoubleTime();
+	for( i = 0; i < LIGHT_TEST_QUERIES; i++ )
+	{
+		VectorSet( org, ( i * 37 ) % 8192 - 4096, ( i * 101 ) % 8192 - 4096, 0.0f );
+		CL_QueryLightBins( bins, org, org, list, ARRAYSIZE( list ), false );
+	}
+	brutetime = Sys_DoubleTime() - start;
+	brute = bins->visits;
+
+	Con_Reportf( "%s: %i lights, %.1f candidates and %.0f ns per query, %.1f and %.0f ns without bins\n", __func__,
+		MAX_BINNED_LIGHTS, (float)j / LIGHT_TEST_QUERIES, gridtime * 1e9 / LIGHT_TEST_QUERIES,
+		(float)brute / LIGHT_TEST_QUERIES, brutetime * 1e9 / LIGHT_TEST_QUERIES );
+
+	TASSERT( j * 8 < brute );
+
+	Mem_Free( lights );
+	Mem_Free( bins );
+}
+#endif /* XASH_ENGINE_TESTS */
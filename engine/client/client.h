@@ -444,6 +444,7 @@ typedef struct
 
 	cl_entity_t	*entities;		// dynamically allocated entity array
 	cl_entity_t	*static_entities;		// dynamically allocated static entity array
+	byte		*ph_ordered;		// per entity, newest ph[] entries with decreasing animtime
 	remap_info_t	**remap_info;		// store local copy of all remap textures for each entity
 
 	int		maxEntities;
@@ -613,6 +614,7 @@ typedef struct
 	int			demoplayback;
 	qboolean		demowaiting;		// don't record until a non-delta message is received
 	qboolean		timedemo;
+	qboolean		demobench;		// timedemo without rendering and sound, see demo_bench
 	string		demoname;			// for demo looping
 	double		demotime;			// recording time
 	qboolean		set_lastdemo;		// store name of last played demo into the cvar
@@ -654,6 +656,10 @@ extern convar_t	cl_logocolor;
 extern convar_t	cl_allow_download;
 extern convar_t	cl_allow_upload;
 extern convar_t	cl_download_ingame;
+extern convar_t	demo_keyframe;
+extern convar_t	timedemo_export;
+extern convar_t	cl_predcache;
+extern convar_t	cl_physindex;
 extern convar_t	*cl_nopred;
 extern convar_t	*cl_timeout;
 extern convar_t	*cl_nodelta;
@@ -701,6 +707,7 @@ void CL_RunLightStyles( void );
 void CL_DecayLights( void );
 dlight_t *CL_GetDynamicLight( int number );
 dlight_t *CL_GetEntityLight( int number );
+int CL_GetLightsInBox( const vec3_t mins, const vec3_t maxs, qboolean elights, int *list, int maxlist );
 
 //=================================================
 
@@ -762,6 +769,17 @@ void CL_ClearState( void );
 //
 // cl_demo.c
 //
+
+// timedemo frame phases
+enum
+{
+	TD_NET = 0,	// reading and parsing messages
+	TD_THINK,		// client.dll, prediction, entities
+	TD_RENDER,
+	TD_SOUND,
+	TD_PHASES
+};
+
 void CL_StartupDemoHeader( void );
 void CL_DrawDemoRecording( void );
 void CL_WriteDemoUserCmd( int cmdnumber );
@@ -772,11 +790,19 @@ void CL_DemoInterpolateAngles( void );
 void CL_CheckStartupDemos( void );
 void CL_WriteDemoJumpTime( void );
 void CL_CloseDemoHeader( void );
+void CL_DemoFullUpdate( void );
+qboolean CL_DemoWantsFullUpdate( void );
 void CL_DemoCompleted( void );
 void CL_StopPlayback( void );
 void CL_StopRecord( void );
 void CL_PlayDemo_f( void );
 void CL_TimeDemo_f( void );
+void CL_DemoSeek_f( void );
+void CL_TimeDemoFrame( void );
+void CL_TimeDemoMark( int phase );
+void CL_DemoBench_f( void );
+void CL_DemoBenchCommand( int cmd );
+void CL_DemoBenchEntity( void );
 void CL_StartDemos_f( void );
 void CL_Demos_f( void );
 void CL_DeleteDemo_f( void );
@@ -927,6 +953,7 @@ void CL_PopTraceBounds( void );
 void CL_MoveSpectatorCamera( void );
 void CL_SetLastUpdate( void );
 void CL_RedoPrediction( void );
+void CL_PredictionStats_f( void );
 void CL_ClearPhysEnts( void );
 void CL_PushPMStates( void );
 void CL_PopPMStates( void );
@@ -982,6 +1009,24 @@ void R_RemoveEfrags( cl_entity_t *ent );
 //
 // cl_tent.c
 //
+typedef struct
+{
+	int		allocs;
+	int		evictions;	// low priority tents overwritten by high ones
+	int		failed;
+	int		traces;		// made by client dll during update
+} tentcounters_t;
+
+typedef struct
+{
+	tentcounters_t	frame;		// being collected
+	tentcounters_t	last;		// shown by r_speeds
+	double		updatetime;
+	qboolean		inupdate;
+} tentstats_t;
+
+extern tentstats_t	cl_tentstats;
+
 struct particle_s;
 int CL_AddEntity( int entityType, cl_entity_t *pEnt );
 void CL_WeaponAnim( int iAnim, int body );
@@ -1005,12 +1050,15 @@ void CL_InitViewBeams( void );
 void CL_ClearViewBeams( void );
 void CL_FreeViewBeams( void );
 cl_entity_t *R_BeamGetEntity( int index );
+int CL_BeamSegments( const vec3_t source, const vec3_t delta, float width, float scale, float freq, float speed, int segments, int flags, const float *noise, const beamview_t *view, beamvert_t *verts );
 void CL_KillDeadBeams( cl_entity_t *pDeadEntity );
 void CL_ParseViewBeam( sizebuf_t *msg, int beamType );
 void CL_LoadClientSprites( void );
 void CL_ReadPointFile_f( void );
 void CL_DrawEFX( float time, qboolean fTrans );
 void CL_ThinkParticle( double frametime, particle_t *p );
+particle_t *CL_AllocBatchParticle( void );
+void CL_ParticleBench_f( void );
 void CL_ReadLineFile_f( void );
 void CL_RunLightStyles( void );
 
@@ -229,6 +229,7 @@ static qboolean R_Init_Video_( const int type )
 	Cbuf_AddText( va( "exec %s.cfg", ref.dllFuncs.R_GetConfigName()));
 	Cbuf_Execute();
 	host.apply_opengl_config = false;
+	ref.novideo = false;
 
 	return R_Init_Video( type );
 }
@@ -358,6 +359,8 @@ static ref_api_t gEngfuncs =
 	CL_GetLightStyle,
 	CL_GetDynamicLight,
 	CL_GetEntityLight,
+	CL_GetLightsInBox,
+	CL_BeamSegments,
 	R_FatPVS,
 	GL_GetOverviewParms,
 	Sys_DoubleTime,
@@ -381,6 +384,7 @@ static ref_api_t gEngfuncs =
 	Image_SetMDLPointer,
 	pfnImage_GetPool,
 	pfnImage_GetPFDesc,
+	Image_BuildMipChain,
 
 	pfnDrawNormalTriangles,
 	pfnDrawTransparentTriangles,
@@ -473,6 +477,11 @@ static qboolean R_LoadProgs( const char *name )
 
 	refState.developer = host_developer.value;
 
+	// cleared by R_Init_Video, a renderer that doesn't call it
+	// allocates its offscreen buffer at this size
+	ref.novideo = true;
+	VID_NullModeSize( &refState.width, &refState.height );
+
 	if( !ref.dllFuncs.R_Init( ) )
 	{
 		COM_FreeLibrary( ref.hInstance );
@@ -481,6 +490,13 @@ static qboolean R_LoadProgs( const char *name )
 		return false;
 	}
 
+	// same as a window mode set from R_Init_Video
+	if( ref.novideo )
+	{
+		Con_Printf( "Renderer runs without a window, %ix%i\n", refState.width, refState.height );
+		R_SaveVideoMode( refState.width, refState.height, refState.width, refState.height );
+	}
+
 	Cvar_FullSet( "host_refloaded", "1", FCVAR_READ_ONLY );
 	ref.initialized = true;
 
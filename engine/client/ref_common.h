@@ -23,6 +23,7 @@ GNU General Public License for more details.
 struct ref_state_s
 {
 	qboolean initialized;
+	qboolean novideo; // renderer never asked for a window and draws offscreen
 
 	HINSTANCE hInstance;
 	ref_interface_t dllFuncs;
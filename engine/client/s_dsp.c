@@ -35,6 +35,8 @@ GNU General Public License for more details.
 #define MAXLP		10
 #define MAXPRESETS		29
 
+#define DSP_BLOCK		256	// samples processed at once by block kernels
+
 typedef struct sx_preset_s
 {
 	float	room_lp;	// lowpass
@@ -179,6 +181,7 @@ convar_t	*sxdly_delay;	// current delay in seconds
 convar_t	*dsp_room;	// for compability
 
 convar_t	*dsp_coeff_table; // use release or 0.52 style
+convar_t	*dsp_block;	// block processing instead of per-sample
 int			idsp_dma_speed;
 int			idsp_room;
 int			room_typeprev;
@@ -195,6 +198,14 @@ portable_samplepair_t	*paintto = NULL;
 dly_t			rgsxdly[MAXDLY]; // stereo is last
 int			rgsxlp[MAXLP];
 
+// block kernels scratch
+static int		dsp_delay[DSP_BLOCK];	// delay line output
+static int		dsp_value[DSP_BLOCK + 1];	// first one keeps previous value
+static int		dsp_vlr[DSP_BLOCK];
+static int		dsp_out[2][DSP_BLOCK];
+static int		dsp_left[DSP_BLOCK];
+static int		dsp_right[DSP_BLOCK];
+
 void SX_Profiling_f( void );
 
 /*
@@ -236,6 +247,7 @@ void SX_Init( void )
 
 	dsp_off          = Cvar_Get( "dsp_off",        "0",  FCVAR_ARCHIVE, "disable DSP processing" );
 	dsp_coeff_table  = Cvar_Get( "dsp_coeff_table", "0", FCVAR_ARCHIVE, "select DSP coefficient table: 0 for release or 1 for alpha 0.52" );
+	dsp_block        = Cvar_Get( "dsp_block", "1", FCVAR_ARCHIVE, "process room effects in blocks, 0 for the per-sample path" );
 
 	roomwater_type   = Cvar_Get( "waterroom_type", "14", 0, "water room type" );
 	room_type        = Cvar_Get( "room_type",      "0",  0, "current room type preset" );
@@ -349,6 +361,69 @@ _inline void DLY_MovePointer( dly_t *dly )
 		dly->idelayoutput = 0;
 }
 
+/*
+============
+DSP_CountDown
+
+same as count times: if( --cur < 0 ) cur = period;
+============
+*/
+static int DSP_CountDown( int cur, int period, int count )
+{
+	cur -= count;
+
+	if( cur < 0 )
+		cur = period - ( -cur - 1 ) % ( period + 1 );
+
+	return cur;
+}
+
+/*
+============
+DLY_BlockSize
+
+longest run of samples that can be processed at once:
+delay line pointers must not wrap inside of it and
+it must not read the samples it writes itself
+============
+*/
+static int DLY_BlockSize( const dly_t *dly, int count )
+{
+	int	dist;
+
+	dist = (int)(( dly->idelayinput + dly->cdelaysamplesmax - dly->idelayoutput ) % dly->cdelaysamplesmax );
+
+	count = Q_min( count, DSP_BLOCK );
+	count = Q_min( count, (int)( dly->cdelaysamplesmax - dly->idelayinput ));
+	count = Q_min( count, (int)( dly->cdelaysamplesmax - dly->idelayoutput ));
+
+	if( dist > 0 )
+		count = Q_min( count, dist );
+
+	return count;
+}
+
+/*
+============
+DLY_MoveBlock
+
+DLY_MovePointer for a whole block
+============
+*/
+static void DLY_MoveBlock( dly_t *dly, int count )
+{
+	dly->idelayinput += count;
+	if( dly->idelayinput >= dly->cdelaysamplesmax )
+		dly->idelayinput = 0;
+
+	dly->idelayoutput += count;
+	if( dly->idelayoutput >= dly->cdelaysamplesmax )
+		dly->idelayoutput = 0;
+
+	if( dly->mod )
+		dly->modcur = DSP_CountDown( dly->modcur, dly->mod, count );
+}
+
 /*
 =============
 DLY_CheckNewStereoDelayVal
@@ -399,66 +474,104 @@ void DLY_CheckNewStereoDelayVal( void )
 
 /*
 =============
-DLY_DoStereoDelay
+DLY_DoStereoDelaySample
 
-Do stereo processing
+Do stereo processing for one sample
 =============
 */
-void DLY_DoStereoDelay( int count )
+static void DLY_DoStereoDelaySample( dly_t *dly, portable_samplepair_t *paint )
 {
-	int			delay, samplexf;
-	dly_t *const		dly = &rgsxdly[STEREODLY];
-	portable_samplepair_t	*paint = paintto;
+	int	delay, samplexf;
 
-	if( !dly->lpdelayline )
-		return; // inactive
+	if( dly->mod && --dly->modcur < 0 )
+		dly->modcur = dly->mod;
+
+	delay = dly->lpdelayline[dly->idelayoutput];
 
-	for( ; count; count--, paint++ )
+	// process only if crossfading, active left value or delayline
+	if( delay || paint->left || dly->xfade )
 	{
-		if( dly->mod && --dly->modcur < 0 )
-			dly->modcur = dly->mod;
+		// set up new crossfade, if not crossfading, not modulating, but going to
+		if( !dly->xfade && !dly->modcur && dly->mod )
+		{
+			dly->idelayoutputxf = dly->idelayoutput + ((COM_RandomLong( 0, 255 ) * dly->delaysamples ) >> 9 );
 
-		delay = dly->lpdelayline[dly->idelayoutput];
+			dly->xfade = 128;
+		}
 
-		// process only if crossfading, active left value or delayline
-		if( delay || paint->left || dly->xfade )
+		dly->idelayoutputxf %= dly->cdelaysamplesmax;
+
+		// modify delay, if crossfading
+		if( dly->xfade )
 		{
-			// set up new crossfade, if not crossfading, not modulating, but going to
-			if( !dly->xfade && !dly->modcur && dly->mod )
-			{
-				dly->idelayoutputxf = dly->idelayoutput + ((COM_RandomLong( 0, 255 ) * dly->delaysamples ) >> 9 );
+			samplexf = dly->lpdelayline[dly->idelayoutputxf] * (128 - dly->xfade) >> 7;
+			delay = samplexf + ((delay * dly->xfade) >> 7);
 
-				dly->xfade = 128;
-			}
+			if( ++dly->idelayoutputxf >= dly->cdelaysamplesmax )
+				dly->idelayoutputxf = 0;
 
-			dly->idelayoutputxf %= dly->cdelaysamplesmax;
+			if( --dly->xfade == 0 )
+				dly->idelayoutput = dly->idelayoutputxf;
+		}
 
-			// modify delay, if crossfading
-			if( dly->xfade )
-			{
-				samplexf = dly->lpdelayline[dly->idelayoutputxf] * (128 - dly->xfade) >> 7;
-				delay = samplexf + ((delay * dly->xfade) >> 7);
+		// save left value to delay line
+		dly->lpdelayline[dly->idelayinput] = CLIP( paint->left );
+
+		// paint new delay value
+		paint->left = delay;
+	}
+	else
+	{
+		// clear delay line
+		dly->lpdelayline[dly->idelayinput] = 0;
+	}
 
-				if( ++dly->idelayoutputxf >= dly->cdelaysamplesmax )
-					dly->idelayoutputxf = 0;
+	DLY_MovePointer( dly );
+}
 
-				if( --dly->xfade == 0 )
-					dly->idelayoutput = dly->idelayoutputxf;
-			}
+/*
+=============
+DLY_DoStereoDelay
 
-			// save left value to delay line
-			dly->lpdelayline[dly->idelayinput] = CLIP( paint->left );
+Do stereo processing
+=============
+*/
+void DLY_DoStereoDelay( int count )
+{
+	dly_t *const		dly = &rgsxdly[STEREODLY];
+	portable_samplepair_t	*paint = paintto;
+	qboolean			block = dsp_block->value != 0.0f;
+	int			i, n;
+
+	if( !dly->lpdelayline )
+		return; // inactive
 
-			// paint new delay value
-			paint->left = delay;
+	while( count > 0 )
+	{
+		// crossfade and modulation are done per sample
+		if( !block || dly->xfade || dly->mod )
+		{
+			DLY_DoStereoDelaySample( dly, paint );
+			paint++;
+			count--;
+			continue;
 		}
-		else
+
+		// otherwise it's a plain copy, silent samples store zero anyway
+		n = DLY_BlockSize( dly, count );
+		memcpy( dsp_delay, dly->lpdelayline + dly->idelayoutput, n * sizeof( int ));
+
+		for( i = 0; i < n; i++ )
 		{
-			// clear delay line
-			dly->lpdelayline[dly->idelayinput] = 0;
+			dsp_value[i] = CLIP( paint[i].left );
+			paint[i].left = dsp_delay[i];
 		}
 
-		DLY_MovePointer( dly );
+		memcpy( dly->lpdelayline + dly->idelayinput, dsp_value, n * sizeof( int ));
+		DLY_MoveBlock( dly, n );
+
+		paint += n;
+		count -= n;
 	}
 }
 
@@ -508,6 +621,47 @@ void DLY_CheckNewDelayVal( void )
 	dly->delayfeedback = 255 * sxdly_feedback->value;
 }
 
+/*
+=============
+DLY_DoDelaySample
+
+Do delay processing for one sample
+=============
+*/
+static void DLY_DoDelaySample( dly_t *dly, portable_samplepair_t *paint )
+{
+	int	delay = dly->lpdelayline[dly->idelayoutput];
+
+	// don't process if delay line and left/right samples are zero
+	if( delay || paint->left || paint->right )
+	{
+		// calculate delayed value from average
+		int val = (( paint->left + paint->right ) >> 1 ) + (( dly->delayfeedback * delay ) >> 8);
+		val = CLIP( val );
+
+		if( dly->lp ) // lowpass
+		{
+			val = ( dly->lp0 + dly->lp1 + val ) / 3;
+			dly->lp0 = dly->lp1;
+			dly->lp1 = val;
+		}
+
+		dly->lpdelayline[dly->idelayinput] = val;
+
+		val >>= 2;
+
+		paint->left = CLIP( paint->left + val );
+		paint->right = CLIP( paint->right + val );
+	}
+	else
+	{
+		dly->lpdelayline[dly->idelayinput] = 0;
+		dly->lp0 = dly->lp1 = dly->lp2 = 0;
+	}
+
+	DLY_MovePointer( dly );
+}
+
 /*
 =============
 DLY_DoDelay
@@ -519,43 +673,70 @@ void DLY_DoDelay( int count )
 {
 	dly_t *const		dly = &rgsxdly[MONODLY];
 	portable_samplepair_t	*paint = paintto;
-	int			delay;
+	int			i, n, val, active, silent;
+	int			lp0, lp1;
 
 	if( !dly->lpdelayline || !count )
 		return; // inactive
 
-	for( ; count; count--, paint++ )
+	if( !dsp_block->value )
 	{
-		delay = dly->lpdelayline[dly->idelayoutput];
+		for( ; count; count--, paint++ )
+			DLY_DoDelaySample( dly, paint );
+		return;
+	}
 
-		// don't process if delay line and left/right samples are zero
-		if( delay || paint->left || paint->right )
+	for( ; count > 0; count -= n, paint += n )
+	{
+		n = DLY_BlockSize( dly, count );
+		memcpy( dsp_delay, dly->lpdelayline + dly->idelayoutput, n * sizeof( int ));
+
+		for( i = 0, silent = 0; i < n; i++ )
 		{
-			// calculate delayed value from average
-			int val = (( paint->left + paint->right ) >> 1 ) + (( dly->delayfeedback * delay ) >> 8);
-			val = CLIP( val );
+			active = dsp_delay[i] | paint[i].left | paint[i].right;
+			val = (( paint[i].left + paint[i].right ) >> 1 ) + (( dly->delayfeedback * dsp_delay[i] ) >> 8 );
+			dsp_value[i] = active ? CLIP( val ) : 0;
+			silent |= !active;
+		}
 
-			if( dly->lp ) // lowpass
+		if( dly->lp )
+		{
+			// lowpass feeds back into itself, keep it serial
+			lp0 = dly->lp0;
+			lp1 = dly->lp1;
+
+			for( i = 0; i < n; i++ )
 			{
-				val = ( dly->lp0 + dly->lp1 + val ) / 3;
-				dly->lp0 = dly->lp1;
-				dly->lp1 = val;
+				if( dsp_delay[i] | paint[i].left | paint[i].right )
+				{
+					dsp_value[i] = ( lp0 + lp1 + dsp_value[i] ) / 3;
+					lp0 = lp1;
+					lp1 = dsp_value[i];
+				}
+				else lp0 = lp1 = 0;
 			}
 
-			dly->lpdelayline[dly->idelayinput] = val;
+			dly->lp0 = lp0;
+			dly->lp1 = lp1;
+		}
 
-			val >>= 2;
+		// silence resets lowpass even if it's disabled
+		if( silent )
+			dly->lp2 = 0;
+		if( silent && !dly->lp )
+			dly->lp0 = dly->lp1 = 0;
 
-			paint->left = CLIP( paint->left + val );
-			paint->right = CLIP( paint->right + val );
-		}
-		else
+		memcpy( dly->lpdelayline + dly->idelayinput, dsp_value, n * sizeof( int ));
+
+		for( i = 0; i < n; i++ )
 		{
-			dly->lpdelayline[dly->idelayinput] = 0;
-			dly->lp0 = dly->lp1 = dly->lp2 = 0;
+			active = dsp_delay[i] | paint[i].left | paint[i].right;
+			val = dsp_value[i] >> 2;
+			paint[i].left = active ? CLIP( paint[i].left + val ) : paint[i].left;
+			paint[i].right = active ? CLIP( paint[i].right + val ) : paint[i].right;
 		}
 
-		DLY_MovePointer( dly );
+		DLY_MoveBlock( dly, n );
 	}
 }
 
@@ -700,6 +881,58 @@ int RVB_DoReverbForOneDly( dly_t *dly, const int vlr, const portable_samplepair_
 
 }
 
+/*
+===========
+RVB_DoReverbBlock
+
+RVB_DoReverbForOneDly for a block of samples, modulated
+delay lines never crossfade so the whole block goes at once
+===========
+*/
+static void RVB_DoReverbBlock( dly_t *dly, const int *vlr, const portable_samplepair_t *paint, int *out, int count )
+{
+	int	i, n, val, active, silent;
+
+	for( ; count > 0; count -= n, vlr += n, paint += n, out += n )
+	{
+		n = DLY_BlockSize( dly, count );
+		memcpy( dsp_delay, dly->lpdelayline + dly->idelayoutput, n * sizeof( int ));
+
+		// dsp_value[0] is the lowpass history
+		dsp_value[0] = dly->lp0;
+
+		for( i = 0, silent = 0; i < n; i++ )
+		{
+			active = dsp_delay[i] | paint[i].left | paint[i].right;
+			val = vlr[i] + (( dly->delayfeedback * dsp_delay[i] ) >> 8 );
+			val = dsp_delay[i] ? CLIP( val ) : vlr[i];
+			dsp_value[i + 1] = active ? val : 0;
+			silent |= !active;
+		}
+
+		if( dly->lp )
+		{
+			for( i = 0; i < n; i++ )
+			{
+				active = dsp_delay[i] | paint[i].left | paint[i].right;
+				out[i] = active ? ( dsp_value[i] + dsp_value[i + 1] ) >> 1 : 0;
+			}
+
+			dly->lp0 = dsp_value[n];
+		}
+		else
+		{
+			memcpy( out, dsp_value + 1, n * sizeof( int ));
+
+			if( silent )
+				dly->lp0 = 0;
+		}
+
+		memcpy( dly->lpdelayline + dly->idelayinput, out, n * sizeof( int ));
+		DLY_MoveBlock( dly, n );
+	}
+}
+
 /*
 ===========
 RVB_DoReverb
@@ -712,27 +945,203 @@ void RVB_DoReverb( int count )
 	dly_t *const		dly1 = &rgsxdly[REVERBPOS];
 	dly_t *const		dly2 = &rgsxdly[REVERBPOS+1];
 	portable_samplepair_t	*paint = paintto;
-	int			vlr, voutm;
+	qboolean			alpha = dsp_coeff_table->value == 1.0f;
+	int			i, n, vlr, voutm;
 
 	if( !dly1->lpdelayline )
 		return;
 
-	for( ; count; count--, paint++ )
+	while( count > 0 )
 	{
-		vlr = ( paint->left + paint->right ) >> 1;
+		// crossfading delay lines are done per sample
+		if( !dsp_block->value || dly1->xfade || !dly1->mod || dly2->xfade || !dly2->mod )
+		{
+			vlr = ( paint->left + paint->right ) >> 1;
+
+			voutm = RVB_DoReverbForOneDly( dly1, vlr, paint );
+			voutm += RVB_DoReverbForOneDly( dly2, vlr, paint );
 
-		voutm = RVB_DoReverbForOneDly( dly1, vlr, paint );
-		voutm += RVB_DoReverbForOneDly( dly2, vlr, paint );
+			if( alpha )
+				voutm /= 6;
+			else voutm = (11 * voutm) >> 6;
+
+			paint->left = CLIP( paint->left + voutm );
+			paint->right = CLIP( paint->right + voutm );
+
+			paint++;
+			count--;
+			continue;
+		}
+
+		n = Q_min( count, DSP_BLOCK );
+
+		for( i = 0; i < n; i++ )
+			dsp_vlr[i] = ( paint[i].left + paint[i].right ) >> 1;
+
+		RVB_DoReverbBlock( dly1, dsp_vlr, paint, dsp_out[0], n );
+		RVB_DoReverbBlock( dly2, dsp_vlr, paint, dsp_out[1], n );
+
+		for( i = 0; i < n; i++ )
+		{
+			voutm = dsp_out[0][i] + dsp_out[1][i];
 
-		if( dsp_coeff_table->value == 1.0f )
-			voutm /= 6; // alpha
-		else voutm = (11 * voutm) >> 6;
+			if( alpha )
+				voutm /= 6; // alpha
+			else voutm = (11 * voutm) >> 6;
 
-		paint->left = CLIP( paint->left + voutm );
-		paint->right = CLIP( paint->right + voutm );
+			paint[i].left = CLIP( paint[i].left + voutm );
+			paint[i].right = CLIP( paint[i].right + voutm );
+		}
+
+		paint += n;
+		count -= n;
 	}
 }
 
+/*
+===========
+RVB_AModLowpass
+
+lowpass part of amplification modulation for one sample
+===========
+*/
+static void RVB_AModLowpass( portable_samplepair_t *res, const portable_samplepair_t *paint )
+{
+	res->left  = rgsxlp[0] + rgsxlp[1] + rgsxlp[2] + rgsxlp[3] + rgsxlp[4] + res->left;
+	res->right = rgsxlp[5] + rgsxlp[6] + rgsxlp[7] + rgsxlp[8] + rgsxlp[9] + res->right;
+
+	res->left >>= 2;
+	res->right >>= 2;
+
+	rgsxlp[4] = paint->left;
+	rgsxlp[9] = paint->right;
+
+	rgsxlp[0] = rgsxlp[1];
+	rgsxlp[1] = rgsxlp[2];
+	rgsxlp[2] = rgsxlp[3];
+	rgsxlp[3] = rgsxlp[4];
+	rgsxlp[4] = rgsxlp[5];
+	rgsxlp[5] = rgsxlp[6];
+	rgsxlp[6] = rgsxlp[7];
+	rgsxlp[7] = rgsxlp[8];
+	rgsxlp[8] = rgsxlp[9];
+}
+
+/*
+===========
+RVB_AModModulate
+
+modulation part of amplification modulation for one sample
+===========
+*/
+static void RVB_AModModulate( portable_samplepair_t *res )
+{
+	if( --sxmod1cur < 0 )
+		sxmod1cur = sxmod1;
+
+	if( !sxmod1 )
+		sxamodlt = COM_RandomLong( 32, 255 );
+
+	if( --sxmod2cur < 0 )
+		sxmod2cur = sxmod2;
+
+	if( !sxmod2 )
+		sxamodrt = COM_RandomLong( 32, 255 );
+
+	res->left = (sxamodl * res->left) >> 8;
+	res->right = (sxamodr * res->right) >> 8;
+
+	if( sxamodl < sxamodlt )
+		sxamodl++;
+	else if( sxamodl > sxamodlt )
+		sxamodl--;
+
+	if( sxamodr < sxamodrt )
+		sxamodr++;
+	else if( sxamodr > sxamodrt )
+		sxamodr--;
+}
+
+/*
+===========
+RVB_AModLowpassBlock
+
+lowpass history shifts out after five samples, the
+rest of the block is a plain FIR over paint buffer
+(right channel leaks into the left one by rgsxlp[4])
+===========
+*/
+static void RVB_AModLowpassBlock( const portable_samplepair_t *paint, int count )
+{
+	portable_samplepair_t	res;
+	int			i, head = Q_min( count, 5 );
+
+	for( i = 0; i < head; i++ )
+	{
+		res.left = dsp_left[i];
+		res.right = dsp_right[i];
+		RVB_AModLowpass( &res, &paint[i] );
+		dsp_left[i] = res.left;
+		dsp_right[i] = res.right;
+	}
+
+	if( count <= 5 )
+		return;
+
+	for( i = 5; i < count; i++ )
+	{
+		dsp_left[i] = ( paint[i].left + paint[i-1].left + paint[i-2].left + paint[i-3].left + paint[i-4].left + paint[i-5].right ) >> 2;
+		dsp_right[i] = ( paint[i].right + 2 * paint[i-1].right + paint[i-2].right + paint[i-3].right + paint[i-4].right ) >> 2;
+	}
+
+	rgsxlp[0] = paint[count-4].left;
+	rgsxlp[1] = paint[count-3].left;
+	rgsxlp[2] = paint[count-2].left;
+	rgsxlp[3] = paint[count-1].left;
+	rgsxlp[4] = paint[count-5].right;
+	rgsxlp[5] = paint[count-4].right;
+	rgsxlp[6] = paint[count-3].right;
+	rgsxlp[7] = paint[count-2].right;
+	rgsxlp[8] = paint[count-1].right;
+	rgsxlp[9] = paint[count-1].right;
+}
+
+/*
+===========
+RVB_AModModulateBlock
+
+once the gains reached their targets it's a constant
+multiply, ramps and random targets go per sample
+===========
+*/
+static void RVB_AModModulateBlock( int count )
+{
+	portable_samplepair_t	res;
+	int			i;
+
+	if( sxamodl != sxamodlt || sxamodr != sxamodrt || !sxmod1 || !sxmod2 )
+	{
+		for( i = 0; i < count; i++ )
+		{
+			res.left = dsp_left[i];
+			res.right = dsp_right[i];
+			RVB_AModModulate( &res );
+			dsp_left[i] = res.left;
+			dsp_right[i] = res.right;
+		}
+		return;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		dsp_left[i] = ( sxamodl * dsp_left[i] ) >> 8;
+		dsp_right[i] = ( sxamodr * dsp_right[i] ) >> 8;
+	}
+
+	sxmod1cur = DSP_CountDown( sxmod1cur, sxmod1, count );
+	sxmod2cur = DSP_CountDown( sxmod2cur, sxmod2, count );
+}
+
 /*
 ===========
 RVB_DoAMod
@@ -743,69 +1152,73 @@ Do amplification modulation processing
 void RVB_DoAMod( int count )
 {
 	portable_samplepair_t	*paint = paintto;
+	qboolean			lowpass = sxmod_lowpass->value != 0.0f;
+	qboolean			modulate = sxmod_mod->value != 0.0f;
+	int			i, n;
 
-	if( !sxmod_lowpass->value && !sxmod_mod->value )
+	if( !lowpass && !modulate )
 		return;
 
-	for( ; count; count--, paint++ )
+	if( !dsp_block->value )
 	{
-		portable_samplepair_t	res = *paint;
-
-		if( sxmod_lowpass->value )
+		for( ; count; count--, paint++ )
 		{
-			res.left  = rgsxlp[0] + rgsxlp[1] + rgsxlp[2] + rgsxlp[3] + rgsxlp[4] + res.left;
-			res.right = rgsxlp[5] + rgsxlp[6] + rgsxlp[7] + rgsxlp[8] + rgsxlp[9] + res.right;
-
-			res.left >>= 2;
-			res.right >>= 2;
-
-			rgsxlp[4] = paint->left;
-			rgsxlp[9] = paint->right;
-
-			rgsxlp[0] = rgsxlp[1];
-			rgsxlp[1] = rgsxlp[2];
-			rgsxlp[2] = rgsxlp[3];
-			rgsxlp[3] = rgsxlp[4];
-			rgsxlp[4] = rgsxlp[5];
-			rgsxlp[5] = rgsxlp[6];
-			rgsxlp[6] = rgsxlp[7];
-			rgsxlp[7] = rgsxlp[8];
-			rgsxlp[8] = rgsxlp[9];
-		}
+			portable_samplepair_t	res = *paint;
 
-		if( sxmod_mod->value )
-		{
-			if( --sxmod1cur < 0 )
-				sxmod1cur = sxmod1;
+			if( lowpass )
+				RVB_AModLowpass( &res, paint );
 
-			if( !sxmod1 )
-				sxamodlt = COM_RandomLong( 32, 255 );
+			if( modulate )
+				RVB_AModModulate( &res );
 
-			if( --sxmod2cur < 0 )
-				sxmod2cur = sxmod2;
+			paint->left = CLIP(res.left);
+			paint->right = CLIP(res.right);
+		}
+		return;
+	}
 
-			if( !sxmod2 )
-				sxamodrt = COM_RandomLong( 32, 255 );
+	for( ; count > 0; count -= n, paint += n )
+	{
+		n = Q_min( count, DSP_BLOCK );
+
+		for( i = 0; i < n; i++ )
+		{
+			dsp_left[i] = paint[i].left;
+			dsp_right[i] = paint[i].right;
+		}
 
-			res.left = (sxamodl * res.left) >> 8;
-			res.right = (sxamodr * res.right) >> 8;
+		if( lowpass )
+			RVB_AModLowpassBlock( paint, n );
 
-			if( sxamodl < sxamodlt )
-				sxamodl++;
-			else if( sxamodl > sxamodlt )
-				sxamodl--;
+		if( modulate )
+			RVB_AModModulateBlock( n );
 
-			if( sxamodr < sxamodrt )
-				sxamodr++;
-			else if( sxamodr > sxamodrt )
-				sxamodr--;
+		for( i = 0; i < n; i++ )
+		{
+			paint[i].left = CLIP( dsp_left[i] );
+			paint[i].right = CLIP( dsp_right[i] );
 		}
-
-		paint->left = CLIP(res.left);
-		paint->right = CLIP(res.right);
 	}
 }
 
+/*
+===========
+SX_ProcessRoom
+
+run installed room preset over the buffer
+===========
+*/
+static void SX_ProcessRoom( portable_samplepair_t *pbfront, int sampleCount )
+{
+	// preset is already installed by CheckNewDspPresets
+	paintto = pbfront;
+
+	RVB_DoAMod( sampleCount );
+	RVB_DoReverb( sampleCount );
+	DLY_DoDelay( sampleCount );
+	DLY_DoStereoDelay( sampleCount );
+}
+
 /*
 ===========
 DSP_Process
@@ -822,13 +1235,7 @@ void DSP_Process( int idsp, portable_samplepair_t *pbfront, int sampleCount )
 	if( cls.key_dest == key_menu || !sampleCount )
 		return;
 
-	// preset is already installed by CheckNewDspPresets
-	paintto = pbfront;
-
-	RVB_DoAMod( sampleCount );
-	RVB_DoReverb( sampleCount );
-	DLY_DoDelay( sampleCount );
-	DLY_DoStereoDelay( sampleCount );
+	SX_ProcessRoom( pbfront, sampleCount );
 }
 
 /*
@@ -924,41 +1331,205 @@ void CheckNewDspPresets( void )
 	ClearBits( sxste_delay->flags, FCVAR_CHANGED );
 }
 
+/*
+===========
+SX_ResetRoom
+
+drop all room state and install the preset from scratch,
+so every profiling or test run starts at the same point
+===========
+*/
+static void SX_ResetRoom( int room )
+{
+	int	i;
+
+	for( i = 0; i < MAXDLY; i++ )
+		DLY_Free( i );
+
+	memset( rgsxdly, 0, sizeof( rgsxdly ));
+	memset( rgsxlp,  0, sizeof( rgsxlp  ));
+
+	sxamodr = sxamodl = sxamodrt = sxamodlt = 255;
+	sxmod1cur = sxmod1;
+	sxmod2cur = sxmod2;
+
+	Cvar_SetValue( "room_type", room );
+	room_typeprev = -1;
+
+	SX_ReloadRoomFX();
+	SetBits( sxrvb_size->flags, FCVAR_CHANGED );
+	CheckNewDspPresets();
+}
+
+/*
+===========
+SX_ProfileRoom
+
+returns nanoseconds per sample
+===========
+*/
+static double SX_ProfileRoom( int room, qboolean block, const portable_samplepair_t *src, portable_samplepair_t *dst, int count, int calls )
+{
+	double	start;
+	int	i;
+
+	Cvar_SetValue( "dsp_block", block );
+	SX_ResetRoom( room );
+
+	start = Sys_DoubleTime();
+
+	for( i = 0; i < calls; i++ )
+	{
+		memcpy( dst, src, count * sizeof( *dst ));
+		SX_ProcessRoom( dst, count );
+	}
+
+	return ( Sys_DoubleTime() - start ) * 1e9 / ((double)calls * count );
+}
+
+// room settings the profile overwrites, room_type goes first
+static const char *sx_roomcvars[] =
+{
+	"room_type", "dsp_block", "room_lp", "room_mod", "room_size", "room_refl",
+	"room_rvblp", "room_delay", "room_feedback", "room_dlylp", "room_left",
+};
+
+/*
+===========
+SX_Profiling_f
+
+dsp_profile [room_type]
+the mixer is kept away while the room state is replaced
+===========
+*/
 void SX_Profiling_f( void )
 {
-	portable_samplepair_t	testbuffer[512];
-	float			oldroom = room_type->value;
-	double			start, end;
-	int			i, calls;
+	portable_samplepair_t	source[512], testbuffer[512];
+	string			saved[ARRAYSIZE( sx_roomcvars )];
+	int			i, first, last, calls;
+	double			single, block;
+
+	if( dsp_off->value )
+	{
+		Con_Printf( "dsp_profile: DSP is disabled\n" );
+		return;
+	}
 
 	for( i = 0; i < 512; i++ )
 	{
-		testbuffer[i].left = COM_RandomLong( 0, 3000 );
-		testbuffer[i].right = COM_RandomLong( 0, 3000 );
+		source[i].left = COM_RandomLong( -3000, 3000 );
+		source[i].right = COM_RandomLong( -3000, 3000 );
 	}
 
 	if( Cmd_Argc() > 1 )
 	{
-		Cvar_SetValue( "room_type", Q_atof( Cmd_Argv( 1 )));
-		SX_ReloadRoomFX();
-		CheckNewDspPresets(); // we just need idsp_room immediately, for message below
+		first = last = bound( 0, Q_atoi( Cmd_Argv( 1 )), MAX_ROOM_TYPES - 1 );
+		calls = 10000;
+	}
+	else
+	{
+		first = 0;
+		last = MAX_ROOM_TYPES - 1;
+		calls = 1000;
 	}
 
-	Con_Printf( "Profiling 10000 calls to DSP. Sample count is 512, room_type is %i\n", idsp_room );
+	for( i = 0; i < ARRAYSIZE( sx_roomcvars ); i++ )
+		Q_strncpy( saved[i], Cvar_VariableString( sx_roomcvars[i] ), sizeof( saved[i] ));
 
-	start = Sys_DoubleTime();
-	for( calls = 10000; calls; calls-- )
+	S_LockMixer();
+
+	Con_Printf( "Profiling %i calls to DSP. Sample count is 512\n", calls );
+	Con_Printf( "room  per-sample   block  (ns/sample)\n" );
+
+	for( i = first; i <= last; i++ )
 	{
-		DSP_Process( idsp_room, testbuffer, 512 );
+		single = SX_ProfileRoom( i, false, source, testbuffer, 512, calls );
+		block = SX_ProfileRoom( i, true, source, testbuffer, 512, calls );
+
+		Con_Printf( "%4i  %10.2f  %6.2f  %.2fx\n", i, single, block, single / Q_max( block, 0.001 ));
 	}
-	end = Sys_DoubleTime();
 
-	Con_Printf( "----------\nTook %g seconds.\n", end - start );
+	// preset first, then whatever the user had changed on top of it
+	SX_ResetRoom( Q_atoi( saved[0] ));
+	for( i = 1; i < ARRAYSIZE( sx_roomcvars ); i++ )
+		Cvar_Set( sx_roomcvars[i], saved[i] );
+	CheckNewDspPresets();
 
-	if( Cmd_Argc() > 1 )
+	S_UnlockMixer();
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define DSP_TEST_SAMPLES	16384
+#define DSP_TEST_TOLERANCE	1
+
+static void SX_TestRoom( int room, qboolean block, const portable_samplepair_t *src, portable_samplepair_t *dst )
+{
+	// uneven chunks, as the mixer gives them
+	static const int	chunks[] = { 1, 7, 64, 300, 5, 512, 33, 1024 };
+	int		i, n, pos;
+
+	Cvar_SetValue( "dsp_block", block );
+	COM_SetRandomSeed( 1 );
+	SX_ResetRoom( room );
+
+	memcpy( dst, src, DSP_TEST_SAMPLES * sizeof( *dst ));
+
+	for( i = pos = 0; pos < DSP_TEST_SAMPLES; i++, pos += n )
 	{
-		Cvar_SetValue( "room_type", oldroom );
-		SX_ReloadRoomFX();
-		CheckNewDspPresets();
+		n = Q_min( chunks[i % ARRAYSIZE( chunks )], DSP_TEST_SAMPLES - pos );
+		SX_ProcessRoom( dst + pos, n );
 	}
 }
+
+void Test_RunSoundDSP( void )
+{
+	static const int	rooms[] = { 1, 2, 5, 8, 11, 14, 17, 19, 23, 26, 28 };
+	static portable_samplepair_t	src[DSP_TEST_SAMPLES], ref[DSP_TEST_SAMPLES], out[DSP_TEST_SAMPLES];
+	int	i, j, diff = 0;
+
+	SX_Init();
+
+	// noise past the clipping range with silent gaps in it
+	COM_SetRandomSeed( 1 );
+	for( i = 0; i < DSP_TEST_SAMPLES; i++ )
+	{
+		if(( i / 1000 ) % 3 == 2 )
+		{
+			src[i].left = src[i].right = 0;
+			continue;
+		}
+
+		src[i].left = COM_RandomLong( -40000, 40000 );
+		src[i].right = COM_RandomLong( -40000, 40000 );
+	}
+
+	for( i = 0; i < ARRAYSIZE( rooms ); i++ )
+	{
+		SX_TestRoom( rooms[i], false, src, ref );
+		SX_TestRoom( rooms[i], true, src, out );
+
+		for( j = 0; j < DSP_TEST_SAMPLES; j++ )
+		{
+			diff = Q_max( diff, abs( ref[j].left - out[j].left ));
+			diff = Q_max( diff, abs( ref[j].right - out[j].right ));
+		}
+	}
+
+	TASSERT( diff <= DSP_TEST_TOLERANCE );
+
+	// profiling puts back the room as the user had set it up
+	SX_ResetRoom( 5 );
+	Cvar_SetValue( "dsp_block", 0.0f );
+	Cvar_SetValue( "room_size", 0.125f );
+	Cmd_TokenizeString( "dsp_profile 3" );
+	SX_Profiling_f();
+	TASSERT( room_type->value == 5.0f && dsp_block->value == 0.0f && sxrvb_size->value == 0.125f );
+
+	Cvar_SetValue( "dsp_block", 1.0f );
+	SX_ResetRoom( 0 );
+	SX_Free();
+	COM_SetRandomSeed( 0 );
+}
+#endif /* XASH_ENGINE_TESTS */
@@ -30,6 +30,8 @@ static string	s_sentenceImmediateName;	// keep dummy sentence name
 qboolean		s_registering = false;
 int		s_registration_sequence = 0;
 
+CVAR_DEFINE_AUTO( snd_resample, "0", FCVAR_ARCHIVE|FCVAR_FILTERABLE, "resample sounds to the output rate when they are loaded, takes up to 4x memory" );
+
 /*
 =================
 S_SoundList_f
@@ -151,7 +153,10 @@ wavdata_t *S_LoadSound( sfx_t *sfx )
 
 	if( !sc ) sc = S_CreateDefaultSound();
 
-	if( sc->rate < SOUND_11k ) // some bad sounds
+	// mixed straight at the output rate, 11k and 22k passes are skipped
+	if( snd_resample.value && sc->rate != SOUND_DMA_SPEED )
+		Sound_Process( &sc, SOUND_DMA_SPEED, sc->width, SOUND_RESAMPLE );
+	else if( sc->rate < SOUND_11k ) // some bad sounds
 		Sound_Process( &sc, SOUND_11k, sc->width, SOUND_RESAMPLE );
 	else if( sc->rate > SOUND_11k && sc->rate < SOUND_22k ) // some bad sounds
 		Sound_Process( &sc, SOUND_22k, sc->width, SOUND_RESAMPLE );
@@ -303,6 +308,8 @@ void S_EndRegistration( void )
 	if( !s_registering || !dma.initialized )
 		return;
 
+	S_LockMixer();
+
 	// free any sounds not from this registration sequence
 	for( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ )
 	{
@@ -313,6 +320,8 @@ void S_EndRegistration( void )
 			S_FreeSound( sfx ); // don't need this sound
 	}
 
+	S_UnlockMixer();
+
 	// load everything in
 	for( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ )
 	{
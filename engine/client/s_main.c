@@ -23,8 +23,10 @@ GNU General Public License for more details.
 #define SND_CLIP_DISTANCE		1000.0f
 
 dma_t		dma;
+qboolean		s_nulldevice;	// mix into s_null.c device instead of the platform one
 poolhandle_t sndpool;
 static soundfade_t	soundfade;
+static mixstats_t	s_mixstats;
 channel_t   	channels[MAX_CHANNELS];
 sound_t		ambient_sfx[NUM_AMBIENTS];
 rawchan_t		*raw_channels[MAX_RAW_CHANNELS];
@@ -429,8 +431,6 @@ void SND_Spatialize( channel_t *ch )
 {
 	vec3_t	source_vec;
 	float	dist, dot, gain = 1.0f;
-	qboolean	looping = false;
-	wavdata_t	*pSource;
 
 	// anything coming from the view entity will allways be full volume
 	if( S_IsClient( ch->entnum ))
@@ -440,11 +440,6 @@ void SND_Spatialize( channel_t *ch )
 		return;
 	}
 
-	pSource = ch->sfx->cache;
-
-	if( ch->use_loop && pSource && pSource->loopStart != -1 )
-		looping = true;
-
 	if( !ch->staticsound )
 	{
 		if( !CL_GetEntitySpatialization( ch ))
@@ -491,11 +486,8 @@ SV_StartSound.
 */
 void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags )
 {
-	wavdata_t	*pSource;
 	sfx_t	*sfx = NULL;
-	channel_t	*target_chan, *check;
-	int	vol, ch_idx;
-	qboolean	bIgnore = false;
+	int	vol;
 
 	if( !dma.initialized ) return;
 	sfx = S_GetSfxByHandle( handle );
@@ -504,6 +496,82 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 	vol = bound( 0, fvol * 255, 255 );
 	if( pitch <= 1 ) pitch = PITCH_NORM; // Invasion issues
 
+	if( !pos ) pos = refState.vieworg;
+
+	// sentences and sounds not loaded yet are started here,
+	// the mixing thread must not touch the filesystem
+	if( FBitSet( flags, SND_STOP ) || ( sfx->cache && !S_TestSoundChar( sfx->name, '!' )))
+	{
+		if( S_QueueSound( pos, ent, chan, sfx, vol, attn, pitch, flags ))
+			return;
+	}
+
+	S_LockMixer();
+	SND_StartSound( pos, ent, chan, sfx, vol, attn, pitch, flags );
+	S_UnlockMixer();
+}
+
+/*
+====================
+SND_SetupChannel
+====================
+*/
+static void SND_SetupChannel( channel_t *ch, const vec3_t pos, int ent, int chan, sfx_t *sfx, int vol, float attn, int pitch, int flags )
+{
+	memset( ch, 0, sizeof( *ch ));
+
+	VectorCopy( pos, ch->origin );
+	ch->staticsound = ( ent == 0 ) ? true : false;
+	ch->use_loop = (flags & SND_STOP_LOOPING) ? false : true;
+	ch->localsound = (flags & SND_LOCALSOUND) ? true : false;
+	ch->dist_mult = (attn / SND_CLIP_DISTANCE);
+	ch->master_vol = vol;
+	ch->entnum = ent;
+	ch->entchannel = chan;
+	ch->basePitch = pitch;
+	ch->isSentence = false;
+	ch->sfx = sfx;
+}
+
+/*
+====================
+SND_SpatializeCommand
+
+entity origins and the listener belong to the game thread,
+so it works out volumes of a sound sent to the mixing thread
+====================
+*/
+void SND_SpatializeCommand( sndcmd_t *cmd )
+{
+	channel_t	ch;
+	int	flags = cmd->flags;
+
+	if( cmd->chan == CHAN_STREAM )
+		SetBits( flags, SND_STOP_LOOPING );
+
+	SND_SetupChannel( &ch, cmd->pos, cmd->ent, cmd->chan, cmd->sfx, cmd->vol, cmd->attn, cmd->pitch, flags );
+	SND_Spatialize( &ch );
+
+	VectorCopy( ch.origin, cmd->pos );
+	cmd->leftvol = ch.leftvol;
+	cmd->rightvol = ch.rightvol;
+}
+
+/*
+====================
+SND_StartChannel
+
+spatial holds volumes computed by the
+game thread, NULL to spatialize here
+====================
+*/
+static void SND_StartChannel( const vec3_t pos, int ent, int chan, sfx_t *sfx, int vol, float attn, int pitch, int flags, const sndcmd_t *spatial )
+{
+	wavdata_t	*pSource;
+	channel_t	*target_chan, *check;
+	int	ch_idx;
+	qboolean	bIgnore = false;
+
 	if( flags & ( SND_STOP|SND_CHANGE_VOL|SND_CHANGE_PITCH ))
 	{
 		if( S_AlterChannel( ent, chan, sfx, vol, pitch, flags ))
@@ -514,8 +582,6 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 		// and we didn't find it (it's not playing), go ahead and start it up
 	}
 
-	if( !pos ) pos = refState.vieworg;
-
 	if( chan == CHAN_STREAM )
 		SetBits( flags, SND_STOP_LOOPING );
 
@@ -531,19 +597,7 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 	}
 
 	// spatialize
-	memset( target_chan, 0, sizeof( *target_chan ));
-
-	VectorCopy( pos, target_chan->origin );
-	target_chan->staticsound = ( ent == 0 ) ? true : false;
-	target_chan->use_loop = (flags & SND_STOP_LOOPING) ? false : true;
-	target_chan->localsound = (flags & SND_LOCALSOUND) ? true : false;
-	target_chan->dist_mult = (attn / SND_CLIP_DISTANCE);
-	target_chan->master_vol = vol;
-	target_chan->entnum = ent;
-	target_chan->entchannel = chan;
-	target_chan->basePitch = pitch;
-	target_chan->isSentence = false;
-	target_chan->sfx = sfx;
+	SND_SetupChannel( target_chan, pos, ent, chan, sfx, vol, attn, pitch, flags );
 
 	pSource = NULL;
 
@@ -572,7 +626,13 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 		return;
 	}
 
-	SND_Spatialize( target_chan );
+	if( spatial )
+	{
+		target_chan->leftvol = spatial->leftvol;
+		target_chan->rightvol = spatial->rightvol;
+		VOX_SetChanVol( target_chan );
+	}
+	else SND_Spatialize( target_chan );
 
 	// If a client can't hear a sound when they FIRST receive the StartSound message,
 	// the client will never be able to hear that sound. This is so that out of
@@ -611,12 +671,37 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 
 /*
 ====================
-S_RestoreSound
+SND_StartSound
+
+S_StartSound with sound resolved and volume converted
+====================
+*/
+void SND_StartSound( const vec3_t pos, int ent, int chan, sfx_t *sfx, int vol, float attn, int pitch, int flags )
+{
+	SND_StartChannel( pos, ent, chan, sfx, vol, attn, pitch, flags, NULL );
+}
+
+/*
+====================
+SND_StartQueuedSound
+
+sound sent to the mixing thread, doesn't read
+entity origins or the listener the game thread writes
+====================
+*/
+void SND_StartQueuedSound( const sndcmd_t *cmd )
+{
+	SND_StartChannel( cmd->pos, cmd->ent, cmd->chan, cmd->sfx, cmd->vol, cmd->attn, cmd->pitch, cmd->flags, cmd );
+}
+
+/*
+====================
+SND_RestoreSound
 
 Restore a sound effect for the given entity on the given channel
 ====================
 */
-void S_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags, double sample, double end, int wordIndex )
+static void SND_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags, double sample, double end, int wordIndex )
 {
 	wavdata_t	*pSource;
 	sfx_t	*sfx = NULL;
@@ -715,9 +800,16 @@ void S_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float
 	SND_InitMouth( ent, chan );
 }
 
+void S_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags, double sample, double end, int wordIndex )
+{
+	S_LockMixer();
+	SND_RestoreSound( pos, ent, chan, handle, fvol, attn, pitch, flags, sample, end, wordIndex );
+	S_UnlockMixer();
+}
+
 /*
 =================
-S_AmbientSound
+SND_AmbientSound
 
 Start playback of a sound, loaded into the static portion of the channel array.
 Currently, this should be used for looping ambient sounds, looping sounds
@@ -729,7 +821,7 @@ Pitch changes playback pitch of wave by % above or below 100.  Ignored if pitch
 NOTE: volume is 0.0 - 1.0 and attenuation is 0.0 - 1.0 when passed in.
 =================
 */
-void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, float attn, int pitch, int flags )
+static void SND_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, float attn, int pitch, int flags )
 {
 	channel_t	*ch;
 	wavdata_t	*pSource = NULL;
@@ -800,6 +892,13 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 	SND_Spatialize( ch );
 }
 
+void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, float attn, int pitch, int flags )
+{
+	S_LockMixer();
+	SND_AmbientSound( pos, ent, handle, fvol, attn, pitch, flags );
+	S_UnlockMixer();
+}
+
 /*
 ==================
 S_StartLocalSound
@@ -833,6 +932,8 @@ int S_GetCurrentStaticSounds( soundlist_t *pout, int size )
 	if( !dma.initialized )
 		return 0;
 
+	S_LockMixer();
+
 	for( i = MAX_DYNAMIC_CHANNELS; i < total_channels && sounds_left; i++ )
 	{
 		if( channels[i].entchannel == CHAN_STATIC && channels[i].sfx && channels[i].sfx->name[0] )
@@ -856,6 +957,8 @@ int S_GetCurrentStaticSounds( soundlist_t *pout, int size )
 		}
 	}
 
+	S_UnlockMixer();
+
 	return ( size - sounds_left );
 }
 
@@ -874,6 +977,8 @@ int S_GetCurrentDynamicSounds( soundlist_t *pout, int size )
 	if( !dma.initialized )
 		return 0;
 
+	S_LockMixer();
+
 	for( i = 0; i < MAX_CHANNELS && sounds_left; i++ )
 	{
 		if( !channels[i].sfx || !channels[i].sfx->name[0] || !Q_stricmp( channels[i].sfx->name, "*default" ))
@@ -902,6 +1007,8 @@ int S_GetCurrentDynamicSounds( soundlist_t *pout, int size )
 		pout++;
 	}
 
+	S_UnlockMixer();
+
 	return ( size - sounds_left );
 }
 
@@ -1161,7 +1268,7 @@ void S_RawSamples( uint samples, uint rate, word width, word channels, const byt
 S_PositionedRawSamples
 ===================
 */
-void S_StreamAviSamples( void *Avi, int entnum, float fvol, float attn, float synctime )
+static void SND_StreamAviSamples( void *Avi, int entnum, float fvol, float attn, float synctime )
 {
 	int	bufferSamples;
 	int	fileSamples;
@@ -1236,6 +1343,13 @@ void S_StreamAviSamples( void *Avi, int entnum, float fvol, float attn, float sy
 	}
 }
 
+void S_StreamAviSamples( void *Avi, int entnum, float fvol, float attn, float synctime )
+{
+	S_LockMixer();
+	SND_StreamAviSamples( Avi, entnum, fvol, attn, synctime );
+	S_UnlockMixer();
+}
+
 /*
 ===================
 S_GetRawSamplesLength
@@ -1387,6 +1501,29 @@ static void S_FreeRawChannels( void )
 
 //=============================================================================
 
+/*
+==================
+S_BeginPainting
+==================
+*/
+static void S_BeginPainting( void )
+{
+	if( s_nulldevice )
+		SNDNULL_BeginPainting();
+	else SNDDMA_BeginPainting();
+}
+
+/*
+==================
+S_Submit
+==================
+*/
+static void S_Submit( void )
+{
+	if( !s_nulldevice )
+		SNDDMA_Submit();
+}
+
 /*
 ==================
 S_ClearBuffer
@@ -1396,9 +1533,9 @@ void S_ClearBuffer( void )
 {
 	S_ClearRawChannels();
 
-	SNDDMA_BeginPainting ();
+	S_BeginPainting ();
 	if( dma.buffer ) memset( dma.buffer, 0, dma.samples * 2 );
-	SNDDMA_Submit ();
+	S_Submit ();
 
 	MIX_ClearAllPaintBuffers( PAINTBUFFER_SIZE, true );
 }
@@ -1416,6 +1553,11 @@ void GAME_EXPORT S_StopSound( int entnum, int channel, const char *soundname )
 
 	if( !dma.initialized ) return;
 	sfx = S_FindName( soundname, NULL );
+	if( !sfx ) return;
+
+	if( S_QueueSound( vec3_origin, entnum, channel, sfx, 0, 0.0f, 0, SND_STOP ))
+		return;
+
 	S_AlterChannel( entnum, channel, sfx, 0, 0, SND_STOP );
 }
 
@@ -1429,6 +1571,9 @@ void S_StopAllSounds( qboolean ambient )
 	int	i;
 
 	if( !dma.initialized ) return;
+
+	S_LockMixer();
+
 	total_channels = MAX_DYNAMIC_CHANNELS;	// no statics
 
 	for( i = 0; i < MAX_CHANNELS; i++ )
@@ -1449,6 +1594,8 @@ void S_StopAllSounds( qboolean ambient )
 
 	// clear any remaining soundfade
 	memset( &soundfade, 0, sizeof( soundfade ));
+
+	S_UnlockMixer();
 }
 
 /*
@@ -1495,14 +1642,19 @@ void S_UpdateChannels( void )
 {
 	uint	endtime;
 	int	samps;
+	double	start, mixtime;
 
-	SNDDMA_BeginPainting();
+	S_BeginPainting();
 
 	if( !dma.buffer ) return;
 
 	// updates DMA time
 	soundtime = S_GetSoundtime();
 
+	// device played everything that was mixed
+	if( paintedtime < soundtime )
+		s_mixstats.underruns++;
+
 	// soundtime - total samples that have been played out to hardware at dmaspeed
 	// paintedtime - total samples that have been mixed at speed
 	// endtime - target for samples in mixahead buffer at speed
@@ -1519,9 +1671,15 @@ void S_UpdateChannels( void )
 		endtime -= ( endtime - paintedtime ) & 0x3;
 	}
 
+	start = Sys_DoubleTime();
 	MIX_PaintChannels( endtime );
+	mixtime = Sys_DoubleTime() - start;
+
+	s_mixstats.passes++;
+	s_mixstats.total += mixtime;
+	s_mixstats.peak = Q_max( s_mixstats.peak, mixtime );
 
-	SNDDMA_Submit();
+	S_Submit();
 }
 
 /*
@@ -1533,7 +1691,7 @@ Don't let sound skip if going slow
 */
 void S_ExtraUpdate( void )
 {
-	if( !dma.initialized ) return;
+	if( !dma.initialized || S_MixThreadActive( )) return;
 	S_UpdateChannels ();
 }
 
@@ -1549,9 +1707,11 @@ void S_UpdateFrame( struct ref_viewpass_s *rvp )
 	if( !FBitSet( rvp->flags, RF_DRAW_WORLD ) || FBitSet( rvp->flags, RF_ONLY_CLIENTDRAW ))
 		return;
 
+	S_LockMixer();
 	VectorCopy( rvp->vieworigin, s_listener.origin );
 	AngleVectors( rvp->viewangles, s_listener.forward, s_listener.right, s_listener.up );
 	s_listener.entnum = rvp->viewentity; // can be camera entity too
+	S_UnlockMixer();
 }
 
 /*
@@ -1569,6 +1729,11 @@ void SND_UpdateSound( void )
 
 	if( !dma.initialized ) return;
 
+	if( FBitSet( snd_mixthread.flags, FCVAR_CHANGED ))
+		S_UpdateMixThread();
+
+	S_LockMixer();
+
 	// if the loading plaque is up, clear everything
 	// out to make sure we aren't looping a dirty
 	// dma buffer while loading
@@ -1666,11 +1831,15 @@ void SND_UpdateSound( void )
 		Con_NXPrintf( &info, "room_type: %i (%s) ----(%i)---- painted: %i\n", idsp_room, Cvar_VariableString( "dsp_coeff_table" ), total - 1, paintedtime );
 	}
 
+	S_UnlockMixer();
+
+	// decoders lock the mixer only to hand samples over
 	S_StreamBackgroundTrack ();
 	S_StreamSoundTrack ();
 
-	// mix some sound
-	S_UpdateChannels ();
+	// mix some sound, unless the mixing thread does it
+	if( !S_MixThreadActive( ))
+		S_UpdateChannels ();
 }
 
 /*
@@ -1854,6 +2023,15 @@ void S_SoundInfo_f( void )
 	Con_Printf( "%5d bytes/sec\n", SOUND_DMA_SPEED );
 	Con_Printf( "%5d total_channels\n", total_channels );
 
+	if( s_mixstats.passes )
+	{
+		Con_Printf( "mixing: %.3f ms average, %.3f ms peak over %u passes, %u underruns\n",
+			s_mixstats.total * 1000.0 / s_mixstats.passes, s_mixstats.peak * 1000.0,
+			s_mixstats.passes, s_mixstats.underruns );
+	}
+
+	S_PrintMixThreadState();
+
 	S_PrintBackgroundTrackState ();
 }
 
@@ -1882,6 +2060,11 @@ qboolean S_Init( void )
 	Cvar_RegisterVariable( &s_test );
 	Cvar_RegisterVariable( &s_samplecount );
 	Cvar_RegisterVariable( &s_warn_late_precache );
+	Cvar_RegisterVariable( &snd_mixsimd );
+	Cvar_RegisterVariable( &snd_mixthread );
+	Cvar_RegisterVariable( &snd_resample );
+	Cvar_RegisterVariable( &snd_musicthread );
+	Cvar_RegisterVariable( &snd_musicahead );
 
 	Cmd_AddCommand( "play", S_Play_f, "playing a specified sound file" );
 	Cmd_AddCommand( "play2", S_Play2_f, "playing a group of specified sound files" ); // nehahra stuff
@@ -1895,8 +2078,14 @@ qboolean S_Init( void )
 	Cmd_AddCommand( "-voicerecord", Cmd_Null_f, "stop voice recording (non-implemented)" );
 	Cmd_AddCommand( "spk", S_SayReliable_f, "reliable play a specified sententce" );
 	Cmd_AddCommand( "speak", S_Say_f, "playing a specified sententce" );
+	Cmd_AddCommand( "snd_mixbench", S_MixBench_f, "measure channel mixing speed, scalar against vector kernels" );
+	Cmd_AddCommand( "snd_resamplebench", Sound_ResampleBench_f, "measure resampling quality and speed, nearest against polyphase sinc" );
+
+	// silent device clocked by the wall time
+	if( Sys_CheckParm( "-nullaudio" ))
+		s_nulldevice = true;
 
-	if( !SNDDMA_Init( ) )
+	if( !( s_nulldevice ? SNDNULL_Init( ) : SNDDMA_Init( )))
 	{
 		Con_Printf( "Audio: sound system can't be initialized\n" );
 		return false;
@@ -1915,6 +2104,7 @@ qboolean S_Init( void )
 	S_StopAllSounds ( true );
 	S_InitSounds ();
 	VOX_Init ();
+	S_UpdateMixThread ();
 
 	return true;
 }
@@ -1937,14 +2127,20 @@ void S_Shutdown( void )
 	Cmd_RemoveCommand( "-voicerecord" );
 	Cmd_RemoveCommand( "speak" );
 	Cmd_RemoveCommand( "spk" );
+	Cmd_RemoveCommand( "snd_mixbench" );
+	Cmd_RemoveCommand( "snd_resamplebench" );
 
+	S_ShutdownMixThread ();
+	S_StopBackgroundTrack ();
 	S_StopAllSounds (false);
 	S_FreeRawChannels ();
 	S_FreeSounds ();
 	VOX_Shutdown ();
 	SX_Free ();
 
-	SNDDMA_Shutdown ();
+	if( s_nulldevice )
+		SNDNULL_Shutdown ();
+	else SNDDMA_Shutdown ();
 	MIX_FreeAllPaintbuffers ();
 	Mem_FreePool( &sndpool );
 }
@@ -17,6 +17,19 @@ GNU General Public License for more details.
 #include "sound.h"
 #include "client.h"
 
+// vector kernels follow the compiler target, SSE2 is always there on amd64
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SND_MIX_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define SND_MIX_NEON	1
+#endif
+
+#if defined( SND_MIX_SSE2 ) || defined( SND_MIX_NEON )
+#define SND_MIX_SIMD	1
+#endif
+
 #define IPAINTBUFFER	0
 #define IROOMBUFFER		1
 #define ISTREAMBUFFER	2
@@ -41,6 +54,8 @@ paintbuffer_t		paintbuffers[CPAINTBUFFERS];
 
 int			snd_scaletable[SND_SCALE_LEVELS][256];
 
+CVAR_DEFINE_AUTO( snd_mixsimd, "1", FCVAR_ARCHIVE|FCVAR_FILTERABLE, "use SSE2/NEON channel mixing kernels when available" );
+
 void S_InitScaletable( void )
 {
 	int	i, j;
@@ -286,6 +301,389 @@ void S_PaintStereoFrom16( portable_samplepair_t *pbuf, int *volume, short *pData
 	}
 }
 
+/*
+===============================================================================
+
+VECTORIZED CHANNEL MIXING
+
+same results as the scalar functions above, bit for bit. 8-bit products
+fit in 16 bits, 16-bit ones are widened to 32 bits before the shift.
+pitch shifted channels gather their frames into a linear buffer first
+
+===============================================================================
+*/
+#define MIX_GATHER_SIZE	256	// frames gathered per pass for pitch shifted channels
+
+typedef struct
+{
+	int	frame;	// input frame index
+	uint	frac;	// fractional position, FIX_BITS
+	uint	rate;
+} mixstep_t;
+
+/*
+=================
+S_MixUseSIMD
+
+vector kernels are used when the target has them and snd_mixsimd is set
+=================
+*/
+static qboolean S_MixUseSIMD( void )
+{
+#ifdef SND_MIX_SIMD
+	return snd_mixsimd.value != 0.0f;
+#else
+	return false;
+#endif
+}
+
+/*
+=================
+S_MixGather
+
+copy count resampled frames of framesize bytes into out,
+stepping exactly like the scalar pitch shifting loops
+=================
+*/
+static void S_MixGather( void *out, const void *pData, int framesize, mixstep_t *step, int count )
+{
+	int	i;
+
+	switch( framesize )
+	{
+	case 1:
+		for( i = 0; i < count; i++ )
+		{
+			((byte *)out)[i] = ((const byte *)pData)[step->frame];
+			step->frac += step->rate;
+			step->frame += FIX_INTPART( step->frac );
+			step->frac = FIX_FRACPART( step->frac );
+		}
+		break;
+	case 2:
+		for( i = 0; i < count; i++ )
+		{
+			((word *)out)[i] = ((const word *)pData)[step->frame];
+			step->frac += step->rate;
+			step->frame += FIX_INTPART( step->frac );
+			step->frac = FIX_FRACPART( step->frac );
+		}
+		break;
+	case 4:
+		for( i = 0; i < count; i++ )
+		{
+			((uint *)out)[i] = ((const uint *)pData)[step->frame];
+			step->frac += step->rate;
+			step->frame += FIX_INTPART( step->frac );
+			step->frac = FIX_FRACPART( step->frac );
+		}
+		break;
+	}
+}
+
+#ifdef SND_MIX_SSE2
+// left/right volumes repeated over the interleaved lanes
+#define MIX_VOLUMES( l, r )		_mm_set_epi16( r, l, r, l, r, l, r, l )
+
+// sign extend low or high four 16-bit lanes to 32 bits
+#define MIX_EXTEND_LO( x )		_mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 )
+#define MIX_EXTEND_HI( x )		_mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 )
+
+// full 32-bit products of 16-bit lanes, shifted down like the scalar code
+#define MIX_PRODUCT_LO( lo, hi )	_mm_srai_epi32( _mm_unpacklo_epi16( lo, hi ), 8 )
+#define MIX_PRODUCT_HI( lo, hi )	_mm_srai_epi32( _mm_unpackhi_epi16( lo, hi ), 8 )
+
+// add two stereo pairs
+_inline void S_MixAddPairs( portable_samplepair_t *pbuf, __m128i pairs )
+{
+	__m128i	*p = (__m128i *)pbuf;
+
+	_mm_storeu_si128( p, _mm_add_epi32( _mm_loadu_si128( p ), pairs ));
+}
+
+static int S_PaintMonoFrom8SSE2( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	__m128i	vol, b, d, lo, hi;
+	int	i;
+
+	vol = MIX_VOLUMES(( volume[0] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT, ( volume[1] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT );
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		b = _mm_loadl_epi64( (const __m128i *)( pData + i ));
+		d = _mm_srai_epi16( _mm_unpacklo_epi8( b, b ), 8 );
+		lo = _mm_mullo_epi16( _mm_unpacklo_epi16( d, d ), vol );
+		hi = _mm_mullo_epi16( _mm_unpackhi_epi16( d, d ), vol );
+		S_MixAddPairs( pbuf + i + 0, MIX_EXTEND_LO( lo ));
+		S_MixAddPairs( pbuf + i + 2, MIX_EXTEND_HI( lo ));
+		S_MixAddPairs( pbuf + i + 4, MIX_EXTEND_LO( hi ));
+		S_MixAddPairs( pbuf + i + 6, MIX_EXTEND_HI( hi ));
+	}
+
+	return i;
+}
+
+static int S_PaintStereoFrom8SSE2( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	__m128i	vol, b, lo, hi;
+	int	i;
+
+	vol = MIX_VOLUMES(( volume[0] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT, ( volume[1] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT );
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		b = _mm_loadu_si128( (const __m128i *)( pData + i * 2 ));
+		lo = _mm_mullo_epi16( _mm_srai_epi16( _mm_unpacklo_epi8( b, b ), 8 ), vol );
+		hi = _mm_mullo_epi16( _mm_srai_epi16( _mm_unpackhi_epi8( b, b ), 8 ), vol );
+		S_MixAddPairs( pbuf + i + 0, MIX_EXTEND_LO( lo ));
+		S_MixAddPairs( pbuf + i + 2, MIX_EXTEND_HI( lo ));
+		S_MixAddPairs( pbuf + i + 4, MIX_EXTEND_LO( hi ));
+		S_MixAddPairs( pbuf + i + 6, MIX_EXTEND_HI( hi ));
+	}
+
+	return i;
+}
+
+static int S_PaintMonoFrom16SSE2( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	__m128i	vol, d, dd, lo, hi;
+	int	i;
+
+	vol = MIX_VOLUMES( volume[0], volume[1] );
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		d = _mm_loadu_si128( (const __m128i *)( pData + i ));
+
+		dd = _mm_unpacklo_epi16( d, d );
+		lo = _mm_mullo_epi16( dd, vol );
+		hi = _mm_mulhi_epi16( dd, vol );
+		S_MixAddPairs( pbuf + i + 0, MIX_PRODUCT_LO( lo, hi ));
+		S_MixAddPairs( pbuf + i + 2, MIX_PRODUCT_HI( lo, hi ));
+
+		dd = _mm_unpackhi_epi16( d, d );
+		lo = _mm_mullo_epi16( dd, vol );
+		hi = _mm_mulhi_epi16( dd, vol );
+		S_MixAddPairs( pbuf + i + 4, MIX_PRODUCT_LO( lo, hi ));
+		S_MixAddPairs( pbuf + i + 6, MIX_PRODUCT_HI( lo, hi ));
+	}
+
+	return i;
+}
+
+static int S_PaintStereoFrom16SSE2( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	__m128i	vol, d, lo, hi;
+	int	i;
+
+	vol = MIX_VOLUMES( volume[0], volume[1] );
+
+	for( i = 0; i + 4 <= outCount; i += 4 )
+	{
+		d = _mm_loadu_si128( (const __m128i *)( pData + i * 2 ));
+		lo = _mm_mullo_epi16( d, vol );
+		hi = _mm_mulhi_epi16( d, vol );
+		S_MixAddPairs( pbuf + i + 0, MIX_PRODUCT_LO( lo, hi ));
+		S_MixAddPairs( pbuf + i + 2, MIX_PRODUCT_HI( lo, hi ));
+	}
+
+	return i;
+}
+#endif // SND_MIX_SSE2
+
+#ifdef SND_MIX_NEON
+// add two stereo pairs
+_inline void S_MixAddPairs( portable_samplepair_t *pbuf, int32x4_t pairs )
+{
+	int32_t	*p = (int32_t *)pbuf;
+
+	vst1q_s32( p, vaddq_s32( vld1q_s32( p ), pairs ));
+}
+
+static int16x4_t S_MixVolumes( int left, int right )
+{
+	const int16_t	vol[4] = { left, right, left, right };
+
+	return vld1_s16( vol );
+}
+
+static int S_PaintMonoFrom8NEON( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	int16x4_t	vol4 = S_MixVolumes(( volume[0] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT, ( volume[1] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT );
+	int16x8_t	vol = vcombine_s16( vol4, vol4 );
+	int16x8x2_t	d;
+	int16x8_t	lo, hi;
+	int	i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		lo = vmovl_s8( vld1_s8( (const int8_t *)( pData + i )));
+		d = vzipq_s16( lo, lo );
+		lo = vmulq_s16( d.val[0], vol );
+		hi = vmulq_s16( d.val[1], vol );
+		S_MixAddPairs( pbuf + i + 0, vmovl_s16( vget_low_s16( lo )));
+		S_MixAddPairs( pbuf + i + 2, vmovl_s16( vget_high_s16( lo )));
+		S_MixAddPairs( pbuf + i + 4, vmovl_s16( vget_low_s16( hi )));
+		S_MixAddPairs( pbuf + i + 6, vmovl_s16( vget_high_s16( hi )));
+	}
+
+	return i;
+}
+
+static int S_PaintStereoFrom8NEON( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	int16x4_t	vol4 = S_MixVolumes(( volume[0] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT, ( volume[1] >> SND_SCALE_SHIFT ) << SND_SCALE_SHIFT );
+	int16x8_t	vol = vcombine_s16( vol4, vol4 );
+	int8x16_t	b;
+	int16x8_t	lo, hi;
+	int	i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		b = vld1q_s8( (const int8_t *)( pData + i * 2 ));
+		lo = vmulq_s16( vmovl_s8( vget_low_s8( b )), vol );
+		hi = vmulq_s16( vmovl_s8( vget_high_s8( b )), vol );
+		S_MixAddPairs( pbuf + i + 0, vmovl_s16( vget_low_s16( lo )));
+		S_MixAddPairs( pbuf + i + 2, vmovl_s16( vget_high_s16( lo )));
+		S_MixAddPairs( pbuf + i + 4, vmovl_s16( vget_low_s16( hi )));
+		S_MixAddPairs( pbuf + i + 6, vmovl_s16( vget_high_s16( hi )));
+	}
+
+	return i;
+}
+
+static int S_PaintMonoFrom16NEON( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	int16x4_t	vol = S_MixVolumes( volume[0], volume[1] );
+	int16x4x2_t	d;
+	int16x4_t	s;
+	int	i;
+
+	for( i = 0; i + 4 <= outCount; i += 4 )
+	{
+		s = vld1_s16( (const int16_t *)( pData + i ));
+		d = vzip_s16( s, s );
+		S_MixAddPairs( pbuf + i + 0, vshrq_n_s32( vmull_s16( d.val[0], vol ), 8 ));
+		S_MixAddPairs( pbuf + i + 2, vshrq_n_s32( vmull_s16( d.val[1], vol ), 8 ));
+	}
+
+	return i;
+}
+
+static int S_PaintStereoFrom16NEON( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	int16x4_t	vol = S_MixVolumes( volume[0], volume[1] );
+	int16x8_t	d;
+	int	i;
+
+	for( i = 0; i + 4 <= outCount; i += 4 )
+	{
+		d = vld1q_s16( (const int16_t *)( pData + i * 2 ));
+		S_MixAddPairs( pbuf + i + 0, vshrq_n_s32( vmull_s16( vget_low_s16( d ), vol ), 8 ));
+		S_MixAddPairs( pbuf + i + 2, vshrq_n_s32( vmull_s16( vget_high_s16( d ), vol ), 8 ));
+	}
+
+	return i;
+}
+#endif // SND_MIX_NEON
+
+/*
+=================
+S_PaintMonoFrom8SIMD
+
+vector loop with a scalar tail, the S_Paint*SIMD
+functions fall back to plain C on other targets
+=================
+*/
+static void S_PaintMonoFrom8SIMD( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	int	i = 0;
+
+#if defined( SND_MIX_SSE2 )
+	i = S_PaintMonoFrom8SSE2( pbuf, volume, pData, outCount );
+#elif defined( SND_MIX_NEON )
+	i = S_PaintMonoFrom8NEON( pbuf, volume, pData, outCount );
+#endif
+	S_PaintMonoFrom8( pbuf + i, volume, pData + i, outCount - i );
+}
+
+static void S_PaintStereoFrom8SIMD( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	int	i = 0;
+
+#if defined( SND_MIX_SSE2 )
+	i = S_PaintStereoFrom8SSE2( pbuf, volume, pData, outCount );
+#elif defined( SND_MIX_NEON )
+	i = S_PaintStereoFrom8NEON( pbuf, volume, pData, outCount );
+#endif
+	S_PaintStereoFrom8( pbuf + i, volume, pData + i * 2, outCount - i );
+}
+
+static void S_PaintMonoFrom16SIMD( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	int	i = 0;
+
+#if defined( SND_MIX_SSE2 )
+	i = S_PaintMonoFrom16SSE2( pbuf, volume, pData, outCount );
+#elif defined( SND_MIX_NEON )
+	i = S_PaintMonoFrom16NEON( pbuf, volume, pData, outCount );
+#endif
+	S_PaintMonoFrom16( pbuf + i, volume, pData + i, outCount - i );
+}
+
+static void S_PaintStereoFrom16SIMD( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	int	i = 0;
+
+#if defined( SND_MIX_SSE2 )
+	i = S_PaintStereoFrom16SSE2( pbuf, volume, pData, outCount );
+#elif defined( SND_MIX_NEON )
+	i = S_PaintStereoFrom16NEON( pbuf, volume, pData, outCount );
+#endif
+	S_PaintStereoFrom16( pbuf + i, volume, pData + i * 2, outCount - i );
+}
+
+/*
+=================
+S_MixResampledSIMD
+
+pitch shifted channel: gather the frames the scalar loop
+would read, then paint them with the vector kernels
+=================
+*/
+static void S_MixResampledSIMD( portable_samplepair_t *pbuf, int *volume, void *pData, int channels, int width, int inputOffset, uint rateScale, int outCount )
+{
+	uint		gather[MIX_GATHER_SIZE];	// big enough for 16-bit stereo frames
+	mixstep_t		step;
+	int		count;
+
+	step.frame = 0;
+	step.frac = inputOffset;
+	step.rate = rateScale;
+
+	while( outCount > 0 )
+	{
+		count = Q_min( outCount, MIX_GATHER_SIZE );
+		S_MixGather( gather, pData, channels * width, &step, count );
+
+		if( width == 1 )
+		{
+			if( channels == 1 )
+				S_PaintMonoFrom8SIMD( pbuf, volume, (byte *)gather, count );
+			else S_PaintStereoFrom8SIMD( pbuf, volume, (byte *)gather, count );
+		}
+		else
+		{
+			if( channels == 1 )
+				S_PaintMonoFrom16SIMD( pbuf, volume, (short *)gather, count );
+			else S_PaintStereoFrom16SIMD( pbuf, volume, (short *)gather, count );
+		}
+
+		pbuf += count;
+		outCount -= count;
+	}
+}
+
 void S_Mix8MonoTimeCompress( portable_samplepair_t *pbuf, int *volume, byte *pData, int inputOffset, uint rateScale, int outCount, int timecompress )
 {
 }
@@ -392,33 +790,79 @@ void S_Mix16Stereo( portable_samplepair_t *pbuf, int *volume, short *pData, int
 	}
 }
 
-void S_MixChannel( channel_t *pChannel, void *pData, int outputOffset, int inputOffset, uint fracRate, int outCount, int timecompress )
+/*
+=================
+S_MixSamplesSIMD
+=================
+*/
+static void S_MixSamplesSIMD( portable_samplepair_t *pbuf, int *pvol, void *pData, int channels, int width, int inputOffset, uint fracRate, int outCount )
 {
-	int			pvol[CCHANVOLUMES];
-	paintbuffer_t		*ppaint = MIX_GetCurrentPaintbufferPtr();
-	wavdata_t			*pSource = pChannel->sfx->cache;
-	portable_samplepair_t	*pbuf;
+	if( fracRate != FIX( 1 ))
+	{
+		S_MixResampledSIMD( pbuf, pvol, pData, channels, width, inputOffset, fracRate, outCount );
+		return;
+	}
 
-	Assert( pSource != NULL );
+	if( channels == 1 )
+	{
+		if( width == 1 )
+			S_PaintMonoFrom8SIMD( pbuf, pvol, pData, outCount );
+		else S_PaintMonoFrom16SIMD( pbuf, pvol, (short *)pData, outCount );
+	}
+	else
+	{
+		if( width == 1 )
+			S_PaintStereoFrom8SIMD( pbuf, pvol, pData, outCount );
+		else S_PaintStereoFrom16SIMD( pbuf, pvol, (short *)pData, outCount );
+	}
+}
 
-	pvol[0] = bound( 0, pChannel->leftvol, 255 );
-	pvol[1] = bound( 0, pChannel->rightvol, 255 );
-	pbuf = ppaint->pbuf + outputOffset;
+/*
+=================
+S_MixSamples
+
+simd selects the vector kernels, the caller decides
+so tests and benchmarks don't touch snd_mixsimd
+=================
+*/
+static void S_MixSamples( portable_samplepair_t *pbuf, int *pvol, void *pData, int channels, int width, int inputOffset, uint fracRate, int outCount, int timecompress, qboolean simd )
+{
+	if( simd )
+	{
+		S_MixSamplesSIMD( pbuf, pvol, pData, channels, width, inputOffset, fracRate, outCount );
+		return;
+	}
 
-	if( pSource->channels == 1 )
+	if( channels == 1 )
 	{
-		if( pSource->width == 1 )
+		if( width == 1 )
 			S_Mix8Mono( pbuf, pvol, pData, inputOffset, fracRate, outCount, timecompress );
 		else S_Mix16Mono( pbuf, pvol, (short *)pData, inputOffset, fracRate, outCount );
 	}
 	else
 	{
-		if( pSource->width == 1 )
+		if( width == 1 )
 			S_Mix8Stereo( pbuf, pvol, pData, inputOffset, fracRate, outCount );
 		else S_Mix16Stereo( pbuf, pvol, (short *)pData, inputOffset, fracRate, outCount );
 	}
 }
 
+void S_MixChannel( channel_t *pChannel, void *pData, int outputOffset, int inputOffset, uint fracRate, int outCount, int timecompress )
+{
+	int			pvol[CCHANVOLUMES];
+	paintbuffer_t		*ppaint = MIX_GetCurrentPaintbufferPtr();
+	wavdata_t			*pSource = pChannel->sfx->cache;
+	portable_samplepair_t	*pbuf;
+
+	Assert( pSource != NULL );
+
+	pvol[0] = bound( 0, pChannel->leftvol, 255 );
+	pvol[1] = bound( 0, pChannel->rightvol, 255 );
+	pbuf = ppaint->pbuf + outputOffset;
+
+	S_MixSamples( pbuf, pvol, pData, pSource->channels, pSource->width, inputOffset, fracRate, outCount, timecompress, S_MixUseSIMD( ));
+}
+
 int S_MixDataToDevice( channel_t *pChannel, int sampleCount, int outRate, int outOffset, int timeCompress )
 {
 	// save this to compute total output
@@ -1057,3 +1501,141 @@ void MIX_PaintChannels( int endtime )
 		paintedtime = end;
 	}
 }
+
+/*
+===============================================================================
+
+MIXER BENCHMARK
+
+===============================================================================
+*/
+#define MIXBENCH_FRAMES	( PAINTBUFFER_SIZE * 2 + 16 )	// enough input for pitch up to 2.0
+
+typedef struct
+{
+	int	channels;
+	int	width;
+	float	rate;	// input frames per output frame
+} mixvoice_t;
+
+// typical game sounds: 22k and 11k effects, 44k dialog and music
+static const mixvoice_t mix_voices[] =
+{
+	{ 1, 2, 1.0f },
+	{ 1, 2, 0.5f },
+	{ 1, 1, 0.25f },
+	{ 2, 2, 1.0f },
+	{ 1, 1, 1.0f },
+	{ 2, 1, 1.0f },
+	{ 1, 2, 0.537f },	// pitch shifted
+	{ 2, 2, 1.47f },
+};
+
+static short mix_samples[MIXBENCH_FRAMES * 2];
+
+/*
+=================
+S_MixFillSamples
+
+deterministic noise covering the full sample range
+=================
+*/
+static void S_MixFillSamples( void )
+{
+	uint	seed = 0x1234567;
+	int	i;
+
+	for( i = 0; i < ARRAYSIZE( mix_samples ); i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		mix_samples[i] = (short)( seed >> 16 );
+	}
+}
+
+/*
+=================
+S_MixVoices
+
+mix numvoices voices of the test set into count frames
+=================
+*/
+static void S_MixVoices( portable_samplepair_t *pbuf, int numvoices, int count, qboolean simd )
+{
+	const mixvoice_t	*v;
+	int	i, vol[CCHANVOLUMES];
+
+	memset( pbuf, 0, PAINTBUFFER_SIZE * sizeof( *pbuf ));
+
+	for( i = 0; i < numvoices; i++ )
+	{
+		v = &mix_voices[i % ARRAYSIZE( mix_voices )];
+		vol[0] = ( i * 37 + 11 ) & 255;
+		vol[1] = 255 - vol[0];
+
+		S_MixSamples( pbuf, vol, mix_samples, v->channels, v->width, FIX_FLOAT( ( i % 7 ) / 7.0f ), FIX_FLOAT( v->rate ), count, 0, simd );
+	}
+}
+
+/*
+=================
+S_MixBench_f
+
+snd_mixbench [voices]
+=================
+*/
+void S_MixBench_f( void )
+{
+	portable_samplepair_t	*pbuf = temppaintbuffer;
+	int	i, numvoices = 32, passes;
+	double	start, time[2];
+
+	if( Cmd_Argc() > 1 )
+		numvoices = Q_max( 1, Q_atoi( Cmd_Argv( 1 )));
+
+	S_InitScaletable();
+	S_MixFillSamples();
+
+	for( i = 0; i < 2; i++ )
+	{
+		start = Sys_DoubleTime();
+		passes = 0;
+
+		// run for a quarter of a second
+		do
+		{
+			S_MixVoices( pbuf, numvoices, PAINTBUFFER_SIZE, i );
+			passes++;
+		} while( Sys_DoubleTime() - start < 0.25 );
+
+		time[i] = ( Sys_DoubleTime() - start ) * 1000.0 / passes;
+	}
+
+	Con_Printf( "%i voices, %i frames each\n", numvoices, PAINTBUFFER_SIZE );
+	Con_Printf( "scalar: %.4f ms, %.1f voices/ms\n", time[0], numvoices / time[0] );
+#ifdef SND_MIX_SIMD
+	Con_Printf( "simd:   %.4f ms, %.1f voices/ms\n", time[1], numvoices / time[1] );
+#else
+	Con_Printf( "no vector kernels for this target\n" );
+#endif
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+void Test_RunSoundMix( void )
+{
+	static portable_samplepair_t	scalar[PAINTBUFFER_SIZE], simd[PAINTBUFFER_SIZE];
+	int	i;
+
+	S_InitScaletable();
+	S_MixFillSamples();
+
+	// all voice kinds, with frame counts that leave a scalar tail
+	for( i = 0; i < 8; i++ )
+	{
+		S_MixVoices( scalar, ARRAYSIZE( mix_voices ), PAINTBUFFER_SIZE - i, false );
+		S_MixVoices( simd, ARRAYSIZE( mix_voices ), PAINTBUFFER_SIZE - i, true );
+		TASSERT( memcmp( scalar, simd, sizeof( scalar )) == 0 );
+	}
+}
+#endif /* XASH_ENGINE_TESTS */
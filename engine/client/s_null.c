@@ -0,0 +1,80 @@
+/*
+s_null.c - silent sound device
+Copyright (C) 2026 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "common.h"
+#include "sound.h"
+
+#define NULL_BUFFER_SAMPLES	0x8000	// mono samples, same as the platform backends
+
+static double	s_nullstart;	// device clock
+
+/*
+==================
+SNDNULL_Init
+
+device that plays silence at real speed, so
+mixing runs and can be measured without hardware
+==================
+*/
+qboolean SNDNULL_Init( void )
+{
+	dma.format.speed = SOUND_DMA_SPEED;
+	dma.format.channels = 2;
+	dma.format.width = 2;
+	dma.samples = NULL_BUFFER_SAMPLES;
+	dma.samplepos = 0;
+	dma.buffer = Z_Calloc( dma.samples * dma.format.width );
+	s_nullstart = Sys_DoubleTime();
+
+	Con_Printf( "Audio: null device, %i Hz, %i samples\n", dma.format.speed, dma.samples );
+	dma.initialized = true;
+
+	return true;
+}
+
+/*
+==================
+SNDNULL_BeginPainting
+
+advance the play cursor by the wall clock
+==================
+*/
+void SNDNULL_BeginPainting( void )
+{
+	double	played;
+
+	if( !dma.buffer )
+		return;
+
+	played = ( Sys_DoubleTime() - s_nullstart ) * dma.format.speed * dma.format.channels;
+	dma.samplepos = (int)fmod( played, dma.samples ) & ~1;
+}
+
+/*
+==================
+SNDNULL_Shutdown
+==================
+*/
+void SNDNULL_Shutdown( void )
+{
+	Con_Printf( "Shutting down audio.\n" );
+	dma.initialized = false;
+
+	if( dma.buffer )
+	{
+		Z_Free( dma.buffer );
+		dma.buffer = NULL;
+	}
+}
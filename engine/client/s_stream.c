@@ -17,9 +17,426 @@ GNU General Public License for more details.
 #include "sound.h"
 #include "client.h"
 
+#if XASH_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define S_HAVE_THREADS
+#elif XASH_POSIX && !defined XASH_NO_ASYNC_NS_RESOLVE && !XASH_EMSCRIPTEN
+// wscript only links pthreads when asynchronous name resolution is on
+#include <pthread.h>
+#define S_HAVE_THREADS
+#endif
+
+#define MUSIC_CHUNK		4096	// bytes decoded at once
+#define MUSIC_SLEEP		10	// msec to wait for free space in the ring
+
 static bg_track_t		s_bgTrack;
 static musicfade_t		musicfade;	// controlled by game dlls
 
+CVAR_DEFINE_AUTO( snd_musicthread, "1", FCVAR_ARCHIVE|FCVAR_FILTERABLE, "decode background music in a separate thread" );
+CVAR_DEFINE_AUTO( snd_musicahead, "2", FCVAR_ARCHIVE|FCVAR_FILTERABLE, "seconds of background music decoded ahead of playback" );
+
+/*
+===============================================================================
+
+MUSIC DECODING THREAD
+
+worker only decodes ahead into a ring of PCM, streams are
+opened and freed by the main thread: it seeks before the
+start, keeps the loop track open ahead of time and frees
+the streams worker is done with
+
+===============================================================================
+*/
+#ifdef S_HAVE_THREADS
+static struct
+{
+	qboolean	active;
+	qboolean	shutdown;
+	qboolean	finished;		// nothing more will be decoded
+	stream_t	*stream;		// s_bgTrack.stream only tells the track is on
+	wavdata_t	info;		// format of stream
+	qboolean	looping;		// loop track follows
+	stream_t	*next;		// loop track opened ahead, worker takes it at the end
+	wavdata_t	nextinfo;
+	qboolean	nextfailed;	// loop track can't be opened
+	stream_t	*retired;		// worker is done with it, main thread frees it
+
+	byte	*ring;
+	int	ringsize;
+	int	head;		// bytes written so far
+	int	tail;		// bytes read so far
+	int	rate, width, channels;	// format of buffered data
+	int	loopstart;	// head where loop track begins, -1 if not reached
+	int	position;		// stream position after last chunk
+
+	// metrics
+	int	chunks;
+	double	decodetime;
+	double	maxdecode;
+	int	underruns;
+#if XASH_WIN32
+	CRITICAL_SECTION	lock;
+	HANDLE	thread;
+#else
+	pthread_mutex_t	lock;
+	pthread_t	thread;
+#endif
+} s_music;
+
+#if XASH_WIN32
+#define S_LockMusic()	EnterCriticalSection( &s_music.lock )
+#define S_UnlockMusic()	LeaveCriticalSection( &s_music.lock )
+#else
+#define S_LockMusic()	pthread_mutex_lock( &s_music.lock )
+#define S_UnlockMusic()	pthread_mutex_unlock( &s_music.lock )
+#endif
+
+/*
+=================
+S_MusicWrite
+
+append decoded data to the ring, caller checked the free space
+=================
+*/
+static void S_MusicWrite( const byte *data, int size )
+{
+	int	offset = s_music.head % s_music.ringsize;
+	int	part = Q_min( size, s_music.ringsize - offset );
+
+	memcpy( s_music.ring + offset, data, part );
+	memcpy( s_music.ring, data + part, size - part );
+	s_music.head += size;
+}
+
+/*
+=================
+S_MusicThreadLoop
+=================
+*/
+static void S_MusicThreadLoop( void )
+{
+	byte	chunk[MUSIC_CHUNK];
+	qboolean	ready, wait, decoded = false;
+	double	start, time;
+	int	r, frame, space, position;
+
+	while( 1 )
+	{
+		S_LockMusic();
+
+		if( s_music.shutdown )
+		{
+			S_UnlockMusic();
+			return;
+		}
+
+		frame = s_music.info.width * s_music.info.channels;
+		space = s_music.ringsize - ( s_music.head - s_music.tail );
+
+		// new format waits until everything before it was played
+		ready = s_music.head == s_music.tail;
+		if( ready || ( s_music.info.rate == s_music.rate && s_music.info.width == s_music.width && s_music.info.channels == s_music.channels ))
+		{
+			s_music.rate = s_music.info.rate;
+			s_music.width = s_music.info.width;
+			s_music.channels = s_music.info.channels;
+			ready = true;
+		}
+		S_UnlockMusic();
+
+		if( !ready || space < MUSIC_CHUNK )
+		{
+			Sys_Sleep( MUSIC_SLEEP );
+			continue;
+		}
+
+		start = Sys_DoubleTime();
+		r = FS_ReadStream( s_music.stream, MUSIC_CHUNK - MUSIC_CHUNK % frame, chunk );
+		position = FS_GetStreamPos( s_music.stream );
+		time = Sys_DoubleTime() - start;
+
+		if( r > 0 )
+		{
+			S_LockMusic();
+			S_MusicWrite( chunk, r - r % frame );
+			s_music.position = position;
+			s_music.chunks++;
+			s_music.decodetime += time;
+			s_music.maxdecode = Q_max( s_music.maxdecode, time );
+			S_UnlockMusic();
+
+			decoded = true;
+			continue;
+		}
+
+		// switch to the loop track main thread opened,
+		// stop if there is none or it gave nothing
+		S_LockMusic();
+		if( decoded && s_music.next && !s_music.retired )
+		{
+			s_music.retired = s_music.stream;
+			s_music.stream = s_music.next;
+			s_music.info = s_music.nextinfo;
+			s_music.next = NULL;
+			s_music.loopstart = s_music.head;
+			S_UnlockMusic();
+
+			decoded = false;
+			continue;
+		}
+		wait = decoded && s_music.looping && !s_music.nextfailed;
+		S_UnlockMusic();
+
+		if( !wait )
+			break;
+
+		Sys_Sleep( MUSIC_SLEEP );
+	}
+
+	S_LockMusic();
+	s_music.finished = true;
+	S_UnlockMusic();
+}
+
+#if XASH_WIN32
+static DWORD WINAPI S_MusicThread( LPVOID unused )
+{
+	S_MusicThreadLoop();
+	return 0;
+}
+#else
+static void *S_MusicThread( void *unused )
+{
+	S_MusicThreadLoop();
+	return NULL;
+}
+#endif
+
+/*
+=================
+S_MusicUpdateStreams
+
+free the stream worker is done with and open
+the loop track before worker reaches the end
+=================
+*/
+static void S_MusicUpdateStreams( void )
+{
+	stream_t	*retired, *next;
+	qboolean	open;
+
+	S_LockMusic();
+	retired = s_music.retired;
+	s_music.retired = NULL;
+	open = s_music.looping && !s_music.next && !s_music.nextfailed;
+	S_UnlockMusic();
+
+	if( retired )
+		FS_FreeStream( retired );
+
+	if( !open )
+		return;
+
+	next = FS_OpenStream( va( "media/%s", s_bgTrack.loopName ));
+
+	S_LockMusic();
+	if( next )
+		s_music.nextinfo = *FS_StreamInfo( next );
+	s_music.next = next;
+	s_music.nextfailed = !next;
+	S_UnlockMusic();
+}
+#endif // S_HAVE_THREADS
+
+/*
+=================
+S_StartMusicThread
+
+hand opened s_bgTrack.stream over to the worker
+returns false if music must be decoded here
+=================
+*/
+static qboolean S_StartMusicThread( int position )
+{
+#ifdef S_HAVE_THREADS
+	float	ahead = bound( 0.25f, snd_musicahead.value, 10.0f );
+
+	if( !snd_musicthread.value )
+		return false;
+
+	memset( &s_music, 0, sizeof( s_music ));
+
+	// enough for 16-bit stereo at output rate
+	s_music.ringsize = (int)( ahead * SOUND_DMA_SPEED ) * 4;
+	s_music.ringsize = Q_max( s_music.ringsize, MUSIC_CHUNK );
+	s_music.ring = Mem_Malloc( sndpool, s_music.ringsize );
+	s_music.loopstart = -1;
+	s_music.position = position;
+	s_music.stream = s_bgTrack.stream;
+	s_music.looping = s_bgTrack.loopName[0] != '\0';
+
+	if( position != 0 )
+		FS_SetStreamPos( s_music.stream, position );
+	s_music.info = *FS_StreamInfo( s_music.stream );
+
+#if XASH_WIN32
+	InitializeCriticalSection( &s_music.lock );
+#else
+	pthread_mutex_init( &s_music.lock, NULL );
+#endif
+
+	// loop track is ready before the intro ends
+	S_MusicUpdateStreams();
+
+	s_music.active = true;
+
+#if XASH_WIN32
+	if(( s_music.thread = CreateThread( NULL, 0, S_MusicThread, NULL, 0, NULL )) == NULL )
+#else
+	if( pthread_create( &s_music.thread, NULL, S_MusicThread, NULL ) != 0 )
+#endif
+	{
+		s_music.active = false;
+#if XASH_WIN32
+		DeleteCriticalSection( &s_music.lock );
+#else
+		pthread_mutex_destroy( &s_music.lock );
+#endif
+		if( s_music.next )
+			FS_FreeStream( s_music.next );
+		Mem_Free( s_music.ring );
+		Con_Printf( S_ERROR "%s: couldn't create music thread\n", __func__ );
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+=================
+S_StopMusicThread
+
+returns the stream worker was using, it may be different
+from the one it was given
+=================
+*/
+static stream_t *S_StopMusicThread( void )
+{
+#ifdef S_HAVE_THREADS
+	if( !s_music.active )
+		return s_bgTrack.stream;
+
+	S_LockMusic();
+	s_music.shutdown = true;
+	S_UnlockMusic();
+
+#if XASH_WIN32
+	WaitForSingleObject( s_music.thread, INFINITE );
+	CloseHandle( s_music.thread );
+	DeleteCriticalSection( &s_music.lock );
+#else
+	pthread_join( s_music.thread, NULL );
+	pthread_mutex_destroy( &s_music.lock );
+#endif
+	Mem_Free( s_music.ring );
+	s_music.active = false;
+
+	if( s_music.next )
+		FS_FreeStream( s_music.next );
+	if( s_music.retired )
+		FS_FreeStream( s_music.retired );
+
+	return s_music.stream;
+#else
+	return s_bgTrack.stream;
+#endif
+}
+
+/*
+=================
+S_MusicRead
+
+take enough decoded music to fill bufferSamples at output rate,
+buffer must hold MAX_RAW_SAMPLES bytes
+returns count of samples in data format or -1 when
+the track is over and nothing is left
+=================
+*/
+static int S_MusicRead( byte *buffer, int bufferSamples, wavdata_t *info )
+{
+#ifdef S_HAVE_THREADS
+	int	size, offset, part, frame;
+
+	S_MusicUpdateStreams();
+
+	S_LockMusic();
+
+	if( s_music.head == s_music.tail )
+	{
+		// worker didn't keep up
+		if( !s_music.finished && s_music.head > 0 )
+			s_music.underruns++;
+
+		S_UnlockMusic();
+		return s_music.finished ? -1 : 0;
+	}
+
+	info->rate = s_music.rate;
+	info->width = s_music.width;
+	info->channels = s_music.channels;
+	frame = info->width * info->channels;
+
+	// decide how much data needs to be taken
+	size = bufferSamples * ((float)info->rate / SOUND_DMA_SPEED );
+	size = Q_min( size * frame, MAX_RAW_SAMPLES );
+	size = Q_min( size, s_music.head - s_music.tail );
+	size -= size % frame;
+
+	if( size <= 0 )
+	{
+		S_UnlockMusic();
+		return 0;
+	}
+
+	offset = s_music.tail % s_music.ringsize;
+	part = Q_min( size, s_music.ringsize - offset );
+	memcpy( buffer, s_music.ring + offset, part );
+	memcpy( buffer + part, s_music.ring, size - part );
+	s_music.tail += size;
+
+	// loop track is playing now
+	if( s_music.loopstart >= 0 && s_music.tail > s_music.loopstart )
+	{
+		Q_strncpy( s_bgTrack.current, s_bgTrack.loopName, sizeof( s_bgTrack.current ));
+		s_music.loopstart = -1;
+	}
+
+	S_UnlockMusic();
+
+	return size / frame;
+#else
+	return -1;
+#endif
+}
+
+/*
+=================
+S_MusicThreadActive
+=================
+*/
+static qboolean S_MusicThreadActive( void )
+{
+#ifdef S_HAVE_THREADS
+	return s_music.active;
+#else
+	return false;
+#endif
+}
+
 /*
 =================
 S_PrintBackgroundTrackState
@@ -36,6 +453,25 @@ void S_PrintBackgroundTrackState( void )
 	else if( s_bgTrack.loopName[0] )
 		Con_Printf( "%s [loop]\n", s_bgTrack.loopName );
 	else Con_Printf( "not playing\n" );
+
+#ifdef S_HAVE_THREADS
+	if( S_MusicThreadActive( ))
+	{
+		float	rate;
+
+		S_LockMusic();
+		rate = s_music.rate * s_music.width * s_music.channels;
+		Con_Printf( "music thread: %i of %i bytes buffered (%.2f sec), %i underruns\n",
+			s_music.head - s_music.tail, s_music.ringsize,
+			rate ? ( s_music.head - s_music.tail ) / rate : 0.0f, s_music.underruns );
+		if( s_music.chunks )
+		{
+			Con_Printf( "music decode: %.3f ms average, %.3f ms peak over %i chunks\n",
+				s_music.decodetime * 1000.0 / s_music.chunks, s_music.maxdecode * 1000.0, s_music.chunks );
+		}
+		S_UnlockMusic();
+	}
+#endif
 }
 
 /*
@@ -100,6 +536,13 @@ void S_StartBackgroundTrack( const char *introTrack, const char *mainTrack, int
 	memset( &musicfade, 0, sizeof( musicfade )); // clear any soundfade
 	s_bgTrack.source = cls.key_dest;
 
+	if( !s_bgTrack.stream )
+		return;
+
+	// seeked before the worker started
+	if( S_StartMusicThread( position ))
+		return;
+
 	if( position != 0 )
 	{
 		// restore message, update song position
@@ -119,6 +562,7 @@ void S_StopBackgroundTrack( void )
 	if( !dma.initialized ) return;
 	if( !s_bgTrack.stream ) return;
 
+	s_bgTrack.stream = S_StopMusicThread();
 	FS_FreeStream( s_bgTrack.stream );
 	memset( &s_bgTrack, 0, sizeof( bg_track_t ));
 	memset( &musicfade, 0, sizeof( musicfade ));
@@ -161,11 +605,88 @@ qboolean S_StreamGetCurrentState( char *currentTrack, char *loopTrack, int *posi
 	}
 
 	if( position )
+	{
+#ifdef S_HAVE_THREADS
+		if( S_MusicThreadActive( ))
+		{
+			S_LockMusic();
+			*position = s_music.position;
+			S_UnlockMusic();
+		}
+		else
+#endif
 		*position = FS_GetStreamPos( s_bgTrack.stream );
+	}
 
 	return true;
 }
 
+/*
+=================
+S_RawChannelSpace
+
+samples the raw channel can take now, the mixing
+thread moves soundtime so it's read under the lock
+=================
+*/
+static int S_RawChannelSpace( rawchan_t *ch )
+{
+	int	space;
+
+	S_LockMixer();
+	if( ch->s_rawend < soundtime )
+		ch->s_rawend = soundtime;
+	space = ch->max_samples - ( ch->s_rawend - soundtime );
+	S_UnlockMixer();
+
+	return space;
+}
+
+/*
+=================
+S_LockedRawSamples
+
+hand decoded data to the raw channel
+=================
+*/
+static void S_LockedRawSamples( uint samples, uint rate, word width, word channels, const byte *data, int entnum )
+{
+	S_LockMixer();
+	S_RawSamples( samples, rate, width, channels, data, entnum );
+	S_UnlockMixer();
+}
+
+/*
+=================
+S_StreamMusicFromThread
+
+feed raw channel with music decoded by the worker
+=================
+*/
+static void S_StreamMusicFromThread( rawchan_t *ch )
+{
+	byte	raw[MAX_RAW_SAMPLES];
+	wavdata_t	info;
+	int	bufferSamples;
+	int	fileSamples;
+
+	while(( bufferSamples = S_RawChannelSpace( ch )) > 0 )
+	{
+		fileSamples = S_MusicRead( raw, bufferSamples, &info );
+
+		if( fileSamples < 0 )
+		{
+			S_StopBackgroundTrack();
+			return;
+		}
+
+		if( fileSamples == 0 )
+			return; // wait for worker
+
+		S_LockedRawSamples( fileSamples, info.rate, info.width, info.channels, raw, S_RAW_SOUND_BACKGROUNDTRACK );
+	}
+}
+
 /*
 =================
 S_StreamBackgroundTrack
@@ -195,20 +716,23 @@ void S_StreamBackgroundTrack( void )
 	else if( cls.key_dest == key_console )
 		return;
 
+	S_LockMixer();
 	ch = S_FindRawChannel( S_RAW_SOUND_BACKGROUNDTRACK, true );
+	S_UnlockMixer();
 
 	Assert( ch != NULL );
 
-	// see how many samples should be copied into the raw buffer
-	if( ch->s_rawend < soundtime )
-		ch->s_rawend = soundtime;
+	if( S_MusicThreadActive( ))
+	{
+		S_StreamMusicFromThread( ch );
+		return;
+	}
 
-	while( ch->s_rawend < soundtime + ch->max_samples )
+	// see how many samples should be copied into the raw buffer
+	while(( bufferSamples = S_RawChannelSpace( ch )) > 0 )
 	{
 		wavdata_t	*info = FS_StreamInfo( s_bgTrack.stream );
 
-		bufferSamples = ch->max_samples - (ch->s_rawend - soundtime);
-
 		// decide how much data needs to be read from the file
 		fileSamples = bufferSamples * ((float)info->rate / SOUND_DMA_SPEED );
 		if( fileSamples <= 1 ) return; // no more samples need
@@ -234,7 +758,7 @@ void S_StreamBackgroundTrack( void )
 		if( r > 0 )
 		{
 			// add to raw buffer
-			S_RawSamples( fileSamples, info->rate, info->width, info->channels, raw, S_RAW_SOUND_BACKGROUNDTRACK );
+			S_LockedRawSamples( fileSamples, info->rate, info->width, info->channels, raw, S_RAW_SOUND_BACKGROUNDTRACK );
 		}
 		else
 		{
@@ -296,22 +820,19 @@ void S_StreamSoundTrack( void )
 	if( !dma.initialized || !s_listener.streaming || s_listener.paused )
 		return;
 
+	S_LockMixer();
 	ch = S_FindRawChannel( S_RAW_SOUND_SOUNDTRACK, true );
+	S_UnlockMixer();
 
 	Assert( ch != NULL );
 
 	// see how many samples should be copied into the raw buffer
-	if( ch->s_rawend < soundtime )
-		ch->s_rawend = soundtime;
-
-	while( ch->s_rawend < soundtime + ch->max_samples )
+	while(( bufferSamples = S_RawChannelSpace( ch )) > 0 )
 	{
 		wavdata_t	*info = SCR_GetMovieInfo();
 
 		if( !info ) break;	// bad soundtrack?
 
-		bufferSamples = ch->max_samples - (ch->s_rawend - soundtime);
-
 		// decide how much data needs to be read from the file
 		fileSamples = bufferSamples * ((float)info->rate / SOUND_DMA_SPEED );
 		if( fileSamples <= 1 ) return; // no more samples need
@@ -337,8 +858,130 @@ void S_StreamSoundTrack( void )
 		if( r > 0 )
 		{
 			// add to raw buffer
-			S_RawSamples( fileSamples, info->rate, info->width, info->channels, raw, S_RAW_SOUND_SOUNDTRACK );
+			S_LockedRawSamples( fileSamples, info->rate, info->width, info->channels, raw, S_RAW_SOUND_SOUNDTRACK );
 		}
 		else break; // no more samples for this frame
 	}
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define MUSIC_TEST_FILE	"media/test_music.wav"
+#define MUSIC_TEST_SAMPLES	11025
+
+static void Test_WriteMusicFile( void )
+{
+	// 16-bit mono 22 kHz, sample i holds i * 7
+	static const byte	header[44] =
+	{
+		'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+		'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+		0x22, 0x56, 0, 0, 0x44, 0xAC, 0, 0, 2, 0, 16, 0,
+		'd', 'a', 't', 'a', 0, 0, 0, 0,
+	};
+	byte	data[sizeof( header )];
+	file_t	*f;
+	short	s;
+	int	i;
+
+	memcpy( data, header, sizeof( data ));
+	*(uint *)( data + 4 ) = LittleLong( 36 + MUSIC_TEST_SAMPLES * 2 );
+	*(uint *)( data + 40 ) = LittleLong( MUSIC_TEST_SAMPLES * 2 );
+
+	f = FS_Open( MUSIC_TEST_FILE, "wb", true );
+	if( !f ) return;
+
+	FS_Write( f, data, sizeof( data ));
+	for( i = 0; i < MUSIC_TEST_SAMPLES; i++ )
+	{
+		s = LittleShort( (short)( i * 7 ));
+		FS_Write( f, &s, sizeof( s ));
+	}
+	FS_Close( f );
+}
+
+void Test_RunSoundMusic( void )
+{
+	qboolean	oldnull = s_nulldevice;
+	float	oldthread = snd_musicthread.value;
+	float	oldahead = snd_musicahead.value;
+	float	oldvolume = s_musicvolume.value;
+	int	i, loud = 0;
+	const short	*out;
+	double	timeout;
+
+	Test_WriteMusicFile();
+
+	// whole sound system on the silent device
+	s_nulldevice = true;
+	TASSERT( S_Init( ));
+
+	if( !dma.initialized )
+	{
+		s_nulldevice = oldnull;
+		FS_Delete( MUSIC_TEST_FILE );
+		return;
+	}
+
+	// small ring, so the worker has to wait and wrap around
+	snd_musicthread.value = 1.0f;
+	snd_musicahead.value = 0.25f;
+	s_musicvolume.value = 1.0f;
+
+	// intro is opened here, loop track too once the worker gets close to the end
+	S_StartBackgroundTrack( "test_music.wav", "test_music.wav", 0, false );
+	TASSERT( s_bgTrack.stream != NULL );
+#ifdef S_HAVE_THREADS
+	TASSERT( S_MusicThreadActive( ));
+#endif
+
+	// play like client frames do until the loop track takes over
+	timeout = Sys_DoubleTime() + 5.0;
+	while( s_bgTrack.stream && Q_strcmp( s_bgTrack.current, s_bgTrack.loopName ) && Sys_DoubleTime() < timeout )
+	{
+		S_StreamBackgroundTrack();
+		S_UpdateChannels();
+		Sys_Sleep( 5 );
+	}
+
+	TASSERT( s_bgTrack.stream != NULL );
+	TASSERT( !Q_strcmp( s_bgTrack.current, s_bgTrack.loopName ));
+
+	// intro stream worker is done with is freed by next frames
+	for( i = 0; i < 40; i++ )
+	{
+		S_StreamBackgroundTrack();
+		S_UpdateChannels();
+		Sys_Sleep( 5 );
+	}
+
+#ifdef S_HAVE_THREADS
+	if( S_MusicThreadActive( ))
+	{
+		S_LockMusic();
+		TASSERT( s_music.retired == NULL );
+		S_UnlockMusic();
+	}
+#endif
+
+	out = (const short *)dma.buffer;
+	for( i = 0; i < dma.samples; i++ )
+	{
+		if( out[i] != 0 )
+			loud++;
+	}
+	TASSERT( loud > 0 );
+
+	S_StopBackgroundTrack();
+	TASSERT( s_bgTrack.stream == NULL && !S_MusicThreadActive( ));
+
+	S_Shutdown();
+	s_nulldevice = oldnull;
+	snd_musicthread.value = oldthread;
+	snd_musicahead.value = oldahead;
+	s_musicvolume.value = oldvolume;
+
+	FS_Delete( MUSIC_TEST_FILE );
+}
+#endif /* XASH_ENGINE_TESTS */
@@ -0,0 +1,607 @@
+/*
+s_thread.c - sound mixing thread
+Copyright (C) 2026 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "common.h"
+#include "sound.h"
+#include "client.h"
+
+#if XASH_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define S_HAVE_THREADS
+#elif XASH_POSIX && !defined XASH_NO_ASYNC_NS_RESOLVE && !XASH_EMSCRIPTEN
+// wscript only links pthreads when asynchronous name resolution is on
+#include <pthread.h>
+#define S_HAVE_THREADS
+#endif
+
+#define MIXTHREAD_SLEEP		4	// msec between mixing passes
+
+CVAR_DEFINE_AUTO( snd_mixthread, "0", FCVAR_ARCHIVE|FCVAR_FILTERABLE, "mix sound in a separate thread" );
+
+/*
+===============================================================================
+
+SINGLE PRODUCER COMMAND QUEUE
+
+game thread is the only producer, consumers are
+serialized by the mixer lock, so the two indices
+need nothing but acquire/release ordering
+
+===============================================================================
+*/
+#if defined( _MSC_VER )
+#define S_LoadAcquire( p )		InterlockedCompareExchange(( volatile LONG * )( p ), 0, 0 )
+#define S_StoreRelease( p, v )	InterlockedExchange(( volatile LONG * )( p ), ( v ))
+#else
+#define S_LoadAcquire( p )		__atomic_load_n(( p ), __ATOMIC_ACQUIRE )
+#define S_StoreRelease( p, v )	__atomic_store_n(( p ), ( v ), __ATOMIC_RELEASE )
+#endif
+
+/*
+=================
+S_QueuePush
+
+returns false if queue is full
+=================
+*/
+qboolean S_QueuePush( sndqueue_t *queue, const sndcmd_t *cmd )
+{
+	int	head = queue->head;
+
+	if( head - S_LoadAcquire( &queue->tail ) >= SND_QUEUE_SIZE )
+		return false;
+
+	queue->cmds[head & ( SND_QUEUE_SIZE - 1 )] = *cmd;
+	S_StoreRelease( &queue->head, head + 1 );
+
+	return true;
+}
+
+/*
+=================
+S_QueuePop
+
+returns false if queue is empty
+=================
+*/
+qboolean S_QueuePop( sndqueue_t *queue, sndcmd_t *cmd )
+{
+	int	tail = queue->tail;
+
+	if( S_LoadAcquire( &queue->head ) == tail )
+		return false;
+
+	*cmd = queue->cmds[tail & ( SND_QUEUE_SIZE - 1 )];
+	S_StoreRelease( &queue->tail, tail + 1 );
+
+	return true;
+}
+
+/*
+===============================================================================
+
+MIXING THREAD
+
+===============================================================================
+*/
+#ifdef S_HAVE_THREADS
+static struct
+{
+	qboolean	active;
+	int	shutdown;
+	sndqueue_t	queue;
+	int	queuefull;	// producer had to flush the queue itself
+#if XASH_WIN32
+	CRITICAL_SECTION	lock;	// recursive by itself
+	HANDLE	thread;
+#else
+	pthread_mutex_t	lock;
+	pthread_t	thread;
+#endif
+} s_mixthread;
+
+#if XASH_WIN32
+#define S_EnterMixer()	EnterCriticalSection( &s_mixthread.lock )
+#define S_LeaveMixer()	LeaveCriticalSection( &s_mixthread.lock )
+#else
+#define S_EnterMixer()	pthread_mutex_lock( &s_mixthread.lock )
+#define S_LeaveMixer()	pthread_mutex_unlock( &s_mixthread.lock )
+#endif
+
+/*
+=================
+S_RunCommands
+
+apply everything the game thread has sent so far
+mixer lock must be held by caller
+=================
+*/
+static void S_RunCommands( void )
+{
+	sndcmd_t	cmd;
+
+	while( S_QueuePop( &s_mixthread.queue, &cmd ))
+		SND_StartQueuedSound( &cmd );
+}
+
+static void S_MixThreadLoop( void )
+{
+	while( !S_LoadAcquire( &s_mixthread.shutdown ))
+	{
+		S_LockMixer();
+		S_UpdateChannels();
+		S_UnlockMixer();
+
+		Sys_Sleep( MIXTHREAD_SLEEP );
+	}
+}
+
+#if XASH_WIN32
+static DWORD WINAPI S_MixThread( LPVOID unused )
+{
+	S_MixThreadLoop();
+	return 0;
+}
+#else
+static void *S_MixThread( void *unused )
+{
+	S_MixThreadLoop();
+	return NULL;
+}
+#endif
+
+/*
+=================
+S_StartMixThread
+=================
+*/
+static void S_StartMixThread( void )
+{
+#if !XASH_WIN32
+	pthread_mutexattr_t	attr;
+#endif
+
+	memset( &s_mixthread, 0, sizeof( s_mixthread ));
+
+#if XASH_WIN32
+	InitializeCriticalSection( &s_mixthread.lock );
+#else
+	// sound code calls back into locked functions
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( &s_mixthread.lock, &attr );
+	pthread_mutexattr_destroy( &attr );
+#endif
+
+	// set it before the thread may take the lock
+	s_mixthread.active = true;
+
+#if XASH_WIN32
+	if(( s_mixthread.thread = CreateThread( NULL, 0, S_MixThread, NULL, 0, NULL )) == NULL )
+#else
+	if( pthread_create( &s_mixthread.thread, NULL, S_MixThread, NULL ) != 0 )
+#endif
+	{
+		s_mixthread.active = false;
+#if XASH_WIN32
+		DeleteCriticalSection( &s_mixthread.lock );
+#else
+		pthread_mutex_destroy( &s_mixthread.lock );
+#endif
+		Con_Printf( S_ERROR "%s: couldn't create mixing thread\n", __func__ );
+		return;
+	}
+
+	Con_Reportf( "%s: mixing in a separate thread\n", __func__ );
+}
+
+/*
+=================
+S_StopMixThread
+=================
+*/
+static void S_StopMixThread( void )
+{
+	S_StoreRelease( &s_mixthread.shutdown, 1 );
+
+#if XASH_WIN32
+	WaitForSingleObject( s_mixthread.thread, INFINITE );
+	CloseHandle( s_mixthread.thread );
+#else
+	pthread_join( s_mixthread.thread, NULL );
+#endif
+
+	// don't lose commands sent after the last pass
+	S_RunCommands();
+
+	s_mixthread.active = false;
+
+#if XASH_WIN32
+	DeleteCriticalSection( &s_mixthread.lock );
+#else
+	pthread_mutex_destroy( &s_mixthread.lock );
+#endif
+	Con_Reportf( "%s: mixing in the main thread\n", __func__ );
+}
+#endif // S_HAVE_THREADS
+
+/*
+=================
+S_UpdateMixThread
+
+start or stop the mixing thread according to snd_mixthread
+=================
+*/
+void S_UpdateMixThread( void )
+{
+#ifdef S_HAVE_THREADS
+	qboolean	enable = dma.initialized && snd_mixthread.value;
+
+	if( enable && !s_mixthread.active )
+		S_StartMixThread();
+	else if( !enable && s_mixthread.active )
+		S_StopMixThread();
+#endif
+	ClearBits( snd_mixthread.flags, FCVAR_CHANGED );
+}
+
+/*
+=================
+S_ShutdownMixThread
+=================
+*/
+void S_ShutdownMixThread( void )
+{
+#ifdef S_HAVE_THREADS
+	if( s_mixthread.active )
+		S_StopMixThread();
+#endif
+}
+
+/*
+=================
+S_MixThreadActive
+=================
+*/
+qboolean S_MixThreadActive( void )
+{
+#ifdef S_HAVE_THREADS
+	return s_mixthread.active;
+#else
+	return false;
+#endif
+}
+
+/*
+=================
+S_LockMixer
+
+keep the mixer away from channels and sound cache,
+commands queued before are applied first to keep the order
+=================
+*/
+void S_LockMixer( void )
+{
+#ifdef S_HAVE_THREADS
+	if( !s_mixthread.active )
+		return;
+
+	S_EnterMixer();
+	S_RunCommands();
+#endif
+}
+
+/*
+=================
+S_UnlockMixer
+=================
+*/
+void S_UnlockMixer( void )
+{
+#ifdef S_HAVE_THREADS
+	if( s_mixthread.active )
+		S_LeaveMixer();
+#endif
+}
+
+/*
+=================
+S_QueueSound
+
+send the sound to the mixing thread, the sound must be
+loaded already so the mixer never touches the filesystem
+returns false if sound should be started directly
+=================
+*/
+qboolean S_QueueSound( const vec3_t pos, int ent, int chan, sfx_t *sfx, int vol, float attn, int pitch, int flags )
+{
+#ifdef S_HAVE_THREADS
+	sndcmd_t	cmd;
+
+	if( !s_mixthread.active )
+		return false;
+
+	VectorCopy( pos, cmd.pos );
+	cmd.ent = ent;
+	cmd.chan = chan;
+	cmd.sfx = sfx;
+	cmd.vol = vol;
+	cmd.attn = attn;
+	cmd.pitch = pitch;
+	cmd.flags = flags;
+
+	if( !FBitSet( flags, SND_STOP ))
+		SND_SpatializeCommand( &cmd );
+
+	if( !S_QueuePush( &s_mixthread.queue, &cmd ))
+	{
+		// mixer is stuck, flush it here
+		s_mixthread.queuefull++;
+		S_LockMixer();
+		SND_StartQueuedSound( &cmd );
+		S_UnlockMixer();
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+=================
+S_PrintMixThreadState
+=================
+*/
+void S_PrintMixThreadState( void )
+{
+#ifdef S_HAVE_THREADS
+	if( s_mixthread.active )
+	{
+		Con_Printf( "mixing thread: active, %i queue overflows\n", s_mixthread.queuefull );
+		return;
+	}
+#endif
+	Con_Printf( "mixing thread: not active\n" );
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define QUEUE_TEST_COUNT	10000
+
+#ifdef S_HAVE_THREADS
+#if XASH_WIN32
+static DWORD WINAPI Test_QueueProducer( LPVOID ctx )
+#else
+static void *Test_QueueProducer( void *ctx )
+#endif
+{
+	sndqueue_t	*queue = ctx;
+	sndcmd_t	cmd;
+	int	i;
+
+	memset( &cmd, 0, sizeof( cmd ));
+
+	for( i = 0; i < QUEUE_TEST_COUNT; i++ )
+	{
+		cmd.ent = i;
+		cmd.pitch = i ^ 0x5a5a;
+
+		while( !S_QueuePush( queue, &cmd ));
+	}
+
+	return 0;
+}
+#endif // S_HAVE_THREADS
+
+static sndqueue_t	test_queue;
+
+void Test_RunSoundQueue( void )
+{
+	sndcmd_t	cmd;
+	int	i, bad = 0;
+
+	memset( &test_queue, 0, sizeof( test_queue ));
+	memset( &cmd, 0, sizeof( cmd ));
+
+	// fill up, overflow and drain in order
+	for( i = 0; i < SND_QUEUE_SIZE; i++ )
+	{
+		cmd.ent = i;
+		if( !S_QueuePush( &test_queue, &cmd ))
+			bad++;
+	}
+
+	TASSERT( bad == 0 );
+	TASSERT( !S_QueuePush( &test_queue, &cmd ));
+
+	for( i = 0; i < SND_QUEUE_SIZE; i++ )
+	{
+		if( !S_QueuePop( &test_queue, &cmd ) || cmd.ent != i )
+			bad++;
+	}
+
+	TASSERT( bad == 0 );
+	TASSERT( !S_QueuePop( &test_queue, &cmd ));
+
+#ifdef S_HAVE_THREADS
+	{
+#if XASH_WIN32
+		HANDLE	thread;
+
+		if(( thread = CreateThread( NULL, 0, Test_QueueProducer, &test_queue, 0, NULL )) == NULL )
+#else
+		pthread_t	thread;
+
+		if( pthread_create( &thread, NULL, Test_QueueProducer, &test_queue ) != 0 )
+#endif
+		{
+			TASSERT( !"couldn't create producer thread" );
+			return;
+		}
+
+		// consume while the other thread produces, order must hold across wraps
+		for( i = 0; i < QUEUE_TEST_COUNT; i++ )
+		{
+			while( !S_QueuePop( &test_queue, &cmd ));
+
+			if( cmd.ent != i || cmd.pitch != ( i ^ 0x5a5a ))
+				bad++;
+		}
+
+#if XASH_WIN32
+		WaitForSingleObject( thread, INFINITE );
+		CloseHandle( thread );
+#else
+		pthread_join( thread, NULL );
+#endif
+		TASSERT( bad == 0 );
+		TASSERT( !S_QueuePop( &test_queue, &cmd ));
+	}
+#endif // S_HAVE_THREADS
+}
+
+#define MIX_TEST_SOUND	"test_mixthread.wav"
+#define MIX_TEST_SAMPLES	22050
+
+static void Test_WriteMixSound( void )
+{
+	// 16-bit mono 22 kHz, constant level
+	static const byte	header[44] =
+	{
+		'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+		'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+		0x22, 0x56, 0, 0, 0x44, 0xAC, 0, 0, 2, 0, 16, 0,
+		'd', 'a', 't', 'a', 0, 0, 0, 0,
+	};
+	byte	data[sizeof( header )];
+	short	s = LittleShort( 8000 );
+	file_t	*f;
+	int	i;
+
+	memcpy( data, header, sizeof( data ));
+	*(uint *)( data + 4 ) = LittleLong( 36 + MIX_TEST_SAMPLES * 2 );
+	*(uint *)( data + 40 ) = LittleLong( MIX_TEST_SAMPLES * 2 );
+
+	f = FS_Open( DEFAULT_SOUNDPATH MIX_TEST_SOUND, "wb", true );
+	if( !f ) return;
+
+	FS_Write( f, data, sizeof( data ));
+	for( i = 0; i < MIX_TEST_SAMPLES; i++ )
+		FS_Write( f, &s, sizeof( s ));
+	FS_Close( f );
+}
+
+void Test_RunSoundMixThread( void )
+{
+	qboolean	oldnull = s_nulldevice;
+	int	i, painted = 0, loud = 0;
+	const short	*out;
+
+	Test_WriteMixSound();
+
+	// whole sound system on the silent device
+	s_nulldevice = true;
+	TASSERT( S_Init( ));
+
+	if( !dma.initialized )
+	{
+		s_nulldevice = oldnull;
+		FS_Delete( DEFAULT_SOUNDPATH MIX_TEST_SOUND );
+		return;
+	}
+
+	Cvar_DirectSet( &snd_mixthread, "1" );
+	S_UpdateMixThread();
+#ifdef S_HAVE_THREADS
+	TASSERT( S_MixThreadActive( ));
+#endif
+
+	S_StartLocalSound( MIX_TEST_SOUND, VOL_NORM, false );
+
+#ifdef S_HAVE_THREADS
+	// only the mixing thread paints while this one waits
+	Sys_Sleep( 300 );
+#else
+	// no thread to hand it to, paint the same way here
+	for( i = 0; i < 300 / MIXTHREAD_SLEEP; i++ )
+	{
+		S_UpdateChannels();
+		Sys_Sleep( MIXTHREAD_SLEEP );
+	}
+#endif
+
+	S_LockMixer();
+	painted = paintedtime;
+	out = (const short *)dma.buffer;
+	for( i = 0; i < dma.samples; i++ )
+	{
+		if( out[i] != 0 )
+			loud++;
+	}
+	S_UnlockMixer();
+
+	TASSERT( painted > SOUND_DMA_SPEED / 10 );
+	TASSERT( loud > 0 );
+
+	// volumes are worked out by the game thread when the sound is queued,
+	// listener moving before the mixer gets to it must not change them
+	{
+		sndcmd_t	cmd;
+		channel_t	*ch = NULL;
+		int	oldent = s_listener.entnum;
+
+		memset( &cmd, 0, sizeof( cmd ));
+		cmd.sfx = S_FindName( MIX_TEST_SOUND, NULL );
+		cmd.chan = CHAN_ITEM;
+		cmd.vol = 200;
+		cmd.attn = ATTN_NORM;
+		cmd.pitch = PITCH_NORM;
+		VectorSet( cmd.pos, 200.0f, 200.0f, 0.0f );
+
+		S_LockMixer();
+		s_listener.entnum = 1; // world sound isn't played from the view
+		VectorClear( s_listener.origin );
+		VectorSet( s_listener.right, 0.0f, 1.0f, 0.0f );
+
+		SND_SpatializeCommand( &cmd );
+		TASSERT( cmd.rightvol > cmd.leftvol && cmd.leftvol > 0 );
+
+		VectorSet( s_listener.origin, 0.0f, -800.0f, 0.0f );
+		VectorSet( s_listener.right, 0.0f, -1.0f, 0.0f );
+		SND_StartQueuedSound( &cmd );
+
+		for( i = NUM_AMBIENTS; i < MAX_DYNAMIC_CHANNELS; i++ )
+		{
+			if( channels[i].sfx == cmd.sfx && channels[i].entchannel == CHAN_ITEM )
+				ch = &channels[i];
+		}
+
+		TASSERT( ch != NULL );
+		TASSERT( ch && ch->leftvol == cmd.leftvol && ch->rightvol == cmd.rightvol );
+		s_listener.entnum = oldent;
+		S_UnlockMixer();
+	}
+
+	Cvar_DirectSet( &snd_mixthread, "0" );
+	S_Shutdown();
+	TASSERT( !S_MixThreadActive( ) && !dma.initialized );
+
+	s_nulldevice = oldnull;
+	FS_Delete( DEFAULT_SOUNDPATH MIX_TEST_SOUND );
+}
+#endif // XASH_ENGINE_TESTS
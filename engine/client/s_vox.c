@@ -391,7 +391,9 @@ void VOX_FreeWord( channel_t *pchan )
 	if( pchan->words[pchan->wordIndex].sfx )
 	{
 		// If this wave wasn't precached by the game code
-		if( !pchan->words[pchan->wordIndex].fKeepCached )
+		// the mixing thread can't load it back, so keep words
+		// around until the next registration
+		if( !pchan->words[pchan->wordIndex].fKeepCached && !S_MixThreadActive( ))
 		{
 			FS_FreeSound( pchan->words[pchan->wordIndex].sfx->cache );
 			pchan->words[pchan->wordIndex].sfx->cache = NULL;
@@ -414,6 +416,13 @@ void VOX_LoadFirstWord( channel_t *pchan, voxword_t *pwords )
 	}
 	pchan->words[i].sfx = NULL;
 
+	// the mixing thread must not touch the filesystem
+	if( S_MixThreadActive( ))
+	{
+		for( i = 0; pchan->words[i].sfx != NULL; i++ )
+			S_LoadSound( pchan->words[i].sfx );
+	}
+
 	pchan->wordIndex = 0;
 	VOX_LoadWord( pchan );
 }
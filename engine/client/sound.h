@@ -198,6 +198,37 @@ typedef struct
 	int		source;		// may be game, menu, etc
 } bg_track_t;
 
+typedef struct
+{
+	uint		passes;
+	uint		underruns;	// device caught up with the mixer
+	double		total;		// time spent in MIX_PaintChannels
+	double		peak;
+} mixstats_t;
+
+#define SND_QUEUE_SIZE	256	// must be power of two
+
+typedef struct
+{
+	vec3_t		pos;
+	sfx_t		*sfx;
+	int		ent;
+	int		chan;
+	int		vol;
+	float		attn;
+	int		pitch;
+	int		flags;
+	int		leftvol;		// spatialized by the game thread
+	int		rightvol;
+} sndcmd_t;
+
+typedef struct
+{
+	sndcmd_t		cmds[SND_QUEUE_SIZE];
+	int		head;		// written by producer only
+	int		tail;		// written by consumer only
+} sndqueue_t;
+
 //====================================================================
 
 #define MAX_DYNAMIC_CHANNELS	(60 + NUM_AMBIENTS)
@@ -215,6 +246,7 @@ extern int	soundtime;
 extern listener_t	s_listener;
 extern int	idsp_room;
 extern dma_t	dma;
+extern qboolean	s_nulldevice;
 
 extern convar_t	s_musicvolume;
 extern convar_t	s_lerping;
@@ -223,6 +255,11 @@ extern convar_t	s_test;		// cvar to testify new effects
 extern convar_t s_samplecount;
 extern convar_t snd_mute_losefocus;
 extern convar_t s_warn_late_precache;
+extern convar_t snd_mixsimd;
+extern convar_t snd_mixthread;
+extern convar_t snd_resample;
+extern convar_t snd_musicthread;
+extern convar_t snd_musicahead;
 
 void S_InitScaletable( void );
 wavdata_t *S_LoadSound( sfx_t *sfx );
@@ -233,11 +270,16 @@ float S_GetMusicVolume( void );
 // s_main.c
 //
 void S_FreeChannel( channel_t *ch );
+void S_UpdateChannels( void );
+void SND_StartSound( const vec3_t pos, int ent, int chan, sfx_t *sfx, int vol, float attn, int pitch, int flags );
+void SND_StartQueuedSound( const sndcmd_t *cmd );
+void SND_SpatializeCommand( sndcmd_t *cmd );
 
 //
 // s_mix.c
 //
 int S_MixDataToDevice( channel_t *pChannel, int sampleCount, int outputRate, int outputOffset, int timeCompress );
+void S_MixBench_f( void );
 void MIX_ClearAllPaintBuffers( int SampleCount, qboolean clearFilters );
 void MIX_InitAllPaintbuffers( void );
 void MIX_FreeAllPaintbuffers( void );
@@ -296,6 +338,26 @@ qboolean S_StreamGetCurrentState( char *currentTrack, char *loopTrack, int *posi
 void S_PrintBackgroundTrackState( void );
 void S_FadeMusicVolume( float fadePercent );
 
+//
+// s_null.c
+//
+qboolean SNDNULL_Init( void );
+void SNDNULL_BeginPainting( void );
+void SNDNULL_Shutdown( void );
+
+//
+// s_thread.c
+//
+qboolean S_QueuePush( sndqueue_t *queue, const sndcmd_t *cmd );
+qboolean S_QueuePop( sndqueue_t *queue, sndcmd_t *cmd );
+void S_UpdateMixThread( void );
+void S_ShutdownMixThread( void );
+qboolean S_MixThreadActive( void );
+void S_LockMixer( void );
+void S_UnlockMixer( void );
+qboolean S_QueueSound( const vec3_t pos, int ent, int chan, sfx_t *sfx, int vol, float attn, int pitch, int flags );
+void S_PrintMixThreadState( void );
+
 //
 // s_utils.c
 //
@@ -88,6 +88,42 @@ void R_SaveVideoMode( int w, int h , int render_w, int render_h )
 	SCR_VidInit(); // tell client.dll that vid_mode has changed
 }
 
+/*
+=================
+VID_NullModeSize
+
+size of the offscreen mode, used by renderers
+that draw without a window (ref_soft -nullblit)
+=================
+*/
+void VID_NullModeSize( int *width, int *height )
+{
+	*width = Cvar_VariableInteger( "width" );
+	*height = Cvar_VariableInteger( "height" );
+
+	if( *width < VID_MIN_WIDTH || *height < VID_MIN_HEIGHT )
+	{
+		*width = 640;
+		*height = 480;
+	}
+}
+
+/*
+=================
+VID_SetNullMode
+
+there is no window to set a mode on, just pass the size
+=================
+*/
+static void VID_SetNullMode( void )
+{
+	int	w, h;
+
+	VID_NullModeSize( &w, &h );
+	refState.fullScreen = false;
+	R_SaveVideoMode( w, h, w, h );
+}
+
 /*
 =================
 VID_GetModeString
@@ -123,7 +159,11 @@ void VID_CheckChanges( void )
 
 	if( host.renderinfo_changed )
 	{
-		if( VID_SetMode( ))
+		if( ref.novideo )
+		{
+			VID_SetNullMode();
+		}
+		else if( VID_SetMode( ))
 		{
 			SCR_VidInit(); // tell the client.dll what vid_mode has changed
 		}
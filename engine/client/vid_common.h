@@ -37,6 +37,7 @@ extern convar_t	*vid_scale;
 extern convar_t	*gl_msaa_samples;
 void R_SaveVideoMode( int w, int h, int render_w, int render_h );
 void VID_CheckChanges( void );
+void VID_NullModeSize( int *width, int *height );
 const char *VID_GetModeString( int vid_mode );
 void VID_StartupGamma( void );
 
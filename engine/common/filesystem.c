@@ -134,6 +134,19 @@ typedef struct zip_s
 	zipfile_t	*files;
 } zip_t;
 
+typedef struct fsindex_s
+{
+	uint		*hashes;			// open addressing, zero is an empty slot
+	int		size;			// power of two
+	int		count;
+	qboolean		allowed;			// search paths were set up by FS_Rescan
+	qboolean		dirty;			// search paths were changed since last build
+	int		lookups;			// since the level start
+	int		avoided;
+	int		totallookups;
+	int		totalavoided;
+} fsindex_t;
+
 typedef struct searchpath_s
 {
 	string		filename;
@@ -152,6 +165,7 @@ static char			fs_gamedir[MAX_SYSPATH];	// game current directory
 static char			fs_writedir[MAX_SYSPATH];	// path that game allows to overwrite, delete and rename files (and create new of course)
 
 static qboolean		fs_ext_path = false;	// attempt to read\write from ./ or ../ pathes
+static fsindex_t		fs_index;			// hashes of files visible through the search paths
 #if !XASH_WIN32
 static qboolean		fs_caseinsensitive = true; // try to search missing files
 #endif
@@ -233,6 +247,7 @@ static int FS_SysFileTime( const char *filename );
 static signed char W_TypeFromExt( const char *lumpname );
 static const char *W_ExtFromType( signed char lumptype );
 static void FS_Purge( file_t* file );
+static void FS_IndexStats_f( void );
 
 /*
 =============================================================================
@@ -1059,6 +1074,7 @@ static qboolean FS_AddWad_Fullpath( const char *wadfile, qboolean *already_loade
 		search->next = fs_searchpaths;
 		search->flags |= flags;
 		fs_searchpaths = search;
+		fs_index.dirty = true;
 
 		Con_Reportf( "Adding wadfile: %s (%i files)\n", wadfile, wad->numlumps );
 		return true;
@@ -1116,6 +1132,7 @@ static qboolean FS_AddPak_Fullpath( const char *pakfile, qboolean *already_loade
 		search->next = fs_searchpaths;
 		search->flags |= flags;
 		fs_searchpaths = search;
+		fs_index.dirty = true;
 
 		Con_Reportf( "Adding pakfile: %s (%i files)\n", pakfile, pak->numfiles );
 
@@ -1170,6 +1187,7 @@ qboolean FS_AddZip_Fullpath( const char *zipfile, qboolean *already_loaded, int
 		search->next = fs_searchpaths;
 		search->flags |= flags;
 		fs_searchpaths = search;
+		fs_index.dirty = true;
 
 		Con_Reportf( "Adding zipfile: %s (%i files)\n", zipfile, zip->numfiles );
 
@@ -1255,6 +1273,7 @@ void FS_AddGameDirectory( const char *dir, uint flags )
 	search->next = fs_searchpaths;
 	search->flags = flags;
 	fs_searchpaths = search;
+	fs_index.dirty = true;
 }
 
 /*
@@ -1316,6 +1335,8 @@ FS_ClearSearchPath
 */
 void FS_ClearSearchPath( void )
 {
+	fs_index.dirty = true;
+
 	while( fs_searchpaths )
 	{
 		searchpath_t	*search = fs_searchpaths;
@@ -1409,6 +1430,7 @@ void FS_Rescan( void )
 	Con_Reportf( "FS_Rescan( %s )\n", GI->title );
 
 	FS_ClearSearchPath();
+	fs_index.allowed = true;
 
 #if XASH_IOS
 	{
@@ -2063,6 +2085,7 @@ void FS_Init( void )
 
 	Cmd_AddRestrictedCommand( "fs_rescan", FS_Rescan_f, "rescan filesystem search pathes" );
 	Cmd_AddRestrictedCommand( "fs_path", FS_Path_f, "show filesystem search pathes" );
+	Cmd_AddRestrictedCommand( "fs_indexstats", FS_IndexStats_f, "show filesystem probes avoided by the search path index" );
 	Cmd_AddRestrictedCommand( "fs_clearpaths", FS_ClearPaths_f, "clear filesystem search pathes" );
 
 #if !XASH_WIN32
@@ -2183,6 +2206,7 @@ void FS_Shutdown( void )
 
 	FS_ClearSearchPath(); // release all wad files too
 	Mem_FreePool( &fs_mempool );
+	memset( &fs_index, 0, sizeof( fs_index ));
 }
 
 /*
@@ -2466,6 +2490,301 @@ qboolean FS_SysFolderExists( const char *path )
 #endif
 }
 
+/*
+=============================================================================
+
+SEARCH PATH INDEX
+
+keeps hashes of lowercased names of every file visible through the
+search paths, so probing for a missing file costs one hash lookup
+instead of a walk over all the paks, wads and directories.
+hash collision costs only a regular lookup, so names are not stored.
+the index is built on first use after the search paths were changed
+and is updated by every file written through the filesystem
+
+=============================================================================
+*/
+#define FS_INDEX_MAXDEPTH	16	// directory recursion limit
+
+static uint FS_IndexHashString( const char *s, uint hash )
+{
+	for( ; *s; s++ )
+		hash = ( hash ^ (byte)( *s == '\\' ? '/' : Q_tolower( *s ))) * 16777619u;
+	return hash;
+}
+
+static uint FS_IndexHash( const char *name )
+{
+	uint	hash = FS_IndexHashString( name, 2166136261u );
+
+	return hash ? hash : 1;
+}
+
+static qboolean FS_IndexFind( uint hash )
+{
+	uint	i, mask = fs_index.size - 1;
+
+	for( i = hash & mask; fs_index.hashes[i]; i = ( i + 1 ) & mask )
+	{
+		if( fs_index.hashes[i] == hash )
+			return true;
+	}
+
+	return false;
+}
+
+static void FS_IndexInsert( uint hash )
+{
+	uint	*old = fs_index.hashes;
+	int	i, oldsize = fs_index.size;
+	uint	j, mask;
+
+	// keep load factor under the half
+	if(( fs_index.count + 1 ) * 2 > fs_index.size )
+	{
+		fs_index.size = Q_max( fs_index.size * 2, 4096 );
+		fs_index.hashes = Mem_Calloc( fs_mempool, fs_index.size * sizeof( uint ));
+		fs_index.count = 0;
+
+		for( i = 0; i < oldsize; i++ )
+		{
+			if( old[i] )
+				FS_IndexInsert( old[i] );
+		}
+
+		if( old ) Mem_Free( old );
+	}
+
+	mask = fs_index.size - 1;
+
+	for( j = hash & mask; fs_index.hashes[j]; j = ( j + 1 ) & mask )
+	{
+		if( fs_index.hashes[j] == hash )
+			return;
+	}
+
+	fs_index.hashes[j] = hash;
+	fs_index.count++;
+}
+
+static void FS_IndexDirectory( const char *dir, const char *subdir, int depth )
+{
+	char		path[MAX_SYSPATH];
+	stringlist_t	list;
+	int		i;
+
+	stringlistinit( &list );
+	Q_snprintf( path, sizeof( path ), "%s%s", dir, subdir );
+	listdirectory( &list, path, false );
+
+	for( i = 0; i < list.numstrings; i++ )
+	{
+		Q_snprintf( path, sizeof( path ), "%s%s", subdir, list.strings[i] );
+		FS_IndexInsert( FS_IndexHash( path ));
+
+		if( depth < FS_INDEX_MAXDEPTH && FS_SysFolderExists( va( "%s%s", dir, path )))
+		{
+			Q_strncat( path, "/", sizeof( path ));
+			FS_IndexDirectory( dir, path, depth + 1 );
+		}
+	}
+
+	stringlistfreecontents( &list );
+}
+
+static void FS_IndexWad( wfile_t *wad )
+{
+	char	wadname[MAX_SYSPATH];
+	string	lumpname;
+	uint	hash;
+	int	i;
+
+	// lumps are found by their own name and by wadname/lump
+	COM_FileBase( wad->filename, wadname );
+	Q_strncat( wadname, "/", sizeof( wadname ));
+	hash = FS_IndexHashString( wadname, 2166136261u );
+
+	for( i = 0; i < wad->numlumps; i++ )
+	{
+		const char *ext = W_ExtFromType( wad->lumps[i].type );
+
+		if( !*ext ) continue; // only found by the name without extension
+
+		Q_snprintf( lumpname, sizeof( lumpname ), "%s.%s", wad->lumps[i].name, ext );
+		FS_IndexInsert( FS_IndexHash( lumpname ));
+		FS_IndexInsert( Q_max( FS_IndexHashString( lumpname, hash ), 1 ));
+	}
+}
+
+/*
+====================
+FS_IndexBuild
+
+returns false if the index can't be used
+====================
+*/
+static qboolean FS_IndexBuild( void )
+{
+	searchpath_t	*search;
+	double		start;
+	int		i;
+
+	// before the first rescan search paths contain whole root directory
+	if( !fs_index.allowed || fs_ext_path )
+		return false;
+
+	if( !fs_index.dirty && fs_index.hashes )
+		return true;
+
+	start = Sys_DoubleTime();
+
+	if( fs_index.hashes )
+		memset( fs_index.hashes, 0, fs_index.size * sizeof( uint ));
+	fs_index.count = 0;
+
+	for( search = fs_searchpaths; search; search = search->next )
+	{
+		if( search->pack )
+		{
+			for( i = 0; i < search->pack->numfiles; i++ )
+				FS_IndexInsert( FS_IndexHash( search->pack->files[i].name ));
+		}
+		else if( search->zip )
+		{
+			for( i = 0; i < search->zip->numfiles; i++ )
+				FS_IndexInsert( FS_IndexHash( search->zip->files[i].name ));
+		}
+		else if( search->wad )
+		{
+			FS_IndexWad( search->wad );
+		}
+		else
+		{
+			FS_IndexDirectory( search->filename, "", 0 );
+		}
+	}
+
+	// empty search paths still need a table to look into
+	if( !fs_index.hashes )
+		FS_IndexInsert( FS_IndexHash( "" ));
+
+	fs_index.dirty = false;
+	Con_Reportf( "FS_IndexBuild: %i files in %.1f ms\n", fs_index.count, ( Sys_DoubleTime() - start ) * 1000.0 );
+
+	return true;
+}
+
+/*
+====================
+FS_IndexAddFile
+
+file was created in the write directory
+====================
+*/
+static void FS_IndexAddFile( const char *filepath )
+{
+	char		real_path[MAX_SYSPATH];
+	searchpath_t	*search;
+	size_t		len;
+
+	if( !fs_index.hashes || fs_index.dirty )
+		return; // will be seen by the next build
+
+	Q_snprintf( real_path, sizeof( real_path ), "%s%s", fs_writedir, filepath );
+	COM_FixSlashes( real_path );
+
+	// the same file may be visible through a nested directory like downloaded/
+	for( search = fs_searchpaths; search; search = search->next )
+	{
+		if( search->pack || search->zip || search->wad )
+			continue;
+
+		len = Q_strlen( search->filename );
+
+		if( !Q_strnicmp( real_path, search->filename, len ))
+			FS_IndexInsert( FS_IndexHash( real_path + len ));
+	}
+}
+
+/*
+====================
+FS_IndexedFileExists
+
+quick check against the search path index, never returns false
+for an existing file but may return true for a missing one
+====================
+*/
+qboolean FS_IndexedFileExists( const char *path )
+{
+	string		wadname, lumpname;
+	signed char	type;
+	qboolean		found;
+
+	if( !FS_IndexBuild( ))
+		return true; // index is not available, do a regular lookup
+
+	found = FS_IndexFind( FS_IndexHash( path ));
+	type = W_TypeFromExt( path );
+
+	if( type == TYP_ANY )
+		found = true; // lump of any type
+	else if( !found && type != TYP_NONE )
+	{
+		// any folder name selects the wad with the same name
+		COM_ExtractFilePath( path, wadname );
+		if( COM_CheckStringEmpty( wadname ))
+		{
+			COM_FileBase( wadname, wadname );
+			COM_FileBase( path, lumpname );
+			found = FS_IndexFind( FS_IndexHash( va( "%s/%s.%s", wadname, lumpname, COM_FileExtension( path ))));
+		}
+	}
+
+	fs_index.lookups++;
+	fs_index.totallookups++;
+
+	if( !found )
+	{
+		fs_index.avoided++;
+		fs_index.totalavoided++;
+	}
+
+	return found;
+}
+
+/*
+====================
+FS_IndexNewLevel
+
+report probes avoided while the previous level was loaded
+====================
+*/
+void FS_IndexNewLevel( void )
+{
+	if( fs_index.lookups )
+		Con_Reportf( "FS_IndexNewLevel: %i of %i file probes avoided\n", fs_index.avoided, fs_index.lookups );
+
+	fs_index.lookups = fs_index.avoided = 0;
+}
+
+/*
+====================
+FS_IndexStats_f
+====================
+*/
+static void FS_IndexStats_f( void )
+{
+	if( !FS_IndexBuild( ))
+	{
+		Con_Printf( "search path index is not available\n" );
+		return;
+	}
+
+	Con_Printf( "search path index: %i files, %i Kb\n", fs_index.count, (int)( fs_index.size * sizeof( uint ) / 1024 ));
+	Con_Printf( "  this level: %i of %i probes avoided\n", fs_index.avoided, fs_index.lookups );
+	Con_Printf( "  total: %i of %i probes avoided\n", fs_index.totalavoided, fs_index.totallookups );
+}
+
 /*
 ====================
 FS_FindFile
@@ -2723,6 +3042,7 @@ file_t *FS_Open( const char *filepath, const char *mode, qboolean gamedironly )
 		// open the file on disk directly
 		Q_sprintf( real_path, "%s/%s", fs_writedir, filepath );
 		FS_CreatePath( real_path );// Create directories up to the file
+		FS_IndexAddFile( filepath );
 		return FS_SysOpen( real_path, mode );
 	}
 
@@ -3502,6 +3822,7 @@ qboolean FS_Rename( const char *oldname, const char *newname )
 	COM_FixSlashes( newpath );
 
 	iRet = rename( oldpath, newpath );
+	if( iRet == 0 ) FS_IndexAddFile( newname );
 
 	return (iRet == 0);
 }
@@ -4158,3 +4479,38 @@ static byte *W_LoadFile( const char *path, fs_offset_t *lumpsizeptr, qboolean ga
 		return W_ReadLump( search->wad, &search->wad->lumps[index], lumpsizeptr );
 	return NULL;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+void Test_RunFSIndex( void )
+{
+	fsindex_t		saved = fs_index;
+	searchpath_t	*savedpaths = fs_searchpaths;
+	dlumpinfo_t	lump;
+	wfile_t		wad;
+
+	memset( &fs_index, 0, sizeof( fs_index ));
+	memset( &wad, 0, sizeof( wad ));
+	memset( &lump, 0, sizeof( lump ));
+	fs_index.allowed = true;
+	fs_searchpaths = NULL;
+	FS_IndexBuild();
+
+	Q_strncpy( wad.filename, "valve/decals.wad", sizeof( wad.filename ));
+	Q_strncpy( lump.name, "{blood1", sizeof( lump.name ));
+	lump.type = TYP_MIPTEX;
+	wad.lumps = &lump;
+	wad.numlumps = 1;
+	FS_IndexWad( &wad );
+	FS_IndexInsert( FS_IndexHash( "gfx/env/desertup.tga" ));
+
+	TASSERT( FS_IndexedFileExists( "GFX\\env\\DesertUp.tga" ) && !FS_IndexedFileExists( "gfx/env/desertup.png" ));
+	TASSERT( FS_IndexedFileExists( "{BLOOD1.mip" ) && FS_IndexedFileExists( "decals.wad/{blood1.mip" ) && !FS_IndexedFileExists( "gfx/{blood1.mip" ));
+	TASSERT( fs_index.avoided == 2 );
+
+	Mem_Free( fs_index.hashes );
+	fs_index = saved;
+	fs_searchpaths = savedpaths;
+}
+#endif /* XASH_ENGINE_TESTS */
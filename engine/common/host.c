@@ -820,9 +820,35 @@ static void Host_RunTests( int stage )
 		Test_RunCommon();
 		Test_RunCmd();
 		Test_RunCvar();
+#if !XASH_DEDICATED
+		Test_RunSoundMix();
+		Test_RunSoundQueue();
+		Test_RunSoundDSP();
+#endif
 		break;
 	case 1: // after FS load
+		Cvar_Set( "image_cache", "0" ); // keep test images out of the cache
 		Test_RunImagelib();
+		Test_RunImageKernels();
+		Test_RunImageCache();
+		Test_RunImagePNG();
+		Test_RunFSIndex();
+		Test_RunSoundlib();
+		Test_RunPhysIndex();
+#if !XASH_DEDICATED
+		Test_ClientSetup();
+		Test_RunSoundMusic();
+		Test_RunSoundMixThread();
+		Test_RunParticles();
+		Test_RunBeamSegments();
+		Test_RunTempEnts();
+		Test_RunLightBins();
+		Test_RunTimeDemoStats();
+		Test_RunDemoIndex();
+		Test_RunInterpHistory();
+		Test_RunPredictionCache();
+		Test_ClientShutdown();
+#endif
 		Msg( "Done! %d passed, %d failed\n", tests_stats.passed, tests_stats.failed );
 		Sys_Quit();
 	}
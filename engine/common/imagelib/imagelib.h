@@ -96,6 +96,8 @@ typedef struct imglib_s
 	int			cmd_flags;	// global imglib flags
 	int			force_flags;	// override cmd_flags
 	qboolean			custom_palette;	// custom palette was installed
+	qboolean			nosimd;		// scalar resample and mip kernels only
+	int			numthreads;	// mip chain threads, detected on first use
 } imglib_t;
 
 // imagelib definitions
@@ -124,6 +126,16 @@ enum
 
 extern imglib_t image;
 
+typedef struct imgcachekey_s
+{
+	byte			digest[16];
+	qboolean			valid;		// image can be cached
+	size_t			srcsize;		// source file size
+	double			start;		// lookup time, to measure decode cost
+} imgcachekey_t;
+
+void Image_Resample32Lerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight );
+void Image_Resample24Lerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight );
 byte *Image_ResampleInternal( const void *indata, int in_w, int in_h, int out_w, int out_h, int intype, qboolean *done );
 byte *Image_FlipInternal( const byte *in, word *srcwidth, word *srcheight, int type, int flags );
 rgbdata_t *Image_Load(const char *filename, const byte *buffer, size_t buffsize );
@@ -177,5 +189,14 @@ void Image_CopyParms( rgbdata_t *src );
 qboolean Image_ValidSize( const char *name );
 qboolean Image_LumpValidSize( const char *name );
 qboolean Image_CheckFlag( int bit );
+qboolean Image_ProcessPasses( rgbdata_t **pix, int width, int height, uint flags, float reserved );
+
+//
+// img_cache.c
+//
+void Image_CacheInit( void );
+void Image_CacheShutdown( void );
+rgbdata_t *Image_CacheLoad( imgcachekey_t *key, const loadpixformat_t *format, const char *name, const byte *buffer, size_t size );
+rgbdata_t *Image_CacheStore( const imgcachekey_t *key, rgbdata_t *pic );
 
 #endif//IMAGELIB_H
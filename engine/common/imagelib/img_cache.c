@@ -0,0 +1,688 @@
+/*
+img_cache.c - persistent cache of decoded images
+Copyright (C) 2026 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "imagelib.h"
+#include "crclib.h"
+#include "xash3d_mathlib.h"
+
+/*
+===============================================================================
+
+IMAGE CACHE
+
+decoded FS_LoadImage results are kept in the game write directory
+as imagecache/<md5>.img, the key covers the source bytes, the loader
+and every flag that can change the decoded result, so a stale entry
+is never addressed. entries are evicted in least recently used order
+when the directory grows beyond image_cache_size megabytes
+
+===============================================================================
+*/
+#define IMAGECACHE_DIR		"imagecache"
+#define IMAGECACHE_IDENT		(('C'<<24)+('M'<<16)+('I'<<8)+'X') // little-endian "XIMC"
+#define IMAGECACHE_VERSION		1
+#define IMAGECACHE_HASHSIZE		1024	// must be power of two
+#define IMAGECACHE_MIN_SIZE		16384	// smaller images decode faster than a file open
+
+typedef struct
+{
+	int		ident;
+	int		version;
+	byte		key[16];
+	word		width;
+	word		height;
+	word		depth;
+	word		encode;
+	uint		type;
+	uint		flags;
+	byte		numMips;
+	byte		pad[3];
+	rgba_t		fogParams;
+	uint		size;		// pixel data, starts at sizeof( imgcachehdr_t )
+	uint		palsize;		// palette follows the pixels
+	byte		reserved[8];	// keep pixels 64-byte aligned in the file
+} imgcachehdr_t;
+
+typedef struct
+{
+	byte		key[16];
+	uint		size;		// file size on disk
+	uint		lastuse;
+	int		next;		// hash chain
+} imgcacheentry_t;
+
+typedef enum
+{
+	IMAGECACHE_NORMAL = 0,
+	IMAGECACHE_OFF,		// neither lookup nor store
+	IMAGECACHE_COLD,		// skip lookup, store everything
+} imgcachemode_t;
+
+static struct
+{
+	qboolean		loaded;
+	string		gamedir;		// index owner
+	imgcacheentry_t	*entries;
+	int		numentries;
+	int		maxentries;
+	int		hash[IMAGECACHE_HASHSIZE];
+	size_t		totalsize;
+	uint		clock;
+	imgcachemode_t	mode;
+
+	// statistics
+	int		hits;
+	int		misses;
+	int		stores;
+	int		evictions;
+	size_t		hitbytes;
+	double		hittime;
+	double		misstime;
+} icache;
+
+static CVAR_DEFINE_AUTO( image_cache, "0", FCVAR_ARCHIVE, "keep decoded images in the imagecache directory" );
+static CVAR_DEFINE_AUTO( image_cache_size, "64", FCVAR_ARCHIVE, "image cache size limit in megabytes" );
+
+static uint Image_CacheHash( const byte key[16] )
+{
+	return ( key[0] | ( key[1] << 8 )) & ( IMAGECACHE_HASHSIZE - 1 );
+}
+
+static const char *Image_CachePath( const byte key[16], const char *ext )
+{
+	return va( IMAGECACHE_DIR "/%s.%s", MD5_Print( (byte *)key ), ext );
+}
+
+static int Image_CachePaletteSize( const rgbdata_t *pic )
+{
+	switch( pic->type )
+	{
+	case PF_INDEXED_24: return 768;
+	case PF_INDEXED_32: return 1024;
+	}
+	return 0;
+}
+
+/*
+=================
+Image_CacheHashData
+
+MD5 of a megabyte costs more than reading it, so the bulk of the
+source is folded by four multiplicative lanes and only the lanes
+and the tail go through MD5
+=================
+*/
+static void Image_CacheHashData( MD5Context_t *ctx, const byte *data, size_t size )
+{
+	uint64_t	lanes[4] = { 0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL };
+	uint64_t	v;
+	size_t	i;
+	int	j;
+
+	for( i = 0; i + sizeof( lanes ) <= size; i += sizeof( lanes ))
+	{
+		for( j = 0; j < 4; j++ )
+		{
+			memcpy( &v, data + i + j * sizeof( v ), sizeof( v ));
+			lanes[j] = ( lanes[j] ^ v ) * 0x9E3779B97F4A7C15ULL;
+			lanes[j] ^= lanes[j] >> 29;
+		}
+	}
+
+	MD5Update( ctx, (const byte *)lanes, sizeof( lanes ));
+	MD5Update( ctx, data + i, size - i );
+}
+
+static int Image_CacheHexDigit( char c )
+{
+	if( c >= '0' && c <= '9' ) return c - '0';
+	if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+	if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+	return -1;
+}
+
+static qboolean Image_CacheParseKey( const char *filename, byte key[16] )
+{
+	char	base[MAX_QPATH];
+	int	i, hi, lo;
+
+	COM_FileBase( filename, base );
+
+	if( strlen( base ) != 32 )
+		return false;
+
+	for( i = 0; i < 16; i++ )
+	{
+		hi = Image_CacheHexDigit( base[i*2+0] );
+		lo = Image_CacheHexDigit( base[i*2+1] );
+		if( hi < 0 || lo < 0 )
+			return false;
+		key[i] = ( hi << 4 ) | lo;
+	}
+
+	return true;
+}
+
+/*
+===============================================================================
+
+INDEX
+
+===============================================================================
+*/
+static void Image_CacheRehash( void )
+{
+	int	i, h;
+
+	for( i = 0; i < IMAGECACHE_HASHSIZE; i++ )
+		icache.hash[i] = -1;
+
+	for( i = 0; i < icache.numentries; i++ )
+	{
+		h = Image_CacheHash( icache.entries[i].key );
+		icache.entries[i].next = icache.hash[h];
+		icache.hash[h] = i;
+	}
+}
+
+static int Image_CacheFind( const byte key[16] )
+{
+	int	i;
+
+	for( i = icache.hash[Image_CacheHash( key )]; i != -1; i = icache.entries[i].next )
+	{
+		if( !memcmp( icache.entries[i].key, key, 16 ))
+			return i;
+	}
+
+	return -1;
+}
+
+static void Image_CacheAddEntry( const byte key[16], uint size, uint lastuse )
+{
+	imgcacheentry_t	*e;
+	int		h;
+
+	if( icache.numentries == icache.maxentries )
+	{
+		icache.maxentries = Q_max( icache.maxentries * 2, 256 );
+		icache.entries = Mem_Realloc( host.imagepool, icache.entries, icache.maxentries * sizeof( *e ));
+	}
+
+	e = &icache.entries[icache.numentries];
+	memcpy( e->key, key, 16 );
+	e->size = size;
+	e->lastuse = lastuse;
+
+	h = Image_CacheHash( key );
+	e->next = icache.hash[h];
+	icache.hash[h] = icache.numentries++;
+	icache.totalsize += size;
+}
+
+static void Image_CacheRemoveEntry( int i, qboolean rehash )
+{
+	FS_Delete( Image_CachePath( icache.entries[i].key, "img" ));
+	icache.totalsize -= icache.entries[i].size;
+	icache.entries[i] = icache.entries[--icache.numentries];
+
+	if( rehash )
+		Image_CacheRehash();
+}
+
+/*
+=================
+Image_CacheEvict
+
+drop least recently used entries until the cache fits into the limit,
+entry from previous sessions are ordered by file time
+=================
+*/
+static void Image_CacheEvict( size_t limit )
+{
+	int	i, oldest;
+
+	if( icache.totalsize <= limit )
+		return;
+
+	while( icache.totalsize > limit && icache.numentries > 0 )
+	{
+		for( i = 1, oldest = 0; i < icache.numentries; i++ )
+		{
+			if( icache.entries[i].lastuse < icache.entries[oldest].lastuse )
+				oldest = i;
+		}
+
+		Image_CacheRemoveEntry( oldest, false );
+		icache.evictions++;
+	}
+
+	Image_CacheRehash();
+}
+
+static void Image_CacheFreeIndex( void )
+{
+	if( icache.entries )
+		Mem_Free( icache.entries );
+
+	icache.entries = NULL;
+	icache.numentries = icache.maxentries = 0;
+	icache.totalsize = 0;
+	icache.loaded = false;
+}
+
+/*
+=================
+Image_CacheLoadIndex
+
+the index belongs to the current game directory,
+scan it again when the game is changed
+=================
+*/
+static void Image_CacheLoadIndex( void )
+{
+	const char	*gamedir = GI ? GI->gamefolder : "";
+	search_t		*t;
+	byte		key[16];
+	int		i, time;
+
+	if( icache.loaded && !Q_strcmp( icache.gamedir, gamedir ))
+		return;
+
+	Image_CacheFreeIndex();
+	Image_CacheRehash();
+	Q_strncpy( icache.gamedir, gamedir, sizeof( icache.gamedir ));
+	icache.loaded = true;
+	icache.clock = 0;
+
+	// partially written entries from the crashed session
+	if(( t = FS_Search( IMAGECACHE_DIR "/*.tmp", true, true )) != NULL )
+	{
+		for( i = 0; i < t->numfilenames; i++ )
+			FS_Delete( t->filenames[i] );
+		Mem_Free( t );
+	}
+
+	if(( t = FS_Search( IMAGECACHE_DIR "/*.img", true, true )) == NULL )
+		return;
+
+	for( i = 0; i < t->numfilenames; i++ )
+	{
+		if( !Image_CacheParseKey( t->filenames[i], key ) || Image_CacheFind( key ) != -1 )
+			continue;
+
+		time = Q_max( FS_FileTime( t->filenames[i], true ), 0 );
+		icache.clock = Q_max( icache.clock, (uint)time );
+		Image_CacheAddEntry( key, FS_FileSize( t->filenames[i], true ), time );
+	}
+
+	Mem_Free( t );
+}
+
+/*
+===============================================================================
+
+LOOKUP AND STORE
+
+===============================================================================
+*/
+static qboolean Image_CacheEnabled( void )
+{
+	return image_cache.value != 0.0f && icache.mode != IMAGECACHE_OFF && !image.custom_palette;
+}
+
+/*
+=================
+Image_CacheFormat
+
+only formats that decode into more than they read are worth hashing,
+MIP, SPR, DDS and kept 8-bit palettes stay as large as the source
+=================
+*/
+static qboolean Image_CacheFormat( const loadpixformat_t *format, const byte *buffer, size_t size )
+{
+	if( format->loadfunc == Image_LoadPNG || format->loadfunc == Image_LoadTGA )
+		return true;
+
+	// biBitCount, 8-bit bitmap is expanded unless the palette is kept
+	if( format->loadfunc == Image_LoadBMP )
+		return !Image_CheckFlag( IL_KEEP_8BIT ) || size < 30 || buffer[28] != 8 || buffer[29] != 0;
+
+	return false;
+}
+
+/*
+=================
+Image_CacheLoad
+
+computes the key of the source image and returns cached copy,
+the key is reused by Image_CacheStore when the lookup is missed
+=================
+*/
+rgbdata_t *Image_CacheLoad( imgcachekey_t *key, const loadpixformat_t *format, const char *name, const byte *buffer, size_t size )
+{
+	MD5Context_t	ctx;
+	imgcachehdr_t	hdr;
+	rgbdata_t		*pic;
+	file_t		*f;
+	int		flags, i;
+	double		start;
+
+	key->valid = false;
+	key->start = start = Sys_DoubleTime();
+
+	if( !Image_CacheEnabled( ) || !buffer || !size || !Image_CacheFormat( format, buffer, size ))
+		return NULL;
+
+	// anything that can change the decoded result
+	flags = image.cmd_flags | image.force_flags;
+	i = IMAGECACHE_VERSION;
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, (const byte *)&i, sizeof( i ));
+	MD5Update( &ctx, (const byte *)name, Q_strlen( name ));
+	MD5Update( &ctx, (const byte *)&image.hint, sizeof( image.hint ));
+	MD5Update( &ctx, (const byte *)&flags, sizeof( flags ));
+	Image_CacheHashData( &ctx, buffer, size );
+	MD5Final( key->digest, &ctx );
+	key->srcsize = size;
+	key->valid = true;
+
+	Image_CacheLoadIndex();
+
+	if( icache.mode == IMAGECACHE_COLD || ( i = Image_CacheFind( key->digest )) == -1 )
+	{
+		icache.misses++;
+		return NULL;
+	}
+
+	f = FS_Open( Image_CachePath( key->digest, "img" ), "rb", false );
+
+	if( !f || FS_Read( f, &hdr, sizeof( hdr )) != sizeof( hdr ) || hdr.ident != IMAGECACHE_IDENT
+	 || hdr.version != IMAGECACHE_VERSION || memcmp( hdr.key, key->digest, 16 ) || !hdr.width || !hdr.height
+	 || sizeof( hdr ) + hdr.size + hdr.palsize != icache.entries[i].size )
+	{
+		// damaged or replaced from outside
+		if( f ) FS_Close( f );
+		Image_CacheRemoveEntry( i, true );
+		icache.misses++;
+		return NULL;
+	}
+
+	pic = Mem_Calloc( host.imagepool, sizeof( rgbdata_t ));
+	pic->width = hdr.width;
+	pic->height = hdr.height;
+	pic->depth = hdr.depth;
+	pic->encode = hdr.encode;
+	pic->type = hdr.type;
+	pic->flags = hdr.flags;
+	pic->numMips = hdr.numMips;
+	pic->size = hdr.size;
+	memcpy( pic->fogParams, hdr.fogParams, sizeof( pic->fogParams ));
+	pic->buffer = Mem_Malloc( host.imagepool, hdr.size );
+	if( hdr.palsize ) pic->palette = Mem_Malloc( host.imagepool, hdr.palsize );
+
+	if( FS_Read( f, pic->buffer, hdr.size ) != hdr.size || ( hdr.palsize && FS_Read( f, pic->palette, hdr.palsize ) != hdr.palsize ))
+	{
+		FS_Close( f );
+		FS_FreeImage( pic );
+		Image_CacheRemoveEntry( i, true );
+		icache.misses++;
+		return NULL;
+	}
+
+	FS_Close( f );
+
+	icache.entries[i].lastuse = ++icache.clock;
+	icache.hits++;
+	icache.hitbytes += hdr.size;
+	icache.hittime += Sys_DoubleTime() - start;
+
+	// same as ImagePack
+	image.force_flags = 0;
+
+	return pic;
+}
+
+/*
+=================
+Image_CacheStore
+
+writes freshly decoded image under the key computed by Image_CacheLoad,
+returns the image back to the caller
+=================
+*/
+rgbdata_t *Image_CacheStore( const imgcachekey_t *key, rgbdata_t *pic )
+{
+	const char	*tmppath;
+	imgcachehdr_t	hdr;
+	size_t		limit;
+	file_t		*f;
+	int		i;
+
+	if( !key->valid || !pic || !pic->buffer )
+		return pic;
+
+	icache.misstime += Sys_DoubleTime() - key->start;
+
+	// cubemaps are never loaded from a single source,
+	// uncompressed source is read as fast as the cached copy
+	if( FBitSet( pic->flags, IMAGE_CUBEMAP ) || pic->size < IMAGECACHE_MIN_SIZE || key->srcsize >= pic->size )
+		return pic;
+
+	// palette of the non-indexed image has no known size
+
+	if( pic->palette && !Image_CachePaletteSize( pic ))
+		return pic;
+
+	memset( &hdr, 0, sizeof( hdr ));
+	hdr.ident = IMAGECACHE_IDENT;
+	hdr.version = IMAGECACHE_VERSION;
+	memcpy( hdr.key, key->digest, 16 );
+	hdr.width = pic->width;
+	hdr.height = pic->height;
+	hdr.depth = pic->depth;
+	hdr.encode = pic->encode;
+	hdr.type = pic->type;
+	hdr.flags = pic->flags;
+	hdr.numMips = pic->numMips;
+	memcpy( hdr.fogParams, pic->fogParams, sizeof( hdr.fogParams ));
+	hdr.size = pic->size;
+	hdr.palsize = pic->palette ? Image_CachePaletteSize( pic ) : 0;
+
+	limit = (size_t)( Q_max( image_cache_size.value, 0.0f ) * 1024.0f * 1024.0f );
+	if( sizeof( hdr ) + hdr.size + hdr.palsize > limit )
+		return pic;
+
+	// write to the temporary name first, so interrupted write is never picked up
+	tmppath = Image_CachePath( key->digest, "tmp" );
+	if(( f = FS_Open( tmppath, "wb", true )) == NULL )
+		return pic;
+
+	FS_Write( f, &hdr, sizeof( hdr ));
+	FS_Write( f, pic->buffer, hdr.size );
+	if( hdr.palsize ) FS_Write( f, pic->palette, hdr.palsize );
+	FS_Close( f );
+
+	// cold pass overwrites existing entry
+	if(( i = Image_CacheFind( key->digest )) != -1 )
+		Image_CacheRemoveEntry( i, true );
+
+	if( !FS_Rename( tmppath, Image_CachePath( key->digest, "img" )))
+	{
+		FS_Delete( tmppath );
+		return pic;
+	}
+
+	Image_CacheAddEntry( key->digest, sizeof( hdr ) + hdr.size + hdr.palsize, ++icache.clock );
+	icache.stores++;
+
+	Image_CacheEvict( limit );
+
+	return pic;
+}
+
+/*
+===============================================================================
+
+COMMANDS
+
+===============================================================================
+*/
+static void Image_CacheStats_f( void )
+{
+	Image_CacheLoadIndex();
+
+	Con_Printf( "image cache: %s, %i entries, %.1f of %.0f Mb\n", image_cache.value ? "enabled" : "disabled",
+		icache.numentries, icache.totalsize / ( 1024.0 * 1024.0 ), image_cache_size.value );
+	Con_Printf( "  hits: %i (%.1f Mb in %.1f ms)\n", icache.hits, icache.hitbytes / ( 1024.0 * 1024.0 ), icache.hittime * 1000.0 );
+	Con_Printf( "  misses: %i (decoded in %.1f ms)\n", icache.misses, icache.misstime * 1000.0 );
+	Con_Printf( "  stores: %i, evictions: %i\n", icache.stores, icache.evictions );
+}
+
+static double Image_CacheBenchPass( search_t *t, imgcachemode_t mode, int *loaded )
+{
+	rgbdata_t	*pic;
+	double	start;
+	int	i;
+
+	icache.mode = mode;
+	*loaded = 0;
+	start = Sys_DoubleTime();
+
+	for( i = 0; i < t->numfilenames; i++ )
+	{
+		if(( pic = FS_LoadImage( t->filenames[i], NULL, 0 )) != NULL )
+		{
+			FS_FreeImage( pic );
+			(*loaded)++;
+		}
+	}
+
+	icache.mode = IMAGECACHE_NORMAL;
+
+	return ( Sys_DoubleTime() - start ) * 1000.0;
+}
+
+/*
+=================
+Image_CacheBench_f
+
+loads the same set of images without the cache,
+with cold cache and with warm cache
+=================
+*/
+static void Image_CacheBench_f( void )
+{
+	double	uncached, cold, warm;
+	int	loaded;
+	search_t	*t;
+
+	if( Cmd_Argc() != 2 )
+	{
+		Con_Printf( S_USAGE "imagecache_bench <wildcard>\n" );
+		return;
+	}
+
+	if( !image_cache.value )
+	{
+		Con_Printf( "image cache is disabled\n" );
+		return;
+	}
+
+	if(( t = FS_Search( Cmd_Argv( 1 ), true, false )) == NULL )
+	{
+		Con_Printf( "no files matching %s\n", Cmd_Argv( 1 ));
+		return;
+	}
+
+	uncached = Image_CacheBenchPass( t, IMAGECACHE_OFF, &loaded );
+	cold = Image_CacheBenchPass( t, IMAGECACHE_COLD, &loaded );
+	warm = Image_CacheBenchPass( t, IMAGECACHE_NORMAL, &loaded );
+	Mem_Free( t );
+
+	Con_Printf( "%i images: uncached %.1f ms, cold %.1f ms, warm %.1f ms (%.1fx)\n",
+		loaded, uncached, cold, warm, warm > 0.0 ? uncached / warm : 0.0 );
+}
+
+void Image_CacheInit( void )
+{
+	Cvar_RegisterVariable( &image_cache );
+	Cvar_RegisterVariable( &image_cache_size );
+
+	Cmd_AddCommand( "imagecache_stats", Image_CacheStats_f, "print image cache statistics" );
+	Cmd_AddCommand( "imagecache_bench", Image_CacheBench_f, "compare uncached, cold and warm image loading" );
+}
+
+void Image_CacheShutdown( void )
+{
+	Image_CacheFreeIndex();
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+void Test_RunImageCache( void )
+{
+	const loadpixformat_t	tgaformat = { "%s%s.%s", "tga", Image_LoadTGA, IL_HINT_NO };
+	const loadpixformat_t	mipformat = { "%s%s.%s", "mip", Image_LoadMIP, IL_HINT_NO };
+	imgcachekey_t	key, first;
+	rgbdata_t		src, *pic;
+	byte		source[64];
+	string		oldcache, oldsize;
+	int		i, bad = 0;
+
+	Q_strncpy( oldcache, image_cache.string, sizeof( oldcache ));
+	Q_strncpy( oldsize, image_cache_size.string, sizeof( oldsize ));
+	Cvar_DirectSet( &image_cache, "1" );
+
+	memset( &src, 0, sizeof( src ));
+	src.width = src.height = 128;
+	src.depth = 1;
+	src.type = PF_RGBA_32;
+	src.size = 128 * 128 * 4;
+	src.buffer = Mem_Malloc( host.imagepool, src.size );
+	for( i = 0; i < src.size; i++ )
+		src.buffer[i] = COM_RandomLong( 0, 255 );
+	for( i = 0; i < sizeof( source ); i++ )
+		source[i] = COM_RandomLong( 0, 255 );
+
+	// mip never decodes into more than it reads, so it isn't even hashed
+	i = icache.misses;
+	TASSERT( Image_CacheLoad( &key, &mipformat, "test.mip", source, sizeof( source )) == NULL );
+	TASSERT( !key.valid && icache.misses == i );
+
+	// first lookup misses, second one returns the stored copy
+	TASSERT( Image_CacheLoad( &first, &tgaformat, "test.tga", source, sizeof( source )) == NULL );
+	Image_CacheStore( &first, &src );
+	pic = Image_CacheLoad( &key, &tgaformat, "test.tga", source, sizeof( source ));
+	bad += !pic || pic->width != src.width || pic->type != src.type || memcmp( pic->buffer, src.buffer, src.size );
+	TASSERT( bad == 0 );
+	if( pic ) FS_FreeImage( pic );
+
+	// room for one entry only, the least recently used one goes away
+	Cvar_DirectSet( &image_cache_size, "0.1" );
+	source[0]++;
+	Image_CacheLoad( &key, &tgaformat, "test.tga", source, sizeof( source ));
+	Image_CacheStore( &key, &src );
+	TASSERT( Image_CacheFind( first.digest ) == -1 && Image_CacheFind( key.digest ) != -1 );
+
+	Cvar_DirectSet( &image_cache, oldcache );
+	Cvar_DirectSet( &image_cache_size, oldsize );
+	if(( i = Image_CacheFind( key.digest )) != -1 )
+		Image_CacheRemoveEntry( i, true );
+	Mem_Free( src.buffer );
+}
+#endif /* XASH_ENGINE_TESTS */
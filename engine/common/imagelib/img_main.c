@@ -15,6 +15,7 @@ GNU General Public License for more details.
 
 #include <math.h>
 #include "imagelib.h"
+#include "xash3d_mathlib.h"
 
 // global image variables
 imglib_t	image;
@@ -219,6 +220,8 @@ rgbdata_t *FS_LoadImage( const char *filename, const byte *buffer, size_t size )
 	fs_offset_t	filesize = 0;
 	const loadpixformat_t *format;
 	const cubepack_t	*cmap;
+	imgcachekey_t	key;
+	rgbdata_t		*pic;
 	byte		*f;
 
 	Q_strncpy( loadname, filename, sizeof( loadname ));
@@ -250,14 +253,20 @@ rgbdata_t *FS_LoadImage( const char *filename, const byte *buffer, size_t size )
 		{
 			Q_sprintf( path, format->formatstring, loadname, "", format->ext );
 			image.hint = format->hint;
-			f = FS_LoadFile( path, &filesize, false );
+			f = FS_IndexedFileExists( path ) ? FS_LoadFile( path, &filesize, false ) : NULL;
 
 			if( f && filesize > 0 )
 			{
+				if(( pic = Image_CacheLoad( &key, format, path, f, filesize )) != NULL )
+				{
+					Mem_Free( f ); // release buffer
+					return pic; // decoded before
+				}
+
 				if( format->loadfunc( path, f, filesize ))
 				{
 					Mem_Free( f ); // release buffer
-					return ImagePack(); // loaded
+					return Image_CacheStore( &key, ImagePack( )); // loaded
 				}
 				else Mem_Free( f ); // release buffer
 			}
@@ -278,7 +287,7 @@ rgbdata_t *FS_LoadImage( const char *filename, const byte *buffer, size_t size )
 					Q_sprintf( path, format->formatstring, loadname, cmap->type[i].suf, format->ext );
 					image.hint = (image_hint_t)cmap->type[i].hint; // side hint
 
-					f = FS_LoadFile( path, &filesize, false );
+					f = FS_IndexedFileExists( path ) ? FS_LoadFile( path, &filesize, false ) : NULL;
 					if( f && filesize > 0 )
 					{
 						// this name will be used only for tell user about problems
@@ -330,8 +339,11 @@ rgbdata_t *FS_LoadImage( const char *filename, const byte *buffer, size_t size )
 			image.hint = format->hint;
 			if( buffer && size > 0  )
 			{
+				if(( pic = Image_CacheLoad( &key, format, va( "%s.%s", loadname, format->ext ), buffer, size )) != NULL )
+					return pic; // decoded before
+
 				if( format->loadfunc( loadname, buffer, size ))
-					return ImagePack(); // loaded
+					return Image_CacheStore( &key, ImagePack( )); // loaded
 			}
 		}
 	}
@@ -523,6 +535,116 @@ static void Test_CheckImage( const char *name, rgbdata_t *rgb )
 	Mem_Free( load );
 }
 
+static rgbdata_t *Test_GenImage( int type, int width, int height, int flags )
+{
+	rgbdata_t	*pic = Mem_Calloc( host.imagepool, sizeof( rgbdata_t ));
+	int	i;
+
+	pic->width = width;
+	pic->height = height;
+	pic->type = type;
+	pic->flags = flags;
+	pic->size = width * height * PFDesc[type].bpp;
+	pic->buffer = Mem_Malloc( host.imagepool, pic->size );
+
+	for( i = 0; i < pic->size; i++ )
+		pic->buffer[i] = (byte)( i * 7 + ( i / width ) * 13 + ( i >> 5 ));
+
+	if( type == PF_INDEXED_24 || type == PF_INDEXED_32 )
+	{
+		int	palsize = type == PF_INDEXED_24 ? 768 : 1024;
+
+		pic->palette = Mem_Malloc( host.imagepool, palsize );
+		for( i = 0; i < palsize; i++ )
+			pic->palette[i] = (byte)( i * 31 + 5 );
+	}
+
+	return pic;
+}
+
+static void Test_ProcessImage( void )
+{
+	const struct
+	{
+		int	type, imageflags;
+		uint	flags;
+		int	width, height;
+		qboolean	lerp;
+	} cases[] =
+	{
+	{ PF_INDEXED_24, IMAGE_HAS_LUMA, IMAGE_MAKE_LUMA|IMAGE_FORCE_RGBA, 0, 0, false },
+	{ PF_INDEXED_24, IMAGE_HAS_LUMA, IMAGE_FORCE_RGBA|IMAGE_LIGHTGAMMA, 0, 0, false },
+	{ PF_INDEXED_24, IMAGE_HAS_ALPHA, IMAGE_FORCE_RGBA|IMAGE_RESAMPLE, 64, 37, true },
+	{ PF_INDEXED_24, 0, IMAGE_FORCE_RGBA|IMAGE_RESAMPLE, 301, 150, false },
+	{ PF_INDEXED_32, IMAGE_HAS_LUMA, IMAGE_MAKE_LUMA|IMAGE_FLIP_X|IMAGE_RESAMPLE, 50, 50, false },
+	{ PF_INDEXED_32, 0, IMAGE_REMAP, 3, 9, false },
+	{ PF_RGBA_32, 0, IMAGE_FLIP_X|IMAGE_ROT_90|IMAGE_LIGHTGAMMA, 0, 0, false },
+	{ PF_RGBA_32, 0, IMAGE_FLIP_Y|IMAGE_RESAMPLE, 128, 200, true },
+	{ PF_RGBA_32, 0, IMAGE_RESAMPLE, 50, 20, false },
+	{ PF_BGRA_32, 0, IMAGE_FORCE_RGBA|IMAGE_LIGHTGAMMA|IMAGE_RESAMPLE, 33, 17, true },
+	{ PF_RGB_24, 0, IMAGE_FLIP_X|IMAGE_FLIP_Y, 0, 0, false },
+	{ PF_BGR_24, 0, IMAGE_FORCE_RGBA|IMAGE_RESAMPLE, 40, 90, true },
+	};
+	rgbdata_t	*src, *a, *b;
+	double	start, time[2];
+	int	i, j, bad = 0;
+	int	cmd_flags = image.cmd_flags;
+
+	for( i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ )
+	{
+		qboolean	ra, rb;
+
+		src = Test_GenImage( cases[i].type, 97, 61, cases[i].imageflags );
+		a = FS_CopyImage( src );
+		b = FS_CopyImage( src );
+
+		if( cases[i].lerp ) SetBits( image.cmd_flags, IL_USE_LERPING );
+		else ClearBits( image.cmd_flags, IL_USE_LERPING );
+
+		ra = Image_ProcessPasses( &a, cases[i].width, cases[i].height, cases[i].flags, 0.0f );
+		rb = Image_Process( &b, cases[i].width, cases[i].height, cases[i].flags, 0.0f );
+
+		if( ra != rb || a->type != b->type || a->flags != b->flags || a->size != b->size
+			|| a->width != b->width || a->height != b->height
+			|| memcmp( a->buffer, b->buffer, a->width * a->height * PFDesc[a->type].bpp ))
+			bad++;
+
+		FS_FreeImage( src );
+		FS_FreeImage( a );
+		FS_FreeImage( b );
+	}
+
+	image.cmd_flags = cmd_flags;
+	TASSERT( bad == 0 )
+
+	// map texture and sprite upload paths
+	for( i = 0; i < 2; i++ )
+	{
+		uint	flags = i ? IMAGE_FORCE_RGBA|IMAGE_RESAMPLE : IMAGE_MAKE_LUMA|IMAGE_FORCE_RGBA|IMAGE_LIGHTGAMMA;
+
+		src = Test_GenImage( PF_INDEXED_24, 512, 512, IMAGE_HAS_LUMA );
+
+		for( j = 0; j < 2; j++ )
+		{
+			int	k;
+
+			start = Sys_DoubleTime();
+			for( k = 0; k < 16; k++ )
+			{
+				a = FS_CopyImage( src );
+				if( j ) Image_Process( &a, 256, 256, flags, 0.0f );
+				else Image_ProcessPasses( &a, 256, 256, flags, 0.0f );
+				FS_FreeImage( a );
+			}
+			time[j] = Sys_DoubleTime() - start;
+		}
+
+		Con_Printf( "%s: %s, passes %.1f Mpix/s, rows %.1f Mpix/s\n", __func__, i ? "sprite" : "texture",
+			16 * 512 * 512 / Q_max( time[0], 0.000001 ) / 1e6, 16 * 512 * 512 / Q_max( time[1], 0.000001 ) / 1e6 );
+		FS_FreeImage( src );
+	}
+}
+
 void Test_RunImagelib( void )
 {
 	rgbdata_t rgb = { 0 };
@@ -564,6 +686,133 @@ void Test_RunImagelib( void )
 	}
 
 	Z_Free( rgb.buffer );
+
+	Test_ProcessImage();
+}
+
+#define KERNEL_TEST_SIZE	4096
+
+static size_t Test_MipChainSize( int width, int height, int nummips )
+{
+	size_t	size = 0;
+	int	i;
+
+	for( i = 1; i < nummips; i++ )
+		size += Q_max( 1, width >> i ) * Q_max( 1, height >> i ) * 4;
+
+	return size;
+}
+
+void Test_RunImageKernels( void )
+{
+	const int	sizes[][4] =
+	{
+	{ 97, 61, 64, 37 },
+	{ 97, 61, 200, 150 },
+	{ 4, 3, 1, 1 },
+	{ 1, 7, 513, 17 },
+	{ 333, 1, 31, 2 },
+	{ 256, 256, 255, 129 },
+	};
+	byte	*in, *a, *b;
+	double	start, time[3];
+	size_t	size, chainsize;
+	int	i, j, pass, bad = 0;
+
+	in = Mem_Malloc( host.imagepool, KERNEL_TEST_SIZE * KERNEL_TEST_SIZE * 4 );
+	for( i = 0; i < KERNEL_TEST_SIZE * KERNEL_TEST_SIZE * 4; i++ )
+		in[i] = (byte)( i * 7 + ( i >> 14 ) * 13 + ( i >> 5 ));
+
+	a = Mem_Malloc( host.imagepool, KERNEL_TEST_SIZE * KERNEL_TEST_SIZE * 4 );
+	b = Mem_Malloc( host.imagepool, KERNEL_TEST_SIZE * KERNEL_TEST_SIZE * 4 );
+
+	// fault the pages in before timing
+	memset( a, 0, KERNEL_TEST_SIZE * KERNEL_TEST_SIZE * 4 );
+	memset( b, 0, KERNEL_TEST_SIZE * KERNEL_TEST_SIZE * 4 );
+
+	// vector and threaded kernels must give the scalar result
+	for( i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); i++ )
+	{
+		const int	*sz = sizes[i];
+		int	nummips = 1;
+
+		for( j = 0; j < 2; j++ )
+		{
+			size = sz[2] * sz[3] * ( j ? 3 : 4 );
+
+			image.nosimd = true;
+			if( j ) Image_Resample24Lerp( in, sz[0], sz[1], a, sz[2], sz[3] );
+			else Image_Resample32Lerp( in, sz[0], sz[1], a, sz[2], sz[3] );
+			image.nosimd = false;
+			if( j ) Image_Resample24Lerp( in, sz[0], sz[1], b, sz[2], sz[3] );
+			else Image_Resample32Lerp( in, sz[0], sz[1], b, sz[2], sz[3] );
+
+			if( memcmp( a, b, size ))
+				bad++;
+		}
+
+		while(( Q_max( sz[0], sz[1] ) >> nummips ) > 0 )
+			nummips++;
+		chainsize = Test_MipChainSize( sz[0], sz[1], nummips );
+
+		image.nosimd = true;
+		Image_BuildMipChain( in, sz[0], sz[1], nummips, a );
+		image.nosimd = false;
+		Image_BuildMipChain( in, sz[0], sz[1], nummips, b );
+
+		if( memcmp( a, b, chainsize ))
+			bad++;
+	}
+
+	// full chain of a large image, threaded against a single thread
+	chainsize = Test_MipChainSize( KERNEL_TEST_SIZE, KERNEL_TEST_SIZE, 13 );
+	j = image.numthreads;
+
+	for( pass = 0; pass < 3; pass++ )
+	{
+		image.nosimd = pass == 0;
+		image.numthreads = pass == 2 ? Q_max( j, 4 ) : 1;
+		if( pass == 2 ) memset( b, 0, chainsize );
+
+		start = Sys_DoubleTime();
+		Image_BuildMipChain( in, KERNEL_TEST_SIZE, KERNEL_TEST_SIZE, 13, pass ? b : a );
+		time[pass] = Sys_DoubleTime() - start;
+
+		if( pass && memcmp( a, b, chainsize ))
+			bad++;
+	}
+
+	image.numthreads = j;
+	image.nosimd = false;
+
+	TASSERT( bad == 0 )
+
+	Con_Printf( "%s: mip chain %ix%i, scalar %.0f MB/s, simd %.0f MB/s, simd+threads %.0f MB/s\n", __func__,
+		KERNEL_TEST_SIZE, KERNEL_TEST_SIZE, 64.0 / Q_max( time[0], 0.000001 ),
+		64.0 / Q_max( time[1], 0.000001 ), 64.0 / Q_max( time[2], 0.000001 ));
+
+	// bilinear resamplers, source MB per second
+	for( j = 0; j < 2; j++ )
+	{
+		for( pass = 0; pass < 2; pass++ )
+		{
+			image.nosimd = pass == 0;
+
+			start = Sys_DoubleTime();
+			if( j ) Image_Resample24Lerp( in, KERNEL_TEST_SIZE, KERNEL_TEST_SIZE, a, 3000, 3000 );
+			else Image_Resample32Lerp( in, KERNEL_TEST_SIZE, KERNEL_TEST_SIZE, a, 3000, 3000 );
+			time[pass] = Sys_DoubleTime() - start;
+		}
+
+		Con_Printf( "%s: %i-bit lerp %ix%i -> 3000x3000, scalar %.0f MB/s, simd %.0f MB/s\n", __func__, j ? 24 : 32,
+			KERNEL_TEST_SIZE, KERNEL_TEST_SIZE, ( j ? 48.0 : 64.0 ) / Q_max( time[0], 0.000001 ), ( j ? 48.0 : 64.0 ) / Q_max( time[1], 0.000001 ));
+	}
+
+	image.nosimd = false;
+
+	Mem_Free( in );
+	Mem_Free( a );
+	Mem_Free( b );
 }
 
 #endif /* XASH_ENGINE_TESTS */
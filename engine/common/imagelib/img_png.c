@@ -25,12 +25,532 @@ GNU General Public License for more details.
 	#include <netinet/in.h>
 #endif
 
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define PNG_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define PNG_NEON	1
+#endif
+
 static const char png_sign[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
 static const char ihdr_sign[] = {'I', 'H', 'D', 'R'};
 static const char idat_sign[] = {'I', 'D', 'A', 'T'};
 static const char iend_sign[] = {'I', 'E', 'N', 'D'};
 static const int  iend_crc32 = 0xAE426082;
 
+#define PNG_RING_SIZE	( 64 * 1024 )	// inflated scanlines kept in memory at once
+
+typedef struct
+{
+	z_stream	stream;
+	byte	*ring;		// inflated scanlines, each with its leading filter byte
+	byte	*rows[2];		// unfiltered RGB scanlines, current and prior
+	byte	*zero;		// prior scanline of the first row
+	uint	ringsize;
+	uint	filled;
+	uint	rowsize;
+	uint	pixel_size;
+	uint	y;
+} pngdecode_t;
+
+/*
+==============================================================
+
+SCANLINE UNFILTER KERNELS
+
+==============================================================
+*/
+#ifdef PNG_SSE2
+_inline __m128i Image_PNGLoad32SSE2( const byte *p )
+{
+	int	v;
+
+	memcpy( &v, p, sizeof( v ));
+	return _mm_cvtsi32_si128( v );
+}
+
+_inline void Image_PNGStore32SSE2( byte *p, __m128i v )
+{
+	int	i = _mm_cvtsi128_si32( v );
+
+	memcpy( p, &i, sizeof( i ));
+}
+
+_inline __m128i Image_PNGSelectSSE2( __m128i mask, __m128i a, __m128i b )
+{
+	return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ));
+}
+
+_inline __m128i Image_PNGAbs16SSE2( __m128i v )
+{
+	return _mm_max_epi16( v, _mm_sub_epi16( _mm_setzero_si128(), v ));
+}
+
+static int Image_PNGUpSSE2( byte *out, const byte *raw, const byte *prior, int rowsize )
+{
+	int	i;
+
+	for( i = 0; i + 16 <= rowsize; i += 16 )
+	{
+		__m128i	x = _mm_loadu_si128(( const __m128i *)( raw + i ));
+		__m128i	b = _mm_loadu_si128(( const __m128i *)( prior + i ));
+
+		_mm_storeu_si128(( __m128i *)( out + i ), _mm_add_epi8( x, b ));
+	}
+
+	return i;
+}
+
+static int Image_PNGSubSSE2( byte *out, const byte *raw, int rowsize, int bpp )
+{
+	__m128i	a = _mm_setzero_si128();
+	__m128i	mask = _mm_cvtsi32_si128( 0xFFFFFF );
+	int	i, step = bpp * 4;
+
+	// prefix sum of four pixels, a 3-byte pixel block leaves its last four bytes to the next step
+	for( i = 0; i + 16 <= rowsize; i += step )
+	{
+		__m128i	x = _mm_loadu_si128(( const __m128i *)( raw + i ));
+
+		if( bpp == 4 )
+		{
+			x = _mm_add_epi8( x, _mm_slli_si128( x, 4 ));
+			x = _mm_add_epi8( x, _mm_slli_si128( x, 8 ));
+			x = _mm_add_epi8( x, a );
+			a = _mm_shuffle_epi32( x, _MM_SHUFFLE( 3, 3, 3, 3 ));
+		}
+		else
+		{
+			x = _mm_add_epi8( x, _mm_slli_si128( x, 3 ));
+			x = _mm_add_epi8( x, _mm_slli_si128( x, 6 ));
+			x = _mm_add_epi8( x, a );
+			a = _mm_and_si128( _mm_srli_si128( x, 9 ), mask );
+			a = _mm_or_si128( a, _mm_slli_si128( a, 3 ));
+			a = _mm_or_si128( a, _mm_slli_si128( a, 6 ));
+		}
+
+		_mm_storeu_si128(( __m128i *)( out + i ), x );
+	}
+
+	return i;
+}
+
+static int Image_PNGAverageSSE2( byte *out, const byte *raw, const byte *prior, int rowsize, int bpp )
+{
+	__m128i	one = _mm_set1_epi8( 1 );
+	__m128i	a = _mm_setzero_si128();
+	int	i;
+
+	// one pixel per step, a 3-byte pixel writes a junk byte the next step overwrites
+	for( i = 0; i + 4 <= rowsize; i += bpp )
+	{
+		__m128i	b = Image_PNGLoad32SSE2( prior + i );
+		__m128i	avg = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), one ));
+
+		a = _mm_add_epi8( Image_PNGLoad32SSE2( raw + i ), avg );
+		Image_PNGStore32SSE2( out + i, a );
+	}
+
+	return i;
+}
+
+static int Image_PNGPaethSSE2( byte *out, const byte *raw, const byte *prior, int rowsize, int bpp )
+{
+	__m128i	zero = _mm_setzero_si128();
+	__m128i	a = zero, c = zero;
+	int	i;
+
+	for( i = 0; i + 4 <= rowsize; i += bpp )
+	{
+		__m128i	b = _mm_unpacklo_epi8( Image_PNGLoad32SSE2( prior + i ), zero );
+		__m128i	pa = _mm_sub_epi16( b, c );
+		__m128i	pb = _mm_sub_epi16( a, c );
+		__m128i	pc = Image_PNGAbs16SSE2( _mm_add_epi16( pa, pb ));
+		__m128i	min, x;
+
+		pa = Image_PNGAbs16SSE2( pa );
+		pb = Image_PNGAbs16SSE2( pb );
+		min = _mm_min_epi16( pc, _mm_min_epi16( pa, pb ));
+		x = Image_PNGSelectSSE2( _mm_cmpeq_epi16( min, pb ), b, c );
+		x = Image_PNGSelectSSE2( _mm_cmpeq_epi16( min, pa ), a, x );
+		x = _mm_add_epi8( Image_PNGLoad32SSE2( raw + i ), _mm_packus_epi16( x, x ));
+		Image_PNGStore32SSE2( out + i, x );
+
+		a = _mm_unpacklo_epi8( x, zero );
+		c = b;
+	}
+
+	return i;
+}
+#endif // PNG_SSE2
+
+#ifdef PNG_NEON
+_inline uint8x8_t Image_PNGLoad32NEON( const byte *p )
+{
+	uint32_t	v;
+
+	memcpy( &v, p, sizeof( v ));
+	return vreinterpret_u8_u32( vdup_n_u32( v ));
+}
+
+_inline void Image_PNGStore32NEON( byte *p, uint8x8_t v )
+{
+	uint32_t	i = vget_lane_u32( vreinterpret_u32_u8( v ), 0 );
+
+	memcpy( p, &i, sizeof( i ));
+}
+
+static int Image_PNGUpNEON( byte *out, const byte *raw, const byte *prior, int rowsize )
+{
+	int	i;
+
+	for( i = 0; i + 16 <= rowsize; i += 16 )
+		vst1q_u8( out + i, vaddq_u8( vld1q_u8( raw + i ), vld1q_u8( prior + i )));
+
+	return i;
+}
+
+static int Image_PNGSubNEON( byte *out, const byte *raw, int rowsize, int bpp )
+{
+	static const byte	mask3[16] = { 0xFF, 0xFF, 0xFF };
+	uint8x16_t	zero = vdupq_n_u8( 0 );
+	uint8x16_t	mask = vld1q_u8( mask3 );
+	uint8x16_t	a = zero;
+	int		i, step = bpp * 4;
+
+	for( i = 0; i + 16 <= rowsize; i += step )
+	{
+		uint8x16_t	x = vld1q_u8( raw + i );
+
+		if( bpp == 4 )
+		{
+			x = vaddq_u8( x, vextq_u8( zero, x, 12 ));
+			x = vaddq_u8( x, vextq_u8( zero, x, 8 ));
+			x = vaddq_u8( x, a );
+			a = vreinterpretq_u8_u32( vdupq_n_u32( vgetq_lane_u32( vreinterpretq_u32_u8( x ), 3 )));
+		}
+		else
+		{
+			x = vaddq_u8( x, vextq_u8( zero, x, 13 ));
+			x = vaddq_u8( x, vextq_u8( zero, x, 10 ));
+			x = vaddq_u8( x, a );
+			a = vandq_u8( vextq_u8( x, zero, 9 ), mask );
+			a = vorrq_u8( a, vextq_u8( zero, a, 13 ));
+			a = vorrq_u8( a, vextq_u8( zero, a, 10 ));
+		}
+
+		vst1q_u8( out + i, x );
+	}
+
+	return i;
+}
+
+static int Image_PNGAverageNEON( byte *out, const byte *raw, const byte *prior, int rowsize, int bpp )
+{
+	uint8x8_t	a = vdup_n_u8( 0 );
+	int	i;
+
+	for( i = 0; i + 4 <= rowsize; i += bpp )
+	{
+		a = vadd_u8( Image_PNGLoad32NEON( raw + i ), vhadd_u8( a, Image_PNGLoad32NEON( prior + i )));
+		Image_PNGStore32NEON( out + i, a );
+	}
+
+	return i;
+}
+
+static int Image_PNGPaethNEON( byte *out, const byte *raw, const byte *prior, int rowsize, int bpp )
+{
+	uint8x8_t	a = vdup_n_u8( 0 ), c = a;
+	int	i;
+
+	for( i = 0; i + 4 <= rowsize; i += bpp )
+	{
+		uint8x8_t	b = Image_PNGLoad32NEON( prior + i );
+		uint16x8_t	pa = vabdl_u8( b, c );
+		uint16x8_t	pb = vabdl_u8( a, c );
+		uint16x8_t	pc = vabdq_u16( vaddl_u8( a, b ), vaddl_u8( c, c ));
+		uint8x8_t	sa = vmovn_u16( vandq_u16( vcleq_u16( pa, pb ), vcleq_u16( pa, pc )));
+		uint8x8_t	sb = vmovn_u16( vcleq_u16( pb, pc ));
+
+		a = vadd_u8( Image_PNGLoad32NEON( raw + i ), vbsl_u8( sa, a, vbsl_u8( sb, b, c )));
+		Image_PNGStore32NEON( out + i, a );
+		c = b;
+	}
+
+	return i;
+}
+#endif // PNG_NEON
+
+/*
+=============
+Image_PNGUnfilterRow
+
+restores one scanline, prior is the previous unfiltered scanline
+=============
+*/
+static qboolean Image_PNGUnfilterRow( byte *out, const byte *raw, const byte *prior, int rowsize, int bpp, int filter_type )
+{
+	short	p, a, b, c, pa, pb, pc;
+	int	i = 0;
+
+	switch( filter_type )
+	{
+	case PNG_F_NONE:
+		memcpy( out, raw, rowsize );
+		break;
+	case PNG_F_SUB:
+#if defined( PNG_SSE2 )
+		if( !image.nosimd ) i = Image_PNGSubSSE2( out, raw, rowsize, bpp );
+#elif defined( PNG_NEON )
+		if( !image.nosimd ) i = Image_PNGSubNEON( out, raw, rowsize, bpp );
+#endif
+		for( ; i < bpp; i++ )
+			out[i] = raw[i];
+
+		for( ; i < rowsize; i++ )
+			out[i] = raw[i] + out[i - bpp];
+		break;
+	case PNG_F_UP:
+#if defined( PNG_SSE2 )
+		if( !image.nosimd ) i = Image_PNGUpSSE2( out, raw, prior, rowsize );
+#elif defined( PNG_NEON )
+		if( !image.nosimd ) i = Image_PNGUpNEON( out, raw, prior, rowsize );
+#endif
+		for( ; i < rowsize; i++ )
+			out[i] = raw[i] + prior[i];
+		break;
+	case PNG_F_AVERAGE:
+#if defined( PNG_SSE2 )
+		if( !image.nosimd ) i = Image_PNGAverageSSE2( out, raw, prior, rowsize, bpp );
+#elif defined( PNG_NEON )
+		if( !image.nosimd ) i = Image_PNGAverageNEON( out, raw, prior, rowsize, bpp );
+#endif
+		for( ; i < bpp; i++ )
+			out[i] = raw[i] + ( prior[i] >> 1 );
+
+		for( ; i < rowsize; i++ )
+			out[i] = raw[i] + ( ( out[i - bpp] + prior[i] ) >> 1 );
+		break;
+	case PNG_F_PAETH:
+#if defined( PNG_SSE2 )
+		if( !image.nosimd ) i = Image_PNGPaethSSE2( out, raw, prior, rowsize, bpp );
+#elif defined( PNG_NEON )
+		if( !image.nosimd ) i = Image_PNGPaethNEON( out, raw, prior, rowsize, bpp );
+#endif
+		for( ; i < bpp; i++ )
+			out[i] = raw[i] + prior[i];
+
+		for( ; i < rowsize; i++ )
+		{
+			a = out[i - bpp];
+			b = prior[i];
+			c = prior[i - bpp];
+			p = a + b - c;
+			pa = abs( p - a );
+			pb = abs( p - b );
+			pc = abs( p - c );
+
+			out[i] = raw[i];
+
+			if( pc < pa && pc < pb )
+				out[i] += c;
+			else if( pb < pa )
+				out[i] += b;
+			else
+				out[i] += a;
+		}
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/*
+=============
+Image_PNGFlushRows
+
+unfilters every complete scanline in the ring
+=============
+*/
+static qboolean Image_PNGFlushRows( pngdecode_t *png )
+{
+	uint	rowbytes = png->rowsize + 1; // +1 for filter
+	byte	*raw = png->ring, *out, *prior, *pixbuf, *rowend;
+
+	for( ; png->filled - ( raw - png->ring ) >= rowbytes && png->y < image.height; raw += rowbytes, png->y++ )
+	{
+		if( png->pixel_size == 4 )
+		{
+			// RGBA scanlines go straight to the image
+			out = image.rgba + png->y * png->rowsize;
+			prior = png->y ? out - png->rowsize : png->zero;
+		}
+		else
+		{
+			out = png->rows[png->y & 1];
+			prior = png->y ? png->rows[( png->y - 1 ) & 1] : png->zero;
+		}
+
+		if( !Image_PNGUnfilterRow( out, raw + 1, prior, png->rowsize, png->pixel_size, raw[0] ))
+			return false;
+
+		if( png->pixel_size == 4 )
+			continue;
+
+		// convert RGB-to-RGBA
+		pixbuf = image.rgba + png->y * image.width * 4;
+		for( rowend = out + png->rowsize; out < rowend; out += 3 )
+		{
+			*pixbuf++ = out[0];
+			*pixbuf++ = out[1];
+			*pixbuf++ = out[2];
+			*pixbuf++ = 0xFF;
+		}
+	}
+
+	// keep the incomplete scanline at the ring start
+	png->filled -= raw - png->ring;
+	if( png->filled && raw != png->ring )
+		memmove( png->ring, raw, png->filled );
+
+	return true;
+}
+
+/*
+=============
+Image_PNGInflate
+
+inflates one IDAT chunk through the scanline ring
+=============
+*/
+static qboolean Image_PNGInflate( pngdecode_t *png, const byte *data, uint size, const char *name )
+{
+	int	ret;
+
+	png->stream.next_in = (byte *)data;
+	png->stream.avail_in = size;
+
+	while( png->y < image.height )
+	{
+		png->stream.next_out = png->ring + png->filled;
+		png->stream.avail_out = png->ringsize - png->filled;
+
+		ret = inflate( &png->stream, Z_NO_FLUSH );
+		png->filled = png->ringsize - png->stream.avail_out;
+
+		if( !Image_PNGFlushRows( png ))
+		{
+			Con_DPrintf( S_ERROR "Image_LoadPNG: Found unknown filter type (%s)\n", name );
+			return false;
+		}
+
+		if( ret == Z_STREAM_END )
+			break;
+
+		if( ret != Z_OK && ret != Z_BUF_ERROR )
+		{
+			Con_DPrintf( S_ERROR "Image_LoadPNG: IDAT chunk decompression failed (%s)\n", name );
+			return false;
+		}
+
+		// inflater may still hold output when the ring was full
+		if( ret == Z_BUF_ERROR || ( !png->stream.avail_in && png->stream.avail_out ))
+			break;
+	}
+
+	return true;
+}
+
+/*
+=============
+Image_PNGReadChunks
+
+walks the chunk list, IDAT data is decoded as it's found
+=============
+*/
+static qboolean Image_PNGReadChunks( pngdecode_t *png, const byte *buf_p, const byte *end, const char *name )
+{
+	uint	 	chunk_len, crc32, crc32_check, chunk_sign;
+	qboolean 	has_idat_chunk = false;
+
+	while( 1 )
+	{
+		// length, signature and CRC
+		if( end - buf_p < 12 )
+		{
+			Con_DPrintf( S_ERROR "Image_LoadPNG: IEND chunk not found (%s)\n", name );
+			return false;
+		}
+
+		// get chunk length
+		memcpy( &chunk_len, buf_p, sizeof( chunk_len ) );
+
+		// convert chunk length to little endian
+		chunk_len = ntohl( chunk_len );
+
+		if( chunk_len > INT_MAX || chunk_len > (uint)( end - buf_p - 12 ))
+		{
+			Con_DPrintf( S_ERROR "Image_LoadPNG: Found chunk with wrong size (%s)\n", name );
+			return false;
+		}
+
+		// move pointer
+		buf_p += sizeof( chunk_sign );
+
+		// calculate chunk CRC
+		CRC32_Init( &crc32_check );
+		CRC32_ProcessBuffer( &crc32_check, buf_p, chunk_len + sizeof( idat_sign ) );
+		crc32_check = CRC32_Final( crc32_check );
+
+		// get real chunk CRC
+		memcpy( &crc32, buf_p + sizeof( chunk_sign ) + chunk_len, sizeof( crc32 ) );
+
+		// check chunk CRC
+		if( ntohl( crc32 ) != crc32_check )
+		{
+			Con_DPrintf( S_ERROR "Image_LoadPNG: Found chunk with wrong CRC32 sum (%s)\n", name );
+			return false;
+		}
+
+		if( !memcmp( buf_p, idat_sign, sizeof( idat_sign ) ) )
+		{
+			if( !Image_PNGInflate( png, buf_p + sizeof( idat_sign ), chunk_len, name ))
+				return false;
+			has_idat_chunk = true;
+		}
+		else if( !memcmp( buf_p, iend_sign, sizeof( iend_sign ) ) )
+		{
+			if( chunk_len != 0 )
+			{
+				Con_DPrintf( S_ERROR "Image_LoadPNG: IEND chunk has wrong size (%s)\n", name );
+				return false;
+			}
+			break;
+		}
+
+		// move pointer
+		buf_p += sizeof( chunk_sign ) + chunk_len + sizeof( crc32 );
+	}
+
+	if( !has_idat_chunk )
+	{
+		Con_DPrintf( S_ERROR "Image_LoadPNG: Couldn't find IDAT chunks (%s)\n", name );
+		return false;
+	}
+
+	if( png->y != image.height )
+	{
+		Con_DPrintf( S_ERROR "Image_LoadPNG: IDAT chunk decompression failed (%s)\n", name );
+		return false;
+	}
+
+	return true;
+}
+
 /*
 =============
 Image_LoadPNG
@@ -38,15 +558,11 @@ Image_LoadPNG
 */
 qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesize )
 {
-	int		ret;
-	short		p, a, b, c, pa, pb, pc;
-	byte		*buf_p, *pixbuf, *raw, *prior, *idat_buf = NULL, *uncompressed_buffer = NULL, *rowend;
-	uint	 	chunk_len, crc32, crc32_check, oldsize = 0, newsize = 0, rowsize;
-	uint	 	uncompressed_size, pixel_size, i, y, filter_type, chunk_sign;
-	qboolean 	has_iend_chunk = false;
-	z_stream 	stream = {0};
+	byte		*buf_p;
+	uint	 	crc32_check, ringrows, rowsize, pixel_size;
+	qboolean	ret;
+	pngdecode_t	png = {0};
 	png_t		png_hdr;
-
 	if( filesize < sizeof( png_hdr ) )
 		return false;
 
@@ -140,80 +656,6 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 	// move pointer
 	buf_p += sizeof( png_hdr );
 
-	// find all critical chunks
-	while( !has_iend_chunk && ( buf_p - buffer ) < filesize )
-	{
-		// get chunk length
-		memcpy( &chunk_len, buf_p, sizeof( chunk_len ) );
-
-		// convert chunk length to little endian
-		chunk_len = ntohl( chunk_len );
-
-		if( chunk_len > INT_MAX )
-		{
-			Con_DPrintf( S_ERROR "Image_LoadPNG: Found chunk with wrong size (%s)\n", name );
-			Mem_Free( idat_buf );
-			return false;
-		}
-
-		// move pointer
-		buf_p += sizeof( chunk_sign );
-
-		// get all IDAT chunks data
-		if( !memcmp( buf_p, idat_sign, sizeof( idat_sign ) ) )
-		{
-			newsize = oldsize + chunk_len;
-			idat_buf = (byte *)Mem_Realloc( host.imagepool, idat_buf, newsize );
-			memcpy( idat_buf + oldsize, buf_p + sizeof( idat_sign ), chunk_len );
-			oldsize = newsize;
-		}
-		else if( !memcmp( buf_p, iend_sign, sizeof( iend_sign ) ) )
-			has_iend_chunk = true;
-
-		// calculate chunk CRC
-		CRC32_Init( &crc32_check );
-		CRC32_ProcessBuffer( &crc32_check, buf_p, chunk_len + sizeof( idat_sign ) );
-		crc32_check = CRC32_Final( crc32_check );
-
-		// move pointer
-		buf_p += sizeof( chunk_sign );
-		buf_p += chunk_len;
-
-		// get real chunk CRC
-		memcpy( &crc32, buf_p, sizeof( crc32 ) );
-
-		// check chunk CRC
-		if( ntohl( crc32 ) != crc32_check )
-		{
-			Con_DPrintf( S_ERROR "Image_LoadPNG: Found chunk with wrong CRC32 sum (%s)\n", name );
-			Mem_Free( idat_buf );
-			return false;
-		}
-
-		// move pointer
-		buf_p += sizeof( crc32 );
-	}
-
-	if( !has_iend_chunk )
-	{
-		Con_DPrintf( S_ERROR "Image_LoadPNG: IEND chunk not found (%s)\n", name );
-		Mem_Free( idat_buf );
-		return false;
-	}
-
-	if( chunk_len != 0 )
-	{
-		Con_DPrintf( S_ERROR "Image_LoadPNG: IEND chunk has wrong size (%s)\n", name );
-		Mem_Free( idat_buf );
-		return false;
-	}
-
-	if( oldsize == 0 )
-	{
-		Con_DPrintf( S_ERROR "Image_LoadPNG: Couldn't find IDAT chunks (%s)\n", name );
-		return false;
-	}
-
 	switch( png_hdr.ihdr_chunk.colortype )
 	{
 	case PNG_CT_RGB:
@@ -241,164 +683,39 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 
 	rowsize = pixel_size * image.width;
 
-	uncompressed_size = image.height * ( rowsize + 1 ); // +1 for filter
-	uncompressed_buffer = Mem_Malloc( host.imagepool, uncompressed_size );
-
-	stream.next_in = idat_buf;
-	stream.total_in = stream.avail_in = newsize;
-	stream.next_out = uncompressed_buffer;
-	stream.total_out = stream.avail_out = uncompressed_size;
-
-	// uncompress image
-	if( inflateInit2( &stream, MAX_WBITS ) != Z_OK )
-	{
-		Con_DPrintf( S_ERROR "Image_LoadPNG: IDAT chunk decompression failed (%s)\n", name );
-		Mem_Free( uncompressed_buffer );
-		Mem_Free( idat_buf );
-		return false;
-	}
+	// only a few scanlines are inflated at once instead of the whole image
+	ringrows = bound( 1, PNG_RING_SIZE / ( rowsize + 1 ), image.height );
 
-	ret = inflate( &stream, Z_NO_FLUSH );
-	inflateEnd( &stream );
+	png.rowsize = rowsize;
+	png.pixel_size = pixel_size;
+	png.ringsize = ringrows * ( rowsize + 1 );
+	png.ring = Mem_Malloc( host.imagepool, png.ringsize + rowsize * 3 );
+	png.zero = png.ring + png.ringsize;
+	png.rows[0] = png.zero + rowsize;
+	png.rows[1] = png.rows[0] + rowsize;
+	memset( png.zero, 0, rowsize );
 
-	Mem_Free( idat_buf );
-
-	if( ret != Z_OK && ret != Z_STREAM_END )
+	if( inflateInit2( &png.stream, MAX_WBITS ) != Z_OK )
 	{
 		Con_DPrintf( S_ERROR "Image_LoadPNG: IDAT chunk decompression failed (%s)\n", name );
-		Mem_Free( uncompressed_buffer );
+		Mem_Free( png.ring );
 		return false;
 	}
 
-	prior = pixbuf = image.rgba = Mem_Malloc( host.imagepool, image.size );
-
-	i = 0;
+	image.rgba = Mem_Malloc( host.imagepool, image.size );
 
-	raw = uncompressed_buffer;
+	ret = Image_PNGReadChunks( &png, buf_p, buffer + filesize, name );
 
-	if( png_hdr.ihdr_chunk.colortype == PNG_CT_RGB )
-		prior = pixbuf = raw;
+	inflateEnd( &png.stream );
+	Mem_Free( png.ring );
 
-	filter_type = *raw++;
-
-	// decode adaptive filter
-	switch( filter_type )
+	if( !ret )
 	{
-	case PNG_F_NONE:
-	case PNG_F_UP:
-		for( ; i < rowsize; i++ )
-			pixbuf[i] = raw[i];
-		break;
-	case PNG_F_SUB:
-	case PNG_F_PAETH:
-		for( ; i < pixel_size; i++ )
-			pixbuf[i] = raw[i];
-
-		for( ; i < rowsize; i++ )
-			pixbuf[i] = raw[i] + pixbuf[i - pixel_size];
-		break;
-	case PNG_F_AVERAGE:
-		for( ; i < pixel_size; i++ )
-			pixbuf[i] = raw[i];
-
-		for( ; i < rowsize; i++ )
-			pixbuf[i] = raw[i] + ( pixbuf[i - pixel_size] >> 1 );
-		break;
-	default:
-		Con_DPrintf( S_ERROR "Image_LoadPNG: Found unknown filter type (%s)\n", name );
-		Mem_Free( uncompressed_buffer );
 		Mem_Free( image.rgba );
+		image.rgba = NULL;
 		return false;
 	}
 
-	for( y = 1; y < image.height; y++ )
-	{
-		i = 0;
-
-		pixbuf += rowsize;
-		raw += rowsize;
-
-		filter_type = *raw++;
-
-		switch( filter_type )
-		{
-		case PNG_F_NONE:
-			for( ; i < rowsize; i++ )
-				pixbuf[i] = raw[i];
-			break;
-		case PNG_F_SUB:
-			for( ; i < pixel_size; i++ )
-				pixbuf[i] = raw[i];
-
-			for( ; i < rowsize; i++ )
-				pixbuf[i] = raw[i] + pixbuf[i - pixel_size];
-			break;
-		case PNG_F_UP:
-			for( ; i < rowsize; i++ )
-				pixbuf[i] = raw[i] + prior[i];
-			break;
-		case PNG_F_AVERAGE:
-			for( ; i < pixel_size; i++ )
-				pixbuf[i] = raw[i] + ( prior[i] >> 1 );
-
-			for( ; i < rowsize; i++ )
-				pixbuf[i] = raw[i] + ( ( pixbuf[i - pixel_size] + prior[i] ) >> 1 );
-			break;
-		case PNG_F_PAETH:
-			for( ; i < pixel_size; i++ )
-				pixbuf[i] = raw[i] + prior[i];
-
-			for( ; i < rowsize; i++ )
-			{
-				a = pixbuf[i - pixel_size];
-				b = prior[i];
-				c = prior[i - pixel_size];
-				p = a + b - c;
-				pa = abs( p - a );
-				pb = abs( p - b );
-				pc = abs( p - c );
-
-				pixbuf[i] = raw[i];
-
-				if( pc < pa && pc < pb )
-					pixbuf[i] += c;
-				else if( pb < pa )
-					pixbuf[i] += b;
-				else
-					pixbuf[i] += a;
-			}
-			break;
-		default:
-			Con_DPrintf( S_ERROR "Image_LoadPNG: Found unknown filter type (%s)\n", name );
-			Mem_Free( uncompressed_buffer );
-			Mem_Free( image.rgba );
-			return false;
-		}
-
-		prior = pixbuf;
-	}
-
-	// convert RGB-to-RGBA
-	if( png_hdr.ihdr_chunk.colortype == PNG_CT_RGB )
-	{
-		pixbuf = image.rgba;
-		raw = uncompressed_buffer;
-
-		for( y = 0; y < image.height; y++ )
-		{
-			rowend = raw + rowsize;
-			for( ; raw < rowend; raw += pixel_size )
-			{
-				*pixbuf++ = raw[0];
-				*pixbuf++ = raw[1];
-				*pixbuf++ = raw[2];
-				*pixbuf++ = 0xFF;
-			}
-		}
-	}
-
-	Mem_Free( uncompressed_buffer );
-
 	return true;
 }
 
@@ -610,3 +927,205 @@ qboolean Image_SavePNG( const char *name, rgbdata_t *pix )
 	Mem_Free( buffer );
 	return true;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+static byte *Test_PutChunk( byte *out, const char *sign, const byte *data, uint len )
+{
+	dword	crc;
+	uint	be = htonl( len );
+
+	memcpy( out, &be, 4 );
+	memcpy( out + 4, sign, 4 );
+	if( len ) memcpy( out + 8, data, len );
+
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, out + 4, len + 4 );
+	be = htonl( CRC32_Final( crc ));
+	memcpy( out + 8 + len, &be, 4 );
+
+	return out + 12 + len;
+}
+
+/*
+=============
+Test_EncodePNG
+
+filters rows with every filter type in turn and splits
+compressed stream into the IDAT chunks of given size
+=============
+*/
+static byte *Test_EncodePNG( const byte *pix, int width, int height, int bpp, uint idatsize, fs_offset_t *size )
+{
+	uint		rowsize = width * bpp, filtered_size = ( rowsize + 1 ) * height, idat_len, i, x, y;
+	byte		*filtered, *deflated, *buffer, *out, *raw;
+	const byte	*cur, *prior;
+	int		a, b, c, p, pa, pb, pc;
+	z_stream		stream = {0};
+	png_ihdr_t	ihdr;
+
+	raw = filtered = Mem_Malloc( host.imagepool, filtered_size );
+
+	for( y = 0; y < height; y++ )
+	{
+		cur = pix + y * rowsize;
+		prior = y ? cur - rowsize : NULL;
+		*raw++ = y % 5;
+
+		for( x = 0; x < rowsize; x++ )
+		{
+			a = x >= bpp ? cur[x - bpp] : 0;
+			b = prior ? prior[x] : 0;
+			c = prior && x >= bpp ? prior[x - bpp] : 0;
+
+			switch( y % 5 )
+			{
+			case PNG_F_NONE: raw[x] = cur[x]; break;
+			case PNG_F_SUB: raw[x] = cur[x] - a; break;
+			case PNG_F_UP: raw[x] = cur[x] - b; break;
+			case PNG_F_AVERAGE: raw[x] = cur[x] - (( a + b ) >> 1 ); break;
+			case PNG_F_PAETH:
+				p = a + b - c;
+				pa = abs( p - a );
+				pb = abs( p - b );
+				pc = abs( p - c );
+				raw[x] = cur[x] - (( pa <= pb && pa <= pc ) ? a : ( pb <= pc ) ? b : c );
+				break;
+			}
+		}
+
+		raw += rowsize;
+	}
+
+	idat_len = deflateBound( NULL, filtered_size );
+	deflated = Mem_Malloc( host.imagepool, idat_len );
+	stream.next_in = filtered;
+	stream.avail_in = filtered_size;
+	stream.next_out = deflated;
+	stream.avail_out = idat_len;
+	deflateInit( &stream, Z_BEST_SPEED );
+	deflate( &stream, Z_FINISH );
+	deflateEnd( &stream );
+	idat_len = stream.total_out;
+
+	out = buffer = Mem_Malloc( host.imagepool, sizeof( png_sign ) + 12 + sizeof( ihdr ) + idat_len + ( idat_len / idatsize + 1 ) * 12 + 12 );
+	memcpy( out, png_sign, sizeof( png_sign ));
+	out += sizeof( png_sign );
+
+	memset( &ihdr, 0, sizeof( ihdr ));
+	ihdr.width = htonl( width );
+	ihdr.height = htonl( height );
+	ihdr.bitdepth = 8;
+	ihdr.colortype = bpp == 4 ? PNG_CT_RGBA : PNG_CT_RGB;
+	out = Test_PutChunk( out, ihdr_sign, (byte *)&ihdr, sizeof( ihdr ));
+
+	for( i = 0; i < idat_len; i += idatsize )
+		out = Test_PutChunk( out, idat_sign, deflated + i, Q_min( idatsize, idat_len - i ));
+	out = Test_PutChunk( out, iend_sign, NULL, 0 );
+
+	Mem_Free( filtered );
+	Mem_Free( deflated );
+	*size = out - buffer;
+
+	return buffer;
+}
+
+static byte *Test_GenPNGSource( int width, int height, int bpp )
+{
+	byte	*pix = Mem_Malloc( host.imagepool, width * height * bpp ), *p = pix;
+	int	x, y;
+
+	// smooth gradients with some noise, like most of the skies and huds
+	for( y = 0; y < height; y++ )
+	{
+		for( x = 0; x < width; x++, p += bpp )
+		{
+			p[0] = ( x * 255 / width ) + COM_RandomLong( 0, 3 );
+			p[1] = ( y * 255 / height ) + COM_RandomLong( 0, 3 );
+			p[2] = (( x + y ) * 127 / ( width + height )) + COM_RandomLong( 0, 7 );
+			if( bpp == 4 ) p[3] = ( x / 16 + y / 16 ) & 1 ? 0xFF : ( x * 7 + y ) & 0xFF;
+		}
+	}
+
+	return pix;
+}
+
+static qboolean Test_DecodePNG( const byte *png, fs_offset_t size, const byte *pix, int width, int height, int bpp )
+{
+	rgbdata_t	*pic = FS_LoadImage( "#test.png", png, size );
+	qboolean	ok = pic && pic->width == width && pic->height == height && pic->type == PF_RGBA_32;
+	int	i;
+
+	for( i = 0; ok && i < width * height; i++ )
+		ok = !memcmp( pic->buffer + i * 4, pix + i * bpp, bpp ) && ( bpp == 4 || pic->buffer[i * 4 + 3] == 0xFF );
+
+	if( pic ) FS_FreeImage( pic );
+
+	return ok;
+}
+
+static void Test_BenchPNG( const char *desc, int width, int height, int bpp )
+{
+	byte		*pix = Test_GenPNGSource( width, height, bpp ), *png;
+	double		start, best = 0.0;
+	size_t		base, peak;
+	fs_offset_t	size;
+	rgbdata_t		*pic;
+	int		i;
+
+	png = Test_EncodePNG( pix, width, height, bpp, 8192, &size );
+
+	Mem_PeakSize( host.imagepool, true );
+	base = Mem_PeakSize( host.imagepool, false );
+
+	for( i = 0; i < 4; i++ )
+	{
+		start = Sys_DoubleTime();
+		pic = FS_LoadImage( "#test.png", png, size );
+		start = Sys_DoubleTime() - start;
+		best = i ? Q_min( best, start ) : start;
+		if( pic ) FS_FreeImage( pic );
+	}
+
+	peak = Mem_PeakSize( host.imagepool, false ) - base;
+
+	Con_Printf( "Image_LoadPNG %s %dx%d: %.2f ms, %.1f Mpix/s, peak %.1f Mb (output %.1f Mb)\n", desc, width, height,
+		best * 1000.0, width * height / best / 1000000.0, peak / ( 1024.0 * 1024.0 ), width * height * 4 / ( 1024.0 * 1024.0 ));
+
+	Mem_Free( png );
+	Mem_Free( pix );
+}
+
+void Test_RunImagePNG( void )
+{
+	fs_offset_t	size;
+	byte		*pix, *png;
+	int		bpp, pass, bad = 0;
+
+	// odd sizes and tiny chunks for the kernel tails and chunk boundaries
+	for( bpp = 3; bpp <= 4; bpp++ )
+	{
+		pix = Test_GenPNGSource( 67, 45, bpp );
+		png = Test_EncodePNG( pix, 67, 45, bpp, 97, &size );
+
+		for( pass = 0; pass < 2; pass++ )
+		{
+			image.nosimd = pass == 0;
+			bad += !Test_DecodePNG( png, size, pix, 67, 45, bpp );
+		}
+
+		// truncated stream must fail
+		bad += Test_DecodePNG( png, size / 2, pix, 67, 45, bpp );
+
+		Mem_Free( png );
+		Mem_Free( pix );
+	}
+
+	image.nosimd = false;
+	TASSERT( bad == 0 );
+
+	Test_BenchPNG( "hud", 1024, 1024, 4 );
+	Test_BenchPNG( "sky", 2048, 2048, 3 );
+}
+#endif /* XASH_ENGINE_TESTS */
@@ -17,9 +17,43 @@ GNU General Public License for more details.
 #include "xash3d_mathlib.h"
 #include "mod_local.h"
 
+// vector kernels follow the compiler target, SSE2 is always there on amd64
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define IMAGE_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define IMAGE_NEON	1
+#endif
+
+#if XASH_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define IMAGE_HAVE_THREADS
+#elif XASH_POSIX && !defined XASH_NO_ASYNC_NS_RESOLVE && !XASH_EMSCRIPTEN
+// wscript only links pthreads when asynchronous name resolution is on
+#include <pthread.h>
+#include <unistd.h>
+#define IMAGE_HAVE_THREADS
+#endif
+
 #define LERPBYTE( i )	r = resamplerow1[i]; out[i] = (byte)(((( resamplerow2[i] - r ) * lerp)>>16 ) + r )
 #define FILTER_SIZE		5
 
+// 16-bit lerp fraction as a signed lane, vector kernels add the missing 65536 back
+#define LERP16( l )		((short)(( l ) - ((( l ) & 0x8000 ) << 1 )))
+
+#define IMAGE_MAX_THREADS	8
+#define IMAGE_MIP_BAND	( 128 * 1024 )	// mip pixels per worker thread
+
+typedef const byte *(*pfnImageRow)( void *source, int y );
+
+typedef struct
+{
+	const byte	*data;
+	int		pitch;	// bytes per row
+} imagerows_t;
+
 uint d_8toQ1table[256];
 uint d_8toHLtable[256];
 uint d_8to24table[256];
@@ -161,10 +195,13 @@ void Image_Init( void )
 	}
 
 	image.tempbuffer = NULL;
+
+	Image_CacheInit();
 }
 
 void Image_Shutdown( void )
 {
+	Image_CacheShutdown();
 	Mem_Check(); // check for leaks
 	Mem_FreePool( &host.imagepool );
 }
@@ -555,6 +592,21 @@ void Image_PaletteTranslate( byte *palSrc, int top, int bottom, int pal_size )
 	}
 }
 
+static qboolean Image_PaletteHasColor( const uint *pal )
+{
+	const byte	*col;
+	int		i;
+
+	for( i = 0; i < 256; i++ )
+	{
+		col = (const byte *)&pal[i];
+		if( col[0] != col[1] || col[1] != col[2] )
+			return true;
+	}
+
+	return false;
+}
+
 void Image_CopyParms( rgbdata_t *src )
 {
 	Image_Reset();
@@ -580,7 +632,6 @@ qboolean Image_Copy8bitRGBA( const byte *in, byte *out, int pixels )
 {
 	int	*iout = (int *)out;
 	byte	*fin = (byte *)in;
-	byte	*col;
 	int	i;
 
 	if( !in || !image.d_currentpal )
@@ -594,15 +645,8 @@ qboolean Image_Copy8bitRGBA( const byte *in, byte *out, int pixels )
 	}
 
 	// check for color
-	for( i = 0; i < 256; i++ )
-	{
-		col = (byte *)&image.d_currentpal[i];
-		if( col[0] != col[1] || col[1] != col[2] )
-		{
-			image.flags |= IMAGE_HAS_COLOR;
-			break;
-		}
-	}
+	if( Image_PaletteHasColor( image.d_currentpal ))
+		image.flags |= IMAGE_HAS_COLOR;
 
 	while( pixels >= 8 )
 	{
@@ -645,35 +689,237 @@ qboolean Image_Copy8bitRGBA( const byte *in, byte *out, int pixels )
 	return true;
 }
 
+/*
+==============================================================
+
+RESAMPLE KERNELS
+
+==============================================================
+*/
+#ifdef IMAGE_SSE2
+static int Image_LerpRowSSE2( byte *out, const byte *row1, const byte *row2, int bytes, int lerp )
+{
+	__m128i	zero = _mm_setzero_si128();
+	__m128i	l = _mm_set1_epi16( LERP16( lerp ));
+	__m128i	mask = _mm_srai_epi16( l, 15 );
+	int	i;
+
+	for( i = 0; i + 16 <= bytes; i += 16 )
+	{
+		__m128i	a = _mm_loadu_si128(( const __m128i *)( row1 + i ));
+		__m128i	b = _mm_loadu_si128(( const __m128i *)( row2 + i ));
+		__m128i	alo = _mm_unpacklo_epi8( a, zero );
+		__m128i	ahi = _mm_unpackhi_epi8( a, zero );
+		__m128i	dlo = _mm_sub_epi16( _mm_unpacklo_epi8( b, zero ), alo );
+		__m128i	dhi = _mm_sub_epi16( _mm_unpackhi_epi8( b, zero ), ahi );
+
+		dlo = _mm_add_epi16( _mm_mulhi_epi16( dlo, l ), _mm_and_si128( dlo, mask ));
+		dhi = _mm_add_epi16( _mm_mulhi_epi16( dhi, l ), _mm_and_si128( dhi, mask ));
+		_mm_storeu_si128(( __m128i *)( out + i ), _mm_packus_epi16( _mm_add_epi16( alo, dlo ), _mm_add_epi16( ahi, dhi )));
+	}
+
+	return i;
+}
+
+static int Image_Resample32LerpLineSSE2( const byte *in, byte *out, int outwidth, int fstep, int endx )
+{
+	__m128i	zero = _mm_setzero_si128();
+	int	j, f, f1;
+
+	// two output pixels per step while both have a pixel to lerp to
+	for( j = 0, f = 0; j + 2 <= outwidth; j += 2, f += fstep * 2 )
+	{
+		__m128i	p0, p1, a, d, l;
+
+		f1 = f + fstep;
+		if(( f1 >> 16 ) >= endx )
+			break;
+
+		p0 = _mm_unpacklo_epi8( _mm_loadl_epi64(( const __m128i *)( in + ( f >> 16 ) * 4 )), zero );
+		p1 = _mm_unpacklo_epi8( _mm_loadl_epi64(( const __m128i *)( in + ( f1 >> 16 ) * 4 )), zero );
+		a = _mm_unpacklo_epi64( p0, p1 );
+		d = _mm_sub_epi16( _mm_unpackhi_epi64( p0, p1 ), a );
+		l = _mm_unpacklo_epi64( _mm_set1_epi16( LERP16( f & 0xFFFF )), _mm_set1_epi16( LERP16( f1 & 0xFFFF )));
+		d = _mm_add_epi16( _mm_mulhi_epi16( d, l ), _mm_and_si128( d, _mm_srai_epi16( l, 15 )));
+		_mm_storel_epi64(( __m128i *)( out + j * 4 ), _mm_packus_epi16( _mm_add_epi16( a, d ), zero ));
+	}
+
+	return j;
+}
+
+static int Image_BoxRowSSE2( const byte *row, const byte *next, byte *out, int mipwidth )
+{
+	__m128i	zero = _mm_setzero_si128();
+	int	x;
+
+	// eight source pixels of both rows into four
+	for( x = 0; x + 4 <= mipwidth; x += 4 )
+	{
+		__m128i	r0a = _mm_loadu_si128(( const __m128i *)( row + x * 8 ));
+		__m128i	r0b = _mm_loadu_si128(( const __m128i *)( row + x * 8 + 16 ));
+		__m128i	r1a = _mm_loadu_si128(( const __m128i *)( next + x * 8 ));
+		__m128i	r1b = _mm_loadu_si128(( const __m128i *)( next + x * 8 + 16 ));
+		__m128i	s0 = _mm_add_epi16( _mm_unpacklo_epi8( r0a, zero ), _mm_unpacklo_epi8( r1a, zero ));
+		__m128i	s1 = _mm_add_epi16( _mm_unpackhi_epi8( r0a, zero ), _mm_unpackhi_epi8( r1a, zero ));
+		__m128i	s2 = _mm_add_epi16( _mm_unpacklo_epi8( r0b, zero ), _mm_unpacklo_epi8( r1b, zero ));
+		__m128i	s3 = _mm_add_epi16( _mm_unpackhi_epi8( r0b, zero ), _mm_unpackhi_epi8( r1b, zero ));
+
+		s0 = _mm_add_epi16( _mm_unpacklo_epi64( s0, s1 ), _mm_unpackhi_epi64( s0, s1 ));
+		s2 = _mm_add_epi16( _mm_unpacklo_epi64( s2, s3 ), _mm_unpackhi_epi64( s2, s3 ));
+		_mm_storeu_si128(( __m128i *)( out + x * 4 ), _mm_packus_epi16( _mm_srli_epi16( s0, 2 ), _mm_srli_epi16( s2, 2 )));
+	}
+
+	return x;
+}
+#endif // IMAGE_SSE2
+
+#ifdef IMAGE_NEON
+static _inline int16x8_t Image_MulHiNEON( int16x8_t a, int16x8_t b )
+{
+	int32x4_t	lo = vmull_s16( vget_low_s16( a ), vget_low_s16( b ));
+	int32x4_t	hi = vmull_s16( vget_high_s16( a ), vget_high_s16( b ));
+
+	return vcombine_s16( vshrn_n_s32( lo, 16 ), vshrn_n_s32( hi, 16 ));
+}
+
+static int Image_LerpRowNEON( byte *out, const byte *row1, const byte *row2, int bytes, int lerp )
+{
+	int16x8_t	l = vdupq_n_s16( LERP16( lerp ));
+	int16x8_t	mask = vshrq_n_s16( l, 15 );
+	int	i;
+
+	for( i = 0; i + 16 <= bytes; i += 16 )
+	{
+		uint8x16_t	a = vld1q_u8( row1 + i );
+		uint8x16_t	b = vld1q_u8( row2 + i );
+		int16x8_t		alo = vreinterpretq_s16_u16( vmovl_u8( vget_low_u8( a )));
+		int16x8_t		ahi = vreinterpretq_s16_u16( vmovl_u8( vget_high_u8( a )));
+		int16x8_t		dlo = vsubq_s16( vreinterpretq_s16_u16( vmovl_u8( vget_low_u8( b ))), alo );
+		int16x8_t		dhi = vsubq_s16( vreinterpretq_s16_u16( vmovl_u8( vget_high_u8( b ))), ahi );
+
+		dlo = vaddq_s16( Image_MulHiNEON( dlo, l ), vandq_s16( dlo, mask ));
+		dhi = vaddq_s16( Image_MulHiNEON( dhi, l ), vandq_s16( dhi, mask ));
+		vst1q_u8( out + i, vcombine_u8( vqmovun_s16( vaddq_s16( alo, dlo )), vqmovun_s16( vaddq_s16( ahi, dhi ))));
+	}
+
+	return i;
+}
+
+static int Image_Resample32LerpLineNEON( const byte *in, byte *out, int outwidth, int fstep, int endx )
+{
+	int	j, f, f1;
+
+	// two output pixels per step while both have a pixel to lerp to
+	for( j = 0, f = 0; j + 2 <= outwidth; j += 2, f += fstep * 2 )
+	{
+		int16x8_t	p0, p1, a, d, l;
+
+		f1 = f + fstep;
+		if(( f1 >> 16 ) >= endx )
+			break;
+
+		p0 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( in + ( f >> 16 ) * 4 )));
+		p1 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( in + ( f1 >> 16 ) * 4 )));
+		a = vcombine_s16( vget_low_s16( p0 ), vget_low_s16( p1 ));
+		d = vsubq_s16( vcombine_s16( vget_high_s16( p0 ), vget_high_s16( p1 )), a );
+		l = vcombine_s16( vdup_n_s16( LERP16( f & 0xFFFF )), vdup_n_s16( LERP16( f1 & 0xFFFF )));
+		d = vaddq_s16( Image_MulHiNEON( d, l ), vandq_s16( d, vshrq_n_s16( l, 15 )));
+		vst1_u8( out + j * 4, vqmovun_s16( vaddq_s16( a, d )));
+	}
+
+	return j;
+}
+
+static int Image_BoxRowNEON( const byte *row, const byte *next, byte *out, int mipwidth )
+{
+	int	x, c;
+
+	// sixteen source pixels of both rows into eight, split by channel
+	for( x = 0; x + 8 <= mipwidth; x += 8 )
+	{
+		uint8x16x4_t	r0 = vld4q_u8( row + x * 8 );
+		uint8x16x4_t	r1 = vld4q_u8( next + x * 8 );
+		uint8x8x4_t	o;
+
+		for( c = 0; c < 4; c++ )
+			o.val[c] = vshrn_n_u16( vpadalq_u8( vpaddlq_u8( r0.val[c] ), r1.val[c] ), 2 );
+		vst4_u8( out + x * 4, o );
+	}
+
+	return x;
+}
+#endif // IMAGE_NEON
+
+/*
+=================
+Image_LerpRow
+
+blend two resampled rows, lerp is 16-bit fraction
+=================
+*/
+static void Image_LerpRow( byte *out, const byte *resamplerow1, const byte *resamplerow2, int bytes, int lerp )
+{
+	int	i = 0, r;
+
+#if defined( IMAGE_SSE2 )
+	if( !image.nosimd ) i = Image_LerpRowSSE2( out, resamplerow1, resamplerow2, bytes, lerp );
+#elif defined( IMAGE_NEON )
+	if( !image.nosimd ) i = Image_LerpRowNEON( out, resamplerow1, resamplerow2, bytes, lerp );
+#endif
+
+	for( ; i < bytes; i++ )
+	{
+		LERPBYTE( i );
+	}
+}
+
+/*
+=================
+Image_BufferRow
+
+resamplers pull the source image one row at a time
+=================
+*/
+static const byte *Image_BufferRow( void *source, int y )
+{
+	const imagerows_t	*rows = (const imagerows_t *)source;
+
+	return rows->data + rows->pitch * y;
+}
+
 static void Image_Resample32LerpLine( const byte *in, byte *out, int inwidth, int outwidth )
 {
-	int	j, xi, oldx = 0, f, fstep, endx, lerp;
+	int	j = 0, xi, f, fstep, endx, lerp;
+	const byte	*p;
 
 	fstep = (int)(inwidth * 65536.0f / outwidth);
 	endx = (inwidth-1);
 
-	for( j = 0, f = 0; j < outwidth; j++, f += fstep )
+#if defined( IMAGE_SSE2 )
+	if( !image.nosimd ) j = Image_Resample32LerpLineSSE2( in, out, outwidth, fstep, endx );
+#elif defined( IMAGE_NEON )
+	if( !image.nosimd ) j = Image_Resample32LerpLineNEON( in, out, outwidth, fstep, endx );
+#endif
+
+	for( f = j * fstep, out += j * 4; j < outwidth; j++, f += fstep )
 	{
 		xi = f>>16;
-		if( xi != oldx )
-		{
-			in += (xi - oldx) * 4;
-			oldx = xi;
-		}
+		p = in + xi * 4;
+
 		if( xi < endx )
 		{
 			lerp = f & 0xFFFF;
-			*out++ = (byte)((((in[4] - in[0]) * lerp)>>16) + in[0]);
-			*out++ = (byte)((((in[5] - in[1]) * lerp)>>16) + in[1]);
-			*out++ = (byte)((((in[6] - in[2]) * lerp)>>16) + in[2]);
-			*out++ = (byte)((((in[7] - in[3]) * lerp)>>16) + in[3]);
+			*out++ = (byte)((((p[4] - p[0]) * lerp)>>16) + p[0]);
+			*out++ = (byte)((((p[5] - p[1]) * lerp)>>16) + p[1]);
+			*out++ = (byte)((((p[6] - p[2]) * lerp)>>16) + p[2]);
+			*out++ = (byte)((((p[7] - p[3]) * lerp)>>16) + p[3]);
 		}
 		else // last pixel of the line has no pixel to lerp to
 		{
-			*out++ = in[0];
-			*out++ = in[1];
-			*out++ = in[2];
-			*out++ = in[3];
+			*out++ = p[0];
+			*out++ = p[1];
+			*out++ = p[2];
+			*out++ = p[3];
 		}
 	}
 }
@@ -711,11 +957,9 @@ static void Image_Resample24LerpLine( const byte *in, byte *out, int inwidth, in
 	}
 }
 
-void Image_Resample32Lerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
+static void Image_Resample32LerpRows( pfnImageRow getrow, void *source, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
 {
-	const byte *inrow;
-	int	i, j, r, yi, oldy = 0, f, fstep, lerp, endy = (inheight - 1);
-	int	inwidth4 = inwidth * 4;
+	int	i, yi, oldy = 0, f, fstep, lerp, endy = (inheight - 1);
 	int	outwidth4 = outwidth * 4;
 	byte	*out = (byte *)outdata;
 	byte	*resamplerow1;
@@ -726,10 +970,8 @@ void Image_Resample32Lerp( const void *indata, int inwidth, int inheight, void *
 	resamplerow1 = (byte *)Mem_Malloc( host.imagepool, outwidth * 4 * 2);
 	resamplerow2 = resamplerow1 + outwidth * 4;
 
-	inrow = (const byte *)indata;
-
-	Image_Resample32LerpLine( inrow, resamplerow1, inwidth, outwidth );
-	Image_Resample32LerpLine( inrow + inwidth4, resamplerow2, inwidth, outwidth );
+	Image_Resample32LerpLine( getrow( source, 0 ), resamplerow1, inwidth, outwidth );
+	Image_Resample32LerpLine( getrow( source, 1 ), resamplerow2, inwidth, outwidth );
 
 	for( i = 0, f = 0; i < outheight; i++, f += fstep )
 	{
@@ -740,96 +982,51 @@ void Image_Resample32Lerp( const void *indata, int inwidth, int inheight, void *
 			lerp = f & 0xFFFF;
 			if( yi != oldy )
 			{
-				inrow = (byte *)indata + inwidth4 * yi;
 				if( yi == oldy + 1 ) memcpy( resamplerow1, resamplerow2, outwidth4 );
-				else Image_Resample32LerpLine( inrow, resamplerow1, inwidth, outwidth );
-				Image_Resample32LerpLine( inrow + inwidth4, resamplerow2, inwidth, outwidth );
+				else Image_Resample32LerpLine( getrow( source, yi ), resamplerow1, inwidth, outwidth );
+				Image_Resample32LerpLine( getrow( source, yi + 1 ), resamplerow2, inwidth, outwidth );
 				oldy = yi;
 			}
 
-			j = outwidth - 4;
-
-			while( j >= 0 )
-			{
-				LERPBYTE( 0);
-				LERPBYTE( 1);
-				LERPBYTE( 2);
-				LERPBYTE( 3);
-				LERPBYTE( 4);
-				LERPBYTE( 5);
-				LERPBYTE( 6);
-				LERPBYTE( 7);
-				LERPBYTE( 8);
-				LERPBYTE( 9);
-				LERPBYTE(10);
-				LERPBYTE(11);
-				LERPBYTE(12);
-				LERPBYTE(13);
-				LERPBYTE(14);
-				LERPBYTE(15);
-				out += 16;
-				resamplerow1 += 16;
-				resamplerow2 += 16;
-				j -= 4;
-			}
-
-			if( j & 2 )
-			{
-				LERPBYTE( 0);
-				LERPBYTE( 1);
-				LERPBYTE( 2);
-				LERPBYTE( 3);
-				LERPBYTE( 4);
-				LERPBYTE( 5);
-				LERPBYTE( 6);
-				LERPBYTE( 7);
-				out += 8;
-				resamplerow1 += 8;
-				resamplerow2 += 8;
-			}
-
-			if( j & 1 )
-			{
-				LERPBYTE( 0);
-				LERPBYTE( 1);
-				LERPBYTE( 2);
-				LERPBYTE( 3);
-				out += 4;
-				resamplerow1 += 4;
-				resamplerow2 += 4;
-			}
-
-			resamplerow1 -= outwidth4;
-			resamplerow2 -= outwidth4;
+			Image_LerpRow( out, resamplerow1, resamplerow2, outwidth4, lerp );
+			out += outwidth4;
 		}
 		else
 		{
 			if( yi != oldy )
 			{
-				inrow = (byte *)indata + inwidth4 * yi;
 				if( yi == oldy + 1 ) memcpy( resamplerow1, resamplerow2, outwidth4 );
-				else Image_Resample32LerpLine( inrow, resamplerow1, inwidth, outwidth);
+				else Image_Resample32LerpLine( getrow( source, yi ), resamplerow1, inwidth, outwidth );
 				oldy = yi;
 			}
 
 			memcpy( out, resamplerow1, outwidth4 );
+			out += outwidth4;
 		}
 	}
 
 	Mem_Free( resamplerow1 );
 }
 
-void Image_Resample32Nolerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
+void Image_Resample32Lerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
+{
+	imagerows_t	rows = { (const byte *)indata, inwidth * 4 };
+
+	Image_Resample32LerpRows( Image_BufferRow, &rows, inwidth, inheight, outdata, outwidth, outheight );
+}
+
+static void Image_Resample32NolerpRows( pfnImageRow getrow, void *source, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
 {
 	int	i, j;
 	uint	frac, fracstep;
-	int	*inrow, *out = (int *)outdata; // relies on int being 4 bytes
+	const int	*inrow;
+	int	*out = (int *)outdata; // relies on int being 4 bytes
 
 	fracstep = inwidth * 0x10000 / outwidth;
 
 	for( i = 0; i < outheight; i++)
 	{
-		inrow = (int *)indata + inwidth * (i * inheight / outheight);
+		inrow = (const int *)getrow( source, i * inheight / outheight );
 		frac = fracstep>>1;
 		j = outwidth - 4;
 
@@ -858,10 +1055,17 @@ void Image_Resample32Nolerp( const void *indata, int inwidth, int inheight, void
 	}
 }
 
+void Image_Resample32Nolerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
+{
+	imagerows_t	rows = { (const byte *)indata, inwidth * 4 };
+
+	Image_Resample32NolerpRows( Image_BufferRow, &rows, inwidth, inheight, outdata, outwidth, outheight );
+}
+
 void Image_Resample24Lerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
 {
 	const byte *inrow;
-	int	i, j, r, yi, oldy, f, fstep, lerp, endy = (inheight - 1);
+	int	i, yi, oldy, f, fstep, lerp, endy = (inheight - 1);
 	int	inwidth3 = inwidth * 3;
 	int	outwidth3 = outwidth * 3;
 	byte	*out = (byte *)outdata;
@@ -894,53 +1098,8 @@ void Image_Resample24Lerp( const void *indata, int inwidth, int inheight, void *
 				oldy = yi;
 			}
 
-			j = outwidth - 4;
-
-			while( j >= 0 )
-			{
-				LERPBYTE( 0);
-				LERPBYTE( 1);
-				LERPBYTE( 2);
-				LERPBYTE( 3);
-				LERPBYTE( 4);
-				LERPBYTE( 5);
-				LERPBYTE( 6);
-				LERPBYTE( 7);
-				LERPBYTE( 8);
-				LERPBYTE( 9);
-				LERPBYTE(10);
-				LERPBYTE(11);
-				out += 12;
-				resamplerow1 += 12;
-				resamplerow2 += 12;
-				j -= 4;
-			}
-
-			if( j & 2 )
-			{
-				LERPBYTE( 0);
-				LERPBYTE( 1);
-				LERPBYTE( 2);
-				LERPBYTE( 3);
-				LERPBYTE( 4);
-				LERPBYTE( 5);
-				out += 6;
-				resamplerow1 += 6;
-				resamplerow2 += 6;
-			}
-
-			if( j & 1 )
-			{
-				LERPBYTE( 0);
-				LERPBYTE( 1);
-				LERPBYTE( 2);
-				out += 3;
-				resamplerow1 += 3;
-				resamplerow2 += 3;
-			}
-
-			resamplerow1 -= outwidth3;
-			resamplerow2 -= outwidth3;
+			Image_LerpRow( out, resamplerow1, resamplerow2, outwidth3, lerp );
+			out += outwidth3;
 		}
 		else
 		{
@@ -953,6 +1112,7 @@ void Image_Resample24Lerp( const void *indata, int inwidth, int inheight, void *
 			}
 
 			memcpy( out, resamplerow1, outwidth3 );
+			out += outwidth3;
 		}
 	}
 
@@ -1025,19 +1185,18 @@ void Image_Resample24Nolerp( const void *indata, int inwidth, int inheight, void
 	}
 }
 
-void Image_Resample8Nolerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
+static void Image_Resample8NolerpRows( pfnImageRow getrow, void *source, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
 {
 	int	i, j;
-	byte	*in, *inrow;
+	const byte	*inrow;
 	uint	frac, fracstep;
 	byte	*out = (byte *)outdata;
 
-	in = (byte *)indata;
 	fracstep = inwidth * 0x10000 / outwidth;
 
 	for( i = 0; i < outheight; i++, out += outwidth )
 	{
-		inrow = in + inwidth*(i*inheight/outheight);
+		inrow = getrow( source, i * inheight / outheight );
 		frac = fracstep>>1;
 
 		for( j = 0; j < outwidth; j++ )
@@ -1048,6 +1207,209 @@ void Image_Resample8Nolerp( const void *indata, int inwidth, int inheight, void
 	}
 }
 
+void Image_Resample8Nolerp( const void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight )
+{
+	imagerows_t	rows = { (const byte *)indata, inwidth };
+
+	Image_Resample8NolerpRows( Image_BufferRow, &rows, inwidth, inheight, outdata, outwidth, outheight );
+}
+
+/*
+==============================================================
+
+MIP CHAIN
+
+==============================================================
+*/
+typedef struct
+{
+	const byte	*in;
+	int		width, height;	// source level
+	byte		*out;
+	int		firstrow, lastrow;	// output rows of this band
+} mipband_t;
+
+/*
+=================
+Image_BoxDownsampleRows
+
+2x2 box filter of RGBA image, same as the renderer did in place
+=================
+*/
+static void Image_BoxDownsampleRows( const mipband_t *band )
+{
+	int	instride = band->width * 4;
+	int	mipwidth = Q_max( 1, band->width >> 1 );
+	const byte	*in, *next;
+	byte	*out = band->out + band->firstrow * mipwidth * 4;
+	int	x, y, row;
+
+	for( y = band->firstrow; y < band->lastrow; y++ )
+	{
+		in = band->in + instride * y * 2;
+		next = ((( y << 1 ) + 1 ) < band->height ) ? ( in + instride ) : in;
+		x = 0;
+
+		if( band->width > 1 )
+		{
+#if defined( IMAGE_SSE2 )
+			if( !image.nosimd ) x = Image_BoxRowSSE2( in, next, out, mipwidth );
+#elif defined( IMAGE_NEON )
+			if( !image.nosimd ) x = Image_BoxRowNEON( in, next, out, mipwidth );
+#endif
+		}
+
+		for( row = x * 8, out += x * 4; x < mipwidth; x++, row += 8, out += 4 )
+		{
+			if((( x << 1 ) + 1 ) < band->width )
+			{
+				out[0] = (in[row+0] + in[row+4] + next[row+0] + next[row+4]) >> 2;
+				out[1] = (in[row+1] + in[row+5] + next[row+1] + next[row+5]) >> 2;
+				out[2] = (in[row+2] + in[row+6] + next[row+2] + next[row+6]) >> 2;
+				out[3] = (in[row+3] + in[row+7] + next[row+3] + next[row+7]) >> 2;
+			}
+			else
+			{
+				out[0] = (in[row+0] + next[row+0]) >> 1;
+				out[1] = (in[row+1] + next[row+1]) >> 1;
+				out[2] = (in[row+2] + next[row+2]) >> 1;
+				out[3] = (in[row+3] + next[row+3]) >> 1;
+			}
+		}
+	}
+}
+
+#ifdef IMAGE_HAVE_THREADS
+#if XASH_WIN32
+static DWORD WINAPI Image_MipThread( LPVOID band )
+{
+	Image_BoxDownsampleRows( (const mipband_t *)band );
+	return 0;
+}
+#else
+static void *Image_MipThread( void *band )
+{
+	Image_BoxDownsampleRows( (const mipband_t *)band );
+	return NULL;
+}
+#endif
+
+/*
+=================
+Image_CPUCount
+=================
+*/
+static int Image_CPUCount( void )
+{
+#if XASH_WIN32
+	SYSTEM_INFO	info;
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors;
+#elif defined( _SC_NPROCESSORS_ONLN )
+	return sysconf( _SC_NPROCESSORS_ONLN );
+#else
+	return 1;
+#endif
+}
+#endif // IMAGE_HAVE_THREADS
+
+/*
+=================
+Image_BoxDownsample
+
+large levels are split into row bands, one per thread
+=================
+*/
+static void Image_BoxDownsample( const byte *in, int width, int height, byte *out )
+{
+	mipband_t	bands[IMAGE_MAX_THREADS];
+	int	mipwidth = Q_max( 1, width >> 1 );
+	int	mipheight = Q_max( 1, height >> 1 );
+	int	i, numbands = 1;
+#ifdef IMAGE_HAVE_THREADS
+#if XASH_WIN32
+	HANDLE	threads[IMAGE_MAX_THREADS];
+#else
+	pthread_t	threads[IMAGE_MAX_THREADS];
+#endif
+	qboolean	started[IMAGE_MAX_THREADS];
+
+	if( !image.numthreads )
+		image.numthreads = bound( 1, Image_CPUCount(), IMAGE_MAX_THREADS );
+
+	numbands = bound( 1, mipwidth * mipheight / IMAGE_MIP_BAND, image.numthreads );
+	numbands = Q_min( numbands, mipheight );
+#endif
+
+	for( i = 0; i < numbands; i++ )
+	{
+		bands[i].in = in;
+		bands[i].width = width;
+		bands[i].height = height;
+		bands[i].out = out;
+		bands[i].firstrow = mipheight * i / numbands;
+		bands[i].lastrow = mipheight * ( i + 1 ) / numbands;
+	}
+
+#ifdef IMAGE_HAVE_THREADS
+	// the calling thread takes the first band
+	for( i = 1; i < numbands; i++ )
+	{
+#if XASH_WIN32
+		threads[i] = CreateThread( NULL, 0, Image_MipThread, &bands[i], 0, NULL );
+		started[i] = threads[i] != NULL;
+#else
+		started[i] = pthread_create( &threads[i], NULL, Image_MipThread, &bands[i] ) == 0;
+#endif
+		if( !started[i] ) Image_BoxDownsampleRows( &bands[i] );
+	}
+#endif
+
+	Image_BoxDownsampleRows( &bands[0] );
+
+#ifdef IMAGE_HAVE_THREADS
+	for( i = 1; i < numbands; i++ )
+	{
+		if( !started[i] ) continue;
+#if XASH_WIN32
+		WaitForSingleObject( threads[i], INFINITE );
+		CloseHandle( threads[i] );
+#else
+		pthread_join( threads[i], NULL );
+#endif
+	}
+#endif
+}
+
+/*
+=================
+Image_BuildMipChain
+
+RGBA levels 1..nummips-1 of the image packed one after another into out,
+each level is quarter of the previous one as Q_max( 1, size >> level )
+=================
+*/
+void Image_BuildMipChain( const byte *in, int width, int height, int nummips, byte *out )
+{
+	int	i, mipwidth, mipheight;
+
+	if( !in || !out ) return;
+
+	for( i = 1; i < nummips; i++ )
+	{
+		mipwidth = Q_max( 1, width >> 1 );
+		mipheight = Q_max( 1, height >> 1 );
+
+		Image_BoxDownsample( in, width, height, out );
+
+		in = out;
+		out += mipwidth * mipheight * 4;
+		width = mipwidth;
+		height = mipheight;
+	}
+}
+
 /*
 ================
 Image_Resample
@@ -1213,6 +1575,29 @@ qboolean Image_AddIndexedImageToPack( const byte *in, int width, int height )
 	return true;
 }
 
+/*
+=============
+Image_GetPaletteIndexed
+
+install palette of the indexed image in image.palette
+=============
+*/
+static void Image_GetPaletteIndexed( void )
+{
+	if( PFDesc[image.type].format == PF_INDEXED_24 )
+	{
+		if( image.flags & IMAGE_HAS_ALPHA )
+		{
+			if( image.flags & IMAGE_COLORINDEX )
+				Image_GetPaletteLMP( image.palette, LUMP_GRADIENT );
+			else Image_GetPaletteLMP( image.palette, LUMP_MASKED );
+		}
+		else Image_GetPaletteLMP( image.palette, LUMP_NORMAL );
+	}
+
+	if( !image.d_currentpal ) image.d_currentpal = (uint *)image.palette;
+}
+
 /*
 =============
 Image_Decompress
@@ -1235,16 +1620,8 @@ qboolean Image_Decompress( const byte *data )
 	switch( PFDesc[image.type].format )
 	{
 	case PF_INDEXED_24:
-		if( image.flags & IMAGE_HAS_ALPHA )
-		{
-			if( image.flags & IMAGE_COLORINDEX )
-				Image_GetPaletteLMP( image.palette, LUMP_GRADIENT );
-			else Image_GetPaletteLMP( image.palette, LUMP_MASKED );
-		}
-		else Image_GetPaletteLMP( image.palette, LUMP_NORMAL );
-		// intentionally fallthrough
 	case PF_INDEXED_32:
-		if( !image.d_currentpal ) image.d_currentpal = (uint *)image.palette;
+		Image_GetPaletteIndexed();
 		if( !Image_Copy8bitRGBA( fin, fout, image.width * image.height ))
 			return false;
 		break;
@@ -1359,7 +1736,14 @@ qboolean Image_RemapInternal( rgbdata_t *pic, int topColor, int bottomColor )
 	return true;
 }
 
-qboolean Image_Process(rgbdata_t **pix, int width, int height, uint flags, float reserved )
+/*
+=================
+Image_ProcessPasses
+
+one full image pass per operation, reference for Image_ProcessRows
+=================
+*/
+qboolean Image_ProcessPasses( rgbdata_t **pix, int width, int height, uint flags, float reserved )
 {
 	rgbdata_t	*pic = *pix;
 	qboolean	result = true;
@@ -1437,3 +1821,410 @@ qboolean Image_Process(rgbdata_t **pix, int width, int height, uint flags, float
 
 	return result;
 }
+
+/*
+==============================================================
+
+IMAGE ROW PIPELINE
+
+==============================================================
+*/
+enum
+{
+	PIPE_COPY = 0,	// gather source pixels only
+	PIPE_MAP8,	// indexed -> indexed, luma
+	PIPE_MAP32,	// indexed -> RGBA, luma, palette and gamma
+	PIPE_RGB24,	// RGB -> RGBA
+	PIPE_BGR24,	// BGR -> RGBA
+	PIPE_BGRA32,	// BGRA -> RGBA
+};
+
+typedef struct
+{
+	const byte	*in;		// source pixels
+	int		width, height;	// source dims
+	int		insamples;	// source bytes per pixel
+	qboolean		flip_x, flip_y, flip_i;
+	int		rowwidth, numrows;	// dims after the flip
+	int		outsamples;	// row bytes per pixel
+	int		op;
+	qboolean		gamma;		// apply light gamma to RGBA rows
+	byte		map8[256];
+	uint		map32[256];
+	byte		gammatable[256];
+	byte		*gather;		// flipped source row
+	byte		*row;		// converted row
+	int		rownum;		// cached row index
+} imagepipe_t;
+
+/*
+=================
+Image_PipeGather
+
+returns source pixels of the flipped row, copies them into dst if needed
+=================
+*/
+static const byte *Image_PipeGather( const imagepipe_t *pipe, int y, byte *dst )
+{
+	int		i, x, s = pipe->insamples;
+	int		pitch = pipe->width * s;
+	const byte	*p;
+	int		inc;
+	byte		*out = dst;
+
+	if( pipe->flip_i )
+	{
+		// row y is the source column
+		x = pipe->flip_x ? pipe->width - 1 - y : y;
+		p = pipe->in + x * s;
+		inc = pitch;
+
+		if( pipe->flip_y )
+		{
+			p += ( pipe->height - 1 ) * pitch;
+			inc = -pitch;
+		}
+
+		for( x = 0; x < pipe->rowwidth; x++, p += inc, out += s )
+			for( i = 0; i < s; i++ )
+				out[i] = p[i];
+		return dst;
+	}
+
+	p = pipe->in + ( pipe->flip_y ? pipe->height - 1 - y : y ) * pitch;
+
+	if( !pipe->flip_x )
+		return p;
+
+	for( x = 0, p += pitch - s; x < pipe->rowwidth; x++, p -= s, out += s )
+		for( i = 0; i < s; i++ )
+			out[i] = p[i];
+	return dst;
+}
+
+/*
+=================
+Image_PipeConvert
+
+per pixel operations, in and out may be the same row
+=================
+*/
+static void Image_PipeConvert( const imagepipe_t *pipe, const byte *in, byte *out, int pixels )
+{
+	uint	*iout = (uint *)out;
+	int	i;
+
+	switch( pipe->op )
+	{
+	case PIPE_COPY:
+		if( in != out ) memcpy( out, in, pixels * pipe->insamples );
+		break;
+	case PIPE_MAP8:
+		for( i = 0; i < pixels; i++ )
+			out[i] = pipe->map8[in[i]];
+		return; // indexed rows have no gamma
+	case PIPE_MAP32:
+		for( i = 0; i < pixels; i++ )
+			iout[i] = pipe->map32[in[i]];
+		return; // gamma is in the palette
+	case PIPE_RGB24:
+		for( i = 0; i < pixels; i++, in += 3, out += 4 )
+		{
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+			out[3] = 255;
+		}
+		out -= pixels * 4;
+		break;
+	case PIPE_BGR24:
+		for( i = 0; i < pixels; i++, in += 3, out += 4 )
+		{
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			out[3] = 255;
+		}
+		out -= pixels * 4;
+		break;
+	case PIPE_BGRA32:
+		for( i = 0; i < pixels; i++, in += 4, out += 4 )
+		{
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			out[3] = in[3];
+		}
+		out -= pixels * 4;
+		break;
+	}
+
+	if( !pipe->gamma )
+		return;
+
+	for( i = 0; i < pixels; i++, out += 4 )
+	{
+		out[0] = pipe->gammatable[out[0]];
+		out[1] = pipe->gammatable[out[1]];
+		out[2] = pipe->gammatable[out[2]];
+	}
+}
+
+/*
+=================
+Image_PipeRow
+
+row source for the resamplers
+=================
+*/
+static const byte *Image_PipeRow( void *source, int y )
+{
+	imagepipe_t	*pipe = (imagepipe_t *)source;
+	const byte	*in;
+
+	// lerp reads one row past the end of single row images
+	y = bound( 0, y, pipe->numrows - 1 );
+
+	if( pipe->rownum == y )
+		return pipe->row;
+
+	in = Image_PipeGather( pipe, y, pipe->gather );
+
+	if( pipe->op == PIPE_COPY && !pipe->gamma )
+		return in;
+
+	Image_PipeConvert( pipe, in, pipe->row, pipe->rowwidth );
+	pipe->rownum = y;
+
+	return pipe->row;
+}
+
+/*
+=================
+Image_ProcessRows
+
+streams the image rows through all requested operations at once,
+returns false if the passes have to do it
+=================
+*/
+static qboolean Image_ProcessRows( rgbdata_t **pix, int width, int height, uint flags, qboolean *result )
+{
+	rgbdata_t	*pic = *pix;
+	imagepipe_t	pipe;
+	qboolean	indexed, expand, luma, flip, resample = false;
+	qboolean	quality = Image_CheckFlag( IL_USE_LERPING );
+	int	i, outtype, outwidth, outheight;
+	byte	*out, *buffer;
+
+	if( !pic || !pic->buffer || !flags )
+		return false;
+
+	switch( pic->type )
+	{
+	case PF_INDEXED_24:
+	case PF_INDEXED_32:
+	case PF_RGB_24:
+	case PF_BGR_24:
+	case PF_RGBA_32:
+	case PF_BGRA_32:
+		break;
+	default:
+		return false;
+	}
+
+	memset( &pipe, 0, sizeof( pipe ));
+	indexed = ( pic->type == PF_INDEXED_24 || pic->type == PF_INDEXED_32 );
+	luma = FBitSet( flags, IMAGE_MAKE_LUMA ) && FBitSet( pic->flags, IMAGE_HAS_LUMA ) && indexed;
+	flip = FBitSet( flags, IMAGE_FLIP_X|IMAGE_FLIP_Y|IMAGE_ROT_90 ) ? true : false;
+	expand = FBitSet( flags, IMAGE_FORCE_RGBA ) && pic->type != PF_RGBA_32;
+
+	// remap always expands if it succeeds
+	if( FBitSet( flags, IMAGE_REMAP ) && pic->palette && indexed )
+		expand = true;
+
+	// indexed image has nothing to expand with
+	if( expand && pic->type == PF_INDEXED_32 && !image.d_currentpal && !pic->palette )
+		return false;
+
+	// passes flip only pic->size bytes of the expanded image
+	if( expand && flip )
+		return false;
+
+	outtype = expand ? PF_RGBA_32 : pic->type;
+	pipe.insamples = PFDesc[pic->type].bpp;
+	pipe.outsamples = PFDesc[outtype].bpp;
+
+	if( flip && pic->size != pic->width * pic->height * pipe.insamples )
+		return false;
+
+	pipe.in = pic->buffer;
+	pipe.width = pic->width;
+	pipe.height = pic->height;
+	pipe.flip_x = FBitSet( flags, IMAGE_FLIP_X ) ? true : false;
+	pipe.flip_y = FBitSet( flags, IMAGE_FLIP_Y ) ? true : false;
+	pipe.flip_i = FBitSet( flags, IMAGE_ROT_90 ) ? true : false;
+	pipe.rowwidth = pipe.flip_i ? pipe.height : pipe.width;
+	pipe.numrows = pipe.flip_i ? pipe.width : pipe.height;
+	pipe.rownum = -1;
+	outwidth = pipe.rowwidth;
+	outheight = pipe.numrows;
+
+	if( FBitSet( flags, IMAGE_RESAMPLE ) && width > 0 && height > 0 )
+	{
+		outwidth = bound( 1, width, IMAGE_MAXWIDTH );
+		outheight = bound( 1, height, IMAGE_MAXHEIGHT );
+		resample = ( outwidth != pipe.rowwidth || outheight != pipe.numrows );
+
+		// keep the 24-bit resamplers as they are
+		if( resample && pipe.outsamples == 3 )
+			return false;
+	}
+
+	// from here we can't fall back to passes
+	if( FBitSet( flags, IMAGE_MAKE_LUMA ))
+	{
+		if( !indexed && FBitSet( pic->flags, IMAGE_HAS_LUMA ))
+			Con_Printf( S_ERROR "Image_MakeLuma: unsupported format %s\n", PFDesc[pic->type].name );
+		ClearBits( pic->flags, IMAGE_HAS_LUMA );
+	}
+
+	if( FBitSet( flags, IMAGE_REMAP ))
+		Image_RemapInternal( pic, width, height );
+
+	// light gamma works on RGBA only
+	pipe.gamma = FBitSet( flags, IMAGE_LIGHTGAMMA ) && outtype == PF_RGBA_32;
+
+	if( pipe.gamma )
+	{
+		for( i = 0; i < 256; i++ )
+			pipe.gammatable[i] = LightToTexGamma( i );
+	}
+
+	if( expand && indexed )
+	{
+		Image_CopyParms( pic );
+		image.size = image.ptr = 0;
+		Image_GetPaletteIndexed();
+
+		if( Image_PaletteHasColor( image.d_currentpal ))
+			image.flags |= IMAGE_HAS_COLOR;
+
+		// fold luma and gamma into the palette
+		for( i = 0; i < 256; i++ )
+		{
+			byte	*col = (byte *)&pipe.map32[i];
+			int	c = i;
+
+			if( luma ) c = c >= 224 ? c : 0;
+			else if( FBitSet( image.flags, IMAGE_HAS_LUMA ))
+				c = c < 224 ? c : 0;
+
+			pipe.map32[i] = image.d_currentpal[c];
+
+			if( pipe.gamma )
+			{
+				col[0] = pipe.gammatable[col[0]];
+				col[1] = pipe.gammatable[col[1]];
+				col[2] = pipe.gammatable[col[2]];
+			}
+		}
+
+		pipe.op = PIPE_MAP32;
+		pipe.gamma = false;
+		image.type = PF_RGBA_32;
+		image.size = pic->width * pic->height * 4;
+	}
+	else if( expand )
+	{
+		Image_CopyParms( pic );
+		image.size = pic->width * pic->height * 4;
+
+		switch( pic->type )
+		{
+		case PF_RGB_24: pipe.op = PIPE_RGB24; break;
+		case PF_BGR_24: pipe.op = PIPE_BGR24; break;
+		default: pipe.op = PIPE_BGRA32; break;
+		}
+	}
+	else if( luma )
+	{
+		for( i = 0; i < 256; i++ )
+			pipe.map8[i] = i >= 224 ? i : 0;
+		pipe.op = PIPE_MAP8;
+	}
+
+	if( !expand && !flip && !resample )
+	{
+		// nothing moves, convert in place
+		if( pipe.op != PIPE_COPY || pipe.gamma )
+			Image_PipeConvert( &pipe, pic->buffer, pic->buffer, pic->width * pic->height );
+	}
+	else
+	{
+		buffer = Mem_Malloc( host.imagepool, outwidth * outheight * pipe.outsamples );
+
+		if( resample )
+		{
+			int	gathersize = ( pipe.rowwidth * pipe.insamples + 15 ) & ~15;
+
+			pipe.gather = Mem_Malloc( host.imagepool, gathersize + pipe.rowwidth * pipe.outsamples );
+			pipe.row = pipe.gather + gathersize;
+
+			Con_Reportf( "Image_Resample: from[%d x %d] to [%d x %d]\n", pipe.rowwidth, pipe.numrows, outwidth, outheight );
+
+			if( pipe.outsamples == 1 )
+				Image_Resample8NolerpRows( Image_PipeRow, &pipe, pipe.rowwidth, pipe.numrows, buffer, outwidth, outheight );
+			else if( quality )
+				Image_Resample32LerpRows( Image_PipeRow, &pipe, pipe.rowwidth, pipe.numrows, buffer, outwidth, outheight );
+			else Image_Resample32NolerpRows( Image_PipeRow, &pipe, pipe.rowwidth, pipe.numrows, buffer, outwidth, outheight );
+
+			Mem_Free( pipe.gather );
+		}
+		else
+		{
+			// rows go straight into the new buffer
+			for( i = 0, out = buffer; i < outheight; i++, out += outwidth * pipe.outsamples )
+				Image_PipeConvert( &pipe, Image_PipeGather( &pipe, i, out ), out, outwidth );
+		}
+
+		Mem_Free( pic->buffer );
+		pic->buffer = buffer;
+		pic->width = outwidth;
+		pic->height = outheight;
+
+		if( resample )
+			pic->size = outwidth * outheight * pipe.outsamples;
+	}
+
+	if( expand )
+	{
+		pic->type = PF_RGBA_32;
+		if( pic->palette ) Mem_Free( pic->palette );
+		pic->flags = image.flags;
+		pic->palette = NULL;
+	}
+
+	// resample was requested but size is the same
+	*result = !( FBitSet( flags, IMAGE_RESAMPLE ) && width > 0 && height > 0 && !resample );
+
+	if( FBitSet( flags, IMAGE_QUANTIZE ))
+		pic = Image_Quantize( pic );
+
+	*pix = pic;
+
+	return true;
+}
+
+qboolean Image_Process( rgbdata_t **pix, int width, int height, uint flags, float reserved )
+{
+	qboolean	result;
+
+	if( Image_ProcessRows( pix, width, height, flags, &result ))
+	{
+		// clear any force flags
+		image.force_flags = 0;
+		return result;
+	}
+
+	return Image_ProcessPasses( pix, width, height, flags, reserved );
+}
@@ -443,6 +443,9 @@ model_t *Mod_LoadWorld( const char *name, qboolean preload )
 	// free sequence files on studiomodels
 	Mod_PurgeStudioCache();
 
+	// report probes of the previous level
+	FS_IndexNewLevel();
+
 	// load the newmap
 	world.loading = true;
 	pworld = Mod_FindName( name, false );
@@ -20,6 +20,30 @@ GNU General Public License for more details.
 
 typedef int (*pfnIgnore)( physent_t *pe );	// custom trace filter
 
+#define PM_INDEX_CELLS	32	// grid cells per axis
+#define PM_INDEX_MAX_CELLS	64	// bigger entities are never binned
+#define PM_INDEX_MAX_REFS	4096
+#define PM_INDEX_WORDS	(( MAX_PHYSENTS + 31 ) >> 5 )
+
+// uniform xy grid over a physents array, lets traces
+// skip the entities which are far away from the move
+typedef struct pmindex_s
+{
+	const physent_t	*ents;		// array the index was built for
+	int		numents;		// entries past this one are always tested
+	byte		bounded[MAX_PHYSENTS];	// false for entities tested by every query
+	vec3_t		absmin[MAX_PHYSENTS];	// conservative bounds, without the player hull
+	vec3_t		absmax[MAX_PHYSENTS];
+	vec2_t		origin;		// corner of the grid
+	vec2_t		scale;		// cells per unit
+
+	int		numunbinned;
+	short		unbinned[MAX_PHYSENTS];
+
+	short		first[PM_INDEX_CELLS * PM_INDEX_CELLS + 1];	// start of each cell in refs
+	short		refs[PM_INDEX_MAX_REFS];
+} pmindex_t;
+
 //
 // pm_debug.c
 //
@@ -39,6 +63,9 @@ int PM_HullPointContents( hull_t *hull, int num, const vec3_t p );
 int PM_TruePointContents( playermove_t *pmove, const vec3_t p );
 int PM_PointContents( playermove_t *pmove, const vec3_t p );
 void PM_ConvertTrace( trace_t *out, pmtrace_t *in, edict_t *ent );
+qboolean PM_PhysentBounds( const physent_t *pe, vec3_t absmin, vec3_t absmax );
+void PM_BuildIndex( pmindex_t *index, const physent_t *ents, int numents );
+void PM_SetIndex( const pmindex_t *index );
 
 //
 // pm_surface.c
@@ -27,6 +27,7 @@ GNU General Public License for more details.
 static mplane_t	pm_boxplanes[6];
 static mclipnode_t	pm_boxclipnodes[6];
 static hull_t	pm_boxhull;
+static const pmindex_t	*pm_index;	// broad-phase for one physents array
 
 // default hullmins
 static const vec3_t pm_hullmins[MAX_MAP_HULLS] =
@@ -313,6 +314,255 @@ qboolean PM_RecursiveHullCheck( hull_t *hull, int num, float p1f, float p2f, vec
 	return false;
 }
 
+/*
+==================
+PM_PhysentBounds
+
+box that holds everything the entity can collide with,
+the player hull is added by the query. returns false
+for entities which must be tested by every query
+==================
+*/
+qboolean PM_PhysentBounds( const physent_t *pe, vec3_t absmin, vec3_t absmax )
+{
+	vec3_t	mins, maxs, pad;
+	float	radius;
+	int	i, j;
+
+	// custom shapes are only known to the game
+	if( pe->solid == SOLID_CUSTOM )
+		return false;
+
+	if( pe->model )
+	{
+		if( pe->model->type != mod_brush || !VectorIsNull( pe->angles ))
+			return false;
+
+		// clip hulls can be anchored at other player mins than the query uses
+		VectorClear( pad );
+		for( i = 1; i < MAX_MAP_HULLS; i++ )
+		{
+			for( j = 0; j < 3; j++ )
+				pad[j] = Q_max( pad[j], pe->model->hulls[i].clip_maxs[j] - pe->model->hulls[i].clip_mins[j] );
+		}
+
+		for( j = 0; j < 3; j++ )
+		{
+			absmin[j] = pe->origin[j] + pe->model->mins[j] - pad[j] - 1.0f;
+			absmax[j] = pe->origin[j] + pe->model->maxs[j] + pad[j] + 1.0f;
+		}
+
+		return true;
+	}
+
+	VectorCopy( pe->mins, mins );
+	VectorCopy( pe->maxs, maxs );
+
+	if( pe->studiomodel )
+	{
+		// hitboxes turn with the entity, the sequence bounds
+		// are used for the same purpose on the server
+		AddPointToBounds( pe->studiomodel->mins, mins, maxs );
+		AddPointToBounds( pe->studiomodel->maxs, mins, maxs );
+		radius = RadiusFromBounds( mins, maxs );
+		VectorSet( mins, -radius, -radius, -radius );
+		VectorSet( maxs, radius, radius, radius );
+	}
+
+	for( j = 0; j < 3; j++ )
+	{
+		absmin[j] = pe->origin[j] + mins[j] - 1.0f;
+		absmax[j] = pe->origin[j] + maxs[j] + 1.0f;
+	}
+
+	return true;
+}
+
+static void PM_IndexRange( const pmindex_t *index, const vec3_t mins, const vec3_t maxs, int *range )
+{
+	int	j;
+
+	for( j = 0; j < 2; j++ )
+	{
+		range[j+0] = bound( 0, (int)floor(( mins[j] - index->origin[j] ) * index->scale[j] ), PM_INDEX_CELLS - 1 );
+		range[j+2] = bound( 0, (int)floor(( maxs[j] - index->origin[j] ) * index->scale[j] ), PM_INDEX_CELLS - 1 );
+	}
+}
+
+/*
+==================
+PM_BuildIndex
+
+counting sort of physents into grid cells, the world,
+custom and rotated entities are left out of the grid
+==================
+*/
+void PM_BuildIndex( pmindex_t *index, const physent_t *ents, int numents )
+{
+	int	range[MAX_PHYSENTS][4];
+	short	fill[PM_INDEX_CELLS * PM_INDEX_CELLS];
+	int	i, x, y, cells, numrefs = 0;
+	vec3_t	mins, maxs;
+
+	numents = bound( 0, numents, MAX_PHYSENTS );
+	index->ents = ents;
+	index->numents = numents;
+	index->numunbinned = 0;
+	memset( index->first, 0, sizeof( index->first ));
+	ClearBounds( mins, maxs );
+
+	for( i = 0; i < numents; i++ )
+	{
+		// world hull is solid outside of the map
+		index->bounded[i] = i != 0 && PM_PhysentBounds( &ents[i], index->absmin[i], index->absmax[i] );
+
+		if( index->bounded[i] )
+		{
+			AddPointToBounds( index->absmin[i], mins, maxs );
+			AddPointToBounds( index->absmax[i], mins, maxs );
+		}
+	}
+
+	for( i = 0; i < 2; i++ )
+	{
+		index->origin[i] = mins[i];
+		index->scale[i] = PM_INDEX_CELLS / Q_max( maxs[i] - mins[i], 1.0f );
+	}
+
+	for( i = 0; i < numents; i++ )
+	{
+		range[i][0] = 1; // nothing to bin
+		range[i][2] = 0;
+
+		if( index->bounded[i] )
+		{
+			PM_IndexRange( index, index->absmin[i], index->absmax[i], range[i] );
+			cells = ( range[i][2] - range[i][0] + 1 ) * ( range[i][3] - range[i][1] + 1 );
+		}
+		else cells = 0;
+
+		if( !index->bounded[i] || cells > PM_INDEX_MAX_CELLS || numrefs + cells > PM_INDEX_MAX_REFS )
+		{
+			index->unbinned[index->numunbinned++] = i;
+			range[i][0] = 1;
+			range[i][2] = 0;
+			continue;
+		}
+
+		for( x = range[i][0]; x <= range[i][2]; x++ )
+		{
+			for( y = range[i][1]; y <= range[i][3]; y++ )
+				index->first[y * PM_INDEX_CELLS + x + 1]++;
+		}
+
+		numrefs += cells;
+	}
+
+	for( i = 0; i < PM_INDEX_CELLS * PM_INDEX_CELLS; i++ )
+	{
+		index->first[i + 1] += index->first[i];
+		fill[i] = index->first[i];
+	}
+
+	// entities are added in order, so every cell is sorted by index
+	for( i = 0; i < numents; i++ )
+	{
+		for( x = range[i][0]; x <= range[i][2]; x++ )
+		{
+			for( y = range[i][1]; y <= range[i][3]; y++ )
+				index->refs[fill[y * PM_INDEX_CELLS + x]++] = i;
+		}
+	}
+}
+
+/*
+==================
+PM_SetIndex
+
+index is used for the array it was built for, traces
+through any other array test every entity as before
+==================
+*/
+void PM_SetIndex( const pmindex_t *index )
+{
+	pm_index = index;
+}
+
+/*
+==================
+PM_IndexCandidates
+
+mark physents that can touch the box, returns
+false when there is no index for this array
+==================
+*/
+static qboolean PM_IndexCandidates( const physent_t *ents, int numents, const vec3_t mins, const vec3_t maxs, uint *mask )
+{
+	const pmindex_t	*index = pm_index;
+	int		range[4];
+	int		i, j, x, y, cell;
+
+	if( !index || index->ents != ents || index->numents <= 0 )
+		return false;
+
+	memset( mask, 0, sizeof( uint ) * PM_INDEX_WORDS );
+	PM_IndexRange( index, mins, maxs, range );
+
+	for( x = range[0]; x <= range[2]; x++ )
+	{
+		for( y = range[1]; y <= range[3]; y++ )
+		{
+			cell = y * PM_INDEX_CELLS + x;
+
+			for( j = index->first[cell]; j < index->first[cell + 1]; j++ )
+				SetBits( mask[index->refs[j] >> 5], BIT( index->refs[j] & 31 ));
+		}
+	}
+
+	for( j = 0; j < index->numunbinned; j++ )
+		SetBits( mask[index->unbinned[j] >> 5], BIT( index->unbinned[j] & 31 ));
+
+	// players and such are added after the build
+	for( i = index->numents; i < numents && i < MAX_PHYSENTS; i++ )
+		SetBits( mask[i >> 5], BIT( i & 31 ));
+
+	// cells are coarse, drop the ones far from the box
+	for( i = 0; i < index->numents; i++ )
+	{
+		if( !mask[i >> 5] )
+		{
+			i |= 31; // skip empty words
+			continue;
+		}
+
+		if( index->bounded[i] && !BoundsIntersect( mins, maxs, index->absmin[i], index->absmax[i] ))
+			ClearBits( mask[i >> 5], BIT( i & 31 ));
+	}
+
+	return true;
+}
+
+/*
+==================
+PM_HullQueryBounds
+
+box swept by the player hull along the move
+==================
+*/
+static void PM_HullQueryBounds( playermove_t *pmove, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs )
+{
+	float	extent;
+	int	j;
+
+	for( j = 0; j < 3; j++ )
+	{
+		// symmetric, because hitboxes are grown by half of the hull size
+		extent = Q_max( fabs( pmove->player_mins[pmove->usehull][j] ), fabs( pmove->player_maxs[pmove->usehull][j] ));
+		mins[j] = Q_min( start[j], end[j] ) - extent;
+		maxs[j] = Q_max( start[j], end[j] ) + extent;
+	}
+}
+
 pmtrace_t PM_PlayerTraceExt( playermove_t *pmove, vec3_t start, vec3_t end, int flags, int numents, physent_t *ents, int ignore_pe, pfnIgnore pmFilter )
 {
 	physent_t	*pe;
@@ -325,12 +575,17 @@ pmtrace_t PM_PlayerTraceExt( playermove_t *pmove, vec3_t start, vec3_t end, int
 	int	i, j, hullcount;
 	qboolean	rotated, transform_bbox;
 	hull_t	*hull = NULL;
+	uint	mask[PM_INDEX_WORDS];
+	qboolean	indexed;
 
 	memset( &trace_total, 0, sizeof( trace_total ));
 	VectorCopy( end, trace_total.endpos );
 	trace_total.fraction = 1.0f;
 	trace_total.ent = -1;
 
+	PM_HullQueryBounds( pmove, start, end, mins, maxs );
+	indexed = !FBitSet( flags, PM_WORLD_ONLY ) && PM_IndexCandidates( ents, numents, mins, maxs, mask );
+
 	for( i = 0; i < numents; i++ )
 	{
 		pe = &ents[i];
@@ -338,6 +593,9 @@ pmtrace_t PM_PlayerTraceExt( playermove_t *pmove, vec3_t start, vec3_t end, int
 		if( i != 0 && ( flags & PM_WORLD_ONLY ))
 			break;
 
+		if( indexed && !FBitSet( mask[i >> 5], BIT( i & 31 )))
+			continue;
+
 		// run custom user filter
 		if( pmFilter != NULL )
 		{
@@ -537,14 +795,22 @@ int PM_TestPlayerPosition( playermove_t *pmove, vec3_t pos, pmtrace_t *ptrace, p
 	vec3_t	mins, maxs;
 	pmtrace_t trace;
 	physent_t *pe;
+	uint	mask[PM_INDEX_WORDS];
+	qboolean	indexed;
 
 	trace = PM_PlayerTraceExt( pmove, pmove->origin, pmove->origin, 0, pmove->numphysent, pmove->physents, -1, pmFilter );
 	if( ptrace ) *ptrace = trace;
 
+	PM_HullQueryBounds( pmove, pos, pos, mins, maxs );
+	indexed = PM_IndexCandidates( pmove->physents, pmove->numphysent, mins, maxs, mask );
+
 	for( i = 0; i < pmove->numphysent; i++ )
 	{
 		pe = &pmove->physents[i];
 
+		if( indexed && !FBitSet( mask[i >> 5], BIT( i & 31 )))
+			continue;
+
 		// run custom user filter
 		if( pmFilter != NULL )
 		{
@@ -688,6 +954,8 @@ int PM_PointContents( playermove_t *pmove, const vec3_t p )
 	hull_t	*hull;
 	vec3_t	test;
 	physent_t	*pe;
+	uint	mask[PM_INDEX_WORDS];
+	qboolean	indexed;
 
 	// sanity check
 	if( !p || !pmove->physents[0].model )
@@ -695,11 +963,15 @@ int PM_PointContents( playermove_t *pmove, const vec3_t p )
 
 	// get base contents from world
 	contents = PM_HullPointContents( &pmove->physents[0].model->hulls[0], 0, p );
+	indexed = PM_IndexCandidates( pmove->physents, pmove->numphysent, p, p, mask );
 
 	for( i = 1; i < pmove->numphysent; i++ )
 	{
 		pe = &pmove->physents[i];
 
+		if( indexed && !FBitSet( mask[i >> 5], BIT( i & 31 )))
+			continue;
+
 		if( pe->solid != SOLID_NOT ) // disabled ?
 			continue;
 
@@ -733,3 +1005,108 @@ int PM_PointContents( playermove_t *pmove, const vec3_t p )
 
 	return contents;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define PHYSINDEX_TEST_ENTS	512
+#define PHYSINDEX_TEST_TRACES	4096
+
+static void Test_PhysIndexTraces( playermove_t *pmove, vec3_t *starts, vec3_t *ends, pmtrace_t *out )
+{
+	int	i;
+
+	for( i = 0; i < PHYSINDEX_TEST_TRACES; i++ )
+		out[i] = PM_PlayerTraceExt( pmove, starts[i], ends[i], 0, pmove->numphysent, pmove->physents, -1, NULL );
+}
+
+void Test_RunPhysIndex( void )
+{
+	playermove_t	*pmove = Mem_Calloc( host.mempool, sizeof( *pmove ));
+	pmindex_t		*index = Mem_Calloc( host.mempool, sizeof( *index ));
+	vec3_t		*starts = Mem_Malloc( host.mempool, sizeof( vec3_t ) * PHYSINDEX_TEST_TRACES );
+	vec3_t		*ends = Mem_Malloc( host.mempool, sizeof( vec3_t ) * PHYSINDEX_TEST_TRACES );
+	pmtrace_t		*brute = Mem_Malloc( host.mempool, sizeof( pmtrace_t ) * PHYSINDEX_TEST_TRACES );
+	pmtrace_t		*grid = Mem_Malloc( host.mempool, sizeof( pmtrace_t ) * PHYSINDEX_TEST_TRACES );
+	double		start, brutetime, gridtime;
+	uint		seed = 0x2545F491;
+	int		i, j, bad = 0;
+	physent_t		*pe;
+
+	PM_InitBoxHull();
+	memcpy( pmove->player_mins, pm_hullmins, sizeof( pm_hullmins ));
+	memcpy( pmove->player_maxs, pm_hullmaxs, sizeof( pm_hullmaxs ));
+
+	// crates and such spread over a 4096x4096 area, the first
+	// one stands for the world which is tested by every trace
+	for( i = 0, pe = pmove->physents; i < PHYSINDEX_TEST_ENTS; i++, pe++ )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			seed = seed * 1103515245 + 12345;
+			pe->origin[j] = (int)(( seed >> 8 ) % 4096 ) - 2048;
+			pe->mins[j] = -8.0f - ( seed >> 4 ) % 24;
+			pe->maxs[j] = 8.0f + ( seed >> 12 ) % 24;
+		}
+		pe->origin[2] *= 0.0625f;
+		pe->solid = SOLID_BBOX;
+		pe->info = i;
+	}
+	pmove->numphysent = PHYSINDEX_TEST_ENTS;
+
+	for( i = 0; i < PHYSINDEX_TEST_TRACES; i++ )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			seed = seed * 1103515245 + 12345;
+			starts[i][j] = (int)(( seed >> 8 ) % 4096 ) - 2048;
+			ends[i][j] = starts[i][j] + (int)(( seed >> 4 ) % 512 ) - 256;
+		}
+		starts[i][2] *= 0.0625f;
+		ends[i][2] *= 0.0625f;
+	}
+
+	PM_SetIndex( NULL );
+	start = Sys_DoubleTime();
+	Test_PhysIndexTraces( pmove, starts, ends, brute );
+	brutetime = Sys_DoubleTime() - start;
+
+	PM_BuildIndex( index, pmove->physents, pmove->numphysent );
+	PM_SetIndex( index );
+	start = Sys_DoubleTime();
+	Test_PhysIndexTraces( pmove, starts, ends, grid );
+	gridtime = Sys_DoubleTime() - start;
+
+	for( i = 0; i < PHYSINDEX_TEST_TRACES; i++ )
+	{
+		if( brute[i].ent != grid[i].ent || brute[i].fraction != grid[i].fraction || brute[i].startsolid != grid[i].startsolid
+			|| !VectorCompare( brute[i].endpos, grid[i].endpos ) || !VectorCompare( brute[i].plane.normal, grid[i].plane.normal ))
+			bad++;
+	}
+
+	Con_Reportf( "%s: %i physents, %.0f traces/sec, %.0f traces/sec without the index\n", __func__,
+		PHYSINDEX_TEST_ENTS, PHYSINDEX_TEST_TRACES / Q_max( gridtime, 0.000001 ), PHYSINDEX_TEST_TRACES / Q_max( brutetime, 0.000001 ));
+
+	TASSERT( bad == 0 );
+
+	// position tests see the same entities through the index
+	for( i = 0; i < PHYSINDEX_TEST_TRACES; i += 4 )
+	{
+		PM_SetIndex( NULL );
+		j = PM_TestPlayerPosition( pmove, starts[i], NULL, NULL );
+		PM_SetIndex( index );
+		if( PM_TestPlayerPosition( pmove, starts[i], NULL, NULL ) != j )
+			bad++;
+	}
+
+	TASSERT( bad == 0 );
+
+	PM_SetIndex( NULL );
+	Mem_Free( grid );
+	Mem_Free( brute );
+	Mem_Free( ends );
+	Mem_Free( starts );
+	Mem_Free( index );
+	Mem_Free( pmove );
+}
+#endif
@@ -14,6 +14,33 @@ GNU General Public License for more details.
 */
 
 #include "soundlib.h"
+#include "xash3d_mathlib.h"
+
+// vector kernels follow the compiler target, SSE2 is always there on amd64
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SND_SINC_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define SND_SINC_NEON	1
+#endif
+
+#define SINC_TAPS		32	// filter length in input samples, multiple of 8
+#define SINC_PHASE_BITS	10
+#define SINC_PHASES		(1 << SINC_PHASE_BITS)	// fractional positions between two input samples
+#define SINC_BITS		14	// fixed point scale of filter coefficients
+#define SINC_BETA		7.0	// kaiser window shape
+#define SINC_CUTOFF		0.86	// passband edge relative to the lower nyquist frequency
+
+typedef struct
+{
+	int	inrate;
+	int	outrate;
+	short	coeffs[SINC_PHASES][SINC_TAPS];
+} sincfilter_t;
+
+// polyphase filter for the last pair of rates used at load
+static sincfilter_t	sinc;
 
 /*
 =============================================================================
@@ -152,6 +179,219 @@ void Sound_ConvertToSigned( const byte *data, int channels, int samples )
 	}
 }
 
+/*
+================
+Sound_GetSample
+
+signed 8 or 16 bit sample scaled to 16 bit
+================
+*/
+_inline int Sound_GetSample( const byte *data, int width, int index )
+{
+	if( width == 2 )
+		return ((const short *)data)[index];
+	return (int)((const signed char *)data)[index] << 8;
+}
+
+/*
+================
+Sound_ResampleNearest
+
+steps over input without any filtering, also
+used to change width when rate stays the same
+================
+*/
+static void Sound_ResampleNearest( byte *out, const byte *data, int channels, int inwidth, int outwidth, float stepscale, int outcount )
+{
+	int	i, j, sample, srcsample;
+	int	samplefrac = 0;
+	int	fracstep = stepscale * 256;
+
+	for( i = 0; i < outcount; i++ )
+	{
+		srcsample = samplefrac >> 8;
+		samplefrac += fracstep;
+
+		for( j = 0; j < channels; j++ )
+		{
+			sample = Sound_GetSample( data, inwidth, srcsample * channels + j );
+
+			if( outwidth == 2 ) ((short *)out)[i * channels + j] = sample;
+			else ((signed char *)out)[i * channels + j] = sample >> 8;
+		}
+	}
+}
+
+/*
+================
+Sound_BesselI0
+
+modified bessel function of the first kind, for the kaiser window
+================
+*/
+static double Sound_BesselI0( double x )
+{
+	double	sum = 1.0, term = 1.0;
+	int	k;
+
+	for( k = 1; k < 32; k++ )
+	{
+		term *= ( x / ( 2.0 * k )) * ( x / ( 2.0 * k ));
+		sum += term;
+	}
+
+	return sum;
+}
+
+/*
+================
+Sound_SincSetup
+
+build kaiser windowed sinc filter for each phase,
+table is kept while the rates stay the same
+================
+*/
+static void Sound_SincSetup( sincfilter_t *sinc, int inrate, int outrate )
+{
+	const int	center = SINC_TAPS / 2 - 1;
+	double	h[SINC_TAPS];
+	double	cutoff, x, w, sum;
+	int	phase, tap, total;
+
+	if( sinc->inrate == inrate && sinc->outrate == outrate )
+		return;
+
+	// downsampling must also remove everything above the new nyquist
+	cutoff = SINC_CUTOFF * Q_min( 1.0, (double)outrate / inrate );
+
+	for( phase = 0; phase < SINC_PHASES; phase++ )
+	{
+		sum = 0.0;
+
+		for( tap = 0; tap < SINC_TAPS; tap++ )
+		{
+			x = tap - center - (double)phase / SINC_PHASES;
+			w = x / ( SINC_TAPS / 2 );
+			w = ( w * w < 1.0 ) ? Sound_BesselI0( SINC_BETA * sqrt( 1.0 - w * w )) / Sound_BesselI0( SINC_BETA ) : 0.0;
+			h[tap] = ( x != 0.0 ) ? w * sin( M_PI * cutoff * x ) / ( M_PI * cutoff * x ) : w;
+			sum += h[tap];
+		}
+
+		// unity gain on every phase, rounding error goes to the nearest tap
+		for( tap = 0, total = 0; tap < SINC_TAPS; tap++ )
+		{
+			sinc->coeffs[phase][tap] = (short)floor( h[tap] / sum * ( 1 << SINC_BITS ) + 0.5 );
+			total += sinc->coeffs[phase][tap];
+		}
+
+		sinc->coeffs[phase][center + ( phase >= SINC_PHASES / 2 )] += ( 1 << SINC_BITS ) - total;
+	}
+
+	sinc->inrate = inrate;
+	sinc->outrate = outrate;
+}
+
+/*
+================
+Sound_SincDotScalar
+================
+*/
+static int Sound_SincDotScalar( const short *src, const short *coeffs )
+{
+	int	i, sum = 0;
+
+	for( i = 0; i < SINC_TAPS; i++ )
+		sum += src[i] * coeffs[i];
+
+	return sum;
+}
+
+/*
+================
+Sound_SincDot
+
+filter one output sample, coefficients never reach
+-32768 so pairwise sums of products can't overflow
+================
+*/
+_inline int Sound_SincDot( const short *src, const short *coeffs )
+{
+#if defined( SND_SINC_SSE2 )
+	__m128i	sum = _mm_setzero_si128();
+	int	i;
+
+	for( i = 0; i < SINC_TAPS; i += 8 )
+		sum = _mm_add_epi32( sum, _mm_madd_epi16( _mm_loadu_si128( (const __m128i *)( src + i )), _mm_loadu_si128( (const __m128i *)( coeffs + i ))));
+
+	sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 1, 0, 3, 2 )));
+	sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 2, 3, 0, 1 )));
+
+	return _mm_cvtsi128_si32( sum );
+#elif defined( SND_SINC_NEON )
+	int32x4_t	sum = vdupq_n_s32( 0 );
+	int32x2_t	half;
+	int	i;
+
+	for( i = 0; i < SINC_TAPS; i += 4 )
+		sum = vmlal_s16( sum, vld1_s16( src + i ), vld1_s16( coeffs + i ));
+
+	half = vadd_s32( vget_low_s32( sum ), vget_high_s32( sum ));
+
+	return vget_lane_s32( vpadd_s32( half, half ), 0 );
+#else
+	return Sound_SincDotScalar( src, coeffs );
+#endif
+}
+
+/*
+================
+Sound_ResampleSinc
+
+band-limited rate conversion, every output sample is a dot
+product of SINC_TAPS input samples with the filter phase
+closest to its fractional position
+================
+*/
+static void Sound_ResampleSinc( sincfilter_t *sinc, byte *out, const byte *data, int channels, int inwidth, int outwidth, int inrate, int outrate, int insamples, int outcount, int loopstart )
+{
+	const int	head = SINC_TAPS / 2 - 1;
+	const short	*coeffs;
+	uint64_t	pos, step;
+	int	i, ch, sample;
+	short	*plane;
+
+	Sound_SincSetup( sinc, inrate, outrate );
+
+	// one channel at a time with zero padding around it
+	plane = Mem_Calloc( host.soundpool, ( insamples + SINC_TAPS ) * sizeof( short ));
+	step = ((uint64_t)inrate << 32 ) / outrate;
+
+	for( ch = 0; ch < channels; ch++ )
+	{
+		for( i = 0; i < insamples; i++ )
+			plane[head + i] = Sound_GetSample( data, inwidth, i * channels + ch );
+
+		// looped sounds continue from the loop start
+		for( i = 0; i < SINC_TAPS - head; i++ )
+		{
+			if( loopstart >= 0 && loopstart + i < insamples )
+				plane[head + insamples + i] = Sound_GetSample( data, inwidth, ( loopstart + i ) * channels + ch );
+		}
+
+		for( i = 0, pos = 0; i < outcount; i++, pos += step )
+		{
+			coeffs = sinc->coeffs[(uint)pos >> ( 32 - SINC_PHASE_BITS )];
+			sample = ( Sound_SincDot( plane + ( pos >> 32 ), coeffs ) + ( 1 << ( SINC_BITS - 1 ))) >> SINC_BITS;
+			sample = bound( -32768, sample, 32767 );
+
+			if( outwidth == 2 ) ((short *)out)[i * channels + ch] = sample;
+			else ((signed char *)out)[i * channels + ch] = sample >> 8;
+		}
+	}
+
+	Mem_Free( plane );
+}
+
 /*
 ================
 Sound_ResampleInternal
@@ -162,8 +402,7 @@ We need convert sound to signed even if nothing to resample
 qboolean Sound_ResampleInternal( wavdata_t *sc, int inrate, int inwidth, int outrate, int outwidth )
 {
 	float	stepscale;
-	int	outcount, srcsample;
-	int	i, sample, sample2, samplefrac, fracstep;
+	int	outcount, insamples, loopstart;
 	byte	*data;
 
 	data = sc->buffer;
@@ -173,6 +412,9 @@ qboolean Sound_ResampleInternal( wavdata_t *sc, int inrate, int inwidth, int out
 
 	sound.tempbuffer = (byte *)Mem_Realloc( host.soundpool, sound.tempbuffer, sc->size );
 
+	insamples = sc->samples;
+	loopstart = sc->loopStart;
+
 	sc->samples = outcount;
 	if( sc->loopStart != -1 )
 		sc->loopStart = sc->loopStart / stepscale;
@@ -184,54 +426,9 @@ qboolean Sound_ResampleInternal( wavdata_t *sc, int inrate, int inwidth, int out
 	}
 	else
 	{
-		// general case
-		samplefrac = 0;
-		fracstep = stepscale * 256;
-
-		if( sc->channels == 2 )
-		{
-			for( i = 0; i < outcount; i++ )
-			{
-				srcsample = samplefrac >> 8;
-				samplefrac += fracstep;
-
-				if( inwidth == 2 )
-				{
-					sample = ((short *)data)[srcsample*2+0];
-					sample2 = ((short *)data)[srcsample*2+1];
-				}
-				else
-				{
-					sample = (int)((char)(data[srcsample*2+0])) << 8;
-					sample2 = (int)((char)(data[srcsample*2+1])) << 8;
-				}
-
-				if( outwidth == 2 )
-				{
-					((short *)sound.tempbuffer)[i*2+0] = sample;
-					((short *)sound.tempbuffer)[i*2+1] = sample2;
-				}
-				else
-				{
-					((signed char *)sound.tempbuffer)[i*2+0] = sample >> 8;
-					((signed char *)sound.tempbuffer)[i*2+1] = sample2 >> 8;
-				}
-			}
-		}
-		else
-		{
-			for( i = 0; i < outcount; i++ )
-			{
-				srcsample = samplefrac >> 8;
-				samplefrac += fracstep;
-
-				if( inwidth == 2 ) sample = ((short *)data)[srcsample];
-				else sample = (int)( (char)(data[srcsample])) << 8;
-
-				if( outwidth == 2 ) ((short *)sound.tempbuffer)[i] = sample;
-				else ((signed char *)sound.tempbuffer)[i] = sample >> 8;
-			}
-		}
+		if( inrate != outrate )
+			Sound_ResampleSinc( &sinc, sound.tempbuffer, data, sc->channels, inwidth, outwidth, inrate, outrate, insamples, outcount, loopstart );
+		else Sound_ResampleNearest( sound.tempbuffer, data, sc->channels, inwidth, outwidth, stepscale, outcount );
 
 		Con_Reportf( "Sound_Resample: from[%d bit %d kHz] to [%d bit %d kHz]\n", inwidth * 8, inrate, outwidth * 8, outrate );
 	}
@@ -269,3 +466,150 @@ qboolean Sound_Process( wavdata_t **wav, int rate, int width, uint flags )
 
 	return false;
 }
+
+/*
+================
+Sound_MakeTone
+================
+*/
+static void Sound_MakeTone( short *buffer, int count, double freq, int rate )
+{
+	int	i;
+
+	for( i = 0; i < count; i++ )
+		buffer[i] = (short)( 16000.0 * sin( 2.0 * M_PI * freq * i / rate ));
+}
+
+/*
+================
+Sound_ToneSNR
+
+signal to noise ratio of a resampled tone against
+the exact one, filter length is skipped on both ends
+================
+*/
+static double Sound_ToneSNR( const short *buffer, int count, double freq, int rate )
+{
+	double	signal = 0.0, noise = 0.0, x;
+	int	i;
+
+	for( i = SINC_TAPS; i < count - SINC_TAPS; i++ )
+	{
+		x = 16000.0 * sin( 2.0 * M_PI * freq * i / rate );
+		signal += x * x;
+		noise += ( buffer[i] - x ) * ( buffer[i] - x );
+	}
+
+	return 10.0 * log10( signal / Q_max( noise, 1.0 ));
+}
+
+/*
+================
+Sound_ResampleBench_f
+
+snd_resamplebench [tone frequency]
+================
+*/
+void Sound_ResampleBench_f( void )
+{
+	static const int	rates[][2] =
+	{
+	{ 8000, 11025 },
+	{ 11025, 22050 },
+	{ 11025, 44100 },
+	{ 22050, 44100 },
+	{ 32000, 44100 },
+	{ 44100, 22050 },
+	};
+	sincfilter_t	*filter;
+	short	*in, *out;
+	double	freq = 997.0, start, snr[2], speed[2];
+	int	i, j, passes, inrate, outrate;
+
+	if( Cmd_Argc() > 1 )
+		freq = bound( 1.0, Q_atof( Cmd_Argv( 1 )), 4000.0 );
+
+	// own filter and buffers, sounds may be loading meanwhile
+	filter = Mem_Calloc( host.soundpool, sizeof( *filter ));
+	in = Mem_Malloc( host.soundpool, 44100 * sizeof( short ));
+	out = Mem_Malloc( host.soundpool, 44100 * sizeof( short ));
+
+	Con_Printf( "%g Hz tone, one second of 16 bit mono\n", freq );
+	Con_Printf( " from     to  nearest SNR  Msmp/s  sinc SNR  Msmp/s\n" );
+
+	for( i = 0; i < sizeof( rates ) / sizeof( rates[0] ); i++ )
+	{
+		inrate = rates[i][0];
+		outrate = rates[i][1];
+		Sound_MakeTone( in, inrate, freq, inrate );
+
+		for( j = 0; j < 2; j++ )
+		{
+			start = Sys_DoubleTime();
+			passes = 0;
+
+			do
+			{
+				if( j ) Sound_ResampleSinc( filter, (byte *)out, (byte *)in, 1, 2, 2, inrate, outrate, inrate, outrate, -1 );
+				else Sound_ResampleNearest( (byte *)out, (byte *)in, 1, 2, 2, (float)inrate / outrate, outrate );
+				passes++;
+			} while( Sys_DoubleTime() - start < 0.1 );
+
+			speed[j] = (double)outrate * passes / ( Sys_DoubleTime() - start ) / 1000000.0;
+			snr[j] = Sound_ToneSNR( out, outrate, freq, outrate );
+		}
+
+		Con_Printf( "%5i  %5i  %8.1f dB  %6.1f  %5.1f dB  %6.1f\n", inrate, outrate, snr[0], speed[0], snr[1], speed[1] );
+	}
+
+	Mem_Free( out );
+	Mem_Free( in );
+	Mem_Free( filter );
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+void Test_RunSoundlib( void )
+{
+	sincfilter_t	*filter;
+	wavdata_t	*wav;
+	short	src[64 + SINC_TAPS];
+	int	i, phase, bad = 0;
+
+	// vector kernel gives the same sums as the scalar one
+	filter = Mem_Calloc( host.soundpool, sizeof( *filter ));
+	Sound_SincSetup( filter, 11025, 44100 );
+
+	for( i = 0; i < sizeof( src ) / sizeof( src[0] ); i++ )
+		src[i] = COM_RandomLong( -32768, 32767 );
+
+	for( phase = 0; phase < SINC_PHASES; phase++ )
+	{
+		for( i = 0; i < 64; i++ )
+			bad += Sound_SincDot( src + i, filter->coeffs[phase] ) != Sound_SincDotScalar( src + i, filter->coeffs[phase] );
+	}
+
+	TASSERT( bad == 0 );
+	Mem_Free( filter );
+
+	// 11 kHz tone through the load path
+	wav = Mem_Calloc( host.soundpool, sizeof( *wav ));
+	wav->rate = 11025;
+	wav->width = 2;
+	wav->channels = 1;
+	wav->samples = 11025;
+	wav->loopStart = 1000;
+	wav->size = wav->samples * sizeof( short );
+	wav->buffer = Mem_Malloc( host.soundpool, wav->size );
+	Sound_MakeTone( (short *)wav->buffer, wav->samples, 997.0, 11025 );
+
+	Sound_Process( &wav, 44100, 2, SOUND_RESAMPLE );
+
+	TASSERT( wav->rate == 44100 && wav->samples == 44100 && wav->loopStart == 4000 );
+	TASSERT( Sound_ToneSNR( (short *)wav->buffer, wav->samples, 997.0, 44100 ) > 60.0 );
+
+	Mem_Free( wav->buffer );
+	Mem_Free( wav );
+}
+#endif /* XASH_ENGINE_TESTS */
@@ -22,10 +22,33 @@ extern struct tests_stats_s tests_stats;
 	else tests_stats.passed++;
 
 void Test_RunImagelib( void );
+void Test_RunSoundlib( void );
 void Test_RunLibCommon( void );
 void Test_RunCommon( void );
 void Test_RunCmd( void );
 void Test_RunCvar( void );
+void Test_RunPhysIndex( void );
+void Test_RunImageKernels( void );
+void Test_RunImageCache( void );
+void Test_RunFSIndex( void );
+void Test_RunImagePNG( void );
+#if !XASH_DEDICATED
+void Test_ClientSetup( void );
+void Test_ClientShutdown( void );
+void Test_RunSoundMix( void );
+void Test_RunSoundQueue( void );
+void Test_RunSoundDSP( void );
+void Test_RunSoundMusic( void );
+void Test_RunSoundMixThread( void );
+void Test_RunParticles( void );
+void Test_RunBeamSegments( void );
+void Test_RunTempEnts( void );
+void Test_RunLightBins( void );
+void Test_RunTimeDemoStats( void );
+void Test_RunDemoIndex( void );
+void Test_RunInterpHistory( void );
+void Test_RunPredictionCache( void );
+#endif
 
 #endif
 
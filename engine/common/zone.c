@@ -47,6 +47,7 @@ typedef struct mempool_s
 	size_t		totalsize;	// total memory allocated in this pool (inside memheaders)
 	size_t		realsize;		// total memory allocated in this pool (actual malloc total)
 	size_t		lastchecksize;	// updated each time the pool is displayed by memlist
+	size_t		peaksize;		// highest totalsize since the last Mem_PeakSize reset
 	struct mempool_s	*next;		// linked into global mempool list
 	const char	*filename;	// file name and line where Mem_AllocPool was called
 	int		fileline;
@@ -89,6 +90,8 @@ void *_Mem_Alloc( poolhandle_t poolptr, size_t size, qboolean clear, const char
 	pool = Mem_FindPool( poolptr );
 
 	pool->totalsize += size;
+	if( pool->totalsize > pool->peaksize )
+		pool->peaksize = pool->totalsize;
 
 	// big allocations are not clumped
 	pool->realsize += sizeof( memheader_t ) + size + sizeof( int );
@@ -334,6 +337,23 @@ void _Mem_Check( const char *filename, int fileline )
 			Mem_CheckHeaderSentinels((void *)((byte *) mem + sizeof(memheader_t)), filename, fileline );
 }
 
+/*
+========================
+Mem_PeakSize
+
+highest pool size since the previous reset
+========================
+*/
+size_t Mem_PeakSize( poolhandle_t poolptr, qboolean reset )
+{
+	mempool_t	*pool = Mem_FindPool( poolptr );
+	size_t	peak = pool->peaksize;
+
+	if( reset ) pool->peaksize = pool->totalsize;
+
+	return peak;
+}
+
 void Mem_PrintStats( void )
 {
 	size_t    count = 0, size = 0, realsize = 0;
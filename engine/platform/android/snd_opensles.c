@@ -51,7 +51,8 @@ static SLresult SLAPIENTRY (*pslCreateEngine)(
 
 void SNDDMA_Activate( qboolean active )
 {
-	if( !dma.initialized )
+	// -nullaudio, this backend wasn't opened
+	if( !dma.initialized || s_nulldevice )
 		return;
 
 	if( active )
@@ -215,7 +215,8 @@ between a deactivate and an activate.
 */
 void SNDDMA_Activate( qboolean active )
 {
-	if( !dma.initialized )
+	// -nullaudio, this backend wasn't opened
+	if( !dma.initialized || s_nulldevice )
 		return;
 
 	SDL_PauseAudioDevice( sdl_dev, !active );
@@ -23,15 +23,6 @@ GNU General Public License for more details.
 #define SAMPLE_16BIT_SHIFT		1
 #define SECONDARY_BUFFER_SIZE		0x10000
 
-/*
-=======================================================================
-Global variables. Must be visible to window-procedure function
-so it can unlock and free the data block after it has been played.
-=======================================================================
-*/
-
-dma_t			dma;
-
 void S_Activate( qboolean active )
 {
 }
@@ -30,7 +30,7 @@ GNU General Public License for more details.
 #include "ref_vulkan.h"
 #include "ref_device.h"
 
-#define REF_API_VERSION 1
+#define REF_API_VERSION 4
 
 
 #define TF_SKY		(TF_SKYSIDE|TF_NOMIPMAP)
@@ -232,6 +232,27 @@ typedef struct remap_info_s
 	model_t		*model;		// for catch model changes
 } remap_info_t;
 
+#define NOISE_DIVISIONS	64	// don't touch - many tripmines cause the crash when it equal 128
+#define MAX_BEAM_VERTS	( NOISE_DIVISIONS * 2 )
+
+// view the beam segments are turned to
+typedef struct beamview_s
+{
+	vec3_t		origin;
+	vec3_t		forward;
+	vec3_t		right;
+	vec3_t		up;
+} beamview_t;
+
+// triangle strip vertex of a segmented beam
+typedef struct beamvert_s
+{
+	vec3_t		pos;
+	vec3_t		normal;
+	float		s, t;
+	float		brightness;
+} beamvert_t;
+
 struct con_nprint_s;
 struct engine_studio_api_s;
 struct r_studio_interface_s;
@@ -403,6 +424,8 @@ typedef struct ref_api_s
 	lightstyle_t*	(*GetLightStyle)( int number );
 	dlight_t*	(*GetDynamicLight)( int number );
 	dlight_t*	(*GetEntityLight)( int number );
+	int		(*GetLightsInBox)( const vec3_t mins, const vec3_t maxs, qboolean elights, int *list, int maxlist ); // sorted light numbers near the box
+	int		(*BeamSegments)( const vec3_t source, const vec3_t delta, float width, float scale, float freq, float speed, int segments, int flags, const float *noise, const beamview_t *view, beamvert_t *verts ); // fills MAX_BEAM_VERTS at most
 	int		(*R_FatPVS)( const float *org, float radius, byte *visbuffer, qboolean merge, qboolean fullvis );
 	const struct ref_overview_s *( *GetOverviewParms )( void );
 	double		(*pfnTime)( void );				// Sys_DoubleTime
@@ -428,6 +451,7 @@ typedef struct ref_api_s
 	void (*Image_SetMDLPointer)( byte *p );
 	poolhandle_t (*Image_GetPool)( void );
 	const struct bpc_desc_s *(*Image_GetPFDesc)( int idx );
+	void (*Image_BuildMipChain)( const byte *in, int width, int height, int nummips, byte *out ); // RGBA levels after the first one, packed
 
 	// client exports
 	void	(*pfnDrawNormalTriangles)( void );
@@ -771,7 +771,8 @@ void R_AliasDynamicLight( cl_entity_t *ent, alight_t *plight )
 	vec3_t		origin, dist, finalLight;
 	float		add, radius, total;
 	colorVec		light;
-	uint		lnum;
+	int		lights[MAX_DLIGHTS];
+	int		i, numlights;
 	dlight_t		*dl;
 
 	if( !plight || !ent )
@@ -886,11 +887,15 @@ void R_AliasDynamicLight( cl_entity_t *ent, alight_t *plight )
 	// scale lightdir by light intentsity
 	VectorScale( lightDir, total, lightDir );
 
-	for( lnum = 0; lnum < MAX_DLIGHTS; lnum++ )
+	if( r_dynamic->value )
+		numlights = gEngfuncs.GetLightsInBox( origin, origin, false, lights, MAX_DLIGHTS );
+	else numlights = 0;
+
+	for( i = 0; i < numlights; i++ )
 	{
-		dl = gEngfuncs.GetDynamicLight( lnum );
+		dl = gEngfuncs.GetDynamicLight( lights[i] );
 
-		if( dl->die < g_alias.time || !r_dynamic->value )
+		if( dl->die < g_alias.time )
 			continue;
 
 		VectorSubtract( origin, dl->origin, dist );
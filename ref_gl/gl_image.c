@@ -921,6 +921,28 @@ byte *GL_ApplyFilter( const byte *source, int width, int height )
 	return out;
 }
 
+/*
+=================
+GL_BuildMipChain
+
+all levels after the first one, packed together
+=================
+*/
+static byte *GL_BuildMipChain( const byte *in, int width, int height, int mipCount )
+{
+	static byte	*mipChain = NULL;
+	size_t		size = 0;
+	int		j;
+
+	for( j = 1; j < mipCount; j++ )
+		size += Q_max( 1, ( width >> j )) * Q_max( 1, ( height >> j )) * 4;
+
+	mipChain = Mem_Realloc( r_temppool, mipChain, size );
+	gEngfuncs.Image_BuildMipChain( in, width, height, mipCount, mipChain );
+
+	return mipChain;
+}
+
 /*
 =================
 GL_BuildMipMap
@@ -1220,6 +1242,7 @@ static qboolean GL_UploadTexture( gl_texture_t *tex, rgbdata_t *pic )
 		else // RGBA32
 		{
 			int mipCount = GL_CalcMipmapCount( tex, ( buf != NULL ));
+			byte *mips = NULL;
 
 			// NOTE: only single uncompressed textures can be resamples, no mips, no layers, no sides
 			if(( tex->depth == 1 ) && (( pic->width != tex->width ) || ( pic->height != tex->height )))
@@ -1229,6 +1252,10 @@ static qboolean GL_UploadTexture( gl_texture_t *tex, rgbdata_t *pic )
 			if( !ImageDXT( pic->type ) && !FBitSet( tex->flags, TF_NOMIPMAP ) && FBitSet( pic->flags, IMAGE_ONEBIT_ALPHA ))
 				data = GL_ApplyFilter( data, tex->width, tex->height );
 
+			// plain 2D textures get the whole chain at once, the rest is mipmapped in place
+			if( mipCount > 1 && data && tex->depth == 1 && gEngfuncs.Image_GetPFDesc( pic->type )->bpp == 4 && !FBitSet( tex->flags, TF_NORMALMAP|TF_ALPHACONTRAST ))
+				mips = GL_BuildMipChain( data, tex->width, tex->height, mipCount );
+
 			// mips will be auto-generated if desired
 			for( j = 0; j < mipCount; j++ )
 			{
@@ -1237,7 +1264,9 @@ static qboolean GL_UploadTexture( gl_texture_t *tex, rgbdata_t *pic )
 				texsize = GL_CalcTextureSize( tex->format, width, height, tex->depth );
 				size = GL_CalcImageSize( pic->type, width, height, tex->depth );
 				GL_TextureImageRAW( tex, i, j, width, height, tex->depth, pic->type, data );
-				if( mipCount > 1 )
+				if( mips )
+					data = j ? data + size : mips;
+				else if( mipCount > 1 )
 					GL_BuildMipMap( data, width, height, tex->depth, tex->flags );
 				tex->size += texsize;
 				tex->numMips++;
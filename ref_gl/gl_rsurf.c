@@ -1514,6 +1514,7 @@ R_DrawBrushModel
 void R_DrawBrushModel( cl_entity_t *e )
 {
 	int		i, k, num_sorted;
+	int		lights[MAX_DLIGHTS], numlights;
 	vec3_t		origin_l, oldorigin;
 	int		old_rendermode;
 	vec3_t		mins, maxs;
@@ -1567,8 +1568,11 @@ void R_DrawBrushModel( cl_entity_t *e )
 	else VectorSubtract( RI.cullorigin, e->origin, tr.modelorg );
 
 	// calculate dynamic lighting for bmodel
-	for( k = 0; k < MAX_DLIGHTS; k++ )
+	numlights = gEngfuncs.GetLightsInBox( mins, maxs, false, lights, MAX_DLIGHTS );
+
+	for( i = 0; i < numlights; i++ )
 	{
+		k = lights[i];
 		l = gEngfuncs.GetDynamicLight( k );
 
 		if( l->die < gpGlobals->time || !l->radius )
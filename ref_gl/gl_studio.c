@@ -1357,7 +1357,8 @@ void R_StudioDynamicLight( cl_entity_t *ent, alight_t *plight )
 	vec3_t		origin, dist, finalLight;
 	float		add, radius, total;
 	colorVec		light;
-	uint		lnum;
+	int		lights[MAX_DLIGHTS];
+	int		i, numlights;
 	dlight_t		*dl;
 
 	if( !plight || !ent || !ent->model )
@@ -1472,11 +1473,15 @@ void R_StudioDynamicLight( cl_entity_t *ent, alight_t *plight )
 	// scale lightdir by light intentsity
 	VectorScale( lightDir, total, lightDir );
 
-	for( lnum = 0; lnum < MAX_DLIGHTS; lnum++ )
+	if( r_dynamic->value )
+		numlights = gEngfuncs.GetLightsInBox( ent->origin, ent->origin, false, lights, MAX_DLIGHTS );
+	else numlights = 0;
+
+	for( i = 0; i < numlights; i++ )
 	{
-		dl = gEngfuncs.GetDynamicLight( lnum );
+		dl = gEngfuncs.GetDynamicLight( lights[i] );
 
-		if( dl->die < g_studio.time || !r_dynamic->value )
+		if( dl->die < g_studio.time )
 			continue;
 
 		VectorSubtract( ent->origin, dl->origin, dist );
@@ -1537,6 +1542,7 @@ pfnStudioEntityLight
 void R_StudioEntityLight( alight_t *lightinfo )
 {
 	int		lnum, i, j, k;
+	int		lights[MAX_ELIGHTS], numlights;
 	float		minstrength, dist2, f, r2;
 	float		lstrength[MAX_LOCALLIGHTS];
 	cl_entity_t	*ent = RI.currententity;
@@ -1555,9 +1561,11 @@ void R_StudioEntityLight( alight_t *lightinfo )
 	dist2 = 1000000.0f;
 	k = 0;
 
-	for( lnum = 0; lnum < MAX_ELIGHTS; lnum++ )
+	numlights = gEngfuncs.GetLightsInBox( origin, origin, true, lights, MAX_ELIGHTS );
+
+	for( lnum = 0; lnum < numlights; lnum++ )
 	{
-		el = gEngfuncs.GetEntityLight( lnum );
+		el = gEngfuncs.GetEntityLight( lights[lnum] );
 
 		if( el->die < g_studio.time || el->radius <= 0.0f )
 			continue;
@@ -24,15 +24,6 @@ GNU General Public License for more details.
 
 #include "studio.h"
 
-#define NOISE_DIVISIONS	64	// don't touch - many tripmines cause the crash when it equal 128
-
-typedef struct
-{
-	vec3_t	pos;
-	float	texcoord;	// Y texture coordinate
-	float	width;
-} beamseg_t;
-
 /*
 ==============================================================
 
@@ -75,40 +66,6 @@ static void SineNoise( float *noise, int divs )
 }
 
 
-/*
-==============================================================
-
-BEAM MATHLIB
-
-==============================================================
-*/
-static void R_BeamComputePerpendicular( const vec3_t vecBeamDelta, vec3_t pPerp )
-{
-	// direction in worldspace of the center of the beam
-	vec3_t	vecBeamCenter;
-
-	VectorNormalize2( vecBeamDelta, vecBeamCenter );
-	CrossProduct( RI.vforward, vecBeamCenter, pPerp );
-	VectorNormalize( pPerp );
-}
-
-static void R_BeamComputeNormal( const vec3_t vStartPos, const vec3_t vNextPos, vec3_t pNormal )
-{
-	// vTangentY = line vector for beam
-	vec3_t	vTangentY, vDirToBeam;
-
-	VectorSubtract( vStartPos, vNextPos, vTangentY );
-
-	// vDirToBeam = vector from viewer origin to beam
-	VectorSubtract( vStartPos, RI.vieworg, vDirToBeam );
-
-	// get a vector that is perpendicular to us and perpendicular to the beam.
-	// this is used to fatten the beam.
-	CrossProduct( vTangentY, vDirToBeam, pNormal );
-	VectorNormalizeFast( pNormal );
-}
-
-
 /*
 ==============
 R_BeamCull
@@ -194,176 +151,22 @@ general code for drawing beams
 */
 static void R_DrawSegs( vec3_t source, vec3_t delta, float width, float scale, float freq, float speed, int segments, int flags )
 {
-	int	noiseIndex, noiseStep;
-	int	i, total_segs, segs_drawn;
-	float	div, length, fraction, factor;
-	float	flMaxWidth, vLast, vStep, brightness;
-	vec3_t	perp1, vLastNormal = { 0.0f };
-	beamseg_t	curSeg;
-
-	if( segments < 2 ) return;
-
-	length = VectorLength( delta );
-	flMaxWidth = width * 0.5f;
-	div = 1.0f / ( segments - 1 );
-
-	if( length * div < flMaxWidth * 1.414f )
-	{
-		// here, we have too many segments; we could get overlap... so lets have less segments
-		segments = (int)( length / ( flMaxWidth * 1.414f )) + 1.0f;
-		if( segments < 2 ) segments = 2;
-	}
-
-	if( segments > NOISE_DIVISIONS )
-		segments = NOISE_DIVISIONS;
-
-	div = 1.0f / (segments - 1);
-	length *= 0.01f;
-	vStep = length * div;	// Texture length texels per space pixel
-
-	// Scroll speed 3.5 -- initial texture position, scrolls 3.5/sec (1.0 is entire texture)
-	vLast = fmod( freq * speed, 1 );
-
-	if( flags & FBEAM_SINENOISE )
-	{
-		if( segments < 16 )
-		{
-			segments = 16;
-			div = 1.0f / ( segments - 1 );
-		}
-		scale *= 100.0f;
-		length = segments * 0.1f;
-	}
-	else
-	{
-		scale *= length * 2.0f;
-	}
-
-	// Iterator to resample noise waveform (it needs to be generated in powers of 2)
-	noiseStep = (int)((float)( NOISE_DIVISIONS - 1 ) * div * 65536.0f );
-	brightness = 1.0f;
-	noiseIndex = 0;
+	beamvert_t	verts[MAX_BEAM_VERTS];
+	beamview_t	view;
+	int		i, numverts;
 
-	if( FBitSet( flags, FBEAM_SHADEIN ))
-		brightness = 0;
+	VectorCopy( RI.vieworg, view.origin );
+	VectorCopy( RI.vforward, view.forward );
+	VectorCopy( RI.vright, view.right );
+	VectorCopy( RI.vup, view.up );
 
-	// Choose two vectors that are perpendicular to the beam
-	R_BeamComputePerpendicular( delta, perp1 );
+	numverts = gEngfuncs.BeamSegments( source, delta, width, scale, freq, speed, segments, flags, rgNoise, &view, verts );
 
-	total_segs = segments;
-	segs_drawn = 0;
-
-	// specify all the segments.
-	for( i = 0; i < segments; i++ )
+	for( i = 0; i < numverts; i++ )
 	{
-		beamseg_t	nextSeg;
-		vec3_t	vPoint1, vPoint2;
-
-		Assert( noiseIndex < ( NOISE_DIVISIONS << 16 ));
-
-		fraction = i * div;
-
-		VectorMA( source, fraction, delta, nextSeg.pos );
-
-		// distort using noise
-		if( scale != 0 )
-		{
-			factor = rgNoise[noiseIndex>>16] * scale;
-
-			if( FBitSet( flags, FBEAM_SINENOISE ))
-			{
-				float	s, c;
-
-				SinCos( fraction * M_PI_F * length + freq, &s, &c );
-				VectorMA( nextSeg.pos, (factor * s), RI.vup, nextSeg.pos );
-
-				// rotate the noise along the perpendicluar axis a bit to keep the bolt from looking diagonal
-				VectorMA( nextSeg.pos, (factor * c), RI.vright, nextSeg.pos );
-			}
-			else
-			{
-				VectorMA( nextSeg.pos, factor, perp1, nextSeg.pos );
-			}
-		}
-
-		// specify the next segment.
-		nextSeg.width = width * 2.0f;
-		nextSeg.texcoord = vLast;
-
- 		if( segs_drawn > 0 )
-		{
-			// Get a vector that is perpendicular to us and perpendicular to the beam.
-			// This is used to fatten the beam.
-			vec3_t	vNormal, vAveNormal;
-
-			R_BeamComputeNormal( curSeg.pos, nextSeg.pos, vNormal );
-
-			if( segs_drawn > 1 )
-			{
-				// Average this with the previous normal
-				VectorAdd( vNormal, vLastNormal, vAveNormal );
-				VectorScale( vAveNormal, 0.5f, vAveNormal );
-				VectorNormalizeFast( vAveNormal );
-			}
-			else
-			{
-				VectorCopy( vNormal, vAveNormal );
-			}
-
-			VectorCopy( vNormal, vLastNormal );
-
-			// draw regular segment
-			VectorMA( curSeg.pos, ( curSeg.width * 0.5f ), vAveNormal, vPoint1 );
-			VectorMA( curSeg.pos, (-curSeg.width * 0.5f ), vAveNormal, vPoint2 );
-
-			TriTexCoord2f( 0.0f, curSeg.texcoord );
-			TriBrightness( brightness );
-			//pglNormal3fv( vAveNormal );
-			TriVertex3fv( vPoint1 );
-
-			TriTexCoord2f( 1.0f, curSeg.texcoord );
-			TriBrightness( brightness );
-			//pflNormal3fv( vAveNormal );
-			TriVertex3fv( vPoint2 );
-		}
-
-		curSeg = nextSeg;
-		segs_drawn++;
-
-		if( FBitSet( flags, FBEAM_SHADEIN ) && FBitSet( flags, FBEAM_SHADEOUT ))
-		{
-			if( fraction < 0.5f ) brightness = fraction;
-			else brightness = ( 1.0f - fraction );
-		}
-		else if( FBitSet( flags, FBEAM_SHADEIN ))
-		{
-			brightness = fraction;
-		}
-		else if( FBitSet( flags, FBEAM_SHADEOUT ))
-		{
-			brightness = 1.0f - fraction;
-		}
-
- 		if( segs_drawn == total_segs )
-		{
-			// draw the last segment
-			VectorMA( curSeg.pos, ( curSeg.width * 0.5f ), vLastNormal, vPoint1 );
-			VectorMA( curSeg.pos, (-curSeg.width * 0.5f ), vLastNormal, vPoint2 );
-
-			// specify the points.
-			TriTexCoord2f( 0.0f, curSeg.texcoord );
-			TriBrightness( brightness );
-			//pglNormal3fv( vLastNormal );
-			TriVertex3fv( vPoint1 );
-
-			TriTexCoord2f( 1.0f, curSeg.texcoord );
-			TriBrightness( brightness );
-			//pglNormal3fv( vLastNormal );
-			TriVertex3fv( vPoint2 );
-		}
-
-		vLast += vStep; // Advance texture scroll (v axis only)
-		noiseIndex += noiseStep;
+		TriTexCoord2f( verts[i].s, verts[i].t );
+		TriBrightness( verts[i].brightness );
+		TriVertex3fv( verts[i].pos );
 	}
 }
 
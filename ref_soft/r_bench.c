@@ -0,0 +1,243 @@
+/*
+r_bench.c - scripted camera benchmark with frame hashes
+Copyright (C) 2026 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "r_local.h"
+#include "crclib.h"
+
+#define MAX_BENCH_KEYS	256
+
+enum
+{
+	BENCH_MARKLEAVES = 0,
+	BENCH_EDGES,
+	BENCH_SURFACES,
+	BENCH_STUDIO,
+	BENCH_PARTICLES,
+	BENCH_BLIT,
+	BENCH_FRAME,
+	BENCH_STAGES
+};
+
+static const char *r_benchstages[BENCH_STAGES] =
+{
+	"mark leaves",
+	"edges",
+	"surfaces",
+	"studio",
+	"particles",
+	"blit",
+	"frame",
+};
+
+static struct
+{
+	qboolean	active;
+	qboolean	orbit;	// no path given, turn around the current view
+	int	frame;
+	int	numframes;
+
+	int	numkeys;
+	vec3_t	origin[MAX_BENCH_KEYS];
+	vec3_t	angles[MAX_BENCH_KEYS];
+
+	double	lasttime;
+	double	time[BENCH_STAGES];
+	double	minframe, maxframe;
+	dword	crc;	// hash of all frame hashes
+} rbench;
+
+/*
+===============
+R_BenchLoadPath
+
+camera path file has one key per line:
+origin x y z, angles pitch yaw roll
+keys are spread evenly over the run
+===============
+*/
+static qboolean R_BenchLoadPath( const char *filename )
+{
+	char	token[MAX_TOKEN];
+	char	*afile, *pfile;
+	float	values[6];
+	int	i;
+
+	afile = (char *)gEngfuncs.COM_LoadFile( filename, NULL, false );
+	if( !afile )
+	{
+		gEngfuncs.Con_Printf( S_ERROR "couldn't load camera path %s\n", filename );
+		return false;
+	}
+
+	rbench.numkeys = 0;
+	pfile = afile;
+
+	while( rbench.numkeys < MAX_BENCH_KEYS )
+	{
+		for( i = 0; i < 6; i++ )
+		{
+			if(( pfile = COM_ParseFile( pfile, token, sizeof( token ))) == NULL )
+				break;
+			values[i] = Q_atof( token );
+		}
+
+		if( i != 6 )
+			break;
+
+		VectorCopy( &values[0], rbench.origin[rbench.numkeys] );
+		VectorCopy( &values[3], rbench.angles[rbench.numkeys] );
+		rbench.numkeys++;
+	}
+
+	Mem_Free( afile );
+
+	if( rbench.numkeys < 2 )
+	{
+		gEngfuncs.Con_Printf( S_ERROR "camera path %s needs at least 2 keys\n", filename );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+===============
+R_Bench_f
+
+sw_bench [frames] [camera path]
+===============
+*/
+void R_Bench_f( void )
+{
+	if( !WORLDMODEL )
+	{
+		gEngfuncs.Con_Printf( "sw_bench: no map loaded\n" );
+		return;
+	}
+
+	memset( &rbench, 0, sizeof( rbench ));
+	rbench.numframes = 300;
+
+	if( gEngfuncs.Cmd_Argc() > 1 )
+		rbench.numframes = Q_max( 2, Q_atoi( gEngfuncs.Cmd_Argv( 1 )));
+
+	if( gEngfuncs.Cmd_Argc() > 2 )
+	{
+		if( !R_BenchLoadPath( gEngfuncs.Cmd_Argv( 2 )))
+			return;
+	}
+	else rbench.orbit = true;
+
+	rbench.minframe = 1e10;
+	CRC32_Init( &rbench.crc );
+	rbench.active = true;
+
+	gEngfuncs.Con_Printf( "sw_bench: %i frames at %ix%i, %i threads\n", rbench.numframes, vid.width, vid.height, R_NumThreads( ));
+	gEngfuncs.Con_Printf( "set host_framerate to get repeatable frame hashes\n" );
+}
+
+/*
+===============
+R_BenchSetupView
+
+replace the client view by the camera path
+===============
+*/
+void R_BenchSetupView( void )
+{
+	float	frac;
+	int	key;
+
+	if( !rbench.active || !RI.drawWorld )
+		return;
+
+	if( rbench.orbit && rbench.numkeys == 0 )
+	{
+		// full turn around the view the run was started from
+		VectorCopy( RI.vieworg, rbench.origin[0] );
+		VectorCopy( RI.viewangles, rbench.angles[0] );
+		VectorCopy( RI.vieworg, rbench.origin[1] );
+		VectorCopy( RI.viewangles, rbench.angles[1] );
+		rbench.angles[1][YAW] += 360.0f;
+		rbench.numkeys = 2;
+	}
+
+	frac = (float)rbench.frame * ( rbench.numkeys - 1 ) / ( rbench.numframes - 1 );
+	key = bound( 0, (int)frac, rbench.numkeys - 2 );
+	frac -= key;
+
+	VectorLerp( rbench.origin[key], frac, rbench.origin[key + 1], RI.vieworg );
+	VectorLerp( rbench.angles[key], frac, rbench.angles[key + 1], RI.viewangles );
+	VectorCopy( RI.vieworg, RI.pvsorigin );
+}
+
+/*
+===============
+R_BenchEndFrame
+
+called before frame stats are cleared, when the
+3D view is finished but no 2D was drawn over it
+===============
+*/
+void R_BenchEndFrame( void )
+{
+	double	now, frametime;
+	dword	crc;
+	int	i;
+
+	if( !rbench.active || !RI.drawWorld )
+		return;
+
+	now = gEngfuncs.pfnTime();
+
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, vid.buffer, vid.width * vid.height * sizeof( pixel_t ));
+	crc = CRC32_Final( crc );
+	CRC32_ProcessBuffer( &rbench.crc, &crc, sizeof( crc ));
+
+	// first frame only sets the time base
+	if( rbench.frame > 0 )
+	{
+		frametime = now - rbench.lasttime;
+		rbench.time[BENCH_MARKLEAVES] += r_stats.t_mark_leaves;
+		rbench.time[BENCH_EDGES] += r_stats.t_edge_scan;
+		rbench.time[BENCH_SURFACES] += r_stats.t_surface_draw;
+		rbench.time[BENCH_STUDIO] += r_stats.t_studio_draw;
+		rbench.time[BENCH_PARTICLES] += r_stats.t_particle_draw;
+		rbench.time[BENCH_BLIT] += r_stats.t_blit;
+		rbench.time[BENCH_FRAME] += frametime;
+		rbench.minframe = Q_min( rbench.minframe, frametime );
+		rbench.maxframe = Q_max( rbench.maxframe, frametime );
+	}
+
+	gEngfuncs.Con_Reportf( "sw_bench: frame %i crc %08x\n", rbench.frame, crc );
+
+	rbench.lasttime = now;
+
+	if( ++rbench.frame < rbench.numframes )
+		return;
+
+	rbench.active = false;
+
+	gEngfuncs.Con_Printf( "sw_bench: %i frames, %.3f ms/frame (%.1f fps), min %.3f ms, max %.3f ms\n",
+		rbench.numframes, rbench.time[BENCH_FRAME] * 1000.0 / ( rbench.numframes - 1 ),
+		( rbench.numframes - 1 ) / Q_max( rbench.time[BENCH_FRAME], 0.000001 ),
+		rbench.minframe * 1000.0, rbench.maxframe * 1000.0 );
+
+	for( i = 0; i < BENCH_FRAME; i++ )
+		gEngfuncs.Con_Printf( "  %-12s %8.3f ms\n", r_benchstages[i], rbench.time[i] * 1000.0 / ( rbench.numframes - 1 ));
+
+	gEngfuncs.Con_Printf( "sw_bench: hash %08x\n", CRC32_Final( rbench.crc ));
+}
@@ -308,14 +308,59 @@ void GAME_EXPORT GL_SetTexCoordArrayMode( uint mode )
 
 }
 
+static char	r_speeds_msg[MAX_SYSPATH];
+
 void GAME_EXPORT GL_BackendStartFrame( void )
 {
-
+	r_speeds_msg[0] = '\0';
 }
 
 void GAME_EXPORT GL_BackendEndFrame( void )
 {
+	int	i;
+
+	R_BenchEndFrame();
 
+	if( r_speeds->value <= 0 || !RI.drawWorld )
+		goto reset;
+
+	switch( (int)r_speeds->value )
+	{
+	case 1:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i wpoly, %3i apoly\n%3i epoly, %3i spoly",
+		r_stats.c_world_polys, r_stats.c_alias_polys, r_stats.c_studio_polys, r_stats.c_sprite_polys );
+		break;
+	case 2:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%.3f ms mark leaves\n%.3f ms edges\n%.3f ms surfaces\n%.3f ms studio\n%.3f ms particles\n%.3f ms blit",
+		r_stats.t_mark_leaves * 1000.0, r_stats.t_edge_scan * 1000.0, r_stats.t_surface_draw * 1000.0,
+		r_stats.t_studio_draw * 1000.0, r_stats.t_particle_draw * 1000.0, r_stats.t_blit * 1000.0 );
+		break;
+	case 3:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i alias models drawn\n%3i studio models drawn\n%3i sprites drawn\n%3i studio verts",
+		r_stats.c_alias_models_drawn, r_stats.c_studio_models_drawn, r_stats.c_sprite_models_drawn, r_stats.c_studio_verts );
+		if( r_stats.studio_heaviest )
+			Q_strncat( r_speeds_msg, va( "\nheaviest: %s, %.3f ms", r_stats.studio_heaviest->name, r_stats.t_studio_heaviest * 1000.0 ), sizeof( r_speeds_msg ));
+		break;
+	case 5:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i tempents\n%3i viewbeams\n%3i particles",
+		r_stats.c_active_tents_count, r_stats.c_view_beams_count, r_stats.c_particle_count );
+		break;
+	case 6:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%i render threads\n", R_NumThreads( ));
+		for( i = 0; i < MAX_SPAN_BANDS && d_bandtime[i] > 0.0; i++ )
+			Q_strncat( r_speeds_msg, va( "band %2i: %.3f ms\n", i, d_bandtime[i] * 1000.0 ), sizeof( r_speeds_msg ));
+		break;
+	case 7:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i cache hits\n%3i cache builds, %i in parallel\n%.3f ms building",
+		r_stats.c_surfcache_hits, r_stats.c_surfcache_builds, r_stats.c_surfcache_prebuilt, r_stats.t_surfcache_build * 1000.0 );
+		break;
+	}
+
+reset:
+	if( RI.drawWorld )
+		D_EndSurfaceCacheFrame();
+	memset( &r_stats, 0, sizeof( r_stats ));
+	memset( d_bandtime, 0, sizeof( d_bandtime ));
 }
 
 
@@ -409,7 +454,19 @@ void GAME_EXPORT Mod_SetOrthoBounds(const float *mins, const float *maxs)
 
 qboolean GAME_EXPORT R_SpeedsMessage(char *out, size_t size)
 {
-	return false;
+	if( gEngfuncs.drawFuncs->R_SpeedsMessage != NULL )
+	{
+		if( gEngfuncs.drawFuncs->R_SpeedsMessage( out, size ))
+			return true;
+		// otherwise pass to default handler
+	}
+
+	if( r_speeds->value <= 0 ) return false;
+	if( !out || !size ) return false;
+
+	Q_strncpy( out, r_speeds_msg, size );
+
+	return true;
 }
 
 byte *GAME_EXPORT Mod_GetCurrentVis( void )
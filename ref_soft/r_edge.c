@@ -1117,6 +1117,202 @@ void D_AlphaSurf (surf_t *s)
 }
 
 
+/*
+===============================================================================
+
+BAND SPAN FILLING
+
+span lists never overlap, so solid surfaces can be filled
+in any order: setup and surface caching stay on the main
+thread, spans are sorted into horizontal bands and every
+band is filled by a worker from the r_thread.c pool
+
+===============================================================================
+*/
+
+static spanjob_t	*d_spanjobs;
+static int	d_maxspanjobs;
+static int	d_numspanjobs;
+static int	d_spanbatch = 1;
+
+int	d_numbands = 1;	// 1 means spans are filled right away
+double	d_bandtime[MAX_SPAN_BANDS];
+
+/*
+==============
+D_NumSpanBands
+==============
+*/
+static int D_NumSpanBands (void)
+{
+	int	numbands;
+
+	if (R_NumThreads () <= 1)
+		return 1;
+
+	numbands = sw_bands->value;
+
+	if (numbands <= 0)
+		numbands = R_NumThreads () * 2;
+
+	return bound (1, numbands, MAX_SPAN_BANDS);
+}
+
+/*
+==============
+D_QueueSpanJob
+
+save current gradients and sort the spans into bands
+==============
+*/
+static void D_QueueSpanJob (espan_t *pspan)
+{
+	spanjob_t	*job;
+	espan_t		*next;
+	int			band, height;
+
+	if (d_numspanjobs == d_maxspanjobs)
+	{
+		d_maxspanjobs = Q_max (256, d_maxspanjobs * 2);
+		d_spanjobs = Mem_Realloc (r_temppool, d_spanjobs, d_maxspanjobs * sizeof (spanjob_t));
+	}
+
+	job = &d_spanjobs[d_numspanjobs++];
+	D_CaptureSpanJob (job);
+	memset (job->spans, 0, sizeof (job->spans[0]) * d_numbands);
+
+	height = Q_max (RI.vrectbottom, 1);
+
+	for ( ; pspan ; pspan = next)
+	{
+		next = pspan->pnext;
+		band = bound (0, pspan->v * d_numbands / height, d_numbands - 1);
+		pspan->pnext = job->spans[band];
+		job->spans[band] = pspan;
+	}
+
+	// keep the cache block alive until the spans are drawn
+	if (pcurrentcache)
+		pcurrentcache->spanbatch = d_spanbatch;
+}
+
+/*
+==============
+D_DrawSpanBand
+==============
+*/
+static void D_DrawSpanBand (void *unused, int band, int thread)
+{
+	double	start = gEngfuncs.pfnTime ();
+	int		i;
+
+	for (i = 0 ; i < d_numspanjobs ; i++)
+	{
+		spanjob_t *job = &d_spanjobs[i];
+
+		if (!job->spans[band])
+			continue;
+
+		D_DrawSpans16Job (job, job->spans[band]);
+		D_DrawZSpansJob (job, job->spans[band]);
+	}
+
+	d_bandtime[band] += gEngfuncs.pfnTime () - start;
+}
+
+/*
+==============
+D_FlushSpanJobs
+
+fill all queued spans, returns when every band is done
+==============
+*/
+void D_FlushSpanJobs (void)
+{
+	if (!d_numspanjobs)
+		return;
+
+	R_RunJobs (D_DrawSpanBand, NULL, d_numbands);
+
+	d_numspanjobs = 0;
+	d_spanbatch++;
+}
+
+/*
+==============
+D_UnpinCache
+
+cache block is going to be rewritten, so any queued
+spans that read from it must be drawn and a queued
+build into it must be finished first
+==============
+*/
+void D_UnpinCache (surfcache_t *cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->spanbatch == d_spanbatch)
+		D_FlushSpanJobs ();
+
+	// may be still queued for building
+	if (cache->buildframe == tr.framecount)
+		D_FlushSurfaceBuilds ();
+}
+
+/*
+==============
+D_SolidSurfMipLevel
+==============
+*/
+static int D_SolidSurfMipLevel (surf_t *s, msurface_t *pface)
+{
+	int	miplevel;
+
+	if( pface->flags & SURF_CONVEYOR )
+		miplevel = 1;
+	else
+		miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip );
+	while( 1 << miplevel > gEngfuncs.Mod_SampleSizeForFace(pface))
+		miplevel--;
+
+	return miplevel;
+}
+
+/*
+==============
+D_PrebuildSurfaces
+
+rebuild stale world surface cache blocks on the
+worker pool before D_SolidSurf asks for them
+==============
+*/
+static void D_PrebuildSurfaces (void)
+{
+	cl_entity_t	*oldentity = RI.currententity;
+	surf_t		*s;
+
+	if (R_NumThreads () <= 1)
+		return;
+
+	// texture animation looks at the current entity
+	RI.currententity = gEngfuncs.GetEntityByIndex (0);
+
+	for (s = &surfaces[1] ; s<surface_p ; s++)
+	{
+		if (!s->spans || !s->msurf || s->insubmodel)
+			continue;
+
+		if (s->flags & (SURF_DRAWSKY|SURF_DRAWTURB))
+			continue;
+
+		D_QueueSurfaceBuild (s->msurf, D_SolidSurfMipLevel (s, s->msurf));
+	}
+
+	D_FlushSurfaceBuilds ();
+	RI.currententity = oldentity;
+}
+
 /*
 ==============
 D_SolidSurf
@@ -1166,12 +1362,7 @@ void D_SolidSurf (surf_t *s)
 	if( !pface )
 		return;
 #if 1
-	if( pface->flags & SURF_CONVEYOR )
-		miplevel = 1;
-	else
-		miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip );
-	while( 1 << miplevel > gEngfuncs.Mod_SampleSizeForFace(pface))
-		miplevel--;
+	miplevel = D_SolidSurfMipLevel (s, pface);
 #else
 	{
 		float dot;
@@ -1207,9 +1398,15 @@ void D_SolidSurf (surf_t *s)
 
 	D_CalcGradients (pface);
 
-	D_DrawSpans16 (s->spans);
-
-	D_DrawZSpans (s->spans);
+	if (d_numbands > 1)
+	{
+		D_QueueSpanJob (s->spans);
+	}
+	else
+	{
+		D_DrawSpans16 (s->spans);
+		D_DrawZSpans (s->spans);
+	}
 
 	if (s->insubmodel)
 	{
@@ -1266,12 +1463,19 @@ May be called more than once a frame if the surf list overflows (higher res)
 void D_DrawSurfaces (void)
 {
 	surf_t			*s;
+	double			start = gEngfuncs.pfnTime ();
 
 //	currententity = NULL;	//&r_worldentity;
 	VectorSubtract (RI.vieworg, vec3_origin, tr.modelorg);
 	TransformVector (tr.modelorg, transformed_modelorg);
 	VectorCopy (transformed_modelorg, world_transformed_modelorg);
 
+	if (!sw_drawflat->value && !alphaspans)
+	{
+		D_PrebuildSurfaces ();
+		d_numbands = D_NumSpanBands ();
+	}
+
 	if (!sw_drawflat->value)
 	{
 		for (s = &surfaces[1] ; s<surface_p ; s++)
@@ -1304,6 +1508,11 @@ void D_DrawSurfaces (void)
 	else
 		D_DrawflatSurfaces ();
 
+	D_FlushSpanJobs ();
+	d_numbands = 1;
+
+	r_stats.t_surface_draw += gEngfuncs.pfnTime () - start;
+
 	//RI.currententity = NULL;	//&r_worldentity;
 	VectorSubtract (RI.vieworg, vec3_origin, tr.modelorg);
 	R_TransformFrustum ();
@@ -2,6 +2,15 @@
 #define APIENTRY_LINKAGE static
 #include "../ref_gl/gl_export.h"
 
+// vector kernels follow the compiler target, SSE2 is always there on amd64
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define BLIT_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define BLIT_NEON	1
+#endif
+
 struct swblit_s
 {
 	uint stride;
@@ -436,6 +445,320 @@ static int COUNT_BITS( uint mask )
 	return i;
 }
 
+/*
+===============================================================================
+
+VECTOR PIXEL EXPANSION
+
+vid.screen holds major | minor for each 16-bit pixel, each of the
+six parts is a channel value scaled by mult / div and moved into
+place. the kernels compute the same thing without the table,
+the division is a multiply-high found and checked in R_BuildScreenMap
+
+===============================================================================
+*/
+
+// x * mult / div == (( x << pre ) * magic >> 16 ) >> post for every x < 64
+typedef struct
+{
+	qboolean	identity;	// x * mult / div == x
+	int	pre, post;
+	uint	magic;
+	uint	shift;	// channel position in the output pixel
+} blitscale_t;
+
+static struct
+{
+	blitscale_t	chan[3];
+	qboolean	ok;	// kernels match the table for this format
+} blitsimd;
+
+static qboolean R_BlitFindScale( blitscale_t *c, uint mult, uint div, uint shift )
+{
+	uint	x, a, s, k;
+
+	c->shift = shift;
+
+	for( x = 0; x < 64 && x * mult / div == x; x++ );
+	if(( c->identity = ( x == 64 )))
+		return true;
+
+	for( s = 0; s < 16; s++ )
+	{
+		for( a = 0; a <= 10; a++ )
+		{
+			k = (uint)((((uint64_t)mult << ( 16 + s )) + ( div << a ) - 1 ) / ( div << a ));
+			if( k > 0xFFFF )
+				continue;
+
+			for( x = 0; x < 64; x++ )
+			{
+				if(((( x << a ) * k ) >> ( 16 + s )) != x * mult / div )
+					break;
+			}
+
+			if( x == 64 )
+			{
+				c->pre = a;
+				c->post = s;
+				c->magic = k;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+#if defined( BLIT_SSE2 )
+typedef struct
+{
+	__m128i	pre, post, magic, shift;
+	qboolean	identity;
+} blitscalevec_t;
+
+_inline void R_BlitScaleSetup( blitscalevec_t *v )
+{
+	int	i;
+
+	for( i = 0; i < 3; i++ )
+	{
+		v[i].identity = blitsimd.chan[i].identity;
+		v[i].pre = _mm_cvtsi32_si128( blitsimd.chan[i].pre );
+		v[i].post = _mm_cvtsi32_si128( blitsimd.chan[i].post );
+		v[i].magic = _mm_set1_epi16( blitsimd.chan[i].magic );
+		v[i].shift = _mm_cvtsi32_si128( blitsimd.chan[i].shift );
+	}
+}
+
+_inline __m128i R_BlitScaleSSE2( __m128i x, const blitscalevec_t *v )
+{
+	if( v->identity )
+		return x;
+
+	x = _mm_mulhi_epu16( _mm_sll_epi16( x, v->pre ), v->magic );
+	return _mm_srl_epi16( x, v->post );
+}
+
+// scaled r, g and b of 8 pixels, 332 major bits and GBRGBRGB minor bits
+_inline void R_BlitChannelsSSE2( __m128i p, const blitscalevec_t *v, __m128i *r, __m128i *g, __m128i *b )
+{
+	const __m128i	one = _mm_set1_epi16( 1 ), two = _mm_set1_epi16( 2 ), four = _mm_set1_epi16( 4 );
+	__m128i		rmaj, gmaj, bmaj, rmin, gmin, bmin;
+
+	rmaj = _mm_slli_epi16( _mm_srli_epi16( p, 13 ), 2 );
+	gmaj = _mm_and_si128( _mm_srli_epi16( p, 7 ), _mm_set1_epi16( 7 << 3 ));
+	bmaj = _mm_and_si128( _mm_srli_epi16( p, 5 ), _mm_set1_epi16( 3 << 3 ));
+	rmin = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( p, 4 ), two ), _mm_and_si128( _mm_srli_epi16( p, 2 ), one ));
+	gmin = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( p, 5 ), four ), _mm_and_si128( _mm_srli_epi16( p, 3 ), two ));
+	gmin = _mm_or_si128( gmin, _mm_and_si128( _mm_srli_epi16( p, 1 ), one ));
+	bmin = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( p, 4 ), four ), _mm_and_si128( _mm_srli_epi16( p, 2 ), two ));
+	bmin = _mm_or_si128( bmin, _mm_and_si128( p, one ));
+
+	*r = _mm_or_si128( R_BlitScaleSSE2( rmaj, &v[0] ), R_BlitScaleSSE2( rmin, &v[0] ));
+	*g = _mm_or_si128( R_BlitScaleSSE2( gmaj, &v[1] ), R_BlitScaleSSE2( gmin, &v[1] ));
+	*b = _mm_or_si128( R_BlitScaleSSE2( bmaj, &v[2] ), R_BlitScaleSSE2( bmin, &v[2] ));
+}
+
+static int R_BlitRow16SSE2( unsigned short *dst, const pixel_t *src, int width )
+{
+	blitscalevec_t	v[3];
+	__m128i		r, g, b;
+	int		u;
+
+	R_BlitScaleSetup( v );
+
+	for( u = 0; u + 8 <= width; u += 8 )
+	{
+		R_BlitChannelsSSE2( _mm_loadu_si128(( const __m128i *)( src + u )), v, &r, &g, &b );
+		r = _mm_or_si128( _mm_sll_epi16( r, v[0].shift ), _mm_sll_epi16( g, v[1].shift ));
+		_mm_storeu_si128(( __m128i *)( dst + u ), _mm_or_si128( r, _mm_sll_epi16( b, v[2].shift )));
+	}
+
+	return u;
+}
+
+static int R_BlitRow32SSE2( unsigned int *dst, const pixel_t *src, int width )
+{
+	const __m128i	zero = _mm_setzero_si128();
+	blitscalevec_t	v[3];
+	__m128i		r, g, b, lo, hi;
+	int		u;
+
+	R_BlitScaleSetup( v );
+
+	for( u = 0; u + 8 <= width; u += 8 )
+	{
+		R_BlitChannelsSSE2( _mm_loadu_si128(( const __m128i *)( src + u )), v, &r, &g, &b );
+		lo = _mm_or_si128( _mm_sll_epi32( _mm_unpacklo_epi16( r, zero ), v[0].shift ), _mm_sll_epi32( _mm_unpacklo_epi16( g, zero ), v[1].shift ));
+		hi = _mm_or_si128( _mm_sll_epi32( _mm_unpackhi_epi16( r, zero ), v[0].shift ), _mm_sll_epi32( _mm_unpackhi_epi16( g, zero ), v[1].shift ));
+		_mm_storeu_si128(( __m128i *)( dst + u ), _mm_or_si128( lo, _mm_sll_epi32( _mm_unpacklo_epi16( b, zero ), v[2].shift )));
+		_mm_storeu_si128(( __m128i *)( dst + u + 4 ), _mm_or_si128( hi, _mm_sll_epi32( _mm_unpackhi_epi16( b, zero ), v[2].shift )));
+	}
+
+	return u;
+}
+#define R_BlitRow16SIMD	R_BlitRow16SSE2
+#define R_BlitRow32SIMD	R_BlitRow32SSE2
+#define BLIT_SIMD_NAME	"SSE2"
+#elif defined( BLIT_NEON )
+typedef struct
+{
+	int16x8_t	pre, post;	// post is negative, vshlq shifts right then
+	uint16x4_t	magic;
+	int16x8_t	shift;
+	int32x4_t	shift32;
+	qboolean	identity;
+} blitscalevec_t;
+
+_inline void R_BlitScaleSetup( blitscalevec_t *v )
+{
+	int	i;
+
+	for( i = 0; i < 3; i++ )
+	{
+		v[i].identity = blitsimd.chan[i].identity;
+		v[i].pre = vdupq_n_s16( blitsimd.chan[i].pre );
+		v[i].post = vdupq_n_s16( -blitsimd.chan[i].post );
+		v[i].magic = vdup_n_u16( blitsimd.chan[i].magic );
+		v[i].shift = vdupq_n_s16( blitsimd.chan[i].shift );
+		v[i].shift32 = vdupq_n_s32( blitsimd.chan[i].shift );
+	}
+}
+
+_inline uint16x8_t R_BlitScaleNEON( uint16x8_t x, const blitscalevec_t *v )
+{
+	uint32x4_t	lo, hi;
+
+	if( v->identity )
+		return x;
+
+	x = vshlq_u16( x, v->pre );
+	lo = vmull_u16( vget_low_u16( x ), v->magic );
+	hi = vmull_u16( vget_high_u16( x ), v->magic );
+	x = vcombine_u16( vshrn_n_u32( lo, 16 ), vshrn_n_u32( hi, 16 ));
+	return vshlq_u16( x, v->post );
+}
+
+_inline void R_BlitChannelsNEON( uint16x8_t p, const blitscalevec_t *v, uint16x8_t *r, uint16x8_t *g, uint16x8_t *b )
+{
+	const uint16x8_t	one = vdupq_n_u16( 1 ), two = vdupq_n_u16( 2 ), four = vdupq_n_u16( 4 );
+	uint16x8_t	rmaj, gmaj, bmaj, rmin, gmin, bmin;
+
+	rmaj = vshlq_n_u16( vshrq_n_u16( p, 13 ), 2 );
+	gmaj = vandq_u16( vshrq_n_u16( p, 7 ), vdupq_n_u16( 7 << 3 ));
+	bmaj = vandq_u16( vshrq_n_u16( p, 5 ), vdupq_n_u16( 3 << 3 ));
+	rmin = vorrq_u16( vandq_u16( vshrq_n_u16( p, 4 ), two ), vandq_u16( vshrq_n_u16( p, 2 ), one ));
+	gmin = vorrq_u16( vandq_u16( vshrq_n_u16( p, 5 ), four ), vandq_u16( vshrq_n_u16( p, 3 ), two ));
+	gmin = vorrq_u16( gmin, vandq_u16( vshrq_n_u16( p, 1 ), one ));
+	bmin = vorrq_u16( vandq_u16( vshrq_n_u16( p, 4 ), four ), vandq_u16( vshrq_n_u16( p, 2 ), two ));
+	bmin = vorrq_u16( bmin, vandq_u16( p, one ));
+
+	*r = vorrq_u16( R_BlitScaleNEON( rmaj, &v[0] ), R_BlitScaleNEON( rmin, &v[0] ));
+	*g = vorrq_u16( R_BlitScaleNEON( gmaj, &v[1] ), R_BlitScaleNEON( gmin, &v[1] ));
+	*b = vorrq_u16( R_BlitScaleNEON( bmaj, &v[2] ), R_BlitScaleNEON( bmin, &v[2] ));
+}
+
+static int R_BlitRow16NEON( unsigned short *dst, const pixel_t *src, int width )
+{
+	blitscalevec_t	v[3];
+	uint16x8_t	r, g, b;
+	int		u;
+
+	R_BlitScaleSetup( v );
+
+	for( u = 0; u + 8 <= width; u += 8 )
+	{
+		R_BlitChannelsNEON( vld1q_u16( src + u ), v, &r, &g, &b );
+		r = vorrq_u16( vshlq_u16( r, v[0].shift ), vshlq_u16( g, v[1].shift ));
+		vst1q_u16( dst + u, vorrq_u16( r, vshlq_u16( b, v[2].shift )));
+	}
+
+	return u;
+}
+
+static int R_BlitRow32NEON( unsigned int *dst, const pixel_t *src, int width )
+{
+	blitscalevec_t	v[3];
+	uint16x8_t	r, g, b;
+	uint32x4_t	lo, hi;
+	int		u;
+
+	R_BlitScaleSetup( v );
+
+	for( u = 0; u + 8 <= width; u += 8 )
+	{
+		R_BlitChannelsNEON( vld1q_u16( src + u ), v, &r, &g, &b );
+		lo = vorrq_u32( vshlq_u32( vmovl_u16( vget_low_u16( r )), v[0].shift32 ), vshlq_u32( vmovl_u16( vget_low_u16( g )), v[1].shift32 ));
+		hi = vorrq_u32( vshlq_u32( vmovl_u16( vget_high_u16( r )), v[0].shift32 ), vshlq_u32( vmovl_u16( vget_high_u16( g )), v[1].shift32 ));
+		vst1q_u32( dst + u, vorrq_u32( lo, vshlq_u32( vmovl_u16( vget_low_u16( b )), v[2].shift32 )));
+		vst1q_u32( dst + u + 4, vorrq_u32( hi, vshlq_u32( vmovl_u16( vget_high_u16( b )), v[2].shift32 )));
+	}
+
+	return u;
+}
+#define R_BlitRow16SIMD	R_BlitRow16NEON
+#define R_BlitRow32SIMD	R_BlitRow32NEON
+#define BLIT_SIMD_NAME	"NEON"
+#else
+#define BLIT_SIMD_NAME	"none"	// blitsimd.ok stays false
+#endif
+
+/*
+===============
+R_BlitCheckSIMD
+
+find the multiply-high of each channel and compare the kernels
+with the table for every pixel value, they're left unused otherwise
+===============
+*/
+static void R_BlitCheckSIMD( const uint *mult, const uint *div, const uint *shift )
+{
+#ifdef R_BlitRow16SIMD
+	pixel_t	*all;
+	uint	*out;
+	int	i, done, bad = 0;
+
+	blitsimd.ok = false;
+
+	if( swblit.bpp != 2 && swblit.bpp != 4 )
+		return;
+
+	for( i = 0; i < 3; i++ )
+	{
+		if( !R_BlitFindScale( &blitsimd.chan[i], mult[i], div[i], shift[i] ))
+			return;
+	}
+
+	all = Mem_Malloc( r_temppool, 65536 * sizeof( *all ));
+	out = Mem_Malloc( r_temppool, 65536 * sizeof( *out ));
+
+	for( i = 0; i < 65536; i++ )
+		all[i] = i;
+
+	if( swblit.bpp == 2 )
+	{
+		done = R_BlitRow16SIMD( (unsigned short *)out, all, 65536 );
+		for( i = 0; i < done; i++ )
+			bad += ((unsigned short *)out)[i] != vid.screen[i];
+	}
+	else
+	{
+		done = R_BlitRow32SIMD( out, all, 65536 );
+		for( i = 0; i < done; i++ )
+			bad += out[i] != vid.screen32[i];
+	}
+
+	Mem_Free( all );
+	Mem_Free( out );
+
+	blitsimd.ok = ( done == 65536 && !bad );
+
+	if( !blitsimd.ok )
+		gEngfuncs.Con_Printf( S_WARN "%s: %i of %i pixels differ from the table, vector blit disabled\n", __func__, bad, done );
+#endif
+}
+
 void R_BuildScreenMap( void )
 {
 	int i;
@@ -445,6 +768,7 @@ void R_BuildScreenMap( void )
 	uint rdiv = MASK(5), gdiv = MASK(6), bdiv = MASK(5);
 
 	gEngfuncs.Con_Printf("Blit table: %d %d %d %d %d %d\n", rmult, gmult, bmult, rdiv, gdiv, bdiv );
+	blitsimd.ok = false;
 
 #ifdef SEPARATE_BLIT
 	for( i = 0; i < 256; i++ )
@@ -496,6 +820,13 @@ void R_BuildScreenMap( void )
 		}
 
 	}
+
+	{
+		const uint mult[3] = { rmult, gmult, bmult }, div[3] = { rdiv, gdiv, bdiv };
+		const uint shift[3] = { rshift, gshift, bshift };
+
+		R_BlitCheckSIMD( mult, div, shift );
+	}
 #endif
 }
 
@@ -626,8 +957,65 @@ void R_BuildBlendMaps( void )
 #endif
 }
 
+static void *nullbuf;
+
+static void *R_Lock_Null( void )
+{
+	return nullbuf;
+}
+
+static void R_Unlock_Null( void )
+{
+}
+
+static qboolean R_CreateBuffer_Null( int width, int height, uint *stride, uint *bpp, uint *r, uint *g, uint *b )
+{
+	if( nullbuf )
+		Mem_Free( nullbuf );
+
+	nullbuf = Mem_Malloc( r_temppool, width * height * 4 );
+	*stride = width;
+
+	// -nullblit16 to measure the 16-bit path
+	if( gEngfuncs.Sys_CheckParm( "-nullblit16" ))
+	{
+		*bpp = 2;
+		*r = 0xF800;
+		*g = 0x07E0;
+		*b = 0x001F;
+		return true;
+	}
+
+	// same layout as a typical 32-bit window surface
+	*bpp = 4;
+	*r = 0x00FF0000;
+	*g = 0x0000FF00;
+	*b = 0x000000FF;
+
+	return true;
+}
+
 void R_AllocScreen( void );
 
+/*
+===============
+R_InitNullBlit
+
+render into a plain memory buffer without any window,
+frames are still converted but never presented
+===============
+*/
+void R_InitNullBlit( void )
+{
+	R_BuildBlendMaps();
+
+	swblit.pLockBuffer = R_Lock_Null;
+	swblit.pUnlockBuffer = R_Unlock_Null;
+	swblit.pCreateBuffer = R_CreateBuffer_Null;
+
+	R_AllocScreen();
+}
+
 void R_InitBlit( qboolean glblit )
 {
 	R_BuildBlendMaps();
@@ -684,135 +1072,274 @@ void R_AllocScreen( void )
 	vid.buffer = malloc( vid.width * vid.height*sizeof( pixel_t ) );
 }
 
-void R_BlitScreen( void )
+#define BLIT_TILE	16	// rows and columns per block in rotated blit
+#define BLIT_CACHELINE	64	// bytes
+
+typedef struct
+{
+	byte	*buffer;
+	uint	stride;
+	uint	bpp;
+	uint	rotate;
+	int	rowsperjob;
+	qboolean	simd;	// vector kernels instead of the table
+} blitjob_t;
+
+/*
+===============
+R_BlitRows
+
+convert rows [v0, v1) of vid.buffer into the output buffer
+===============
+*/
+static void R_BlitRows( const blitjob_t *job, int v0, int v1 )
 {
 	int u, v;
-	void *buffer = swblit.pLockBuffer();
-//	gEngfuncs.Con_Printf("blit begin\n");
-	//memset( vid.buffer, 10, vid.width * vid.height );
 
-	if( !buffer || gpGlobals->width != vid.width || gpGlobals->height != vid.height )
+	if( job->bpp == 2 )
 	{
-		gEngfuncs.Con_Printf("pre allocscrn\n");
-		R_AllocScreen();
-		gEngfuncs.Con_Printf("post allocscrn\n");
-		return;
-	}
-	//return;
-	//byte *buf = vid.buffer;
+		unsigned short *pbuf = (unsigned short *)job->buffer;
 
-	//#pragma omp parallel for schedule(static)
-	//gEngfuncs.Con_Printf("swblit %d %d", swblit.bpp, vid.height );
-	if( swblit.rotate )
-	{
-		if( swblit.bpp == 2 )
+		for( v = v0; v < v1; v++ )
 		{
-			unsigned short *pbuf = buffer;
-			for( v = 0; v < vid.height;v++)
-			{
-				uint start = vid.rowbytes * v;
-				uint d = swblit.stride - v - 1;
+			const pixel_t *src = vid.buffer + vid.rowbytes * v;
+			unsigned short *dst = pbuf + job->stride * v;
 
-				for( u = 0; u < vid.width; u++ )
-				{
-					unsigned int s = vid.screen[vid.buffer[start + u]];
-					pbuf[d] = s;
-					d += swblit.stride;
-				}
-			}
+			u = 0;
+#ifdef R_BlitRow16SIMD
+			if( job->simd ) u = R_BlitRow16SIMD( dst, src, vid.width );
+#endif
+			for( ; u < vid.width; u++ )
+				dst[u] = vid.screen[src[u]];
 		}
-		else if( swblit.bpp == 4 )
-		{
-			unsigned int *pbuf = buffer;
-
-			for( v = 0; v < vid.height;v++)
-			{
-				uint start = vid.rowbytes * v;
-				uint d = swblit.stride - v - 1;
+	}
+	else if( job->bpp == 4 )
+	{
+		unsigned int *pbuf = (unsigned int *)job->buffer;
 
-				for( u = 0; u < vid.width; u++ )
-				{
-					unsigned int s = vid.screen32[vid.buffer[start + u]];
-					pbuf[d] = s;
-					d += swblit.stride;
-				}
-			}
-		}
-		else if( swblit.bpp == 3 )
+		for( v = v0; v < v1; v++ )
 		{
-			byte *pbuf = buffer;
-			for( v = 0; v < vid.height;v++)
-			{
-				uint start = vid.rowbytes * v;
-				uint d = swblit.stride - v - 1;
+			const pixel_t *src = vid.buffer + vid.rowbytes * v;
+			unsigned int *dst = pbuf + job->stride * v;
 
-				for( u = 0; u < vid.width; u++ )
-				{
-					unsigned int s = vid.screen32[vid.buffer[start + u]];
-					pbuf[(d)*3] = s;
-					s = s >> 8;
-					pbuf[(d)*3+1] = s;
-					s = s >> 8;
-					pbuf[(d)*3+2] = s;
-					d += swblit.stride;
-				}
-			}
+			u = 0;
+#ifdef R_BlitRow32SIMD
+			if( job->simd ) u = R_BlitRow32SIMD( dst, src, vid.width );
+#endif
+			for( ; u < vid.width; u++ )
+				dst[u] = vid.screen32[src[u]];
 		}
 	}
-	else
+	else if( job->bpp == 3 )
 	{
-		if( swblit.bpp == 2 )
+		for( v = v0; v < v1; v++ )
 		{
-			unsigned short *pbuf = buffer;
-			for( v = 0; v < vid.height;v++)
-			{
-				uint start = vid.rowbytes * v;
-				uint dstart = swblit.stride * v;
+			const pixel_t *src = vid.buffer + vid.rowbytes * v;
+			byte *dst = job->buffer + job->stride * v * 3;
 
-				for( u = 0; u < vid.width; u++ )
-				{
-					unsigned int s = vid.screen[vid.buffer[start + u]];
-					pbuf[dstart + u] = s;
-				}
+			for( u = 0; u < vid.width; u++, dst += 3 )
+			{
+				unsigned int s = vid.screen32[src[u]];
+				dst[0] = s;
+				dst[1] = s >> 8;
+				dst[2] = s >> 16;
 			}
 		}
-		else if( swblit.bpp == 4 )
+	}
+}
+
+/*
+===============
+R_BlitRowsRotated
+
+same as R_BlitRows but rotated by 90 degrees
+source row v goes to output column (stride - v - 1)
+walk in BLIT_TILE square blocks, so output cache lines
+get filled before they are evicted
+===============
+*/
+static void R_BlitRowsRotated( const blitjob_t *job, int v0, int v1 )
+{
+	int u, v, ub, vb, uend, vend;
+
+	for( vb = v0; vb < v1; vb += BLIT_TILE )
+	{
+		vend = Q_min( vb + BLIT_TILE, v1 );
+
+		for( ub = 0; ub < vid.width; ub += BLIT_TILE )
 		{
-			unsigned int *pbuf = buffer;
+			uend = Q_min( ub + BLIT_TILE, vid.width );
 
-			for( v = 0; v < vid.height;v++)
+			for( v = vb; v < vend; v++ )
 			{
-				uint start = vid.rowbytes * v;
-				uint dstart = swblit.stride * v;
+				const pixel_t *src = vid.buffer + vid.rowbytes * v;
+				uint d = job->stride * ub + job->stride - v - 1;
 
-				for( u = 0; u < vid.width; u++ )
+				if( job->bpp == 2 )
 				{
-					unsigned int s = vid.screen32[vid.buffer[start + u]];
-					pbuf[dstart + u] = s;
+					unsigned short *pbuf = (unsigned short *)job->buffer;
+
+					for( u = ub; u < uend; u++, d += job->stride )
+						pbuf[d] = vid.screen[src[u]];
 				}
-			}
-		}
-		else if( swblit.bpp == 3 )
-		{
-			byte *pbuf = buffer;
-			for( v = 0; v < vid.height;v++)
-			{
-				uint start = vid.rowbytes * v;
-				uint dstart = swblit.stride * v;
+				else if( job->bpp == 4 )
+				{
+					unsigned int *pbuf = (unsigned int *)job->buffer;
 
-				for( u = 0; u < vid.width; u++ )
+					for( u = ub; u < uend; u++, d += job->stride )
+						pbuf[d] = vid.screen32[src[u]];
+				}
+				else if( job->bpp == 3 )
 				{
-					unsigned int s = vid.screen32[vid.buffer[start + u]];
-					pbuf[(dstart+u)*3] = s;
-					s = s >> 8;
-					pbuf[(dstart+u)*3+1] = s;
-					s = s >> 8;
-					pbuf[(dstart+u)*3+2] = s;
+					for( u = ub; u < uend; u++, d += job->stride )
+					{
+						unsigned int s = vid.screen32[src[u]];
+						job->buffer[d*3] = s;
+						job->buffer[d*3+1] = s >> 8;
+						job->buffer[d*3+2] = s >> 16;
+					}
 				}
 			}
 		}
 	}
+}
+
+static void R_BlitJob( void *ctx, int jobnum, int thread )
+{
+	const blitjob_t *job = ctx;
+	int v0 = job->rowsperjob * jobnum;
+	int v1 = Q_min( v0 + job->rowsperjob, vid.height );
+
+	if( job->rotate )
+	{
+		// bands are cut at output columns, row v is column stride - v - 1
+		v1 = job->stride - job->rowsperjob * jobnum;
+		v0 = Q_max( v1 - job->rowsperjob, 0 );
+		v1 = Q_min( v1, vid.height );
+
+		if( v0 < v1 )
+			R_BlitRowsRotated( job, v0, v1 );
+	}
+	else R_BlitRows( job, v0, v1 );
+}
+
+/*
+===============
+R_BlitToBuffer
+
+split screen rows between render threads
+rotated bands start at output columns that are a whole
+number of cache lines into the row, so threads only share
+lines when the buffer or its pitch is not line aligned
+===============
+*/
+static void R_BlitToBuffer( void *buffer, uint stride, uint bpp, uint rotate, int numthreads, qboolean simd )
+{
+	blitjob_t	job;
+	int	numjobs, align;
+
+	job.buffer = buffer;
+	job.stride = stride;
+	job.bpp = bpp;
+	job.rotate = rotate;
+	job.simd = simd && blitsimd.ok;
+
+	// 3-byte pixels need 64 of them to end on a line boundary
+	align = rotate ? ( bpp == 3 ? BLIT_CACHELINE : BLIT_CACHELINE / bpp ) : 1;
+	align = Q_max( align, BLIT_TILE );
+
+	numjobs = numthreads > 1 ? numthreads * 2 : 1;
+	job.rowsperjob = ( vid.height + numjobs - 1 ) / numjobs;
+	job.rowsperjob = ( job.rowsperjob + align - 1 ) / align * align;
+
+	// rotated jobs cover output columns, stride may be wider than the screen
+	if( rotate )
+		numjobs = ( stride + job.rowsperjob - 1 ) / job.rowsperjob;
+	else numjobs = ( vid.height + job.rowsperjob - 1 ) / job.rowsperjob;
+
+	R_RunJobs( R_BlitJob, &job, numjobs );
+}
+
+void R_BlitScreen( void )
+{
+	void *buffer = swblit.pLockBuffer();
+//	gEngfuncs.Con_Printf("blit begin\n");
+	//memset( vid.buffer, 10, vid.width * vid.height );
+
+	if( !buffer || gpGlobals->width != vid.width || gpGlobals->height != vid.height )
+	{
+		gEngfuncs.Con_Printf("pre allocscrn\n");
+		R_AllocScreen();
+		gEngfuncs.Con_Printf("post allocscrn\n");
+		return;
+	}
+
+	//gEngfuncs.Con_Printf("swblit %d %d", swblit.bpp, vid.height );
+	R_BlitToBuffer( buffer, swblit.stride, swblit.bpp, swblit.rotate, R_NumThreads( ), sw_blitsimd->value != 0.0f );
 
 	swblit.pUnlockBuffer();
 //	gEngfuncs.Con_Printf("blit end\n");
 }
+
+/*
+===============
+R_BlitBench_f
+
+sw_blitbench [frames] [noise]
+measure blit throughput for every display transform
+into a scratch buffer, with one thread and with the pool.
+noise fills the frame with random pixels, the worst
+case for the table
+===============
+*/
+void R_BlitBench_f( void )
+{
+	int	rotate, pass, simd, i, frames = 100;
+	uint	stride, seed = 0x1234567;
+	byte	*buffer;
+
+	if( gEngfuncs.Cmd_Argc() > 1 )
+		frames = bound( 1, Q_atoi( gEngfuncs.Cmd_Argv( 1 )), 10000 );
+
+	if( !vid.buffer || !swblit.bpp )
+		return;
+
+	if( gEngfuncs.Cmd_Argc() > 2 && !Q_strcmp( gEngfuncs.Cmd_Argv( 2 ), "noise" ))
+	{
+		for( i = 0; i < vid.rowbytes * vid.height; i++ )
+		{
+			seed = seed * 1103515245 + 12345;
+			vid.buffer[i] = seed >> 16;
+		}
+	}
+
+	buffer = Mem_Malloc( r_temppool, vid.width * vid.height * swblit.bpp );
+
+	for( rotate = 0; rotate <= 1; rotate++ )
+	{
+		stride = rotate ? vid.height : vid.width;
+
+		// the rotated path always goes through the table
+		for( pass = 0; pass < 2; pass++ )
+		for( simd = 0; simd <= ( !rotate && blitsimd.ok ); simd++ )
+		{
+			int numthreads = pass ? R_NumThreads() : 1;
+			double start, time;
+
+			if( pass && numthreads == 1 )
+				continue;
+
+			start = gEngfuncs.pfnTime();
+			for( i = 0; i < frames; i++ )
+				R_BlitToBuffer( buffer, stride, swblit.bpp, rotate, numthreads, simd );
+			time = gEngfuncs.pfnTime() - start;
+
+			gEngfuncs.Con_Printf( "rotate %i, %i bpp, %2i threads, %s: %8.2f MP/s, %.3f ms/frame\n",
+				rotate, swblit.bpp * 8, numthreads, simd ? BLIT_SIMD_NAME : "table",
+				(double)vid.width * vid.height * frames / Q_max( time, 0.000001 ) / 1000000.0,
+				time * 1000.0 / frames );
+		}
+	}
+
+	Mem_Free( buffer );
+}
@@ -320,8 +320,23 @@ typedef struct
 	uint		c_particle_count;
 
 	uint		c_client_ents;	// entities that moved to client
+	uint		c_surfcache_hits;
+	uint		c_surfcache_builds;
+	uint		c_surfcache_prebuilt;	// built by the parallel pre-pass
+	uint		c_studio_verts;	// projected by the batched vertex stage
+	double		t_studio_heaviest;	// slowest studio model this frame
+	model_t		*studio_heaviest;
 	double		t_world_node;
 	double		t_world_draw;
+	double		t_surfcache_build;
+
+	// frame stages
+	double		t_mark_leaves;
+	double		t_edge_scan;	// without surface drawing
+	double		t_surface_draw;
+	double		t_studio_draw;
+	double		t_particle_draw;
+	double		t_blit;		// previous frame, blit happens after the reset
 } ref_speeds_t;
 
 extern ref_speeds_t		r_stats;
@@ -850,6 +865,15 @@ typedef struct finalvert_s {
 
 #endif
 
+// points projected all at once before triangle setup, coordinates
+// are kept in separate arrays so the loops can be vectorized
+typedef struct aliasbatch_s
+{
+	float	*x, *y, *z;	// eye space
+	int	*u, *v, *zi;
+	int	*flags;
+} aliasbatch_t;
+
 
 typedef struct
 {
@@ -905,6 +929,25 @@ typedef struct
 	int                     surfheight;     // in mipmapped texels
 } drawsurf_t;
 
+#define MAX_BLOCKLIGHTS	10240	// allow some very large lightmaps
+
+// everything needed to light and rasterize one surface
+// cache block, so blocks can be built on any thread
+typedef struct surfbuild_s
+{
+	drawsurf_t      drawsurf;
+	unsigned        *blocklights;
+	matrix4x4       objectmatrix;   // dlight transform for moved bmodels
+	qboolean        identity;
+
+	// set up by R_DrawSurface for the block drawers
+	pixel_t         *source, *sourcemax;
+	int             sourcetstep, stepback;
+	int             blocksize, lightwidth;
+	int             numhblocks, numvblocks;
+	float           worldlux_s, worldlux_t;
+} surfbuild_t;
+
 
 #if 0
 typedef struct {
@@ -947,6 +990,8 @@ typedef struct surfcache_s
 	unsigned                        height;         // DEBUG only needed for debug
 	float                           mipscale;
 	image_t							*image;
+	int                             spanbatch;      // queued span jobs still read this block
+	int                             buildframe;     // prebuilt on this frame by D_QueueSurfaceBuild
 	byte                            data[4];        // width*height elements
 } surfcache_t;
 
@@ -981,6 +1026,23 @@ typedef struct surf_s
 	int                     pad[2];                         // to 64 bytes
 } surf_t;
 
+#define MAX_RENDER_THREADS	16
+#define MAX_SPAN_BANDS	32
+
+// texture gradients of a surface, captured so
+// its spans can be filled later by the band workers
+typedef struct spanjob_s
+{
+	pixel_t         *cacheblock;
+	int             cachewidth;
+	float           sdivzstepu, tdivzstepu, zistepu;
+	float           sdivzstepv, tdivzstepv, zistepv;
+	float           sdivzorigin, tdivzorigin, ziorigin;
+	fixed16_t       sadjust, tadjust;
+	fixed16_t       bbextents, bbextentt;
+	espan_t         *spans[MAX_SPAN_BANDS];         // spans sorted by screen band
+} spanjob_t;
+
 // !!! if this is changed, it must be changed in asm_draw.h too !!!
 typedef struct edge_s
 {
@@ -1018,7 +1080,7 @@ void R_PolysetUpdateTables (void);
 
 extern drawsurf_t       r_drawsurf;
 
-void R_DrawSurface (void);
+void R_DrawSurface (surfbuild_t *sb);
 
 //extern int              c_surf;
 
@@ -1043,6 +1105,9 @@ extern  fixed16_t       bbextents, bbextentt;
 
 void D_DrawSpans16 (espan_t *pspans);
 void D_DrawZSpans (espan_t *pspans);
+void D_DrawSpans16Job (const spanjob_t *job, espan_t *pspan);
+void D_DrawZSpansJob (const spanjob_t *job, espan_t *pspan);
+void D_CaptureSpanJob (spanjob_t *job);
 void Turbulent8 (espan_t *pspan);
 void NonTurbulent8 (espan_t *pspan);	//PGM
 
@@ -1119,6 +1184,10 @@ extern cvar_t	*r_decals;
 extern cvar_t	*r_traceglow;
 extern cvar_t	*sw_notransbrushes;
 extern cvar_t	*sw_noalphabrushes;
+extern cvar_t	*sw_threads;
+extern cvar_t	*sw_bands;
+extern cvar_t	*sw_blitsimd;
+extern cvar_t	*sw_surfsimd;
 
 extern cvar_t	*tracerred;
 extern cvar_t	*tracergreen;
@@ -1183,7 +1252,9 @@ void R_DrawBrushModel(cl_entity_t *pent);
 //
 void R_InitCaches (void);
 void R_BlitScreen( void );
+void R_BlitBench_f( void );
 void R_InitBlit( qboolean gl );
+void R_InitNullBlit( void );
 qboolean R_SetDisplayTransform( ref_screen_rotation_t rotate, int offset_x, int offset_y, float scale_x, float scale_y );
 
 //
@@ -1193,12 +1264,37 @@ void R_SurfacePatch (void);
 void R_BeginEdgeFrame (void);
 void R_RenderWorld (void);
 void R_ScanEdges (void);
+void D_FlushSpanJobs (void);
+void D_UnpinCache (surfcache_t *cache);
+
+extern double	d_bandtime[MAX_SPAN_BANDS];	// accumulated fill time per band, reset each frame
+extern int	d_numbands;
 
 
 //
 // r_surf.c
 //
 void D_FlushCaches( void );
+qboolean D_QueueSurfaceBuild( msurface_t *surface, int miplevel );
+void D_FlushSurfaceBuilds( void );
+void D_EndSurfaceCacheFrame( void );
+void R_SurfaceCacheStats_f( void );
+void R_SurfaceBench_f( void );
+
+//
+// r_thread.c
+//
+void R_InitThreads( void );
+void R_ShutdownThreads( void );
+int R_NumThreads( void );
+void R_RunJobs( void (*func)( void *ctx, int job, int thread ), void *ctx, int numjobs );
+
+//
+// r_bench.c
+//
+void R_Bench_f( void );
+void R_BenchSetupView( void );
+void R_BenchEndFrame( void );
 
 //
 // r_draw.c
@@ -1224,6 +1320,9 @@ void R_RenderFace (msurface_t *fa, int clipflags);
 
 void R_RenderTriangle( finalvert_t *fv1 , finalvert_t *fv2, finalvert_t *fv3 );
 void R_SetupFinalVert( finalvert_t *fv, float x, float y, float z, int light, int s, int t );
+void R_AliasProjectBatch( const aliasbatch_t *batch, const vec3_t *in, int numverts );
+void TriVertexBatch( const aliasbatch_t *batch, int index );
+void TriLightLevel( int level );
 void RotatedBBox (vec3_t mins, vec3_t maxs, vec3_t angles, vec3_t tmins, vec3_t tmaxs);
 int R_BmodelCheckBBox (float *minmaxs);
 int CL_FxBlend( cl_entity_t *e );
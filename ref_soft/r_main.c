@@ -71,6 +71,10 @@ cvar_t	*sw_waterwarp;
 cvar_t	*sw_texfilt;
 cvar_t	*sw_notransbrushes;
 cvar_t	*sw_noalphabrushes;
+cvar_t	*sw_threads;
+cvar_t	*sw_bands;
+cvar_t	*sw_blitsimd;
+cvar_t	*sw_surfsimd;
 
 cvar_t	*r_drawworld;
 cvar_t	*r_dspeeds;
@@ -794,6 +798,7 @@ void R_DrawEntitiesOnList( void )
 {
 	extern void	(*d_pdrawspans)(void *);
 	int	i;
+	double	start;
 	//extern int d_aflatcolor;
 	//d_aflatcolor = 0;
 	tr.blend = 1.0f;
@@ -821,7 +826,9 @@ void R_DrawEntitiesOnList( void )
 			break;
 		case mod_studio:
 			R_SetUpWorldTransform();
+			start = gEngfuncs.pfnTime();
 			R_DrawStudioModel( RI.currententity );
+			r_stats.t_studio_draw += gEngfuncs.pfnTime() - start;
 		#if 0
 			// gradient debug (for colormap testing)
 		{finalvert_t fv[3];
@@ -878,7 +885,9 @@ void R_DrawEntitiesOnList( void )
 
 	if( !RI.onlyClientDraw )
 	{
+		start = gEngfuncs.pfnTime();
 		gEngfuncs.CL_DrawEFX( tr.frametime, false );
+		r_stats.t_particle_draw += gEngfuncs.pfnTime() - start;
 	}
 
 //	GL_CheckForErrors();
@@ -914,7 +923,9 @@ void R_DrawEntitiesOnList( void )
 			break;
 		case mod_studio:
 			R_SetUpWorldTransform();
+			start = gEngfuncs.pfnTime();
 			R_DrawStudioModel( RI.currententity );
+			r_stats.t_studio_draw += gEngfuncs.pfnTime() - start;
 			break;
 		case mod_sprite:
 			R_SetUpWorldTransform();
@@ -938,7 +949,9 @@ void R_DrawEntitiesOnList( void )
 	if( !RI.onlyClientDraw )
 	{
 		R_AllowFog( false );
+		start = gEngfuncs.pfnTime();
 		gEngfuncs.CL_DrawEFX( tr.frametime, true );
+		r_stats.t_particle_draw += gEngfuncs.pfnTime() - start;
 		R_AllowFog( true );
 	}
 
@@ -948,7 +961,11 @@ void R_DrawEntitiesOnList( void )
 	GL_SetRenderMode(kRenderNormal);
 	R_SetUpWorldTransform();
 	if( !RI.onlyClientDraw )
+	{
+		start = gEngfuncs.pfnTime();
 		R_DrawViewModel();
+		r_stats.t_studio_draw += gEngfuncs.pfnTime() - start;
+	}
 	gEngfuncs.CL_ExtraUpdate();
 
 	//GL_CheckForErrors();
@@ -1124,7 +1141,8 @@ void R_DrawBEntitiesOnList (void)
 
 	for( i = 0; i < tr.draw_list->num_edge_entities && !RI.onlyClientDraw; i++ )
 	{
-		int k;
+		int k, j, numlights;
+		int lights[MAX_DLIGHTS];
 		RI.currententity = tr.draw_list->edge_entities[i];
 		RI.currentmodel = RI.currententity->model;
 		if (!RI.currentmodel)
@@ -1180,11 +1198,16 @@ void R_DrawBEntitiesOnList (void)
 		}*/
 
 		// calculate dynamic lighting for bmodel
-		for( k = 0; k < MAX_DLIGHTS; k++ )
+		numlights = gEngfuncs.GetLightsInBox( minmaxs, minmaxs + 3, false, lights, MAX_DLIGHTS );
+
+		for( j = 0; j < numlights; j++ )
 		{
-			dlight_t *l = gEngfuncs.GetDynamicLight( k );
+			dlight_t *l;
 			vec3_t origin_l, oldorigin;
 
+			k = lights[j];
+			l = gEngfuncs.GetDynamicLight( k );
+
 			if( l->die < gpGlobals->time || !l->radius )
 				continue;
 
@@ -1244,7 +1267,8 @@ void R_DrawBrushModel(cl_entity_t *pent)
 	vec3_t		mins, maxs;
 	float		minmaxs[6];
 	mnode_t		*topnode;
-	int k;
+	int k, j, numlights;
+	int lights[MAX_DLIGHTS];
 	edge_t	ledges[NUMSTACKEDGES +
 				((CACHE_SIZE - 1) / sizeof(edge_t)) + 1];
 	surf_t	lsurfs[NUMSTACKSURFACES +
@@ -1336,11 +1360,16 @@ void R_DrawBrushModel(cl_entity_t *pent)
 		}*/
 
 		// calculate dynamic lighting for bmodel
-		for( k = 0; k < MAX_DLIGHTS; k++ )
+		numlights = gEngfuncs.GetLightsInBox( minmaxs, minmaxs + 3, false, lights, MAX_DLIGHTS );
+
+		for( j = 0; j < numlights; j++ )
 		{
-			dlight_t *l = gEngfuncs.GetDynamicLight( k );
+			dlight_t *l;
 			vec3_t origin_l, oldorigin;
 
+			k = lights[j];
+			l = gEngfuncs.GetDynamicLight( k );
+
 			if( l->die < gpGlobals->time || !l->radius )
 				continue;
 
@@ -1403,10 +1432,14 @@ void R_EdgeDrawing (void)
 				((CACHE_SIZE - 1) / sizeof(edge_t)) + 1];
 	surf_t	lsurfs[NUMSTACKSURFACES +
 				((CACHE_SIZE - 1) / sizeof(surf_t)) + 1];
+	double	start, surfstart;
 
 	if ( !RI.drawWorld )
 		return;
 
+	start = gEngfuncs.pfnTime();
+	surfstart = r_stats.t_surface_draw;
+
 	if (auxedges)
 	{
 		r_edges = auxedges;
@@ -1439,6 +1472,9 @@ void R_EdgeDrawing (void)
 
 	// display all edges
 	R_ScanEdges ();
+
+	// surfaces are drawn from R_ScanEdges, don't count them twice
+	r_stats.t_edge_scan += gEngfuncs.pfnTime() - start - ( r_stats.t_surface_draw - surfstart );
 }
 
 #if 0
@@ -1570,6 +1606,8 @@ R_SetupRefParams must be called right before
 */
 void GAME_EXPORT R_RenderScene( void )
 {
+	double	start;
+
 	if( !WORLDMODEL && RI.drawWorld )
 		gEngfuncs.Host_Error( "R_RenderView: NULL worldmodel\n" );
 
@@ -1601,7 +1639,9 @@ void GAME_EXPORT R_RenderScene( void )
 //	R_SetupGL( true );
 	//R_Clear( ~0 );
 
+	start = gEngfuncs.pfnTime();
 	R_MarkLeaves();
+	r_stats.t_mark_leaves += gEngfuncs.pfnTime() - start;
 	// R_PushDlights (r_worldmodel); ??
 	//R_DrawWorld();
 	R_EdgeDrawing ();
@@ -1679,6 +1719,12 @@ void GAME_EXPORT R_BeginFrame( qboolean clearScene )
 		ClearBits( vid_gamma->flags, FCVAR_CHANGED );
 	}
 
+	if( FBitSet( sw_threads->flags, FCVAR_CHANGED ))
+	{
+		R_ShutdownThreads();
+		R_InitThreads();
+	}
+
 	R_Set2DMode( true );
 
 	// draw buffer stuff
@@ -1739,6 +1785,7 @@ void GAME_EXPORT R_RenderFrame( const ref_viewpass_t *rvp )
 
 	// setup the initial render params
 	R_SetupRefParams( rvp );
+	R_BenchSetupView();
 
 	// completely override rendering
 	if( gEngfuncs.drawFuncs->GL_RenderFrame != NULL )
@@ -1771,11 +1818,15 @@ R_EndFrame
 */
 void GAME_EXPORT R_EndFrame( void )
 {
+	double	start;
+
 	// flush any remaining 2D bits
 	R_Set2DMode( false );
 
 	// blit pixels
+	start = gEngfuncs.pfnTime();
 	R_BlitScreen();
+	r_stats.t_blit = gEngfuncs.pfnTime() - start;
 }
 
 /*
@@ -1909,6 +1960,8 @@ void R_InitTurb (void)
 
 
 
+static qboolean nullblit;	// -nullblit or -nullblit16, render offscreen without a window
+
 qboolean GAME_EXPORT R_Init( void )
 {
 	qboolean glblit = false;
@@ -1931,6 +1984,10 @@ qboolean GAME_EXPORT R_Init( void )
 	sw_waterwarp = gEngfuncs.Cvar_Get ("sw_waterwarp", "1", FCVAR_GLCONFIG, "nothing");
 	sw_notransbrushes = gEngfuncs.Cvar_Get( "sw_notransbrushes", "0", FCVAR_GLCONFIG, "do not apply transparency to water/glasses (faster)");
 	sw_noalphabrushes = gEngfuncs.Cvar_Get( "sw_noalphabrushes", "0", FCVAR_GLCONFIG, "do not draw brush holes (faster)");
+	sw_threads = gEngfuncs.Cvar_Get( "sw_threads", "0", FCVAR_GLCONFIG, "number of rendering threads, 0 - autodetect" );
+	sw_bands = gEngfuncs.Cvar_Get( "sw_bands", "0", FCVAR_GLCONFIG, "number of screen bands for span filling, 0 - twice the thread count" );
+	sw_blitsimd = gEngfuncs.Cvar_Get( "sw_blitsimd", "0", FCVAR_GLCONFIG, "expand pixels with vector code instead of the lookup table, compare with sw_blitbench" );
+	sw_surfsimd = gEngfuncs.Cvar_Get( "sw_surfsimd", "1", FCVAR_GLCONFIG, "draw lit surface cache blocks with vector code, compare with sw_surfbench" );
 	r_traceglow = gEngfuncs.Cvar_Get( "r_traceglow", "1", FCVAR_GLCONFIG, "cull flares behind models" );
 #ifndef DISABLE_TEXFILTER
 	sw_texfilt = gEngfuncs.Cvar_Get ("sw_texfilt", "0", FCVAR_GLCONFIG, "texture dither");
@@ -1945,22 +2002,27 @@ qboolean GAME_EXPORT R_Init( void )
 	r_temppool = Mem_AllocPool( "ref_soft zone" );
 
 	glblit = !!gEngfuncs.Sys_CheckParm( "-glblit" );
+	nullblit = gEngfuncs.Sys_CheckParm( "-nullblit" ) || gEngfuncs.Sys_CheckParm( "-nullblit16" );
 
+	// no window at all, the engine has already picked the size
+	if( nullblit )
+		R_InitNullBlit();
 	// create the window and set up the context
-	if( !glblit && !gEngfuncs.R_Init_Video( REF_SOFTWARE )) // request software blitter
+	else if( !glblit && !gEngfuncs.R_Init_Video( REF_SOFTWARE )) // request software blitter
 	{
 		gEngfuncs.R_Free_Video();
 		gEngfuncs.Con_Printf("failed to initialize software blitter, fallback to glblit\n");
 		glblit = true;
 	}
 
-	if( glblit && !gEngfuncs.R_Init_Video( REF_GL )) // request GL context
+	if( !nullblit && glblit && !gEngfuncs.R_Init_Video( REF_GL )) // request GL context
 	{
 		gEngfuncs.R_Free_Video();
 		return false;
 	}
 
-	R_InitBlit( glblit );
+	if( !nullblit )
+		R_InitBlit( glblit );
 
 	R_InitImages();
 	// init draw stack
@@ -1973,14 +2035,26 @@ qboolean GAME_EXPORT R_Init( void )
 	R_StudioInit();
 	R_SpriteInit();
 	R_InitTurb();
+	R_InitThreads();
+
+	gEngfuncs.Cmd_AddCommand( "sw_blitbench", R_BlitBench_f, "measure screen blit throughput, 'noise' for random pixels" );
+	gEngfuncs.Cmd_AddCommand( "sw_surfcachestats", R_SurfaceCacheStats_f, "print and reset surface cache statistics" );
+	gEngfuncs.Cmd_AddCommand( "sw_surfbench", R_SurfaceBench_f, "measure the surface block drawers" );
+	gEngfuncs.Cmd_AddCommand( "sw_bench", R_Bench_f, "fly a camera path and report per-stage frame times and hashes" );
 
 	return true;
 }
 
 void GAME_EXPORT R_Shutdown( void )
 {
+	gEngfuncs.Cmd_RemoveCommand( "sw_blitbench" );
+	gEngfuncs.Cmd_RemoveCommand( "sw_surfcachestats" );
+	gEngfuncs.Cmd_RemoveCommand( "sw_surfbench" );
+	gEngfuncs.Cmd_RemoveCommand( "sw_bench" );
+	R_ShutdownThreads();
 	R_ShutdownImages();
-	gEngfuncs.R_Free_Video();
+	if( !nullblit )
+		gEngfuncs.R_Free_Video();
 }
 
 
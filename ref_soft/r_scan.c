@@ -588,12 +588,12 @@ int kernel[2][2][2] =
 #endif
 /*
 =============
-D_DrawSpans16
+D_DrawSpans16Job
 
   FIXME: actually make this subdivide by 16 instead of 8!!!
 =============
 */
-void D_DrawSpans16 (espan_t *pspan)
+void D_DrawSpans16Job (const spanjob_t *job, espan_t *pspan)
 {
 	int				count, spancount;
 	pixel_t	*pbase, *pdest;
@@ -604,11 +604,11 @@ void D_DrawSpans16 (espan_t *pspan)
 	sstep = 0;	// keep compiler happy
 	tstep = 0;	// ditto
 
-	pbase = cacheblock;
+	pbase = job->cacheblock;
 
-	sdivz8stepu = d_sdivzstepu * 8;
-	tdivz8stepu = d_tdivzstepu * 8;
-	zi8stepu = d_zistepu * 8;
+	sdivz8stepu = job->sdivzstepu * 8;
+	tdivz8stepu = job->tdivzstepu * 8;
+	zi8stepu = job->zistepu * 8;
 
 	do
 	{
@@ -621,20 +621,20 @@ void D_DrawSpans16 (espan_t *pspan)
 		du = (float)pspan->u;
 		dv = (float)pspan->v;
 
-		sdivz = d_sdivzorigin + dv*d_sdivzstepv + du*d_sdivzstepu;
-		tdivz = d_tdivzorigin + dv*d_tdivzstepv + du*d_tdivzstepu;
-		zi = d_ziorigin + dv*d_zistepv + du*d_zistepu;
+		sdivz = job->sdivzorigin + dv*job->sdivzstepv + du*job->sdivzstepu;
+		tdivz = job->tdivzorigin + dv*job->tdivzstepv + du*job->tdivzstepu;
+		zi = job->ziorigin + dv*job->zistepv + du*job->zistepu;
 		z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
 
-		s = (int)(sdivz * z) + sadjust;
-		if (s > bbextents)
-			s = bbextents;
+		s = (int)(sdivz * z) + job->sadjust;
+		if (s > job->bbextents)
+			s = job->bbextents;
 		else if (s < 0)
 			s = 0;
 
-		t = (int)(tdivz * z) + tadjust;
-		if (t > bbextentt)
-			t = bbextentt;
+		t = (int)(tdivz * z) + job->tadjust;
+		if (t > job->bbextentt)
+			t = job->bbextentt;
 		else if (t < 0)
 			t = 0;
 
@@ -657,17 +657,17 @@ void D_DrawSpans16 (espan_t *pspan)
 				zi += zi8stepu;
 				z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
 
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + job->sadjust;
+				if (snext > job->bbextents)
+					snext = job->bbextents;
 				else if (snext < 8)
 					snext = 8;	// prevent round-off error on <0 steps from
 								//  from causing overstepping & running off the
 								//  edge of the texture
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + job->tadjust;
+				if (tnext > job->bbextentt)
+					tnext = job->bbextentt;
 				else if (tnext < 8)
 					tnext = 8;	// guard against round-off error on <0 steps
 
@@ -681,21 +681,21 @@ void D_DrawSpans16 (espan_t *pspan)
 			  // span by division, biasing steps low so we don't run off the
 			  // texture
 				spancountminus1 = (float)(spancount - 1);
-				sdivz += d_sdivzstepu * spancountminus1;
-				tdivz += d_tdivzstepu * spancountminus1;
-				zi += d_zistepu * spancountminus1;
+				sdivz += job->sdivzstepu * spancountminus1;
+				tdivz += job->tdivzstepu * spancountminus1;
+				zi += job->zistepu * spancountminus1;
 				z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + job->sadjust;
+				if (snext > job->bbextents)
+					snext = job->bbextents;
 				else if (snext < 8)
 					snext = 8;	// prevent round-off error on <0 steps from
 								//  from causing overstepping & running off the
 								//  edge of the texture
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + job->tadjust;
+				if (tnext > job->bbextentt)
+					tnext = job->bbextentt;
 				else if (tnext < 8)
 					tnext = 8;	// guard against round-off error on <0 steps
 
@@ -712,7 +712,7 @@ void D_DrawSpans16 (espan_t *pspan)
 				{
 					do
 					{
-						*pdest++ = *(pbase + (s >> 16) + (t >> 16) * cachewidth);
+						*pdest++ = *(pbase + (s >> 16) + (t >> 16) * job->cachewidth);
 						s += sstep;
 						t += tstep;
 					} while (--spancount > 0);
@@ -739,7 +739,7 @@ void D_DrawSpans16 (espan_t *pspan)
 						iditht = iditht ? iditht -1 : iditht;
 
 
-						*pdest++ = *(pbase + idiths + iditht * cachewidth);
+						*pdest++ = *(pbase + idiths + iditht * job->cachewidth);
 						s += sstep;
 						t += tstep;
 					} while (--spancount > 0);
@@ -751,6 +751,45 @@ void D_DrawSpans16 (espan_t *pspan)
 	} while ((pspan = pspan->pnext) != NULL);
 }
 
+/*
+=============
+D_CaptureSpanJob
+
+save the current texture gradients
+=============
+*/
+void D_CaptureSpanJob (spanjob_t *job)
+{
+	job->cacheblock = cacheblock;
+	job->cachewidth = cachewidth;
+	job->sdivzstepu = d_sdivzstepu;
+	job->tdivzstepu = d_tdivzstepu;
+	job->zistepu = d_zistepu;
+	job->sdivzstepv = d_sdivzstepv;
+	job->tdivzstepv = d_tdivzstepv;
+	job->zistepv = d_zistepv;
+	job->sdivzorigin = d_sdivzorigin;
+	job->tdivzorigin = d_tdivzorigin;
+	job->ziorigin = d_ziorigin;
+	job->sadjust = sadjust;
+	job->tadjust = tadjust;
+	job->bbextents = bbextents;
+	job->bbextentt = bbextentt;
+}
+
+/*
+=============
+D_DrawSpans16
+=============
+*/
+void D_DrawSpans16 (espan_t *pspan)
+{
+	spanjob_t	job;
+
+	D_CaptureSpanJob (&job);
+	D_DrawSpans16Job (&job, pspan);
+}
+
 
 /*
 =============
@@ -1360,10 +1399,10 @@ void D_AddSpans16 (espan_t *pspan)
 
 /*
 =============
-D_DrawZSpans
+D_DrawZSpansJob
 =============
 */
-void D_DrawZSpans (espan_t *pspan)
+void D_DrawZSpansJob (const spanjob_t *job, espan_t *pspan)
 {
 	int				count, doublecount, izistep;
 	int				izi;
@@ -1374,7 +1413,7 @@ void D_DrawZSpans (espan_t *pspan)
 
 // FIXME: check for clamping/range problems
 // we count on FP exceptions being turned off to avoid range problems
-	izistep = (int)(d_zistepu * 0x8000 * 0x10000);
+	izistep = (int)(job->zistepu * 0x8000 * 0x10000);
 
 	do
 	{
@@ -1386,7 +1425,7 @@ void D_DrawZSpans (espan_t *pspan)
 		du = (float)pspan->u;
 		dv = (float)pspan->v;
 
-		zi = d_ziorigin + dv*d_zistepv + du*d_zistepu;
+		zi = job->ziorigin + dv*job->zistepv + du*job->zistepu;
 	// we count on FP exceptions being turned off to avoid range problems
 		izi = (int)(zi * 0x8000 * 0x10000);
 
@@ -1416,5 +1455,21 @@ void D_DrawZSpans (espan_t *pspan)
 	} while ((pspan = pspan->pnext) != NULL);
 }
 
+/*
+=============
+D_DrawZSpans
+=============
+*/
+void D_DrawZSpans (espan_t *pspan)
+{
+	spanjob_t	job;
+
+	job.zistepu = d_zistepu;
+	job.zistepv = d_zistepv;
+	job.ziorigin = d_ziorigin;
+
+	D_DrawZSpansJob (&job, pspan);
+}
+
 #endif
 
@@ -86,6 +86,18 @@ typedef struct
 	vec3_t		verts[MAXSTUDIOVERTS];
 	vec3_t		norms[MAXSTUDIOVERTS];
 
+	// batched vertex stage, verts projected once per submodel
+	aliasbatch_t	batch;
+	float		batchx[MAXSTUDIOVERTS];
+	float		batchy[MAXSTUDIOVERTS];
+	float		batchz[MAXSTUDIOVERTS];
+	int		batchu[MAXSTUDIOVERTS];
+	int		batchv[MAXSTUDIOVERTS];
+	int		batchzi[MAXSTUDIOVERTS];
+	int		batchflags[MAXSTUDIOVERTS];
+	int		lightlevel[MAXSTUDIOVERTS];	// per normal, TriAPI light for plain shading
+	qboolean		uselightlevel;
+
 	// lighting state
 	float		ambientlight;
 	float		shadelight;
@@ -150,6 +162,14 @@ void R_StudioInit( void )
 
 	Matrix3x4_LoadIdentity( g_studio.rotationmatrix );
 
+	g_studio.batch.x = g_studio.batchx;
+	g_studio.batch.y = g_studio.batchy;
+	g_studio.batch.z = g_studio.batchz;
+	g_studio.batch.u = g_studio.batchu;
+	g_studio.batch.v = g_studio.batchv;
+	g_studio.batch.zi = g_studio.batchzi;
+	g_studio.batch.flags = g_studio.batchflags;
+
 	// g-cont. cvar disabled by Valve
 //	gEngfuncs.Cvar_RegisterVariable( &r_shadows );
 
@@ -1361,7 +1381,8 @@ void R_StudioDynamicLight( cl_entity_t *ent, alight_t *plight )
 	vec3_t		origin, dist, finalLight;
 	float		add, radius, total;
 	colorVec		light;
-	uint		lnum;
+	int		lights[MAX_DLIGHTS];
+	int		i, numlights;
 	dlight_t		*dl;
 
 	if( !plight || !ent || !ent->model )
@@ -1476,11 +1497,15 @@ void R_StudioDynamicLight( cl_entity_t *ent, alight_t *plight )
 	// scale lightdir by light intentsity
 	VectorScale( lightDir, total, lightDir );
 
-	for( lnum = 0; lnum < MAX_DLIGHTS; lnum++ )
+	if( r_dynamic->value )
+		numlights = gEngfuncs.GetLightsInBox( ent->origin, ent->origin, false, lights, MAX_DLIGHTS );
+	else numlights = 0;
+
+	for( i = 0; i < numlights; i++ )
 	{
-		dl = gEngfuncs.GetDynamicLight( lnum );
+		dl = gEngfuncs.GetDynamicLight( lights[i] );
 
-		if( dl->die < g_studio.time || !r_dynamic->value )
+		if( dl->die < g_studio.time )
 			continue;
 
 		VectorSubtract( ent->origin, dl->origin, dist );
@@ -1541,6 +1566,7 @@ pfnStudioEntityLight
 void R_StudioEntityLight( alight_t *lightinfo )
 {
 	int		lnum, i, j, k;
+	int		lights[MAX_ELIGHTS], numlights;
 	float		minstrength, dist2, f, r2;
 	float		lstrength[MAX_LOCALLIGHTS];
 	cl_entity_t	*ent = RI.currententity;
@@ -1559,9 +1585,11 @@ void R_StudioEntityLight( alight_t *lightinfo )
 	dist2 = 1000000.0f;
 	k = 0;
 
-	for( lnum = 0; lnum < MAX_ELIGHTS; lnum++ )
+	numlights = gEngfuncs.GetLightsInBox( origin, origin, true, lights, MAX_ELIGHTS );
+
+	for( lnum = 0; lnum < numlights; lnum++ )
 	{
-		el = gEngfuncs.GetEntityLight( lnum );
+		el = gEngfuncs.GetEntityLight( lights[lnum] );
 
 		if( el->die < g_studio.time || el->radius <= 0.0f )
 			continue;
@@ -1754,6 +1782,12 @@ static void R_StudioSetColorBegin(short *ptricmds, vec3_t *pstudionorms )
 	float	*lv = (float *)g_studio.lightvalues[ptricmds[1]];
 	rgba_t color;
 
+	if( g_studio.uselightlevel )
+	{
+		TriLightLevel( g_studio.lightlevel[ptricmds[1]] );
+		return;
+	}
+
 	if( g_studio.numlocallights )
 	{
 		color[3] = tr.blend * 255;
@@ -1951,7 +1985,7 @@ _inline void R_StudioDrawNormalMesh( short *ptricmds, vec3_t *pstudionorms, floa
 			R_StudioSetColorBegin( ptricmds, pstudionorms );
 
 			TriTexCoord2f( ptricmds[2] * s, ptricmds[3] * t );
-			TriVertex3fv( g_studio.verts[ptricmds[0]] );
+			TriVertexBatch( &g_studio.batch, ptricmds[0] );
 		}
 
 		TriEnd();
@@ -1983,7 +2017,7 @@ _inline void R_StudioDrawFloatMesh( short *ptricmds, vec3_t *pstudionorms )
 		{
 			R_StudioSetColorBegin( ptricmds, pstudionorms );
 			TriTexCoord2f( HalfToFloat( ptricmds[2] ), HalfToFloat( ptricmds[3] ));
-			TriVertex3fv( g_studio.verts[ptricmds[0]] );
+			TriVertexBatch( &g_studio.batch, ptricmds[0] );
 		}
 
 		TriEnd();
@@ -2033,7 +2067,7 @@ _inline void R_StudioDrawChromeMesh( short *ptricmds, vec3_t *pstudionorms, floa
 				lv = (float *)g_studio.lightvalues[ptricmds[1]];
 				R_StudioSetColorBegin( ptricmds, pstudionorms );
 				TriTexCoord2f( g_studio.chrome[idx][0] * s, g_studio.chrome[idx][1] * t );
-				TriVertex3fv( g_studio.verts[ptricmds[0]] );
+				TriVertexBatch( &g_studio.batch, ptricmds[0] );
 			}
 		}
 
@@ -2114,6 +2148,11 @@ static void R_StudioDrawPoints( void )
 		R_StudioGenerateNormals();
 	}
 
+	// every shared vertex is transformed and projected once here,
+	// triangle setup below only picks the results up
+	R_AliasProjectBatch( &g_studio.batch, g_studio.verts, m_pSubModel->numverts );
+	r_stats.c_studio_verts += m_pSubModel->numverts;
+
 	for( j = k = 0; j < m_pSubModel->nummesh; j++ )
 	{
 		g_nFaceFlags = ptexture[pskinref[pmesh[j].skinref]].flags | g_nForceFaceFlags;
@@ -2149,6 +2188,20 @@ static void R_StudioDrawPoints( void )
 		}
 	}
 
+	// normal mode only needs the light level from TriAPI colors, convert
+	// all of them at once instead of on every triangle vertex
+	g_studio.uselightlevel = !g_studio.numlocallights && !vid.is2d && vid.rendermode == kRenderNormal
+		&& RI.currententity->curstate.rendermode != kRenderTransColor;
+
+	if( g_studio.uselightlevel )
+	{
+		for( i = 0; i < k; i++ )
+		{
+			float	level = ( g_studio.lightvalues[i][0] + g_studio.lightvalues[i][1] + g_studio.lightvalues[i][2] ) * 31 / 3;
+			g_studio.lightlevel[i] = Q_min( level, 31 );
+		}
+	}
+
 	if( r_studio_sort_textures->value && need_sort )
 	{
 		// resort opaque and translucent meshes draw order
@@ -3363,9 +3416,15 @@ R_DrawStudioModel
 */
 void R_DrawStudioModel( cl_entity_t *e )
 {
+	qboolean	timed = r_speeds->value >= 3;
+	double	start = 0.0, cost;
+
 	if( FBitSet( RI.params, RP_ENVVIEW ))
 		return;
 
+	if( timed )
+		start = gEngfuncs.pfnTime();
+
 	R_StudioSetupTimings();
 
 	if( e->player )
@@ -3390,6 +3449,17 @@ void R_DrawStudioModel( cl_entity_t *e )
 
 		R_StudioDrawModelInternal( e, STUDIO_RENDER|STUDIO_EVENTS );
 	}
+
+	// remember the most expensive model for r_speeds 3
+	if( !timed )
+		return;
+
+	cost = gEngfuncs.pfnTime() - start;
+	if( cost > r_stats.t_studio_heaviest )
+	{
+		r_stats.t_studio_heaviest = cost;
+		r_stats.studio_heaviest = e->model;
+	}
 }
 
 /*
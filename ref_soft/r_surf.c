@@ -22,39 +22,55 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "r_local.h"
 #include "mod_local.h"
 
+// vector block drawers follow the compiler target, same as the blit
+#if defined( __SSE2__ ) || defined( _M_AMD64 ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SURF_SSE2	1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define SURF_NEON	1
+#endif
+
 drawsurf_t	r_drawsurf;
 
-uint				lightleft, sourcesstep, blocksize, sourcetstep;
-uint				lightdelta, lightdeltastep;
-uint				lightright, lightleftstep, lightrightstep, blockdivshift;
-unsigned		blockdivmask;
-void			*prowdestbase;
-pixel_t	*pbasesource;
-int				surfrowbytes;	// used by ASM files
-unsigned		*r_lightptr;
-int				r_stepback;
-int				r_lightwidth;
-int				r_numhblocks, r_numvblocks;
-pixel_t	*r_source, *r_sourcemax;
-
-void R_DrawSurfaceBlock8_mip0 (void);
-void R_DrawSurfaceBlock8_mip1 (void);
-void R_DrawSurfaceBlock8_mip2 (void);
-void R_DrawSurfaceBlock8_mip3 (void);
-void R_DrawSurfaceBlock8_Generic (void);
-void R_DrawSurfaceBlock8_World (void);
-
-static float worldlux_s, worldlux_t;
-
-static void	(*surfmiptable[4])(void) = {
+typedef void (*blockdrawer_t)(const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+
+void R_DrawSurfaceBlock8_mip0 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+void R_DrawSurfaceBlock8_mip1 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+void R_DrawSurfaceBlock8_mip2 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+void R_DrawSurfaceBlock8_mip3 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+void R_DrawSurfaceBlock8_Generic (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+void R_DrawSurfaceBlock8_World (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+
+static blockdrawer_t	surfmiptable[4] = {
 	R_DrawSurfaceBlock8_mip0,
 	R_DrawSurfaceBlock8_mip1,
 	R_DrawSurfaceBlock8_mip2,
 	R_DrawSurfaceBlock8_mip3
 };
 
+#if SURF_SSE2 || SURF_NEON
+static void R_DrawSurfaceBlock8_mip0SIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+static void R_DrawSurfaceBlock8_mip1SIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+static void R_DrawSurfaceBlock8_mip2SIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+static void R_DrawSurfaceBlock8_GenericSIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+static void R_DrawSurfaceBlock8_WorldSIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest);
+
+// mip3 rows are two texels, shorter than a vector
+static blockdrawer_t	surfmiptable_simd[4] = {
+	R_DrawSurfaceBlock8_mip0SIMD,
+	R_DrawSurfaceBlock8_mip1SIMD,
+	R_DrawSurfaceBlock8_mip2SIMD,
+	R_DrawSurfaceBlock8_mip3
+};
+#else
+#define surfmiptable_simd	surfmiptable
+#define R_DrawSurfaceBlock8_GenericSIMD	R_DrawSurfaceBlock8_Generic
+#define R_DrawSurfaceBlock8_WorldSIMD	R_DrawSurfaceBlock8_World
+#endif
+
 //void R_BuildLightMap (void);
-extern	unsigned		blocklights[10240];	// allow some very large lightmaps
+extern	unsigned		blocklights[MAX_BLOCKLIGHTS];	// allow some very large lightmaps
 
 float           surfscale;
 qboolean        r_cache_thrash;         // set if surface cache is thrashing
@@ -66,14 +82,15 @@ static int		rtable[MOD_FRAMES][MOD_FRAMES];
 
 #if 1
 
-static void R_BuildLightMap( void );
+static void R_BuildLightMap( surfbuild_t *sb );
 /*
 ===============
 R_AddDynamicLights
 ===============
 */
-void R_AddDynamicLights( msurface_t *surf )
+static void R_AddDynamicLights( surfbuild_t *sb )
 {
+	msurface_t	*surf = sb->drawsurf.surf;
 	float		dist, rad, minlight;
 	int		lnum, s, t, sd, td, smax, tmax;
 	float		sl, tl, sacc, tacc;
@@ -110,8 +127,8 @@ void R_AddDynamicLights( msurface_t *surf )
 		dl = gEngfuncs.GetDynamicLight( lnum );
 
 		// transform light origin to local bmodel space
-		if( !tr.modelviewIdentity )
-			Matrix4x4_VectorITransform( RI.objectMatrix, dl->origin, origin_l );
+		if( !sb->identity )
+			Matrix4x4_VectorITransform( sb->objectmatrix, dl->origin, origin_l );
 		else
 			VectorCopy( dl->origin, origin_l );
 
@@ -135,7 +152,7 @@ void R_AddDynamicLights( msurface_t *surf )
 
 		sl = DotProduct( impact, info->lmvecs[0] ) + info->lmvecs[0][3] - info->lightmapmins[0];
 		tl = DotProduct( impact, info->lmvecs[1] ) + info->lmvecs[1][3] - info->lightmapmins[1];
-		bl = blocklights;
+		bl = sb->blocklights;
 
 		for( t = 0, tacc = 0; t < tmax; t++, tacc += sample_size )
 		{
@@ -172,13 +189,14 @@ Combine and scale multiple lightmaps into the floating
 format in r_blocklights
 =================
 */
-static void R_BuildLightMap( void )
+static void R_BuildLightMap( surfbuild_t *sb )
 {
 	int		smax, tmax;
 	uint		*bl, scale;
 	int		i, map, size, s, t;
 	int		sample_size;
-	msurface_t *surf = r_drawsurf.surf;
+	uint		*blocklights = sb->blocklights;
+	msurface_t *surf = sb->drawsurf.surf;
 	mextrasurf_t	*info = surf->info;
 	color24		*lm;
 	qboolean dynamic = 0;
@@ -223,7 +241,7 @@ static void R_BuildLightMap( void )
 
 	// add all the dynamic lights
 	if( surf->dlightframe == tr.framecount )
-		R_AddDynamicLights( surf );
+		R_AddDynamicLights( sb );
 
 	// Put into texture format
 	//stride -= (smax << 2);
@@ -479,21 +497,20 @@ texture_t *R_TextureAnimation( msurface_t *s )
 R_DrawSurface
 ===============
 */
-void R_DrawSurface (void)
+void R_DrawSurface (surfbuild_t *sb)
 {
+	drawsurf_t		*ds = &sb->drawsurf;
 	pixel_t	*basetptr;
 	int				smax, tmax, twidth;
 	int				u;
 	int				soffset, basetoffset, texwidth;
 	int				horzblockstep;
 	pixel_t	*pcolumndest;
-	void			(*pblockdrawer)(void);
+	blockdrawer_t	pblockdrawer;
 	image_t			*mt;
-	uint sample_size, sample_bits, sample_pot;
-
-	surfrowbytes = r_drawsurf.rowbytes;
+	uint sample_size, sample_bits, sample_pot, blockdivshift;
 
-	sample_size = LM_SAMPLE_SIZE_AUTO(r_drawsurf.surf);
+	sample_size = LM_SAMPLE_SIZE_AUTO(ds->surf);
 	if( sample_size == 16 )
 		sample_bits = 4, sample_pot = sample_size;
 	else
@@ -508,78 +525,75 @@ void R_DrawSurface (void)
 		else
 			sample_pot = 1 << sample_bits;
 	}
-	mt = r_drawsurf.image;
+	mt = ds->image;
 
-	r_source = mt->pixels[r_drawsurf.surfmip];
+	sb->source = mt->pixels[ds->surfmip];
 
 // the fractional light values should range from 0 to (VID_GRADES - 1) << 16
 // from a source range of 0 - 255
 
-	texwidth = mt->width >> r_drawsurf.surfmip;
+	texwidth = mt->width >> ds->surfmip;
 
-	blocksize = sample_pot >> r_drawsurf.surfmip;
-	blockdivshift = sample_bits - r_drawsurf.surfmip;
-	blockdivmask = (1 << blockdivshift) - 1;
+	sb->blocksize = sample_pot >> ds->surfmip;
+	blockdivshift = sample_bits - ds->surfmip;
 
 	if( sample_size == 16 )
-		r_lightwidth = ( r_drawsurf.surf->info->lightextents[0]>>4)+1;
+		sb->lightwidth = ( ds->surf->info->lightextents[0]>>4)+1;
 	else
-		r_lightwidth = ( r_drawsurf.surf->info->lightextents[0] / sample_size ) + 1;
+		sb->lightwidth = ( ds->surf->info->lightextents[0] / sample_size ) + 1;
 
-	r_numhblocks = r_drawsurf.surfwidth >> blockdivshift;
-	r_numvblocks = r_drawsurf.surfheight >> blockdivshift;
+	sb->numhblocks = ds->surfwidth >> blockdivshift;
+	sb->numvblocks = ds->surfheight >> blockdivshift;
 
 
 //==============================
 
 	if( sample_size == 16 )
-		pblockdrawer = surfmiptable[r_drawsurf.surfmip];
+		pblockdrawer = sw_surfsimd->value ? surfmiptable_simd[ds->surfmip] : surfmiptable[ds->surfmip];
+	else if( sw_surfsimd->value && sb->blocksize >= 4 )
+		pblockdrawer = R_DrawSurfaceBlock8_GenericSIMD;
 	else
 		pblockdrawer = R_DrawSurfaceBlock8_Generic;
 
 // TODO: only needs to be set when there is a display settings change
-	horzblockstep = blocksize;
+	horzblockstep = sb->blocksize;
 
-	smax = mt->width >> r_drawsurf.surfmip;
+	smax = mt->width >> ds->surfmip;
 	twidth = texwidth;
-	tmax = mt->height >> r_drawsurf.surfmip;
-	sourcetstep = texwidth;
-	r_stepback = tmax * twidth;
+	tmax = mt->height >> ds->surfmip;
+	sb->sourcetstep = texwidth;
+	sb->stepback = tmax * twidth;
 
-	r_sourcemax = r_source + (tmax * smax);
+	sb->sourcemax = sb->source + (tmax * smax);
 
 	// glitchy and slow way to draw some lightmap
-	if( r_drawsurf.surf->texinfo->flags & TEX_WORLD_LUXELS )
+	if( ds->surf->texinfo->flags & TEX_WORLD_LUXELS )
 	{
-		worldlux_s = r_drawsurf.surf->extents[0] / r_drawsurf.surf->info->lightextents[0];
-		worldlux_t = r_drawsurf.surf->extents[1] / r_drawsurf.surf->info->lightextents[1];
-		if( worldlux_s == 0 )
-			worldlux_s = 1;
-		if( worldlux_t == 0 )
-			worldlux_t = 1;
-
-		soffset = r_drawsurf.surf->texturemins[0];
-		basetoffset = r_drawsurf.surf->texturemins[1];
-		//soffset =  r_drawsurf.surf->info->lightmapmins[0] * worldlux_s;
-		//basetoffset = r_drawsurf.surf->info->lightmapmins[1] * worldlux_t;
+		sb->worldlux_s = ds->surf->extents[0] / ds->surf->info->lightextents[0];
+		sb->worldlux_t = ds->surf->extents[1] / ds->surf->info->lightextents[1];
+		if( sb->worldlux_s == 0 )
+			sb->worldlux_s = 1;
+		if( sb->worldlux_t == 0 )
+			sb->worldlux_t = 1;
+
+		soffset = ds->surf->texturemins[0];
+		basetoffset = ds->surf->texturemins[1];
+		//soffset =  ds->surf->info->lightmapmins[0] * sb->worldlux_s;
+		//basetoffset = ds->surf->info->lightmapmins[1] * sb->worldlux_t;
 		// << 16 components are to guarantee positive values for %
-		soffset = ((soffset >> r_drawsurf.surfmip) + (smax << 16)) % smax;
-		basetptr = &r_source[((((basetoffset >> r_drawsurf.surfmip)
+		soffset = ((soffset >> ds->surfmip) + (smax << 16)) % smax;
+		basetptr = &sb->source[((((basetoffset >> ds->surfmip)
 			+ (tmax << 16)) % tmax) * twidth)];
 
-		pcolumndest = r_drawsurf.surfdat;
+		pcolumndest = ds->surfdat;
 
-		for (u=0 ; u<r_numhblocks; u++)
+		for (u=0 ; u<sb->numhblocks; u++)
 		{
-			r_lightptr = blocklights + (int)(u/ (worldlux_s+0.5f));
-
-			prowdestbase = pcolumndest;
-
-			pbasesource = basetptr + soffset;
+			if( sw_surfsimd->value && sb->blocksize >= 4 )
+				R_DrawSurfaceBlock8_WorldSIMD( sb, sb->blocklights + (int)(u/ (sb->worldlux_s+0.5f)), basetptr + soffset, pcolumndest );
+			else R_DrawSurfaceBlock8_World( sb, sb->blocklights + (int)(u/ (sb->worldlux_s+0.5f)), basetptr + soffset, pcolumndest );
 
-			R_DrawSurfaceBlock8_World();
-
-			soffset = soffset + blocksize;
+			soffset = soffset + sb->blocksize;
 			if (soffset >= smax)
 				soffset = 0;
 
@@ -588,27 +602,21 @@ void R_DrawSurface (void)
 		return;
 	}
 
-	soffset =  r_drawsurf.surf->info->lightmapmins[0];
-	basetoffset = r_drawsurf.surf->info->lightmapmins[1];
+	soffset =  ds->surf->info->lightmapmins[0];
+	basetoffset = ds->surf->info->lightmapmins[1];
 
 // << 16 components are to guarantee positive values for %
-	soffset = ((soffset >> r_drawsurf.surfmip) + (smax << 16)) % smax;
-	basetptr = &r_source[((((basetoffset >> r_drawsurf.surfmip)
+	soffset = ((soffset >> ds->surfmip) + (smax << 16)) % smax;
+	basetptr = &sb->source[((((basetoffset >> ds->surfmip)
 		+ (tmax << 16)) % tmax) * twidth)];
 
-	pcolumndest = r_drawsurf.surfdat;
+	pcolumndest = ds->surfdat;
 
-	for (u=0 ; u<r_numhblocks; u++)
+	for (u=0 ; u<sb->numhblocks; u++)
 	{
-		r_lightptr = blocklights + u;
-
-		prowdestbase = pcolumndest;
-
-		pbasesource = basetptr + soffset;
-
-		(*pblockdrawer)();
+		(*pblockdrawer)( sb, sb->blocklights + u, basetptr + soffset, pcolumndest );
 
-		soffset = soffset + blocksize;
+		soffset = soffset + sb->blocksize;
 		if (soffset >= smax)
 			soffset = 0;
 
@@ -631,36 +639,33 @@ R_DrawSurfaceBlock8_World
 Does not draw lightmap correclty, but scale it correctly. Better than nothing
 ================
 */
-void R_DrawSurfaceBlock8_World (void)
+void R_DrawSurfaceBlock8_World (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
 {
 	int				v, i, b;
 	uint lightstep, lighttemp, light;
-	pixel_t	pix, *psource, *prowdest;
+	uint lightleft, lightright, lightleftstep, lightrightstep;
+	pixel_t	pix;
 	int lightpos = 0;
 
-	psource = pbasesource;
-	prowdest = prowdestbase;
-
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
-	// FIXME: make these locals?
 	// FIXME: use delta rather than both right and left, like ASM?
-		lightleft = r_lightptr[(lightpos/r_lightwidth) * r_lightwidth];
-		lightright = r_lightptr[(lightpos/r_lightwidth) * r_lightwidth+1];
-		lightpos += r_lightwidth / worldlux_s;
-		lightleftstep = (r_lightptr[(lightpos/r_lightwidth) * r_lightwidth] - lightleft) >> (4-r_drawsurf.surfmip);
-		lightrightstep =(r_lightptr[(lightpos/r_lightwidth) * r_lightwidth+1] - lightright) >> (4-r_drawsurf.surfmip);
+		lightleft = lightptr[(lightpos/sb->lightwidth) * sb->lightwidth];
+		lightright = lightptr[(lightpos/sb->lightwidth) * sb->lightwidth+1];
+		lightpos += sb->lightwidth / sb->worldlux_s;
+		lightleftstep = (lightptr[(lightpos/sb->lightwidth) * sb->lightwidth] - lightleft) >> (4-sb->drawsurf.surfmip);
+		lightrightstep =(lightptr[(lightpos/sb->lightwidth) * sb->lightwidth+1] - lightright) >> (4-sb->drawsurf.surfmip);
 
-		for (i=0 ; i<blocksize ; i++)
+		for (i=0 ; i<sb->blocksize ; i++)
 		{
 			lighttemp = lightleft - lightright;
-			lightstep = lighttemp >> (4-r_drawsurf.surfmip);
+			lightstep = lighttemp >> (4-sb->drawsurf.surfmip);
 
 			light = lightright;
 
-			for (b=blocksize-1; b>=0; b--)
+			for (b=sb->blocksize-1; b>=0; b--)
 			{
-				//pix = psource[(uint)(b * worldlux_s)];
+				//pix = psource[(uint)(b * sb->worldlux_s)];
 				pix = psource[b];
 				prowdest[b] = BLEND_LM(pix, light);
 				if( pix == TRANSPARENT_COLOR )
@@ -670,14 +675,14 @@ void R_DrawSurfaceBlock8_World (void)
 				light += lightstep;
 			}
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
 			lightright += lightrightstep;
 			lightleft += lightleftstep;
-			prowdest += surfrowbytes;
+			prowdest += sb->drawsurf.rowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
@@ -687,33 +692,30 @@ void R_DrawSurfaceBlock8_World (void)
 R_DrawSurfaceBlock8_Generic
 ================
 */
-void R_DrawSurfaceBlock8_Generic (void)
+void R_DrawSurfaceBlock8_Generic (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
 {
 	int				v, i, b;
 	uint lightstep, lighttemp, light;
-	pixel_t	pix, *psource, *prowdest;
+	uint lightleft, lightright, lightleftstep, lightrightstep;
+	pixel_t	pix;
 
-	psource = pbasesource;
-	prowdest = prowdestbase;
-
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
-	// FIXME: make these locals?
 	// FIXME: use delta rather than both right and left, like ASM?
-		lightleft = r_lightptr[0];
-		lightright = r_lightptr[1];
-		r_lightptr += r_lightwidth;
-		lightleftstep = (r_lightptr[0] - lightleft) >> (4-r_drawsurf.surfmip);
-		lightrightstep = (r_lightptr[1] - lightright) >> (4-r_drawsurf.surfmip);
+		lightleft = lightptr[0];
+		lightright = lightptr[1];
+		lightptr += sb->lightwidth;
+		lightleftstep = (lightptr[0] - lightleft) >> (4-sb->drawsurf.surfmip);
+		lightrightstep = (lightptr[1] - lightright) >> (4-sb->drawsurf.surfmip);
 
-		for (i=0 ; i<blocksize ; i++)
+		for (i=0 ; i<sb->blocksize ; i++)
 		{
 			lighttemp = lightleft - lightright;
-			lightstep = lighttemp >> (4-r_drawsurf.surfmip);
+			lightstep = lighttemp >> (4-sb->drawsurf.surfmip);
 
 			light = lightright;
 
-			for (b=blocksize-1; b>=0; b--)
+			for (b=sb->blocksize-1; b>=0; b--)
 			{
 				pix = psource[b];
 				prowdest[b] = BLEND_LM(pix, light);
@@ -724,14 +726,14 @@ void R_DrawSurfaceBlock8_Generic (void)
 				light += lightstep;
 			}
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
 			lightright += lightrightstep;
 			lightleft += lightleftstep;
-			prowdest += surfrowbytes;
+			prowdest += sb->drawsurf.rowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
@@ -741,24 +743,21 @@ void R_DrawSurfaceBlock8_Generic (void)
 R_DrawSurfaceBlock8_mip0
 ================
 */
-void R_DrawSurfaceBlock8_mip0 (void)
+void R_DrawSurfaceBlock8_mip0 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
 {
 	int				v, i, b;
 	uint lightstep, lighttemp, light;
-	pixel_t	pix, *psource, *prowdest;
+	uint lightleft, lightright, lightleftstep, lightrightstep;
+	pixel_t	pix;
 
-	psource = pbasesource;
-	prowdest = prowdestbase;
-
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
-	// FIXME: make these locals?
 	// FIXME: use delta rather than both right and left, like ASM?
-		lightleft = r_lightptr[0];
-		lightright = r_lightptr[1];
-		r_lightptr += r_lightwidth;
-		lightleftstep = (r_lightptr[0] - lightleft) >> 4;
-		lightrightstep = (r_lightptr[1] - lightright) >> 4;
+		lightleft = lightptr[0];
+		lightright = lightptr[1];
+		lightptr += sb->lightwidth;
+		lightleftstep = (lightptr[0] - lightleft) >> 4;
+		lightrightstep = (lightptr[1] - lightright) >> 4;
 
 		for (i=0 ; i<16 ; i++)
 		{
@@ -780,14 +779,14 @@ void R_DrawSurfaceBlock8_mip0 (void)
 				light += lightstep;
 			}
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
 			lightright += lightrightstep;
 			lightleft += lightleftstep;
-			prowdest += surfrowbytes;
+			prowdest += sb->drawsurf.rowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
@@ -797,24 +796,21 @@ void R_DrawSurfaceBlock8_mip0 (void)
 R_DrawSurfaceBlock8_mip1
 ================
 */
-void R_DrawSurfaceBlock8_mip1 (void)
+void R_DrawSurfaceBlock8_mip1 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
 {
 	int				v, i, b;
 	uint lightstep, lighttemp, light;
-	pixel_t	pix, *psource, *prowdest;
-
-	psource = pbasesource;
-	prowdest = prowdestbase;
+	uint lightleft, lightright, lightleftstep, lightrightstep;
+	pixel_t	pix;
 
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
-	// FIXME: make these locals?
 	// FIXME: use delta rather than both right and left, like ASM?
-		lightleft = r_lightptr[0];
-		lightright = r_lightptr[1];
-		r_lightptr += r_lightwidth;
-		lightleftstep = (r_lightptr[0] - lightleft) >> 3;
-		lightrightstep = (r_lightptr[1] - lightright) >> 3;
+		lightleft = lightptr[0];
+		lightright = lightptr[1];
+		lightptr += sb->lightwidth;
+		lightleftstep = (lightptr[0] - lightleft) >> 3;
+		lightrightstep = (lightptr[1] - lightright) >> 3;
 
 		for (i=0 ; i<8 ; i++)
 		{
@@ -832,14 +828,14 @@ void R_DrawSurfaceBlock8_mip1 (void)
 				light += lightstep;
 			}
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
 			lightright += lightrightstep;
 			lightleft += lightleftstep;
-			prowdest += surfrowbytes;
+			prowdest += sb->drawsurf.rowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
@@ -849,24 +845,21 @@ void R_DrawSurfaceBlock8_mip1 (void)
 R_DrawSurfaceBlock8_mip2
 ================
 */
-void R_DrawSurfaceBlock8_mip2 (void)
+void R_DrawSurfaceBlock8_mip2 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
 {
 	int				v, i, b;
 	uint lightstep, lighttemp, light;
-	pixel_t	pix, *psource, *prowdest;
+	uint lightleft, lightright, lightleftstep, lightrightstep;
+	pixel_t	pix;
 
-	psource = pbasesource;
-	prowdest = prowdestbase;
-
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
-	// FIXME: make these locals?
 	// FIXME: use delta rather than both right and left, like ASM?
-		lightleft = r_lightptr[0];
-		lightright = r_lightptr[1];
-		r_lightptr += r_lightwidth;
-		lightleftstep = (r_lightptr[0] - lightleft) >> 2;
-		lightrightstep = (r_lightptr[1] - lightright) >> 2;
+		lightleft = lightptr[0];
+		lightright = lightptr[1];
+		lightptr += sb->lightwidth;
+		lightleftstep = (lightptr[0] - lightleft) >> 2;
+		lightrightstep = (lightptr[1] - lightright) >> 2;
 
 		for (i=0 ; i<4 ; i++)
 		{
@@ -884,14 +877,14 @@ void R_DrawSurfaceBlock8_mip2 (void)
 				light += lightstep;
 			}
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
 			lightright += lightrightstep;
 			lightleft += lightleftstep;
-			prowdest += surfrowbytes;
+			prowdest += sb->drawsurf.rowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
@@ -901,24 +894,21 @@ void R_DrawSurfaceBlock8_mip2 (void)
 R_DrawSurfaceBlock8_mip3
 ================
 */
-void R_DrawSurfaceBlock8_mip3 (void)
+void R_DrawSurfaceBlock8_mip3 (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
 {
 	int				v, i, b;
 	uint lightstep, lighttemp, light;
-	pixel_t	pix, *psource, *prowdest;
-
-	psource = pbasesource;
-	prowdest = prowdestbase;
+	uint lightleft, lightright, lightleftstep, lightrightstep;
+	pixel_t	pix;
 
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
-	// FIXME: make these locals?
 	// FIXME: use delta rather than both right and left, like ASM?
-		lightleft = r_lightptr[0];
-		lightright = r_lightptr[1];
-		r_lightptr += r_lightwidth;
-		lightleftstep = (r_lightptr[0] - lightleft) >> 1;
-		lightrightstep = (r_lightptr[1] - lightright) >> 1;
+		lightleft = lightptr[0];
+		lightright = lightptr[1];
+		lightptr += sb->lightwidth;
+		lightleftstep = (lightptr[0] - lightleft) >> 1;
+		lightrightstep = (lightptr[1] - lightright) >> 1;
 
 		for (i=0 ; i<2 ; i++)
 		{
@@ -936,17 +926,230 @@ void R_DrawSurfaceBlock8_mip3 (void)
 				light += lightstep;
 			}
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
+			lightright += lightrightstep;
+			lightleft += lightleftstep;
+			prowdest += sb->drawsurf.rowbytes;
+		}
+
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
+	}
+}
+
+#endif
+
+/*
+===============================================================================
+
+VECTOR BLOCK DRAWERS
+
+the colormap index of a row is computed four texels at a time,
+SSE2 and NEON have no gather so the lookups stay scalar. compare
+with the scalar drawers using sw_surfbench
+
+===============================================================================
+*/
+
+#if SURF_SSE2
+/*
+================
+R_DrawSurfaceRowSSE2
+
+texel b of the row gets light + (count - 1 - b) * step,
+like the scalar loops that walk the row backwards
+================
+*/
+static void R_DrawSurfaceRowSSE2 (pixel_t *prowdest, const pixel_t *psource, uint light, uint lightstep, int count, qboolean transparent)
+{
+	const __m128i	zero = _mm_setzero_si128 ();
+	const __m128i	lightmask = _mm_set1_epi32 (0x1f00);
+	const __m128i	lowbits = _mm_set1_epi16 (7);
+	const __m128i	trans = _mm_set1_epi16 ((short)TRANSPARENT_COLOR);
+	__m128i			l, lstep, p, idx, out, eq;
+	uint			index[4];
+	int				b;
+
+	light += (count - 1) * lightstep;
+	l = _mm_setr_epi32 (light, light - lightstep, light - lightstep * 2, light - lightstep * 3);
+	lstep = _mm_set1_epi32 (lightstep * 4);
+
+	for (b = 0; b < count; b += 4)
+	{
+		p = _mm_loadl_epi64 ((const __m128i *)(psource + b));
+		idx = _mm_or_si128 (_mm_srli_epi32 (_mm_unpacklo_epi16 (p, zero), 3),
+			_mm_slli_epi32 (_mm_and_si128 (l, lightmask), 5));
+		_mm_storeu_si128 ((__m128i *)index, idx);
+
+		out = _mm_cvtsi32_si128 (vid.colormap[index[0]] | (vid.colormap[index[1]] << 16));
+		out = _mm_insert_epi16 (out, vid.colormap[index[2]], 2);
+		out = _mm_insert_epi16 (out, vid.colormap[index[3]], 3);
+		out = _mm_or_si128 (out, _mm_and_si128 (p, lowbits));
+
+		if (transparent)
+		{
+			eq = _mm_cmpeq_epi16 (p, trans);
+			out = _mm_or_si128 (_mm_andnot_si128 (eq, out), _mm_and_si128 (eq, trans));
+		}
+
+		_mm_storel_epi64 ((__m128i *)(prowdest + b), out);
+		l = _mm_sub_epi32 (l, lstep);
+	}
+}
+#define R_DrawSurfaceRowSIMD	R_DrawSurfaceRowSSE2
+#define SURF_SIMD_NAME			"SSE2"
+#elif SURF_NEON
+/*
+================
+R_DrawSurfaceRowNEON
+
+texel b of the row gets light + (count - 1 - b) * step,
+like the scalar loops that walk the row backwards
+================
+*/
+static void R_DrawSurfaceRowNEON (pixel_t *prowdest, const pixel_t *psource, uint light, uint lightstep, int count, qboolean transparent)
+{
+	const uint32x4_t	lightmask = vdupq_n_u32 (0x1f00);
+	const uint16x4_t	lowbits = vdup_n_u16 (7);
+	const uint16x4_t	trans = vdup_n_u16 (TRANSPARENT_COLOR);
+	uint32x4_t			l, lstep, idx;
+	uint16x4_t			p, out;
+	uint				index[4];
+	pixel_t				texel[4];
+	int					b;
+
+	light += (count - 1) * lightstep;
+	index[0] = light;
+	index[1] = light - lightstep;
+	index[2] = light - lightstep * 2;
+	index[3] = light - lightstep * 3;
+	l = vld1q_u32 (index);
+	lstep = vdupq_n_u32 (lightstep * 4);
+
+	for (b = 0; b < count; b += 4)
+	{
+		p = vld1_u16 (psource + b);
+		idx = vorrq_u32 (vshrq_n_u32 (vmovl_u16 (p), 3), vshlq_n_u32 (vandq_u32 (l, lightmask), 5));
+		vst1q_u32 (index, idx);
+
+		texel[0] = vid.colormap[index[0]];
+		texel[1] = vid.colormap[index[1]];
+		texel[2] = vid.colormap[index[2]];
+		texel[3] = vid.colormap[index[3]];
+		out = vorr_u16 (vld1_u16 (texel), vand_u16 (p, lowbits));
+
+		if (transparent)
+			out = vbsl_u16 (vceq_u16 (p, trans), trans, out);
+
+		vst1_u16 (prowdest + b, out);
+		l = vsubq_u32 (l, lstep);
+	}
+}
+#define R_DrawSurfaceRowSIMD	R_DrawSurfaceRowNEON
+#define SURF_SIMD_NAME			"NEON"
+#endif
+
+#ifdef R_DrawSurfaceRowSIMD
+/*
+================
+R_DrawSurfaceBlockSIMD
+
+R_DrawSurfaceBlock8_mip0..2 and _Generic with the rows drawn
+by vectors, mip1 and mip2 don't check for transparent texels
+================
+*/
+static void R_DrawSurfaceBlockSIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest, int blocksize, int shift, qboolean transparent)
+{
+	int		v, i;
+	uint	lightleft, lightright, lightleftstep, lightrightstep;
+
+	for (v=0 ; v<sb->numvblocks ; v++)
+	{
+		lightleft = lightptr[0];
+		lightright = lightptr[1];
+		lightptr += sb->lightwidth;
+		lightleftstep = (lightptr[0] - lightleft) >> shift;
+		lightrightstep = (lightptr[1] - lightright) >> shift;
+
+		for (i=0 ; i<blocksize ; i++)
+		{
+			R_DrawSurfaceRowSIMD (prowdest, psource, lightright, (lightleft - lightright) >> shift, blocksize, transparent);
+
+			psource += sb->sourcetstep;
 			lightright += lightrightstep;
 			lightleft += lightleftstep;
-			prowdest += surfrowbytes;
+			prowdest += sb->drawsurf.rowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
+static void R_DrawSurfaceBlock8_mip0SIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
+{
+	R_DrawSurfaceBlockSIMD (sb, lightptr, psource, prowdest, 16, 4, true);
+}
+
+static void R_DrawSurfaceBlock8_mip1SIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
+{
+	R_DrawSurfaceBlockSIMD (sb, lightptr, psource, prowdest, 8, 3, false);
+}
+
+static void R_DrawSurfaceBlock8_mip2SIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
+{
+	R_DrawSurfaceBlockSIMD (sb, lightptr, psource, prowdest, 4, 2, false);
+}
+
+/*
+================
+R_DrawSurfaceBlock8_GenericSIMD
+
+blocks of at least four texels
+================
+*/
+static void R_DrawSurfaceBlock8_GenericSIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
+{
+	R_DrawSurfaceBlockSIMD (sb, lightptr, psource, prowdest, sb->blocksize, 4 - sb->drawsurf.surfmip, true);
+}
+
+/*
+================
+R_DrawSurfaceBlock8_WorldSIMD
+
+blocks of at least four texels
+================
+*/
+static void R_DrawSurfaceBlock8_WorldSIMD (const surfbuild_t *sb, const unsigned *lightptr, pixel_t *psource, pixel_t *prowdest)
+{
+	int		v, i;
+	uint	lightleft, lightright, lightleftstep, lightrightstep;
+	int		lightpos = 0;
+
+	for (v=0 ; v<sb->numvblocks ; v++)
+	{
+		lightleft = lightptr[(lightpos/sb->lightwidth) * sb->lightwidth];
+		lightright = lightptr[(lightpos/sb->lightwidth) * sb->lightwidth+1];
+		lightpos += sb->lightwidth / sb->worldlux_s;
+		lightleftstep = (lightptr[(lightpos/sb->lightwidth) * sb->lightwidth] - lightleft) >> (4-sb->drawsurf.surfmip);
+		lightrightstep =(lightptr[(lightpos/sb->lightwidth) * sb->lightwidth+1] - lightright) >> (4-sb->drawsurf.surfmip);
+
+		for (i=0 ; i<sb->blocksize ; i++)
+		{
+			R_DrawSurfaceRowSIMD (prowdest, psource, lightright, (lightleft - lightright) >> (4-sb->drawsurf.surfmip), sb->blocksize, true);
+
+			psource += sb->sourcetstep;
+			lightright += lightrightstep;
+			lightleft += lightleftstep;
+			prowdest += sb->drawsurf.rowbytes;
+		}
+
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
+	}
+}
+#else
+#define SURF_SIMD_NAME			"none"
 #endif
 
 
@@ -1058,6 +1261,7 @@ surfcache_t     *D_SCAlloc (int width, int size)
 
 // colect and free surfcache_t blocks until the rover block is large enough
 	new = sc_rover;
+	D_UnpinCache (sc_rover);
 	if (sc_rover->owner)
 		*sc_rover->owner = NULL;
 
@@ -1067,6 +1271,7 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		sc_rover = sc_rover->next;
 		if (!sc_rover)
 			gEngfuncs.Host_Error ("D_SCAlloc: hit the end of memory");
+		D_UnpinCache (sc_rover);
 		if (sc_rover->owner)
 			*sc_rover->owner = NULL;
 
@@ -1082,6 +1287,8 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		sc_rover->next = new->next;
 		sc_rover->width = 0;
 		sc_rover->owner = NULL;
+		sc_rover->spanbatch = 0;
+		sc_rover->buildframe = -1;
 		new->next = sc_rover;
 		new->size = size;
 	}
@@ -1094,6 +1301,8 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		new->height = (size - sizeof(*new) + sizeof(new->data)) / width;
 
 	new->owner = NULL;              // should be set properly after return
+	new->spanbatch = 0;
+	new->buildframe = -1;
 
 	if (d_roverwrapped)
 	{
@@ -1156,9 +1365,9 @@ int D_log2 (int num)
 
 //=============================================================================
 void R_DecalComputeBasis( msurface_t *surf, int flags, vec3_t textureSpaceBasis[3] );
-void R_DrawSurfaceDecals( void )
+static void R_DrawSurfaceDecals( const drawsurf_t *ds )
 {
-	msurface_t *fa = r_drawsurf.surf;
+	msurface_t *fa = ds->surf;
 	decal_t *p;
 
 	for( p = fa->pdecals; p; p = p->pnext)
@@ -1189,10 +1398,10 @@ void R_DrawSurfaceDecals( void )
 			x = DotProduct( p->position, textureU ) + textureU[3] - fa->texturemins[0] - w/2;
 			y = DotProduct( p->position, textureV ) + textureV[3] - fa->texturemins[1] - h/2;
 
-			x = x >> r_drawsurf.surfmip;
-			y = y >> r_drawsurf.surfmip;
-			w = w >> r_drawsurf.surfmip;
-			h = h >> r_drawsurf.surfmip;
+			x = x >> ds->surfmip;
+			y = y >> ds->surfmip;
+			w = w >> ds->surfmip;
+			h = h >> ds->surfmip;
 
 			if( w < 1 || h < 1 )
 				continue;
@@ -1202,15 +1411,15 @@ void R_DrawSurfaceDecals( void )
 				s1 += (-x)*(s2-s1) / w;
 				x = 0;
 			}
-			if( x + w > r_drawsurf.surfwidth )
+			if( x + w > ds->surfwidth )
 			{
-				s2 -= (x + w - r_drawsurf.surfwidth) * (s2 - s1)/ w ;
-				w = r_drawsurf.surfwidth - x;
+				s2 -= (x + w - ds->surfwidth) * (s2 - s1)/ w ;
+				w = ds->surfwidth - x;
 			}
-			if( y + h > r_drawsurf.surfheight )
+			if( y + h > ds->surfheight )
 			{
-				t2 -= (y + h - r_drawsurf.surfheight) * (t2 - t1) / h;
-				h = r_drawsurf.surfheight - y;
+				t2 -= (y + h - ds->surfheight) * (t2 - t1) / h;
+				h = ds->surfheight - y;
 			}
 
 			if( s1 < 0 )
@@ -1244,7 +1453,7 @@ void R_DrawSurfaceDecals( void )
 			else
 				skip = 0;
 
-			dest = ((pixel_t*)r_drawsurf.surfdat) + y * r_drawsurf.rowbytes + x;
+			dest = ((pixel_t*)ds->surfdat) + y * ds->rowbytes + x;
 
 			for (v=0 ; v<height ; v++)
 			{
@@ -1286,7 +1495,7 @@ void R_DrawSurfaceDecals( void )
 
 					}
 				}
-				dest += r_drawsurf.rowbytes;
+				dest += ds->rowbytes;
 			}
 	}
 
@@ -1294,10 +1503,14 @@ void R_DrawSurfaceDecals( void )
 
 /*
 ================
-D_CacheSurface
+D_PrepareSurfaceCache
+
+look up the cache block of a surface and allocate
+a new one if needed, returns false if the block can be
+used as is, otherwise r_drawsurf describes what to build
 ================
 */
-surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
+static qboolean D_PrepareSurfaceCache (msurface_t *surface, int miplevel, surfcache_t **pcache, qboolean prepass)
 {
 	surfcache_t     *cache;
 	int maps;
@@ -1344,13 +1557,25 @@ surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
 	}
 
 
+	*pcache = cache;
+
+	// already built by the pre-pass, lights can't change within a frame,
+	// it was counted as a build there
+	if (cache && cache->buildframe == tr.framecount)
+		return false;
+
 	if (cache && !cache->dlight && surface->dlightframe != tr.framecount
 			&& cache->image == r_drawsurf.image
 			&& cache->lightadj[0] == r_drawsurf.lightadj[0]
 			&& cache->lightadj[1] == r_drawsurf.lightadj[1]
 			&& cache->lightadj[2] == r_drawsurf.lightadj[2]
 			&& cache->lightadj[3] == r_drawsurf.lightadj[3] )
-		return cache;
+	{
+		// the pre-pass looks again when the surface is drawn
+		if (!prepass)
+			r_stats.c_surfcache_hits++;
+		return false;
+	}
 
 	if( surface->dlightframe == tr.framecount )
 	{
@@ -1393,7 +1618,9 @@ surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
 		CACHESPOT(surface)[miplevel] = cache;
 		cache->owner = &CACHESPOT(surface)[miplevel];
 		cache->mipscale = surfscale;
+		*pcache = cache;
 	}
+	else D_UnpinCache (cache);	// going to be redrawn in place
 
 	if (surface->dlightframe == tr.framecount)
 		cache->dlight = 1;
@@ -1411,21 +1638,327 @@ surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
 	{
 		surface->cached_light[maps] = tr.lightstylevalue[surface->styles[maps]];
 	}
-//
-// draw and light the surface texture
-//
 	r_drawsurf.surf = surface;
+	r_stats.c_surfcache_builds++;
 
-	//c_surf++;
+	return true;
+}
+
+/*
+================
+D_BuildSurface
 
+light and rasterize the surface into its cache block
+================
+*/
+static void D_BuildSurface (surfbuild_t *sb)
+{
 	// calculate the lightings
-	R_BuildLightMap ( );
+	R_BuildLightMap (sb);
 
 	// rasterize the surface into the cache
-	R_DrawSurface ();
-	R_DrawSurfaceDecals();
+	R_DrawSurface (sb);
+	R_DrawSurfaceDecals (&sb->drawsurf);
+}
+
+/*
+================
+D_CacheSurface
+================
+*/
+surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
+{
+	surfcache_t	*cache;
+	surfbuild_t	sb;
+	double		start;
+
+	if (!D_PrepareSurfaceCache (surface, miplevel, &cache, false))
+		return cache;
+
+	start = gEngfuncs.pfnTime ();
+
+	sb.drawsurf = r_drawsurf;
+	sb.blocklights = blocklights;
+	sb.identity = tr.modelviewIdentity;
+	Matrix4x4_Copy (sb.objectmatrix, RI.objectMatrix);
+	D_BuildSurface (&sb);
+
+	r_stats.t_surfcache_build += gEngfuncs.pfnTime () - start;
 
 	return cache;
 }
 
+/*
+===============================================================================
+
+PARALLEL SURFACE BUILDING
+
+stale world surfaces are collected before the spans
+are drawn and rebuilt on the r_thread.c pool, every
+thread has its own blocklights and a job writes only
+to its own cache block
+
+===============================================================================
+*/
+
+#define SURFCACHE_HIST_SIZE	6	// < 1, 2, 4, 8, 16 and >= 16 ms
+
+static surfbuild_t	*d_surfbuilds;
+static int	d_maxsurfbuilds;
+static int	d_numsurfbuilds;
+
+static unsigned	*d_surflights;	// MAX_BLOCKLIGHTS for each thread
+static int	d_numsurflights;
+
+static uint	d_buildhist[SURFCACHE_HIST_SIZE];	// frames by surface build time
+static uint	d_totalhits, d_totalbuilds, d_totalprebuilt;
+static double	d_maxbuildtime;
+
+/*
+================
+D_QueueSurfaceBuild
+
+check a world surface and queue its rebuild if needed
+returns true if the surface was queued
+================
+*/
+qboolean D_QueueSurfaceBuild (msurface_t *surface, int miplevel)
+{
+	surfcache_t	*cache;
+	surfbuild_t	*sb;
+
+	// conveyors change their extents on every lookup
+	if (surface->flags & SURF_CONVEYOR)
+		return false;
+
+	if (!D_PrepareSurfaceCache (surface, miplevel, &cache, true))
+		return false;
+
+	if (d_numsurfbuilds == d_maxsurfbuilds)
+	{
+		d_maxsurfbuilds = Q_max (256, d_maxsurfbuilds * 2);
+		d_surfbuilds = Mem_Realloc (r_temppool, d_surfbuilds, d_maxsurfbuilds * sizeof (surfbuild_t));
+	}
+
+	sb = &d_surfbuilds[d_numsurfbuilds++];
+	sb->drawsurf = r_drawsurf;
+	sb->blocklights = NULL;	// set by the worker
+	sb->identity = true;
+
+	cache->buildframe = tr.framecount;
+	r_stats.c_surfcache_prebuilt++;
+
+	return true;
+}
+
+static void D_BuildSurfaceJob (void *unused, int job, int thread)
+{
+	surfbuild_t	*sb = &d_surfbuilds[job];
+
+	sb->blocklights = d_surflights + thread * MAX_BLOCKLIGHTS;
+	D_BuildSurface (sb);
+}
+
+/*
+================
+D_FlushSurfaceBuilds
+
+build all queued surfaces, returns when every one is done
+================
+*/
+void D_FlushSurfaceBuilds (void)
+{
+	double	start;
+
+	if (!d_numsurfbuilds)
+		return;
+
+	// too big for the worker stacks
+	if (d_numsurflights != R_NumThreads ())
+	{
+		d_numsurflights = R_NumThreads ();
+		d_surflights = Mem_Realloc (r_temppool, d_surflights, d_numsurflights * MAX_BLOCKLIGHTS * sizeof (unsigned));
+	}
+
+	start = gEngfuncs.pfnTime ();
+	R_RunJobs (D_BuildSurfaceJob, NULL, d_numsurfbuilds);
+	d_numsurfbuilds = 0;
+
+	r_stats.t_surfcache_build += gEngfuncs.pfnTime () - start;
+}
+
+/*
+================
+D_EndSurfaceCacheFrame
 
+account this frame in the surface cache statistics
+================
+*/
+void D_EndSurfaceCacheFrame (void)
+{
+	double	ms = r_stats.t_surfcache_build * 1000.0;
+	int		bucket;
+
+	for (bucket = 0; bucket < SURFCACHE_HIST_SIZE - 1 && ms >= (1 << bucket); bucket++);
+
+	d_buildhist[bucket]++;
+	d_totalhits += r_stats.c_surfcache_hits;
+	d_totalbuilds += r_stats.c_surfcache_builds;
+	d_totalprebuilt += r_stats.c_surfcache_prebuilt;
+	d_maxbuildtime = Q_max (d_maxbuildtime, ms);
+}
+
+/*
+================
+R_SurfaceCacheStats_f
+
+print and reset the surface cache statistics
+================
+*/
+void R_SurfaceCacheStats_f (void)
+{
+	uint	frames = 0;
+	int		i;
+
+	for (i = 0; i < SURFCACHE_HIST_SIZE; i++)
+		frames += d_buildhist[i];
+
+	gEngfuncs.Con_Printf ("%u frames, %u hits, %u builds (%u in parallel), worst frame %.2f ms\n",
+		frames, d_totalhits, d_totalbuilds, d_totalprebuilt, d_maxbuildtime);
+
+	for (i = 0; i < SURFCACHE_HIST_SIZE; i++)
+	{
+		if (i < SURFCACHE_HIST_SIZE - 1)
+			gEngfuncs.Con_Printf ("  < %2i ms: %u\n", 1 << i, d_buildhist[i]);
+		else gEngfuncs.Con_Printf (" >= %2i ms: %u\n", 1 << (i - 1), d_buildhist[i]);
+	}
+
+	memset (d_buildhist, 0, sizeof (d_buildhist));
+	d_totalhits = d_totalbuilds = d_totalprebuilt = 0;
+	d_maxbuildtime = 0.0;
+}
+
+#define SURFBENCH_SIZE	256		// mip0 texels on each side of the test surface
+#define SURFBENCH_TEX	64
+
+/*
+================
+R_SurfaceBenchRun
+
+draw the test surface like R_DrawSurface does,
+returns nanoseconds per texel
+================
+*/
+static double R_SurfaceBenchRun (surfbuild_t *sb, blockdrawer_t drawer, qboolean world, int passes)
+{
+	int		pass, u, soffset, texwidth = SURFBENCH_TEX >> sb->drawsurf.surfmip;
+	double	start = gEngfuncs.pfnTime ();
+	const unsigned	*lightptr;
+
+	for (pass = 0; pass < passes; pass++)
+	{
+		for (u = 0, soffset = 0; u < sb->numhblocks; u++)
+		{
+			lightptr = world ? sb->blocklights + (int)(u / (sb->worldlux_s + 0.5f)) : sb->blocklights + u;
+			drawer (sb, lightptr, sb->source + soffset, sb->drawsurf.surfdat + u * sb->blocksize);
+
+			soffset = (soffset + sb->blocksize) % texwidth;
+		}
+	}
+
+	return (gEngfuncs.pfnTime () - start) * 1e9 / ((double)passes * sb->drawsurf.surfwidth * sb->drawsurf.surfheight);
+}
+
+/*
+================
+R_SurfaceBench_f
+
+sw_surfbench [passes]
+time each block drawer against its vector version on a
+random 256x256 surface and check they draw the same
+================
+*/
+void R_SurfaceBench_f (void)
+{
+	const struct
+	{
+		const char		*name;
+		int				mip, samplesize;
+		qboolean		world;
+		blockdrawer_t	scalar, simd;
+	} kernels[] =
+	{
+	{ "mip0", 0, 16, false, R_DrawSurfaceBlock8_mip0, surfmiptable_simd[0] },
+	{ "mip1", 1, 16, false, R_DrawSurfaceBlock8_mip1, surfmiptable_simd[1] },
+	{ "mip2", 2, 16, false, R_DrawSurfaceBlock8_mip2, surfmiptable_simd[2] },
+	{ "mip3", 3, 16, false, R_DrawSurfaceBlock8_mip3, surfmiptable_simd[3] },
+	{ "generic", 0, 8, false, R_DrawSurfaceBlock8_Generic, R_DrawSurfaceBlock8_GenericSIMD },
+	{ "world", 0, 16, true, R_DrawSurfaceBlock8_World, R_DrawSurfaceBlock8_WorldSIMD },
+	};
+	surfbuild_t	sb;
+	pixel_t		*source, *dest[2];
+	unsigned	*lights;
+	uint		seed = 0x1234567;
+	int			i, k, size, passes = 200;
+	double		time[2];
+
+	if (gEngfuncs.Cmd_Argc () > 1)
+		passes = bound (1, Q_atoi (gEngfuncs.Cmd_Argv (1)), 100000);
+
+	source = Mem_Malloc (r_temppool, SURFBENCH_TEX * SURFBENCH_TEX * sizeof (*source));
+	lights = Mem_Malloc (r_temppool, (SURFBENCH_SIZE + 1) * (SURFBENCH_SIZE + 1) * sizeof (*lights));
+	dest[0] = Mem_Malloc (r_temppool, SURFBENCH_SIZE * SURFBENCH_SIZE * sizeof (pixel_t));
+	dest[1] = Mem_Malloc (r_temppool, SURFBENCH_SIZE * SURFBENCH_SIZE * sizeof (pixel_t));
+
+	// one texel in sixteen is transparent
+	for (i = 0; i < SURFBENCH_TEX * SURFBENCH_TEX; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		source[i] = (seed >> 28) ? (seed >> 12) : TRANSPARENT_COLOR;
+	}
+
+	for (i = 0; i < (SURFBENCH_SIZE + 1) * (SURFBENCH_SIZE + 1); i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		lights[i] = (seed >> 16) & 0x3fff;
+	}
+
+	gEngfuncs.Con_Printf ("%i passes over a %ix%i surface, ns per texel\n", passes, SURFBENCH_SIZE, SURFBENCH_SIZE);
+
+	for (k = 0; k < ARRAYSIZE (kernels); k++)
+	{
+		memset (&sb, 0, sizeof (sb));
+		size = SURFBENCH_SIZE >> kernels[k].mip;
+		sb.drawsurf.surfmip = kernels[k].mip;
+		sb.drawsurf.surfwidth = sb.drawsurf.surfheight = sb.drawsurf.rowbytes = size;
+		sb.blocklights = lights;
+		sb.blocksize = kernels[k].samplesize >> kernels[k].mip;
+		sb.lightwidth = SURFBENCH_SIZE / kernels[k].samplesize + 1;
+		sb.numhblocks = sb.numvblocks = size / sb.blocksize;
+		sb.source = source;
+		sb.sourcetstep = SURFBENCH_TEX >> kernels[k].mip;
+		sb.stepback = sb.sourcetstep * sb.sourcetstep;
+		sb.sourcemax = source + sb.stepback;
+		sb.worldlux_s = sb.worldlux_t = 1.0f;
+
+		for (i = 0; i < 2; i++)
+		{
+			sb.drawsurf.surfdat = dest[i];
+			time[i] = R_SurfaceBenchRun (&sb, i ? kernels[k].simd : kernels[k].scalar, kernels[k].world, passes);
+		}
+
+		if (kernels[k].simd == kernels[k].scalar)
+		{
+			gEngfuncs.Con_Printf ("%8s: %.3f, no vector version\n", kernels[k].name, time[0]);
+			continue;
+		}
+
+		gEngfuncs.Con_Printf ("%8s: %.3f, %s %.3f%s\n", kernels[k].name, time[0], SURF_SIMD_NAME, time[1],
+			memcmp (dest[0], dest[1], size * size * sizeof (pixel_t)) ? ", DIFFERENT OUTPUT" : "");
+	}
+
+	Mem_Free (source);
+	Mem_Free (lights);
+	Mem_Free (dest[0]);
+	Mem_Free (dest[1]);
+}
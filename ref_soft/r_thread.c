@@ -0,0 +1,315 @@
+/*
+r_thread.c - small worker pool for parallel rasterization
+Copyright (C) 2026 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "r_local.h"
+
+#if XASH_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define R_HAVE_THREADS
+#elif XASH_POSIX && !XASH_EMSCRIPTEN
+#include <pthread.h>
+#include <unistd.h>
+#define R_HAVE_THREADS
+#endif
+
+#ifdef R_HAVE_THREADS
+static struct
+{
+	void	(*func)( void *ctx, int job, int thread );
+	void	*ctx;
+	int	numjobs;
+	int	nextjob;	// next job index to pick up
+	int	pending;	// jobs not finished yet
+	int	generation;
+	qboolean	shutdown;
+	int	numthreads;	// worker threads, not counting the main one
+#if XASH_WIN32
+	CRITICAL_SECTION	lock;
+	HANDLE	wake;	// semaphore, released once per worker for each batch
+	HANDLE	done;	// auto-reset event, set by the last finished job
+	HANDLE	threads[MAX_RENDER_THREADS];
+#else
+	pthread_mutex_t	lock;
+	pthread_cond_t	wake;
+	pthread_cond_t	done;
+	pthread_t	threads[MAX_RENDER_THREADS];
+#endif
+} rthreads;
+
+#if XASH_WIN32
+#define R_LockJobs()	EnterCriticalSection( &rthreads.lock )
+#define R_UnlockJobs()	LeaveCriticalSection( &rthreads.lock )
+#define R_SignalDone()	SetEvent( rthreads.done )
+#else
+#define R_LockJobs()	pthread_mutex_lock( &rthreads.lock )
+#define R_UnlockJobs()	pthread_mutex_unlock( &rthreads.lock )
+#define R_SignalDone()	pthread_cond_signal( &rthreads.done )
+#endif
+
+/*
+===============
+R_RunWorkerJobs
+
+pick up jobs until the batch is exhausted
+lock must be held by caller
+===============
+*/
+static void R_RunWorkerJobs( int thread )
+{
+	int	job;
+
+	while( rthreads.nextjob < rthreads.numjobs )
+	{
+		job = rthreads.nextjob++;
+
+		R_UnlockJobs();
+		rthreads.func( rthreads.ctx, job, thread );
+		R_LockJobs();
+
+		if( --rthreads.pending == 0 )
+			R_SignalDone();
+	}
+}
+
+#if XASH_WIN32
+static DWORD WINAPI R_WorkerThread( LPVOID arg )
+{
+	int	thread = (int)(intptr_t)arg;
+
+	while( 1 )
+	{
+		WaitForSingleObject( rthreads.wake, INFINITE );
+
+		R_LockJobs();
+
+		if( rthreads.shutdown )
+		{
+			R_UnlockJobs();
+			break;
+		}
+
+		R_RunWorkerJobs( thread );
+		R_UnlockJobs();
+	}
+
+	return 0;
+}
+#else
+static void *R_WorkerThread( void *arg )
+{
+	int	thread = (int)(intptr_t)arg;
+	int	seen = 0;
+
+	R_LockJobs();
+
+	while( 1 )
+	{
+		while( rthreads.generation == seen && !rthreads.shutdown )
+			pthread_cond_wait( &rthreads.wake, &rthreads.lock );
+
+		if( rthreads.shutdown )
+			break;
+
+		seen = rthreads.generation;
+		R_RunWorkerJobs( thread );
+	}
+
+	R_UnlockJobs();
+
+	return NULL;
+}
+#endif
+
+/*
+===============
+R_CPUCount
+===============
+*/
+static int R_CPUCount( void )
+{
+#if XASH_WIN32
+	SYSTEM_INFO	info;
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors;
+#elif defined( _SC_NPROCESSORS_ONLN )
+	return sysconf( _SC_NPROCESSORS_ONLN );
+#else
+	return 1;
+#endif
+}
+#endif // R_HAVE_THREADS
+
+/*
+===============
+R_InitThreads
+
+spawn worker threads according to sw_threads
+===============
+*/
+void R_InitThreads( void )
+{
+#ifdef R_HAVE_THREADS
+	int	i, count = sw_threads->value;
+
+	if( count <= 0 )
+		count = R_CPUCount();
+
+	count = bound( 1, count, MAX_RENDER_THREADS );
+
+	memset( &rthreads, 0, sizeof( rthreads ));
+
+#if XASH_WIN32
+	InitializeCriticalSection( &rthreads.lock );
+	rthreads.wake = CreateSemaphore( NULL, 0, 0x7FFFFFFF, NULL );
+	rthreads.done = CreateEvent( NULL, FALSE, FALSE, NULL );
+#else
+	pthread_mutex_init( &rthreads.lock, NULL );
+	pthread_cond_init( &rthreads.wake, NULL );
+	pthread_cond_init( &rthreads.done, NULL );
+#endif
+
+	for( i = 0; i < count - 1; i++ )
+	{
+#if XASH_WIN32
+		if(( rthreads.threads[i] = CreateThread( NULL, 0, R_WorkerThread, (LPVOID)(intptr_t)( i + 1 ), 0, NULL )) == NULL )
+			break;
+#else
+		if( pthread_create( &rthreads.threads[i], NULL, R_WorkerThread, (void *)(intptr_t)( i + 1 )) != 0 )
+			break;
+#endif
+		rthreads.numthreads++;
+	}
+
+	if( rthreads.numthreads != count - 1 )
+		gEngfuncs.Con_Printf( S_WARN "%s: only %i of %i threads were created\n", __func__, rthreads.numthreads + 1, count );
+
+	if( rthreads.numthreads > 0 )
+		gEngfuncs.Con_Reportf( "%s: using %i threads\n", __func__, rthreads.numthreads + 1 );
+#endif // R_HAVE_THREADS
+
+	ClearBits( sw_threads->flags, FCVAR_CHANGED );
+}
+
+/*
+===============
+R_ShutdownThreads
+===============
+*/
+void R_ShutdownThreads( void )
+{
+#ifdef R_HAVE_THREADS
+	int	i;
+
+#if XASH_WIN32
+	R_LockJobs();
+	rthreads.shutdown = true;
+	R_UnlockJobs();
+	ReleaseSemaphore( rthreads.wake, rthreads.numthreads, NULL );
+	WaitForMultipleObjects( rthreads.numthreads, rthreads.threads, TRUE, INFINITE );
+
+	for( i = 0; i < rthreads.numthreads; i++ )
+		CloseHandle( rthreads.threads[i] );
+	CloseHandle( rthreads.wake );
+	CloseHandle( rthreads.done );
+	DeleteCriticalSection( &rthreads.lock );
+#else
+	R_LockJobs();
+	rthreads.shutdown = true;
+	pthread_cond_broadcast( &rthreads.wake );
+	R_UnlockJobs();
+
+	for( i = 0; i < rthreads.numthreads; i++ )
+		pthread_join( rthreads.threads[i], NULL );
+
+	pthread_cond_destroy( &rthreads.wake );
+	pthread_cond_destroy( &rthreads.done );
+	pthread_mutex_destroy( &rthreads.lock );
+#endif
+	rthreads.numthreads = 0;
+#endif // R_HAVE_THREADS
+}
+
+/*
+===============
+R_NumThreads
+
+threads available to R_RunJobs, including the calling one
+===============
+*/
+int R_NumThreads( void )
+{
+#ifdef R_HAVE_THREADS
+	return rthreads.numthreads + 1;
+#else
+	return 1;
+#endif
+}
+
+/*
+===============
+R_RunJobs
+
+call func for each job index in [0, numjobs) across
+the worker pool and wait until every job is finished
+the calling thread takes jobs too, as thread 0, workers
+pass their own index below R_NumThreads
+===============
+*/
+void R_RunJobs( void (*func)( void *ctx, int job, int thread ), void *ctx, int numjobs )
+{
+	int	i;
+
+#ifdef R_HAVE_THREADS
+	if( rthreads.numthreads > 0 && numjobs > 1 )
+	{
+		R_LockJobs();
+		rthreads.func = func;
+		rthreads.ctx = ctx;
+		rthreads.numjobs = numjobs;
+		rthreads.nextjob = 0;
+		rthreads.pending = numjobs;
+		rthreads.generation++;
+#if XASH_WIN32
+		ReleaseSemaphore( rthreads.wake, Q_min( rthreads.numthreads, numjobs - 1 ), NULL );
+#else
+		pthread_cond_broadcast( &rthreads.wake );
+#endif
+
+		R_RunWorkerJobs( 0 );
+
+#if XASH_WIN32
+		if( rthreads.pending > 0 )
+		{
+			R_UnlockJobs();
+			WaitForSingleObject( rthreads.done, INFINITE );
+			return;
+		}
+
+		// the last job was finished here or the event is already stale
+		ResetEvent( rthreads.done );
+#else
+		while( rthreads.pending > 0 )
+			pthread_cond_wait( &rthreads.done, &rthreads.lock );
+#endif
+		R_UnlockJobs();
+		return;
+	}
+#endif // R_HAVE_THREADS
+
+	for( i = 0; i < numjobs; i++ )
+		func( ctx, i, 0 );
+}
@@ -270,6 +270,59 @@ void R_SetupFinalVert( finalvert_t *fv, float x, float y, float z, int light, in
 	fv->t = t << 16;
 }
 
+/*
+================
+R_AliasProjectBatch
+
+same math as R_SetupFinalVert for a whole vertex array,
+z-clipped points get only the flag like they do there
+================
+*/
+void R_AliasProjectBatch( const aliasbatch_t *batch, const vec3_t *in, int numverts )
+{
+	float	xf[3][4];
+	float	*x = batch->x, *y = batch->y, *z = batch->z;
+	int	*u = batch->u, *v = batch->v, *zi = batch->zi, *flags = batch->flags;
+	float	xscale = aliasxscale, yscale = aliasyscale;
+	float	xcenter = aliasxcenter, ycenter = aliasycenter, ziscale = s_ziscale;
+	int	left = RI.aliasvrect.x, top = RI.aliasvrect.y;
+	int	right = RI.aliasvrectright, bottom = RI.aliasvrectbottom;
+	float	fzi, zc;
+	int	i, pu, pv, clip, znear;
+
+	// local copies keep the loops free of aliasing with the outputs
+	memcpy( xf, aliastransform, sizeof( xf ));
+
+	for( i = 0; i < numverts; i++ )
+	{
+		x[i] = in[i][0] * xf[0][0] + in[i][1] * xf[0][1] + in[i][2] * xf[0][2] + xf[0][3];
+		y[i] = in[i][0] * xf[1][0] + in[i][1] * xf[1][1] + in[i][2] * xf[1][2] + xf[1][3];
+		z[i] = in[i][0] * xf[2][0] + in[i][1] * xf[2][1] + in[i][2] * xf[2][2] + xf[2][3];
+	}
+
+	for( i = 0; i < numverts; i++ )
+	{
+		// clipped points are projected too, against the clip plane, but
+		// their result is never used. Arithmetic select instead of Q_max,
+		// a float conditional keeps the compiler from vectorizing the loop
+		znear = z[i] < ALIAS_Z_CLIP_PLANE;
+		zc = z[i] + znear * ( ALIAS_Z_CLIP_PLANE - z[i] );
+		fzi = 1.0f / zc;
+
+		zi[i] = fzi * ziscale;
+		pu = ( x[i] * xscale * fzi ) + xcenter;
+		pv = ( y[i] * yscale * fzi ) + ycenter;
+		u[i] = pu;
+		v[i] = pv;
+
+		clip = ( pu < left ) ? ALIAS_LEFT_CLIP : 0;
+		clip |= ( pv < top ) ? ALIAS_TOP_CLIP : 0;
+		clip |= ( pu > right ) ? ALIAS_RIGHT_CLIP : 0;
+		clip |= ( pv > bottom ) ? ALIAS_BOTTOM_CLIP : 0;
+		flags[i] = znear ? ALIAS_Z_CLIP : clip;
+	}
+}
+
 void R_RenderTriangle( finalvert_t *fv1, finalvert_t *fv2, finalvert_t *fv3  )
 {
 
@@ -278,15 +278,31 @@ void GAME_EXPORT TriVertex3fv( const float *v )
 
 /*
 =============
-TriVertex3f
+TriVertexSlot
 
+next vertex to fill for the current primitive
 =============
 */
-void GAME_EXPORT TriVertex3f( float x, float y, float z )
+static finalvert_t *TriVertexSlot( void )
+{
+	if( mode == TRI_TRIANGLE_STRIP )
+		return &triv[n];
+	if( mode == TRI_TRIANGLES || mode == TRI_TRIANGLE_FAN )
+		return &triv[vertcount];
+	return NULL;
+}
+
+/*
+=============
+TriVertexEmit
+
+advance the primitive after the slot was filled
+=============
+*/
+static void TriVertexEmit( void )
 {
 	if( mode == TRI_TRIANGLES )
 	{
-		R_SetupFinalVert( &triv[vertcount], x, y, z, light << 8,s,t);
 		vertcount++;
 		if( vertcount == 3 )
 		{
@@ -297,7 +313,6 @@ void GAME_EXPORT TriVertex3f( float x, float y, float z )
 	}
 	if( mode == TRI_TRIANGLE_FAN )
 	{
-		R_SetupFinalVert( &triv[vertcount], x, y, z, light << 8,s,t);
 		vertcount++;
 		if( vertcount >= 3 )
 		{
@@ -309,7 +324,6 @@ void GAME_EXPORT TriVertex3f( float x, float y, float z )
 	}
 	if( mode == TRI_TRIANGLE_STRIP )
 	{
-		R_SetupFinalVert( &triv[n], x, y, z, light << 8,s,t);
 		n++;
 		vertcount++;
 		if( n == 3 )
@@ -322,29 +336,63 @@ void GAME_EXPORT TriVertex3f( float x, float y, float z )
 				R_RenderTriangle( &triv[2], &triv[1], &triv[0] );
 		}
 	}
-#if 0
-		if( mode == TRI_TRIANGLE_STRIP )
-		{
-			R_SetupFinalVert( &triv[vertcount], x, y, z, 0,s,t);
-			vertcount++;
-			if( vertcount == 3 )
-			{
-
-				R_RenderTriangle( triv );
-				finalvert_t fv = triv[0];
-
-				triv[0] = triv[2];
-				triv[2] = fv;
-				R_RenderTriangle( triv );
-				fv = triv[0];
-				triv[0] = triv[2];
-				triv[2] = fv;
-				triv[0] = triv[1];
-				triv[1] = triv[2];
-				vertcount = 2;
-			}
-		}
-#endif
+}
+
+/*
+=============
+TriVertex3f
+
+=============
+*/
+void GAME_EXPORT TriVertex3f( float x, float y, float z )
+{
+	finalvert_t	*fv = TriVertexSlot();
+
+	if( !fv )
+		return;
+
+	R_SetupFinalVert( fv, x, y, z, light << 8,s,t);
+	TriVertexEmit();
+}
+
+/*
+=============
+TriVertexBatch
+
+emit a point projected by R_AliasProjectBatch
+=============
+*/
+void TriVertexBatch( const aliasbatch_t *batch, int index )
+{
+	finalvert_t	*fv = TriVertexSlot();
+
+	if( !fv )
+		return;
+
+	fv->xyz[0] = batch->x[index];
+	fv->xyz[1] = batch->y[index];
+	fv->xyz[2] = batch->z[index];
+	fv->u = batch->u[index];
+	fv->v = batch->v[index];
+	fv->zi = batch->zi[index];
+	fv->flags = batch->flags[index];
+	fv->l = light << 8;
+	fv->s = s << 16;
+	fv->t = t << 16;
+	TriVertexEmit();
+}
+
+/*
+=============
+TriLightLevel
+
+set the light level directly, for callers
+that already did the color conversion
+=============
+*/
+void TriLightLevel( int level )
+{
+	light = level;
 }
 
 /*